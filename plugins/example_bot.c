@@ -0,0 +1,60 @@
+/* Example plugin bot: heads for the food along the larger axis first and
+ * avoids cells the occupancy map says are taken.
+ *
+ *   snakey --bot plugin:./libsnakey_example_bot.so
+ */
+#include "snakey_plugin.h"
+
+#include <stddef.h>
+
+static int is_free(const snakey_state *s, int x, int y) {
+  if (s->wrapping) {
+    x = (x + s->width) % s->width;
+    y = (y + s->height) % s->height;
+  } else if (x < 0 || y < 0 || x >= s->width || y >= s->height) {
+    return 0;
+  }
+  return s->occupancy[y * s->width + x] == 0;
+}
+
+static int32_t choose(void *bot, const snakey_state *s) {
+  static const int dx[] = { 0, 0, -1, 1 };
+  static const int dy[] = { -1, 1, 0, 0 };
+  static const int opposite[] = { SNAKEY_DOWN, SNAKEY_UP, SNAKEY_RIGHT, SNAKEY_LEFT };
+  const snakey_snake *me = &s->snakes[s->self];
+  snakey_point head = me->ring[me->head_slot];
+  /* Preferred moves first, then anything that keeps the snake alive */
+  int wanted[7];
+  int count = 0;
+  int fx = s->food.x - head.x, fy = s->food.y - head.y;
+  int horizontal = fx < 0 ? SNAKEY_LEFT : SNAKEY_RIGHT;
+  int vertical = fy < 0 ? SNAKEY_UP : SNAKEY_DOWN;
+  (void)bot;
+
+  if ((fx < 0 ? -fx : fx) >= (fy < 0 ? -fy : fy)) {
+    if (fx != 0) { wanted[count++] = horizontal; }
+    if (fy != 0) { wanted[count++] = vertical; }
+  } else {
+    if (fy != 0) { wanted[count++] = vertical; }
+    if (fx != 0) { wanted[count++] = horizontal; }
+  }
+  wanted[count++] = me->direction;
+  for (int d = 0; d < 4; ++d) { wanted[count++] = d; }
+
+  for (int i = 0; i < count; ++i) {
+    int d = wanted[i];
+    if (d == opposite[me->direction]) { continue; }
+    if (is_free(s, head.x + dx[d], head.y + dy[d])) { return d; }
+  }
+  return me->direction;
+}
+
+static const snakey_plugin plugin = {
+  SNAKEY_PLUGIN_ABI_VERSION,
+  "example",
+  NULL,
+  NULL,
+  choose,
+};
+
+const snakey_plugin *snakey_plugin_entry(void) { return &plugin; }
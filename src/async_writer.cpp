@@ -0,0 +1,477 @@
+#include "async_writer.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+using Clock = std::chrono::steady_clock;
+
+struct AsyncWriter::Request {
+  enum class Kind { File, Log } kind = Kind::File;
+  std::string path;
+  std::vector<uint8_t> data;  // Owned bytes of a file write
+  const uint8_t *bytes = nullptr;
+  size_t size = 0;
+  size_t done = 0;            // Bytes written so far, for short writes
+  uint64_t offset = 0;
+  int fd = -1;
+  Log *log = nullptr;
+  Clock::time_point enqueued;
+};
+
+struct AsyncWriter::Log {
+  std::string path;
+  int fd = -1;
+  std::vector<uint8_t> front, back;
+  std::atomic<bool> back_busy{ false };
+  uint64_t offset = 0;
+};
+
+// Completed requests come back as (request, bytes written or -errno)
+using Completion = std::pair<AsyncWriter::Request *, int>;
+
+class AsyncWriter::Backend {
+public:
+  virtual ~Backend() = default;
+  virtual const char *name() const = 0;
+  virtual size_t capacity() const = 0;
+  virtual size_t in_flight() const = 0;
+  // Starts writing the rest of a request
+  virtual void start(Request *request) = 0;
+  // Collects finished writes, blocking for at least one if `wait` is set
+  virtual void reap(bool wait, std::vector<Completion> &done) = 0;
+  // Syncs `fds`; only called with nothing in flight
+  virtual void sync(const std::vector<int> &fds) = 0;
+};
+
+namespace {
+
+// Writes synchronously on the writer thread
+class PwriteBackend : public AsyncWriter::Backend {
+public:
+  const char *name() const override { return "pwrite"; }
+  size_t capacity() const override { return 1; }
+  size_t in_flight() const override { return finished.size(); }
+
+  void start(AsyncWriter::Request *request) override {
+    ssize_t n;
+    do {
+      n = pwrite(request->fd, request->bytes + request->done, request->size - request->done,
+                 static_cast<off_t>(request->offset + request->done));
+    } while (n < 0 && errno == EINTR);
+    finished.emplace_back(request, n < 0 ? -errno : static_cast<int>(n));
+  }
+
+  void reap(bool, std::vector<Completion> &done) override {
+    done.insert(done.end(), finished.begin(), finished.end());
+    finished.clear();
+  }
+
+  void sync(const std::vector<int> &fds) override {
+    for (int fd : fds) { fsync(fd); }
+  }
+
+private:
+  std::vector<Completion> finished;
+};
+
+// Talks to the kernel directly through the io_uring system calls, keeping
+// up to `entries` writes in flight at once
+class UringBackend : public AsyncWriter::Backend {
+public:
+  ~UringBackend() override {
+    if (sqes) { munmap(sqes, sqes_size); }
+    if (cq_ring && cq_ring != sq_ring) { munmap(cq_ring, cq_size); }
+    if (sq_ring) { munmap(sq_ring, sq_size); }
+    if (ring_fd >= 0) { close(ring_fd); }
+  }
+
+  bool init(unsigned entries) {
+    io_uring_params params{};
+    ring_fd = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+    if (ring_fd < 0) { return false; }
+    // IORING_OP_WRITE arrived in the same kernel as this feature flag
+    if (!(params.features & IORING_FEAT_RW_CUR_POS)) { return false; }
+
+    sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cq_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) { sq_size = cq_size = std::max(sq_size, cq_size); }
+    sq_ring = map(sq_size, IORING_OFF_SQ_RING);
+    if (!sq_ring) { return false; }
+    cq_ring = (params.features & IORING_FEAT_SINGLE_MMAP) ? sq_ring : map(cq_size, IORING_OFF_CQ_RING);
+    if (!cq_ring) { return false; }
+    sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+    sqes = static_cast<io_uring_sqe *>(map(sqes_size, IORING_OFF_SQES));
+    if (!sqes) { return false; }
+
+    auto *sq = static_cast<uint8_t *>(sq_ring);
+    sq_tail = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+    sq_mask = *reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+    sq_array = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+    auto *cq = static_cast<uint8_t *>(cq_ring);
+    cq_head = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+    cq_tail = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+    cq_mask = *reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+    cqes = reinterpret_cast<io_uring_cqe *>(cq + params.cq_off.cqes);
+    sq_entries = params.sq_entries;
+    return true;
+  }
+
+  const char *name() const override { return "io_uring"; }
+  size_t capacity() const override { return sq_entries; }
+  size_t in_flight() const override { return pending; }
+
+  void start(AsyncWriter::Request *request) override {
+    io_uring_sqe *sqe = next_sqe();
+    sqe->opcode = IORING_OP_WRITE;
+    sqe->fd = request->fd;
+    sqe->addr = reinterpret_cast<uint64_t>(request->bytes + request->done);
+    sqe->len = static_cast<uint32_t>(std::min<size_t>(request->size - request->done, 1u << 30));
+    sqe->off = request->offset + request->done;
+    sqe->user_data = reinterpret_cast<uint64_t>(request);
+    ++pending;
+  }
+
+  void reap(bool wait, std::vector<Completion> &done) override {
+    enter(wait ? 1 : 0);
+    drain([&](const io_uring_cqe &cqe) {
+      done.emplace_back(reinterpret_cast<AsyncWriter::Request *>(cqe.user_data), cqe.res);
+    });
+  }
+
+  void sync(const std::vector<int> &fds) override {
+    for (size_t i = 0; i < fds.size(); i += sq_entries) {
+      size_t batch = std::min<size_t>(sq_entries, fds.size() - i);
+      for (size_t j = 0; j < batch; ++j) {
+        io_uring_sqe *sqe = next_sqe();
+        sqe->opcode = IORING_OP_FSYNC;
+        sqe->fd = fds[i + j];
+        sqe->user_data = 0;
+      }
+      pending += batch;
+      while (pending > 0) {
+        enter(1);
+        drain([](const io_uring_cqe &) {});
+      }
+    }
+  }
+
+private:
+  void *map(size_t size, off_t offset) {
+    void *p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, offset);
+    return p == MAP_FAILED ? nullptr : p;
+  }
+
+  // Only the writer thread fills the submission ring, so the tail is ours
+  io_uring_sqe *next_sqe() {
+    unsigned tail = *sq_tail + unsubmitted;
+    unsigned index = tail & sq_mask;
+    io_uring_sqe *sqe = &sqes[index];
+    std::memset(sqe, 0, sizeof(*sqe));
+    sq_array[index] = index;
+    ++unsubmitted;
+    return sqe;
+  }
+
+  // Publishes queued entries and optionally waits for completions
+  void enter(unsigned min_complete) {
+    std::atomic_ref<unsigned>(*sq_tail).store(*sq_tail + unsubmitted, std::memory_order_release);
+    unsigned to_submit = unsubmitted;
+    unsubmitted = 0;
+    unsigned flags = min_complete ? IORING_ENTER_GETEVENTS : 0;
+    if (!to_submit && !min_complete) { return; }
+    if (min_complete && cq_ready() > 0) { min_complete = 0; flags = 0; }
+    while (syscall(__NR_io_uring_enter, ring_fd, to_submit, min_complete, flags, nullptr, 0) < 0) {
+      if (errno != EINTR && errno != EAGAIN && errno != EBUSY) { break; }
+    }
+  }
+
+  unsigned cq_ready() const {
+    return std::atomic_ref<unsigned>(*cq_tail).load(std::memory_order_acquire) - *cq_head;
+  }
+
+  template <typename Visit>
+  void drain(Visit visit) {
+    unsigned head = *cq_head;
+    unsigned tail = std::atomic_ref<unsigned>(*cq_tail).load(std::memory_order_acquire);
+    for (; head != tail; ++head) {
+      visit(cqes[head & cq_mask]);
+      --pending;
+    }
+    std::atomic_ref<unsigned>(*cq_head).store(head, std::memory_order_release);
+  }
+
+  int ring_fd = -1;
+  void *sq_ring = nullptr, *cq_ring = nullptr;
+  size_t sq_size = 0, cq_size = 0, sqes_size = 0;
+  io_uring_sqe *sqes = nullptr;
+  io_uring_cqe *cqes = nullptr;
+  unsigned *sq_tail = nullptr, *sq_array = nullptr;
+  unsigned *cq_head = nullptr, *cq_tail = nullptr;
+  unsigned sq_mask = 0, cq_mask = 0, sq_entries = 0;
+  unsigned unsubmitted = 0;
+  size_t pending = 0;
+};
+
+void raise_max(std::atomic<uint64_t> &max, uint64_t value) {
+  uint64_t seen = max.load(std::memory_order_relaxed);
+  while (value > seen && !max.compare_exchange_weak(seen, value, std::memory_order_relaxed)) {}
+}
+
+} // namespace
+
+AsyncWriter::AsyncWriter(Options options) : options(options) {
+  size_t capacity = 2;
+  while (capacity < options.queue_capacity) { capacity *= 2; }
+  cells = std::make_unique<Cell[]>(capacity);
+  for (size_t i = 0; i < capacity; ++i) { cells[i].sequence.store(i, std::memory_order_relaxed); }
+  mask = capacity - 1;
+
+  if (options.use_io_uring) {
+    auto uring = std::make_unique<UringBackend>();
+    if (uring->init(64)) { backend = std::move(uring); }
+  }
+  if (!backend) { backend = std::make_unique<PwriteBackend>(); }
+  thread = std::thread([this]() { run(); });
+}
+
+AsyncWriter::~AsyncWriter() {
+  flush();
+  stopping.store(true);
+  wake.fetch_add(1, std::memory_order_release);
+  wake.notify_one();
+  thread.join();
+  for (auto &log : logs) { close(log->fd); }
+}
+
+bool AsyncWriter::push(Request *request) {
+  request->enqueued = Clock::now();
+  size_t pos = enqueue_pos.load(std::memory_order_relaxed);
+  Cell *cell;
+  for (;;) {
+    cell = &cells[pos & mask];
+    size_t sequence = cell->sequence.load(std::memory_order_acquire);
+    auto diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+    if (diff == 0) {
+      if (enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) { break; }
+    } else if (diff < 0) {
+      rejected.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    } else {
+      pos = enqueue_pos.load(std::memory_order_relaxed);
+    }
+  }
+  cell->request = request;
+  cell->sequence.store(pos + 1, std::memory_order_release);
+  writes.fetch_add(1, std::memory_order_relaxed);
+  raise_max(max_queue_depth, pos + 1 - dequeue_pos.load(std::memory_order_relaxed));
+
+  wake.fetch_add(1, std::memory_order_release);
+  wake.notify_one();
+  return true;
+}
+
+bool AsyncWriter::write_file(std::string path, std::vector<uint8_t> data) {
+  auto *request = new Request;
+  request->kind = Request::Kind::File;
+  request->path = std::move(path);
+  request->data = std::move(data);
+  request->bytes = request->data.data();
+  request->size = request->data.size();
+  if (push(request)) { return true; }
+  delete request;
+  return false;
+}
+
+int AsyncWriter::open_log(const std::string &path) {
+  // O_APPEND puts every write at the end whatever its offset, so runs add
+  // to what earlier runs left
+  int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+  if (fd < 0) { return -1; }
+  auto log = std::make_unique<Log>();
+  log->path = path;
+  log->fd = fd;
+  const off_t end = lseek(fd, 0, SEEK_END);
+  log->offset = end > 0 ? static_cast<uint64_t>(end) : 0;
+  log->front.reserve(options.log_buffer);
+  log->back.reserve(options.log_buffer);
+  logs.push_back(std::move(log));
+  return static_cast<int>(logs.size() - 1);
+}
+
+void AsyncWriter::append(int log, const void *data, size_t size) {
+  Log &l = *logs[log];
+  const auto *p = static_cast<const uint8_t *>(data);
+  l.front.insert(l.front.end(), p, p + size);
+  if (l.front.size() >= options.log_buffer) { hand_over(l); }
+}
+
+// Queues the front buffer if the back one is free again; otherwise the
+// front keeps growing until the next attempt
+void AsyncWriter::hand_over(Log &log) {
+  if (log.front.empty() || log.back_busy.load(std::memory_order_acquire)) { return; }
+  auto *request = new Request;
+  request->kind = Request::Kind::Log;
+  request->log = &log;
+  request->fd = log.fd;
+  request->bytes = log.front.data();
+  request->size = log.front.size();
+  request->offset = log.offset;
+  log.back_busy.store(true, std::memory_order_relaxed);
+  if (!push(request)) {
+    log.back_busy.store(false, std::memory_order_relaxed);
+    delete request;
+    return;
+  }
+  // The vectors swap their storage, so the queued pointer stays valid
+  log.offset += log.front.size();
+  log.front.swap(log.back);
+  log.front.clear();
+}
+
+void AsyncWriter::flush() {
+  for (auto &log : logs) {
+    while (!log->front.empty()) {
+      hand_over(*log);
+      if (!log->front.empty()) { std::this_thread::yield(); }
+    }
+  }
+  uint64_t target = writes.load();
+  for (uint64_t seen = durable.load(); seen < target; seen = durable.load()) { durable.wait(seen); }
+}
+
+void AsyncWriter::run() {
+  std::vector<Completion> done;
+  std::vector<Request *> unsynced;  // Written files waiting to be synced and closed
+  std::vector<int> dirty;
+  uint64_t unsynced_writes = 0;
+
+  auto queue_empty = [&]() {
+    size_t pos = dequeue_pos.load(std::memory_order_relaxed);
+    return cells[pos & mask].sequence.load(std::memory_order_acquire) != pos + 1;
+  };
+  auto pop = [&]() -> Request * {
+    size_t pos = dequeue_pos.load(std::memory_order_relaxed);
+    Cell &cell = cells[pos & mask];
+    if (cell.sequence.load(std::memory_order_acquire) != pos + 1) { return nullptr; }
+    Request *request = cell.request;
+    cell.sequence.store(pos + mask + 1, std::memory_order_release);
+    dequeue_pos.store(pos + 1, std::memory_order_relaxed);
+    return request;
+  };
+  // `error` is the errno of a failed request
+  auto finish = [&](Request *request, bool ok, int error = 0) {
+    if (!ok) {
+      const std::string &path = request->kind == Request::Kind::Log ? request->log->path : request->path;
+      std::fprintf(stderr, "failed to write %s: %s\n", path.c_str(), std::strerror(error));
+    }
+    auto latency = static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - request->enqueued).count());
+    latency_ns_total.fetch_add(latency, std::memory_order_relaxed);
+    raise_max(latency_ns_max, latency);
+    (ok ? completed : failed).fetch_add(1, std::memory_order_relaxed);
+    if (ok) { bytes.fetch_add(request->size, std::memory_order_relaxed); }
+
+    if (request->kind == Request::Kind::Log) {
+      request->log->back_busy.store(false, std::memory_order_release);
+      if (std::find(dirty.begin(), dirty.end(), request->fd) == dirty.end()) { dirty.push_back(request->fd); }
+      delete request;
+      ++unsynced_writes;
+    } else if (ok) {
+      dirty.push_back(request->fd);
+      unsynced.push_back(request);
+      ++unsynced_writes;
+    } else {
+      if (request->fd >= 0) { close(request->fd); }
+      delete request;
+      durable.fetch_add(1);
+      durable.notify_all();
+    }
+  };
+  auto sync_all = [&]() {
+    backend->sync(dirty);
+    fsyncs.fetch_add(dirty.size(), std::memory_order_relaxed);
+    for (Request *request : unsynced) {
+      close(request->fd);
+      delete request;
+    }
+    unsynced.clear();
+    dirty.clear();
+    durable.fetch_add(unsynced_writes);
+    durable.notify_all();
+    unsynced_writes = 0;
+  };
+
+  for (;;) {
+    uint32_t seen = wake.load(std::memory_order_acquire);
+
+    // Hold back new work once a sync is due, so it runs with nothing in flight
+    if (unsynced_writes < options.fsync_batch) {
+      while (backend->in_flight() < backend->capacity()) {
+        Request *request = pop();
+        if (!request) { break; }
+        if (request->kind == Request::Kind::File) {
+          request->fd = open(request->path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+          if (request->fd < 0) { finish(request, false, errno); continue; }
+        }
+        backend->start(request);
+      }
+    }
+
+    if (backend->in_flight() > 0) {
+      done.clear();
+      backend->reap(true, done);
+      for (auto [request, result] : done) {
+        if (result < 0 || (result == 0 && request->done < request->size)) {
+          finish(request, false, result < 0 ? -result : EIO);
+          continue;
+        }
+        request->done += static_cast<size_t>(result);
+        if (request->done < request->size) { backend->start(request); }  // Short write
+        else { finish(request, true); }
+      }
+      continue;
+    }
+
+    bool idle = queue_empty();
+    if (unsynced_writes > 0 && (idle || unsynced_writes >= options.fsync_batch)) { sync_all(); }
+    if (!idle) { continue; }
+    if (stopping.load()) { break; }
+    wake.wait(seen, std::memory_order_acquire);
+  }
+}
+
+AsyncWriter::Stats AsyncWriter::get_stats() const {
+  Stats stats;
+  stats.backend = backend->name();
+  stats.writes = writes.load();
+  stats.completed = completed.load();
+  stats.failed = failed.load();
+  stats.rejected = rejected.load();
+  stats.bytes = bytes.load();
+  stats.fsyncs = fsyncs.load();
+  size_t in = enqueue_pos.load(), out = dequeue_pos.load();
+  stats.queue_depth = in > out ? in - out : 0;
+  stats.max_queue_depth = max_queue_depth.load();
+  stats.latency_ns_total = latency_ns_total.load();
+  stats.latency_ns_max = latency_ns_max.load();
+  return stats;
+}
+
+void AsyncWriter::print_stats(FILE *out) const {
+  Stats s = get_stats();
+  uint64_t finished = s.completed + s.failed;
+  std::fprintf(out,
+               "writer %s: %llu writes, %.1f KiB, %llu failed, %llu rejected, %llu fsyncs, "
+               "queue depth %llu (max %llu), latency avg %.1fus max %.1fus\n",
+               s.backend, (unsigned long long)s.writes, s.bytes / 1024.0, (unsigned long long)s.failed,
+               (unsigned long long)s.rejected, (unsigned long long)s.fsyncs, (unsigned long long)s.queue_depth,
+               (unsigned long long)s.max_queue_depth,
+               finished ? s.latency_ns_total / 1e3 / finished : 0.0, s.latency_ns_max / 1e3);
+}
@@ -0,0 +1,100 @@
+#pragma once
+
+// Background writer for replays and logs.
+// Producers hand buffers over through a lock-free queue and never wait on
+// the disk. A single writer thread submits them with io_uring, or with
+// pwrite where io_uring is unavailable, and syncs finished files in batches
+// whenever it runs out of work. Failed writes are reported on stderr with
+// their path.
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+class AsyncWriter {
+public:
+  struct Options {
+    size_t queue_capacity = 1024;  // Rounded up to a power of two
+    bool use_io_uring = true;
+    size_t fsync_batch = 64;       // Sync at the latest after this many writes
+    size_t log_buffer = 64 << 10;  // Bytes a log gathers before handing over
+  };
+
+  struct Stats {
+    const char *backend = "";
+    uint64_t writes = 0;           // Buffers accepted
+    uint64_t completed = 0;
+    uint64_t failed = 0;
+    uint64_t rejected = 0;         // Turned away because the queue was full
+    uint64_t bytes = 0;
+    uint64_t fsyncs = 0;
+    uint64_t queue_depth = 0;
+    uint64_t max_queue_depth = 0;
+    uint64_t latency_ns_total = 0; // Enqueue to write completion
+    uint64_t latency_ns_max = 0;
+  };
+
+  AsyncWriter() : AsyncWriter(Options{}) {}
+  explicit AsyncWriter(Options options);
+  // Writes out everything still queued before returning
+  ~AsyncWriter();
+
+  AsyncWriter(const AsyncWriter &) = delete;
+  AsyncWriter &operator=(const AsyncWriter &) = delete;
+
+  // Replaces the file at `path` with `data`. Returns false without blocking
+  // if the queue is full, leaving the caller to retry or write it directly.
+  bool write_file(std::string path, std::vector<uint8_t> data);
+
+  // Opens a log for appending, creating it if needed. Opening blocks, so do
+  // it before the hot loop. Returns -1 on failure.
+  int open_log(const std::string &path);
+  // Appends to a log. Each log is double-buffered: bytes go into the front
+  // buffer, which is swapped out and queued once full while the previous
+  // one may still be in flight. Only one thread may append to a given log.
+  void append(int log, const void *data, size_t size);
+
+  // Queues every log's pending bytes and blocks until all writes accepted
+  // so far are on disk
+  void flush();
+
+  Stats get_stats() const;
+  void print_stats(FILE *out) const;
+
+  struct Request;
+  struct Log;
+  class Backend;
+
+private:
+  bool push(Request *request);
+  void hand_over(Log &log);
+  void run();
+
+  Options options;
+  std::unique_ptr<Backend> backend;
+
+  // Bounded multi-producer queue (Vyukov): each cell carries a sequence
+  // number telling producers and the consumer whose turn it is
+  struct Cell {
+    std::atomic<size_t> sequence;
+    Request *request;
+  };
+  std::unique_ptr<Cell[]> cells;
+  size_t mask = 0;
+  alignas(64) std::atomic<size_t> enqueue_pos{ 0 };
+  alignas(64) std::atomic<size_t> dequeue_pos{ 0 };
+
+  alignas(64) std::atomic<uint32_t> wake{ 0 };
+  std::atomic<uint64_t> durable{ 0 };
+  std::atomic<bool> stopping{ false };
+  std::vector<std::unique_ptr<Log>> logs;
+
+  std::atomic<uint64_t> writes{ 0 }, completed{ 0 }, failed{ 0 }, rejected{ 0 }, bytes{ 0 }, fsyncs{ 0 };
+  std::atomic<uint64_t> max_queue_depth{ 0 }, latency_ns_total{ 0 }, latency_ns_max{ 0 };
+
+  std::thread thread;
+};
@@ -0,0 +1,256 @@
+// snakey_batch: plays many headless bot games on all cores and reports how
+// they went.
+//
+//   snakey_batch [--games N] [--bots a,b,...] [--seed N] [--threads N]
+//                [--max-ticks N] [--tick-rate MS] [--no-wrap] [--heatmap OUT.snh]
+//                [--frame-games N] [--workers N] [--range N]
+//
+// Game i is played by bot i mod the bot count on seed + i, so results do not
+// depend on the thread count. With --heatmap every thread counts head
+// visits, deaths and food eaten per cell on its own map; the maps are summed
+// in parallel at the end and saved for `snakey --heatmap`.
+//
+// With a single `proc:COMMAND` bot and --frame-games N, every thread starts
+// one bot process and plays N games in lockstep with it, sending the states
+// of all N in one frame per tick (see bot_process.hpp). Moves that miss half
+// of --tick-rate keep the snake going straight.
+//
+// --workers N plays the games in N worker processes instead of threads (see
+// batch_workers.hpp). Workers take --range games at a time and send back
+// their totals and heatmaps; a worker that crashes is replaced and its range
+// played again, so totals match a threaded run unless a range keeps
+// crashing.
+
+#include "batch_workers.hpp"
+#include "bot_process.hpp"
+#include "bots.hpp"
+#include "heatmap.hpp"
+#include "plugin.hpp"
+#include "util.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+// Counters are written by one thread at a time, apart from their neighbours
+struct alignas(64) WorkerState {
+  BatchStats stats;
+  Heatmap heatmap;
+};
+
+void print_totals(const BatchStats &total, double seconds, int parallel, const char *unit) {
+  std::printf("%llu games in %.2fs on %d %s (%.1f games/s, %.0f ticks/s)\n", (unsigned long long)total.games,
+              seconds, parallel, unit, total.games / std::max(seconds, 1e-9), total.ticks / std::max(seconds, 1e-9));
+  if (total.games == 0) { return; }
+  std::printf("average length %.1f, best %llu, average ticks %.0f\n", double(total.length) / total.games,
+              (unsigned long long)total.best_length, double(total.ticks) / total.games);
+  std::printf("ended by:");
+  for (int i = 0; i < CAUSE_COUNT; ++i) {
+    if (total.deaths[i] == 0) { continue; }
+    std::printf(" %s %llu", i == 0 ? "tick limit" : death_cause_name(static_cast<DeathCause>(i)),
+                (unsigned long long)total.deaths[i]);
+  }
+  std::printf("\n");
+}
+
+// `merge_ms` is left out of the report when negative
+bool write_heatmap(const Heatmap &heatmap, const std::string &path, double merge_ms) {
+  if (!save_heatmap(heatmap, path)) {
+    std::fprintf(stderr, "cannot write %s\n", path.c_str());
+    return false;
+  }
+  char merged[48] = "";
+  if (merge_ms >= 0) { std::snprintf(merged, sizeof(merged), " merged in %.2fms,", merge_ms); }
+  std::printf("heatmap of %llu games%s written to %s (%llu visits, %llu deaths, %llu food)\n",
+              (unsigned long long)heatmap.get_games(), merged, path.c_str(),
+              (unsigned long long)heatmap.total(HeatLayer::Visits),
+              (unsigned long long)heatmap.total(HeatLayer::Deaths),
+              (unsigned long long)heatmap.total(HeatLayer::Food));
+  return true;
+}
+
+// A game in a lockstep frame
+struct FrameSlot {
+  World world;
+  std::optional<HeatmapRecorder> recorder;
+  uint64_t index;  // Game number, also its id in the frame
+  bool active;
+};
+
+} // namespace
+
+int main(int argc, char **argv) {
+  uint64_t games = 1000;
+  std::vector<std::string> bots = { "path" };
+  uint64_t seed = 1;
+  int threads = std::max(1u, std::thread::hardware_concurrency());
+  std::string heatmap_path;
+  int frame_games = 1;
+  int worker_processes = 0;
+  uint64_t range_games = 0;
+  Rules rules;
+  rules.max_ticks = 10000;
+  rules.starvation_ticks = 2 * rules.width * rules.height;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    bool has_value = i + 1 < argc;
+    if (arg == "--games" && has_value) { games = std::strtoull(argv[++i], nullptr, 10); }
+    else if (arg == "--bots" && has_value) { bots = split(argv[++i]); }
+    else if (arg == "--seed" && has_value) { seed = std::strtoull(argv[++i], nullptr, 10); }
+    else if (arg == "--threads" && has_value) { threads = std::max(1, std::atoi(argv[++i])); }
+    else if (arg == "--max-ticks" && has_value) { rules.max_ticks = std::max(0, std::atoi(argv[++i])); }
+    else if (arg == "--tick-rate" && has_value) { rules.tick_rate_ms = std::max(1, std::atoi(argv[++i])); }
+    else if (arg == "--no-wrap") { rules.wrapping = false; }
+    else if (arg == "--heatmap" && has_value) { heatmap_path = argv[++i]; }
+    else if (arg == "--frame-games" && has_value) { frame_games = std::max(1, std::atoi(argv[++i])); }
+    else if (arg == "--workers" && has_value) { worker_processes = std::max(1, std::atoi(argv[++i])); }
+    else if (arg == "--range" && has_value) { range_games = std::strtoull(argv[++i], nullptr, 10); }
+    else {
+      std::fprintf(stderr, "usage: snakey_batch [--games N] [--bots a,b,...] [--seed N] [--threads N] "
+                           "[--max-ticks N] [--tick-rate MS] [--no-wrap] [--heatmap OUT.snh] "
+                           "[--frame-games N] [--workers N] [--range N]\n");
+      return 1;
+    }
+  }
+  if (bots.empty()) { bots = { "path" }; }
+  std::string process_command;
+  if (frame_games > 1) {
+    if (bots.size() != 1 || bots[0].rfind("proc:", 0) != 0) {
+      std::fprintf(stderr, "--frame-games needs a single proc:COMMAND bot\n");
+      return 1;
+    }
+    process_command = bots[0].substr(5);
+  }
+  for (const std::string &name : bots) {
+    if (!make_bot(name)) { std::fprintf(stderr, "unknown bot %s\n", name.c_str()); return 1; }
+    if (is_single_instance_bot(name) && (threads > 1 || worker_processes > 0)) {
+      std::fprintf(stderr, "%s plays one game at a time; use --threads 1 without --workers\n", name.c_str());
+      return 1;
+    }
+  }
+
+  const bool want_heatmap = !heatmap_path.empty();
+  BatchJob job;
+  job.rules = rules;
+  job.bots = bots;
+  job.seed = seed;
+  job.games = games;
+  job.heatmap = want_heatmap;
+
+  if (worker_processes > 0) {
+    if (frame_games > 1) { std::fprintf(stderr, "--frame-games is not supported with --workers\n"); return 1; }
+    // A few ranges per worker keeps them busy to the end without making
+    // the coordinator a bottleneck
+    if (range_games == 0) { range_games = std::clamp<uint64_t>(games / (uint64_t(worker_processes) * 8), 1, 1000); }
+    WorkerReport report;
+    std::string error;
+    auto start = std::chrono::steady_clock::now();
+    if (!run_batch_workers(job, worker_processes, range_games, report, &error)) {
+      std::fprintf(stderr, "%s\n", error.c_str());
+      return 1;
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    print_totals(report.stats, seconds, worker_processes, "workers");
+    std::printf("%llu ranges of up to %llu games, %llu workers started, %llu crashed, %llu ranges reassigned, "
+                "%llu games failed\n",
+                (unsigned long long)report.ranges, (unsigned long long)range_games,
+                (unsigned long long)report.workers_started, (unsigned long long)report.crashes,
+                (unsigned long long)report.reassigned, (unsigned long long)report.failed_games);
+    if (want_heatmap && !write_heatmap(report.heatmap, heatmap_path, -1.0)) { return 1; }
+    return report.failed_games > 0 ? 1 : 0;
+  }
+
+  std::vector<WorkerState> workers(threads);
+  for (WorkerState &worker : workers) {
+    if (want_heatmap) { worker.heatmap = Heatmap(rules.width, rules.height); }
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  std::atomic<uint64_t> next{ 0 };
+  std::atomic<uint64_t> failed_games{ 0 };
+  std::vector<std::thread> pool;
+  for (int t = 0; t < threads; ++t) {
+    pool.emplace_back([&, t]() {
+      WorkerState &state = workers[t];
+      if (!process_command.empty()) {
+        std::string error;
+        auto process = BotProcess::spawn(process_command, &error);
+        if (!process) { std::fprintf(stderr, "%s\n", error.c_str()); return; }
+        // Slots take a new game as soon as theirs ends, so frames stay full
+        // until the games run out
+        std::vector<FrameSlot> slots;
+        slots.reserve(frame_games);
+        auto claim = [&](FrameSlot &slot) {
+          uint64_t i = next++;
+          slot.active = i < games;
+          if (!slot.active) { return; }
+          slot.index = i;
+          slot.world = World(rules, seed + i);
+          if (want_heatmap) { slot.recorder.emplace(state.heatmap, slot.world); }
+        };
+        for (int k = 0; k < frame_games; ++k) {
+          slots.push_back({ World(rules, seed), std::nullopt, 0, false });
+          claim(slots.back());
+        }
+        std::vector<BotRequest> requests;
+        std::vector<FrameSlot *> requested;
+        std::vector<Direction> moves;
+        const int64_t budget_us = int64_t(rules.tick_rate_ms) * 500;
+        for (;;) {
+          requests.clear();
+          requested.clear();
+          for (FrameSlot &slot : slots) {
+            if (!slot.active) { continue; }
+            requests.push_back({ &slot.world, 0, static_cast<uint32_t>(slot.index) });
+            requested.push_back(&slot);
+          }
+          if (requests.empty()) { break; }
+          process->exchange(requests, moves, budget_us);
+          for (size_t r = 0; r < requested.size(); ++r) {
+            FrameSlot &slot = *requested[r];
+            slot.world.set_direction(0, moves[r]);
+            slot.world.step();
+            if (slot.recorder) { slot.recorder->observe(slot.world); }
+            if (slot.world.is_over()) {
+              record_batch_game(state.stats, slot.world);
+              claim(slot);
+            }
+          }
+        }
+        return;
+      }
+      for (uint64_t i = next++; i < games; i = next++) {
+        if (!play_batch_game(job, i, state.stats, want_heatmap ? &state.heatmap : nullptr)) { failed_games++; }
+      }
+    });
+  }
+  for (std::thread &worker : pool) { worker.join(); }
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  BatchStats total;
+  for (const WorkerState &worker : workers) { total.merge(worker.stats); }
+  print_totals(total, seconds, threads, "threads");
+  if (failed_games > 0) {
+    std::fprintf(stderr, "%llu games failed: their bot could not be made\n", (unsigned long long)failed_games.load());
+  }
+
+  if (want_heatmap) {
+    std::vector<Heatmap> parts;
+    for (WorkerState &worker : workers) { parts.push_back(std::move(worker.heatmap)); }
+    auto merge_start = std::chrono::steady_clock::now();
+    Heatmap heatmap = merge_heatmaps(parts, threads);
+    double merge_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - merge_start).count();
+    if (!write_heatmap(heatmap, heatmap_path, merge_ms)) { return 1; }
+  }
+  print_plugin_stats(stdout);
+  print_process_stats(stdout);
+  return failed_games > 0 ? 1 : 0;
+}
@@ -0,0 +1,325 @@
+#include "batch_workers.hpp"
+#include "bots.hpp"
+#include "util.hpp"
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <optional>
+
+namespace {
+
+// Tries a range gets before its games are given up on
+constexpr int MAX_ATTEMPTS = 3;
+constexpr uint32_t MAX_MESSAGE_BYTES = 1 << 24;
+
+// Messages are a little-endian u32 payload length, a u8 type and the payload
+enum class Message : uint8_t {
+  Range = 1,   // Coordinator to worker: u64 first, u64 count; a count of 0 stops the worker
+  Result = 2   // Worker to coordinator: u64 first, u64 count, the BatchStats fields, u32 size and a heatmap
+};
+
+struct Range {
+  uint64_t first;
+  uint64_t count;
+  int attempts;
+};
+
+struct Worker {
+  pid_t pid;
+  int fd;
+  bool busy;   // A range is out with it
+  Range range;
+  bool gone;
+};
+
+class Reader {
+public:
+  Reader(const std::vector<uint8_t> &bytes) : bytes(bytes) {}
+  bool ok() const { return !overrun; }
+  size_t remaining() const { return bytes.size() - offset; }
+  const uint8_t *here() const { return bytes.data() + offset; }
+  void skip(size_t n) { offset += std::min(n, remaining()); }
+
+  uint64_t fixed(int n) {
+    if (overrun || remaining() < static_cast<size_t>(n)) { overrun = true; return 0; }
+    uint64_t v = 0;
+    for (int i = 0; i < n; ++i) { v |= uint64_t(bytes[offset++]) << (8 * i); }
+    return v;
+  }
+
+private:
+  const std::vector<uint8_t> &bytes;
+  size_t offset = 0;
+  bool overrun = false;
+};
+
+bool read_all(int fd, void *data, size_t size) {
+  auto *p = static_cast<uint8_t *>(data);
+  while (size > 0) {
+    ssize_t n = read(fd, p, size);
+    if (n < 0 && errno == EINTR) { continue; }
+    if (n <= 0) { return false; }
+    p += n;
+    size -= static_cast<size_t>(n);
+  }
+  return true;
+}
+
+bool write_all(int fd, const void *data, size_t size) {
+  auto *p = static_cast<const uint8_t *>(data);
+  while (size > 0) {
+    ssize_t n = send(fd, p, size, MSG_NOSIGNAL);
+    if (n < 0 && errno == EINTR) { continue; }
+    if (n <= 0) { return false; }
+    p += n;
+    size -= static_cast<size_t>(n);
+  }
+  return true;
+}
+
+bool send_message(int fd, Message type, const std::vector<uint8_t> &payload) {
+  std::vector<uint8_t> bytes;
+  put_fixed(bytes, payload.size(), 4);
+  put_fixed(bytes, static_cast<uint8_t>(type), 1);
+  bytes.insert(bytes.end(), payload.begin(), payload.end());
+  return write_all(fd, bytes.data(), bytes.size());
+}
+
+bool receive_message(int fd, Message &type, std::vector<uint8_t> &payload) {
+  uint8_t header[5];
+  if (!read_all(fd, header, sizeof(header))) { return false; }
+  uint32_t size = uint32_t(header[0]) | uint32_t(header[1]) << 8 | uint32_t(header[2]) << 16 | uint32_t(header[3]) << 24;
+  if (size > MAX_MESSAGE_BYTES) { return false; }
+  type = static_cast<Message>(header[4]);
+  payload.resize(size);
+  return read_all(fd, payload.data(), size);
+}
+
+bool send_range(int fd, uint64_t first, uint64_t count) {
+  std::vector<uint8_t> payload;
+  put_fixed(payload, first, 8);
+  put_fixed(payload, count, 8);
+  return send_message(fd, Message::Range, payload);
+}
+
+[[noreturn]] void run_worker(int fd, const BatchJob &job) {
+  Message type;
+  std::vector<uint8_t> payload;
+  std::vector<uint8_t> heatmap_bytes;
+  while (receive_message(fd, type, payload) && type == Message::Range) {
+    Reader r(payload);
+    uint64_t first = r.fixed(8);
+    uint64_t count = r.fixed(8);
+    if (!r.ok() || count == 0) { break; }
+
+    BatchStats stats;
+    Heatmap heatmap;
+    if (job.heatmap) { heatmap = Heatmap(job.rules.width, job.rules.height); }
+    for (uint64_t i = first; i < first + count; ++i) {
+      // Leaving without a result makes the coordinator treat the range as
+      // crashed and retry it elsewhere
+      if (!play_batch_game(job, i, stats, job.heatmap ? &heatmap : nullptr)) { _exit(1); }
+    }
+
+    payload.clear();
+    put_fixed(payload, first, 8);
+    put_fixed(payload, count, 8);
+    put_fixed(payload, stats.games, 8);
+    put_fixed(payload, stats.ticks, 8);
+    put_fixed(payload, stats.length, 8);
+    put_fixed(payload, stats.best_length, 8);
+    for (uint64_t deaths : stats.deaths) { put_fixed(payload, deaths, 8); }
+    heatmap_bytes.clear();
+    if (job.heatmap) { encode_heatmap(heatmap, heatmap_bytes); }
+    put_fixed(payload, heatmap_bytes.size(), 4);
+    payload.insert(payload.end(), heatmap_bytes.begin(), heatmap_bytes.end());
+    if (!send_message(fd, Message::Result, payload)) { break; }
+  }
+  // Leave without running the coordinator's exit handlers or flushing its
+  // buffers a second time
+  _exit(0);
+}
+
+// Reads a result for `range`, false if it is malformed or for another range
+bool take_result(const std::vector<uint8_t> &payload, const Range &range, const BatchJob &job, WorkerReport &report) {
+  Reader r(payload);
+  if (r.fixed(8) != range.first || r.fixed(8) != range.count) { return false; }
+  BatchStats stats;
+  stats.games = r.fixed(8);
+  stats.ticks = r.fixed(8);
+  stats.length = r.fixed(8);
+  stats.best_length = r.fixed(8);
+  for (uint64_t &deaths : stats.deaths) { deaths = r.fixed(8); }
+  uint64_t heatmap_size = r.fixed(4);
+  if (!r.ok() || heatmap_size != r.remaining()) { return false; }
+  if (job.heatmap) {
+    Heatmap heatmap;
+    if (!decode_heatmap(r.here(), heatmap_size, heatmap)) { return false; }
+    if (heatmap.get_width() != report.heatmap.get_width() || heatmap.get_height() != report.heatmap.get_height()) {
+      return false;
+    }
+    report.heatmap.merge(heatmap);
+  }
+  report.stats.merge(stats);
+  report.ranges++;
+  return true;
+}
+
+} // namespace
+
+void BatchStats::merge(const BatchStats &other) {
+  games += other.games;
+  ticks += other.ticks;
+  length += other.length;
+  best_length = std::max(best_length, other.best_length);
+  for (int i = 0; i < CAUSE_COUNT; ++i) { deaths[i] += other.deaths[i]; }
+}
+
+void record_batch_game(BatchStats &stats, const World &world) {
+  const uint64_t length = world.get_snake(0).get_length();
+  stats.games++;
+  stats.ticks += world.get_tick();
+  stats.length += length;
+  stats.best_length = std::max(stats.best_length, length);
+  stats.deaths[static_cast<int>(world.get_death_cause(0))]++;
+}
+
+bool play_batch_game(const BatchJob &job, uint64_t index, BatchStats &stats, Heatmap *heatmap) {
+  std::unique_ptr<Bot> bot = make_bot(job.bots[index % job.bots.size()]);
+  if (!bot) { return false; }
+  World world(job.rules, job.seed + index);
+  std::optional<HeatmapRecorder> recorder;
+  if (heatmap) { recorder.emplace(*heatmap, world); }
+  while (!world.is_over()) {
+    world.set_direction(0, bot->choose(world, 0));
+    world.step();
+    bot->on_tick(world, 0);
+    if (recorder) { recorder->observe(world); }
+  }
+  record_batch_game(stats, world);
+  return true;
+}
+
+bool run_batch_workers(const BatchJob &job, int workers, uint64_t range_games, WorkerReport &report,
+                       std::string *error) {
+  report = WorkerReport();
+  if (job.heatmap) { report.heatmap = Heatmap(job.rules.width, job.rules.height); }
+  range_games = std::max<uint64_t>(1, range_games);
+
+  std::deque<Range> retries;
+  uint64_t next_first = 0;
+  auto work_left = [&]() { return !retries.empty() || next_first < job.games; };
+  auto next_range = [&](Range &range) {
+    if (!retries.empty()) {
+      range = retries.front();
+      retries.pop_front();
+      return true;
+    }
+    if (next_first >= job.games) { return false; }
+    range = { next_first, std::min(range_games, job.games - next_first), 0 };
+    next_first += range.count;
+    return true;
+  };
+
+  std::vector<Worker> pool;
+  // A failed send shows up as a hang-up on the next poll and is handled there
+  auto assign = [&](Worker &worker) {
+    worker.busy = next_range(worker.range);
+    if (worker.busy) { send_range(worker.fd, worker.range.first, worker.range.count); }
+    else { send_range(worker.fd, 0, 0); }
+  };
+  auto spawn = [&]() {
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) != 0) { return false; }
+    std::fflush(nullptr);
+    pid_t pid = fork();
+    if (pid < 0) {
+      close(fds[0]);
+      close(fds[1]);
+      return false;
+    }
+    if (pid == 0) {
+      close(fds[0]);
+      for (const Worker &other : pool) { close(other.fd); }
+      run_worker(fds[1], job);
+    }
+    close(fds[1]);
+    pool.push_back({ pid, fds[0], false, {}, false });
+    report.workers_started++;
+    assign(pool.back());
+    return true;
+  };
+
+  for (int i = 0; i < workers && work_left(); ++i) {
+    if (!spawn()) {
+      if (error) { *error = std::string("cannot start a worker: ") + std::strerror(errno); }
+      for (Worker &worker : pool) { close(worker.fd); waitpid(worker.pid, nullptr, 0); }
+      return false;
+    }
+  }
+
+  std::vector<pollfd> fds;
+  Message type;
+  std::vector<uint8_t> payload;
+  while (!pool.empty()) {
+    fds.clear();
+    for (const Worker &worker : pool) { fds.push_back({ worker.fd, POLLIN, 0 }); }
+    if (poll(fds.data(), fds.size(), -1) < 0) {
+      if (errno == EINTR) { continue; }
+      break;
+    }
+    int replacements = 0;
+    for (size_t i = 0; i < pool.size(); ++i) {
+      if (!fds[i].revents) { continue; }
+      Worker &worker = pool[i];
+      if (worker.busy && receive_message(worker.fd, type, payload) && type == Message::Result &&
+          take_result(payload, worker.range, job, report)) {
+        assign(worker);
+        continue;
+      }
+
+      // Hung up: either done after being told to stop, or crashed mid-range
+      close(worker.fd);
+      int status = 0;
+      waitpid(worker.pid, &status, 0);
+      worker.gone = true;
+      if (!worker.busy) { continue; }
+      report.crashes++;
+      if (WIFSIGNALED(status)) {
+        std::fprintf(stderr, "worker %d died of signal %d in games %llu-%llu\n", int(worker.pid), WTERMSIG(status),
+                     (unsigned long long)worker.range.first,
+                     (unsigned long long)(worker.range.first + worker.range.count - 1));
+      } else {
+        std::fprintf(stderr, "worker %d stopped in games %llu-%llu\n", int(worker.pid),
+                     (unsigned long long)worker.range.first,
+                     (unsigned long long)(worker.range.first + worker.range.count - 1));
+      }
+      if (++worker.range.attempts < MAX_ATTEMPTS) {
+        retries.push_back(worker.range);
+        report.reassigned++;
+      } else {
+        report.failed_games += worker.range.count;
+      }
+      ++replacements;
+    }
+    pool.erase(std::remove_if(pool.begin(), pool.end(), [](const Worker &w) { return w.gone; }), pool.end());
+
+    // Idle workers were already told to stop, so crashes are replaced by
+    // fresh processes as long as there is work for them
+    for (; replacements > 0 && work_left(); --replacements) {
+      if (!spawn() && pool.empty()) {
+        if (error) { *error = std::string("cannot restart a worker: ") + std::strerror(errno); }
+        return false;
+      }
+    }
+  }
+  return true;
+}
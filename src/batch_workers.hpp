@@ -0,0 +1,57 @@
+#pragma once
+
+// Games and totals of snakey_batch, and its multi-process mode: a
+// coordinator forks worker processes, hands them ranges of game numbers over
+// Unix domain sockets and merges the totals and heatmaps they send back.
+// Each worker has its own heap, and a worker that crashes loses only the
+// range it was playing, which is handed to a fresh worker.
+
+#include "core.hpp"
+#include "heatmap.hpp"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+constexpr int CAUSE_COUNT = static_cast<int>(DeathCause::Starved) + 1;
+
+// Totals of a share of the games; shares add up field by field
+struct BatchStats {
+  uint64_t games = 0;
+  uint64_t ticks = 0;
+  uint64_t length = 0;
+  uint64_t best_length = 0;
+  uint64_t deaths[CAUSE_COUNT] = {};
+
+  void merge(const BatchStats &other);
+};
+
+struct BatchJob {
+  Rules rules;
+  std::vector<std::string> bots;
+  uint64_t seed = 1;
+  uint64_t games = 0;
+  bool heatmap = false;
+};
+
+// Plays game `index`: bot index mod the bot count on seed + index. The
+// heatmap may be null. False, with nothing recorded, if the bot cannot be
+// made.
+bool play_batch_game(const BatchJob &job, uint64_t index, BatchStats &stats, Heatmap *heatmap);
+void record_batch_game(BatchStats &stats, const World &world);
+
+struct WorkerReport {
+  BatchStats stats;
+  Heatmap heatmap;
+  uint64_t ranges = 0;
+  uint64_t workers_started = 0;
+  uint64_t crashes = 0;
+  uint64_t reassigned = 0;    // Ranges handed out again after a crash
+  uint64_t failed_games = 0;  // Games of ranges given up on
+};
+
+// Plays the job on `workers` processes, `range_games` games per range. A
+// range is tried on at most three workers before its games count as failed.
+// Call it before starting any threads, since it forks.
+bool run_batch_workers(const BatchJob &job, int workers, uint64_t range_games, WorkerReport &report,
+                       std::string *error = nullptr);
@@ -0,0 +1,142 @@
+// snakey_bench: measures the core loop at different snake lengths.
+//
+//   snakey_bench [--lengths 3,64,256,1024] [--ticks N] [--seed N]
+//                [--no-counters] [--json FILE]
+//
+// For each length a path bot plays on a board wide enough for the snake to
+// start in one row, restarting whenever it dies, until --ticks ticks have
+// been played. Only the instrumented parts of World::step are measured, not
+// the bot. Hardware counters are used where the kernel allows them.
+
+#include "bots.hpp"
+#include "perf_counters.hpp"
+#include "util.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+namespace {
+
+struct Run {
+  int length;
+  uint64_t ticks;
+  int games;
+  double average_length;
+  std::string counters;  // JSON from perf_counters_json
+};
+
+std::vector<int> parse_lengths(const std::string &list) {
+  std::vector<int> lengths;
+  for (const std::string &part : split(list)) {
+    int length = std::atoi(part.c_str());
+    if (length > 0) { lengths.push_back(length); }
+  }
+  return lengths;
+}
+
+Run run_length(int length, uint64_t ticks, uint64_t seed) {
+  Rules rules;
+  rules.initial_length = length;
+  rules.width = std::max(GRID_WIDTH, length + length / 2 + 8);
+  rules.height = GRID_HEIGHT;
+
+  perf_counters_reset();
+  Run run = { length, 0, 0, 0.0, "" };
+  uint64_t length_sum = 0;
+  while (run.ticks < ticks) {
+    World world(rules, seed + run.games, 1);
+    std::unique_ptr<Bot> bot = make_bot("path");
+    ++run.games;
+    while (!world.is_over() && run.ticks < ticks) {
+      world.set_direction(0, bot->choose(world, 0));
+      world.step();
+      ++run.ticks;
+      length_sum += world.get_snake(0).get_length();
+    }
+  }
+  run.average_length = run.ticks ? double(length_sum) / run.ticks : 0.0;
+  run.counters = perf_counters_json();
+  return run;
+}
+
+void print_run(const Run &run) {
+  std::printf("length %d: %llu ticks over %d games, average length %.1f\n", run.length,
+              (unsigned long long)run.ticks, run.games, run.average_length);
+  std::printf("  %-10s %10s %10s %10s %10s %6s %10s %10s\n", "scope", "calls", "ns/call", "cycles", "instr",
+              "ipc", "cache-miss", "br-miss");
+  for (size_t s = 0; s < PERF_SCOPE_COUNT; ++s) {
+    PerfScope scope = static_cast<PerfScope>(s);
+    PerfTotals t = perf_totals(scope);
+    if (t.calls == 0) { continue; }
+    auto per_call = [&](PerfEvent event) -> std::string {
+      if (!perf_event_available(event)) { return "-"; }
+      char text[32];
+      std::snprintf(text, sizeof(text), "%.1f", double(t.events[static_cast<size_t>(event)]) / t.calls);
+      return text;
+    };
+    uint64_t cycles = t.events[static_cast<size_t>(PerfEvent::Cycles)];
+    uint64_t instructions = t.events[static_cast<size_t>(PerfEvent::Instructions)];
+    char ipc[16] = "-";
+    if (cycles && perf_event_available(PerfEvent::Instructions)) {
+      std::snprintf(ipc, sizeof(ipc), "%.2f", double(instructions) / cycles);
+    }
+    std::printf("  %-10s %10llu %10.1f %10s %10s %6s %10s %10s\n", perf_scope_name(scope),
+                (unsigned long long)t.calls, double(t.ns) / t.calls, per_call(PerfEvent::Cycles).c_str(),
+                per_call(PerfEvent::Instructions).c_str(), ipc, per_call(PerfEvent::CacheMisses).c_str(),
+                per_call(PerfEvent::BranchMisses).c_str());
+  }
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  std::vector<int> lengths = { 3, 64, 256, 1024 };
+  uint64_t ticks = 20000;
+  uint64_t seed = 1;
+  bool counters = true;
+  std::string json_path;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    bool has_value = i + 1 < argc;
+    if (arg == "--lengths" && has_value) { lengths = parse_lengths(argv[++i]); }
+    else if (arg == "--ticks" && has_value) { ticks = std::strtoull(argv[++i], nullptr, 10); }
+    else if (arg == "--seed" && has_value) { seed = std::strtoull(argv[++i], nullptr, 10); }
+    else if (arg == "--json" && has_value) { json_path = argv[++i]; }
+    else if (arg == "--no-counters") { counters = false; }
+    else {
+      std::fprintf(stderr, "usage: snakey_bench [--lengths a,b,...] [--ticks N] [--seed N] [--no-counters] [--json FILE]\n");
+      return 1;
+    }
+  }
+
+  bool hardware = perf_counters_enable(counters);
+  if (counters && !hardware) {
+    std::printf("hardware counters unavailable (%s), timing only\n", perf_counters_status().c_str());
+  } else if (counters && !perf_counters_status().empty()) {
+    std::printf("some counters unavailable: %s\n", perf_counters_status().c_str());
+  }
+
+  std::vector<Run> runs;
+  for (int length : lengths) {
+    runs.push_back(run_length(length, ticks, seed));
+    print_run(runs.back());
+  }
+
+  if (!json_path.empty()) {
+    FILE *file = std::fopen(json_path.c_str(), "w");
+    if (!file) { std::fprintf(stderr, "cannot write %s\n", json_path.c_str()); return 1; }
+    std::fprintf(file, "{\"runs\": [");
+    for (size_t i = 0; i < runs.size(); ++i) {
+      const Run &run = runs[i];
+      std::fprintf(file, "%s\n  {\"length\": %d, \"ticks\": %llu, \"games\": %d, \"average_length\": %.1f, \"counters\": %s}",
+                   i ? "," : "", run.length, (unsigned long long)run.ticks, run.games, run.average_length,
+                   run.counters.c_str());
+    }
+    std::fprintf(file, "\n]}\n");
+    std::fclose(file);
+  }
+  return 0;
+}
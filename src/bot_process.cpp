@@ -0,0 +1,319 @@
+#include "bot_process.hpp"
+#include "util.hpp"
+
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <charconv>
+#include <chrono>
+#include <cstring>
+#include <map>
+#include <mutex>
+
+extern char **environ;
+
+struct ProcessStats {
+  std::atomic<uint64_t> frames{ 0 };
+  std::atomic<uint64_t> states{ 0 };
+  std::atomic<uint64_t> late{ 0 };          // Frames whose answer missed the deadline
+  std::atomic<uint64_t> invalid{ 0 };       // Moves that were not U D L R
+  std::atomic<uint64_t> writes{ 0 };
+  std::atomic<uint64_t> reads{ 0 };
+  std::atomic<uint64_t> bytes_out{ 0 };
+  std::atomic<uint64_t> frame_ns{ 0 };
+  std::atomic<uint64_t> max_frame_ns{ 0 };
+  std::atomic<uint64_t> exits{ 0 };
+};
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// How long a bot gets to exit on its own once its stdin is closed
+constexpr auto EXIT_GRACE = std::chrono::milliseconds(100);
+// Unwritten frames a bot may fall behind by before it is given up on
+constexpr size_t MAX_PENDING_OUTPUT = 1 << 20;
+
+std::mutex registry_mutex;
+std::map<std::string, std::shared_ptr<ProcessStats>> registry;
+
+std::shared_ptr<ProcessStats> stats_for(const std::string &command) {
+  std::lock_guard<std::mutex> lock(registry_mutex);
+  auto &stats = registry[command];
+  if (!stats) { stats = std::make_shared<ProcessStats>(); }
+  return stats;
+}
+
+char direction_letter(Direction direction) {
+  switch (direction) {
+    case Direction::Up:    return 'U';
+    case Direction::Down:  return 'D';
+    case Direction::Left:  return 'L';
+    case Direction::Right: return 'R';
+  }
+  return 'R';
+}
+
+bool parse_direction(char letter, Direction &direction) {
+  switch (letter) {
+    case 'U': direction = Direction::Up; return true;
+    case 'D': direction = Direction::Down; return true;
+    case 'L': direction = Direction::Left; return true;
+    case 'R': direction = Direction::Right; return true;
+    default: return false;
+  }
+}
+
+void append_number(std::string &out, int64_t value) {
+  char text[24];
+  auto end = std::to_chars(text, text + sizeof(text), value).ptr;
+  out.append(text, end);
+}
+
+uint64_t elapsed_ns(Clock::time_point since) {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - since).count();
+}
+
+} // namespace
+
+std::unique_ptr<BotProcess> BotProcess::spawn(const std::string &command, std::string *error) {
+  // A bot that exits while the game writes to it must not take the game down
+  static std::once_flag ignore_sigpipe;
+  std::call_once(ignore_sigpipe, [] { signal(SIGPIPE, SIG_IGN); });
+
+  int to_child[2];
+  int from_child[2];
+  if (pipe2(to_child, O_CLOEXEC) != 0) {
+    fail(error, std::string("pipe: ") + std::strerror(errno));
+    return nullptr;
+  }
+  if (pipe2(from_child, O_CLOEXEC) != 0) {
+    fail(error, std::string("pipe: ") + std::strerror(errno));
+    close(to_child[0]);
+    close(to_child[1]);
+    return nullptr;
+  }
+  posix_spawn_file_actions_t actions;
+  posix_spawn_file_actions_init(&actions);
+  posix_spawn_file_actions_adddup2(&actions, to_child[0], STDIN_FILENO);
+  posix_spawn_file_actions_adddup2(&actions, from_child[1], STDOUT_FILENO);
+  char shell[] = "/bin/sh";
+  char flag[] = "-c";
+  std::string text = command;
+  char *argv[] = { shell, flag, text.data(), nullptr };
+  pid_t pid = -1;
+  int result = posix_spawn(&pid, shell, &actions, nullptr, argv, environ);
+  posix_spawn_file_actions_destroy(&actions);
+  close(to_child[0]);
+  close(from_child[1]);
+  if (result != 0) {
+    close(to_child[1]);
+    close(from_child[0]);
+    fail(error, "cannot run " + command + ": " + std::strerror(result));
+    return nullptr;
+  }
+  // Both ends are polled against the deadline, never blocked on
+  fcntl(to_child[1], F_SETFL, fcntl(to_child[1], F_GETFL) | O_NONBLOCK);
+  fcntl(from_child[0], F_SETFL, fcntl(from_child[0], F_GETFL) | O_NONBLOCK);
+  return std::unique_ptr<BotProcess>(new BotProcess(pid, to_child[1], from_child[0], stats_for(command)));
+}
+
+BotProcess::~BotProcess() {
+  close(to_child);
+  close(from_child);
+  auto give_up = Clock::now() + EXIT_GRACE;
+  while (waitpid(pid, nullptr, WNOHANG) == 0) {
+    if (Clock::now() >= give_up) {
+      kill(pid, SIGKILL);
+      waitpid(pid, nullptr, 0);
+      break;
+    }
+    usleep(1000);
+  }
+}
+
+void BotProcess::stop() {
+  if (!running) { return; }
+  running = false;
+  stats->exits++;
+}
+
+void BotProcess::encode(const std::vector<BotRequest> &requests) {
+  if (output_offset == output.size()) {
+    output.clear();
+    output_offset = 0;
+  }
+  output += "F ";
+  append_number(output, sequence);
+  output += ' ';
+  append_number(output, static_cast<int64_t>(requests.size()));
+  output += '\n';
+  for (const BotRequest &request : requests) {
+    const World &world = *request.world;
+    const Rules &rules = world.get_rules();
+    const int64_t header[] = { request.game, world.get_tick(), rules.width, rules.height, rules.wrapping ? 1 : 0,
+                               world.get_food().x, world.get_food().y, world.get_snake_count(), request.self };
+    for (size_t i = 0; i < std::size(header); ++i) {
+      if (i > 0) { output += ' '; }
+      append_number(output, header[i]);
+    }
+    for (int s = 0; s < world.get_snake_count(); ++s) {
+      const Snake &snake = world.get_snake(s);
+      output += world.is_alive(s) ? " 1 " : " 0 ";
+      output += direction_letter(snake.get_direction());
+      output += ' ';
+      append_number(output, snake.get_length());
+      for (int age = 0; age < snake.get_length(); ++age) {
+        const Point &p = snake.segment(age);
+        output += ' ';
+        append_number(output, p.x);
+        output += ' ';
+        append_number(output, p.y);
+      }
+    }
+    output += '\n';
+  }
+}
+
+bool BotProcess::take_answer(size_t count, std::vector<Direction> &moves) {
+  size_t start = 0;
+  bool answered = false;
+  for (size_t end; !answered && (end = input.find('\n', start)) != std::string::npos; start = end + 1) {
+    const char *line = input.data() + start;
+    const char *line_end = input.data() + end;
+    uint32_t seq = 0;
+    auto [after, ec] = std::from_chars(line, line_end, seq);
+    if (ec != std::errc() || seq != sequence) { continue; }  // Late answer to an earlier frame
+    while (after < line_end && *after == ' ') { ++after; }
+    for (size_t i = 0; i < count; ++i) {
+      Direction direction;
+      if (after + i < line_end && parse_direction(after[i], direction)) { moves[i] = direction; }
+      else { stats->invalid++; }
+    }
+    answered = true;
+  }
+  input.erase(0, start);
+  return answered;
+}
+
+bool BotProcess::exchange(const std::vector<BotRequest> &requests, std::vector<Direction> &moves,
+                          int64_t timeout_us) {
+  moves.resize(requests.size());
+  for (size_t i = 0; i < requests.size(); ++i) {
+    moves[i] = requests[i].world->get_snake(requests[i].self).get_direction();
+  }
+  if (!running) { return false; }
+
+  const auto start = Clock::now();
+  const auto deadline = start + std::chrono::microseconds(timeout_us);
+  ++sequence;
+  encode(requests);
+  if (output.size() - output_offset > MAX_PENDING_OUTPUT) {
+    stop();
+    return false;
+  }
+  stats->frames++;
+  stats->states += requests.size();
+
+  bool answered = false;
+  while (running && !answered) {
+    auto remaining = deadline - Clock::now();
+    if (remaining <= Clock::duration::zero()) { break; }
+    pollfd fds[2] = { { from_child, POLLIN, 0 }, { to_child, POLLOUT, 0 } };
+    nfds_t count = output_offset < output.size() ? 2 : 1;
+    auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(remaining).count();
+    timespec timeout{ static_cast<time_t>(ns / 1000000000), static_cast<long>(ns % 1000000000) };
+    if (ppoll(fds, count, &timeout, nullptr) < 0) {
+      if (errno == EINTR) { continue; }
+      stop();
+      break;
+    }
+    if (count == 2 && fds[1].revents) {
+      ssize_t n = write(to_child, output.data() + output_offset, output.size() - output_offset);
+      stats->writes++;
+      if (n > 0) {
+        output_offset += static_cast<size_t>(n);
+        stats->bytes_out += static_cast<uint64_t>(n);
+      } else if (n < 0 && errno != EAGAIN && errno != EINTR) {
+        stop();
+      }
+    }
+    if (fds[0].revents) {
+      char buffer[1 << 16];
+      ssize_t n = read(from_child, buffer, sizeof(buffer));
+      stats->reads++;
+      if (n > 0) {
+        input.append(buffer, static_cast<size_t>(n));
+        answered = take_answer(requests.size(), moves);
+      } else if (n == 0 || (errno != EAGAIN && errno != EINTR)) {
+        stop();
+      }
+    }
+  }
+
+  uint64_t frame_ns = elapsed_ns(start);
+  stats->frame_ns += frame_ns;
+  uint64_t max = stats->max_frame_ns.load();
+  while (frame_ns > max && !stats->max_frame_ns.compare_exchange_weak(max, frame_ns)) {}
+  if (!answered) { stats->late++; }
+  return running;
+}
+
+namespace {
+
+class ProcessBot : public Bot {
+public:
+  explicit ProcessBot(std::unique_ptr<BotProcess> process) : process(std::move(process)) {}
+
+  Direction choose(const World &world, int self) override {
+    if (world.get_tick() < last_tick || &world != last_world) { ++game; }
+    last_tick = world.get_tick();
+    last_world = &world;
+    // Half the tick is left for the game itself, as for plugins
+    int64_t budget_us = int64_t(std::max(1, world.get_rules().tick_rate_ms)) * 500;
+    requests.assign(1, { &world, self, game });
+    process->exchange(requests, moves, budget_us);
+    return moves[0];
+  }
+
+private:
+  std::unique_ptr<BotProcess> process;
+  std::vector<BotRequest> requests;
+  std::vector<Direction> moves;
+  const World *last_world = nullptr;
+  uint32_t last_tick = 0;
+  uint32_t game = 0;
+};
+
+} // namespace
+
+std::unique_ptr<Bot> make_process_bot(const std::string &command) {
+  std::string error;
+  auto process = BotProcess::spawn(command, &error);
+  if (!process) {
+    std::fprintf(stderr, "proc:%s: %s\n", command.c_str(), error.c_str());
+    return nullptr;
+  }
+  return std::make_unique<ProcessBot>(std::move(process));
+}
+
+void print_process_stats(FILE *out) {
+  std::lock_guard<std::mutex> lock(registry_mutex);
+  for (const auto &[command, s] : registry) {
+    uint64_t frames = s->frames.load();
+    std::fprintf(out, "process %s: %llu frames, %llu states, %.0f us/frame (max %.0f), "
+                      "%llu writes, %llu reads, %llu bytes out, %llu late, %llu invalid, %llu exited\n",
+                 command.c_str(), (unsigned long long)frames, (unsigned long long)s->states.load(),
+                 frames ? double(s->frame_ns) / frames / 1000.0 : 0.0, double(s->max_frame_ns) / 1000.0,
+                 (unsigned long long)s->writes.load(), (unsigned long long)s->reads.load(),
+                 (unsigned long long)s->bytes_out.load(), (unsigned long long)s->late.load(),
+                 (unsigned long long)s->invalid.load(), (unsigned long long)s->exits.load());
+  }
+}
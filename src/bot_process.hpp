@@ -0,0 +1,85 @@
+#pragma once
+
+// Bots that run as child processes and talk over their stdin and stdout,
+// so they can be written in any language. The command runs under /bin/sh.
+//
+// The game writes frames and the bot answers each with one line:
+//
+//   F <seq> <count>                    frame header
+//   <state>                            count state lines, one per game
+//   ...
+//   <seq> <moves>                      answer: one of U D L R per state
+//
+// A state line is
+//
+//   <game> <tick> <width> <height> <wrap> <food_x> <food_y> <snakes> <self>
+//   then per snake: <alive> <direction> <length> <x> <y> ... head first
+//
+// with directions as U D L R. Answers must come within half a tick; late
+// answers are skipped by their sequence number and the snake keeps its
+// direction, as does any game whose move is missing or not one of U D L R.
+// Batch mode puts many games into one frame, so a whole tick of games costs
+// one write and one read.
+
+#include "bots.hpp"
+
+#include <sys/types.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+
+struct BotRequest {
+  const World *world;
+  int self;
+  uint32_t game;  // Tells games apart within a frame and across restarts
+};
+
+struct ProcessStats;
+
+class BotProcess {
+public:
+  // Returns nullptr with the reason in `error` if the command cannot start
+  static std::unique_ptr<BotProcess> spawn(const std::string &command, std::string *error = nullptr);
+
+  // Closes the bot's stdin and gives it a moment to exit before killing it
+  ~BotProcess();
+  BotProcess(const BotProcess &) = delete;
+  BotProcess &operator=(const BotProcess &) = delete;
+
+  // Sends one frame with a state per request and reads the answer, waiting
+  // up to `timeout_us`. `moves` is filled with each snake's current
+  // direction first, so games the answer misses keep going straight. False
+  // once the process has exited.
+  bool exchange(const std::vector<BotRequest> &requests, std::vector<Direction> &moves, int64_t timeout_us);
+
+  bool is_running() const { return running; }
+
+private:
+  BotProcess(pid_t pid, int to_child, int from_child, std::shared_ptr<ProcessStats> stats)
+    : pid(pid), to_child(to_child), from_child(from_child), stats(std::move(stats)) {}
+
+  void encode(const std::vector<BotRequest> &requests);
+  // Consumes complete lines; true once the answer to the current frame is in
+  bool take_answer(size_t count, std::vector<Direction> &moves);
+  void stop();
+
+  pid_t pid;
+  int to_child;
+  int from_child;
+  bool running = true;
+  uint32_t sequence = 0;
+  std::string output;         // Bytes not yet written, possibly from earlier frames
+  size_t output_offset = 0;
+  std::string input;          // Bytes read but not yet parsed into lines
+  std::shared_ptr<ProcessStats> stats;
+};
+
+// `proc:COMMAND` in make_bot: one game per frame. Returns nullptr, with the
+// reason on stderr, if the command cannot start.
+std::unique_ptr<Bot> make_process_bot(const std::string &command);
+
+// Prints frames, syscalls, late answers and timings for every command
+void print_process_stats(FILE *out);
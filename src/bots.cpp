@@ -0,0 +1,199 @@
+#include "bots.hpp"
+#include "bot_process.hpp"
+#include "plugin.hpp"
+#include "shm_channel.hpp"
+#include "search.hpp"
+
+#include <algorithm>
+#include <random>
+
+namespace {
+
+constexpr Direction ALL_DIRECTIONS[] = { Direction::Up, Direction::Down, Direction::Left, Direction::Right };
+
+// Picks a random safe move, otherwise keeps going
+class RandomBot : public Bot {
+public:
+  Direction choose(const World &world, int self) override {
+    std::vector<Direction> moves = safe_moves(world, self);
+    if (moves.empty()) { return world.get_snake(self).get_direction(); }
+    return moves[random_engine() % moves.size()];
+  }
+
+private:
+  std::mt19937 random_engine{ 12345 };
+};
+
+// Follows the shortest path to the food, falling back to the move that
+// keeps the most room when the food cannot be reached
+class PathBot : public Bot {
+public:
+  Direction choose(const World &world, int self) override {
+    const Rules &rules = world.get_rules();
+    const Snake &snake = world.get_snake(self);
+    const Point head = snake.get_head();
+    const Point food = world.get_food();
+    const int cells = rules.width * rules.height;
+
+    // Breadth-first search from the head, remembering each cell's first move
+    first_move.assign(cells, -1);
+    queue.clear();
+    for (Direction d : ALL_DIRECTIONS) {
+      if (is_opposite(d, snake.get_direction())) { continue; }
+      Point next = world.wrap(step_towards(head, d));
+      if (world.is_blocked(next)) { continue; }
+      int index = next.y * rules.width + next.x;
+      if (first_move[index] != -1) { continue; }
+      first_move[index] = static_cast<int>(d);
+      queue.push_back(next);
+    }
+    for (size_t i = 0; i < queue.size(); ++i) {
+      Point cell = queue[i];
+      int index = cell.y * rules.width + cell.x;
+      if (cell.x == food.x && cell.y == food.y) {
+        Direction move = static_cast<Direction>(first_move[index]);
+        // Only commit to the path if it does not lead into a pocket
+        Point next = world.wrap(step_towards(head, move));
+        if (reachable_cells(world, next, snake.get_length()) >= snake.get_length()) { return move; }
+        break;
+      }
+      for (Direction d : ALL_DIRECTIONS) {
+        Point next = world.wrap(step_towards(cell, d));
+        if (world.is_blocked(next)) { continue; }
+        int next_index = next.y * rules.width + next.x;
+        if (first_move[next_index] != -1) { continue; }
+        first_move[next_index] = first_move[index];
+        queue.push_back(next);
+      }
+    }
+
+    Direction best = snake.get_direction();
+    int best_room = -1;
+    for (Direction d : safe_moves(world, self)) {
+      int room = reachable_cells(world, world.wrap(step_towards(head, d)), cells);
+      if (room > best_room) { best_room = room; best = d; }
+    }
+    return best;
+  }
+
+private:
+  std::vector<int> first_move;
+  std::vector<Point> queue;
+};
+
+// Walks a fixed Hamiltonian cycle through every cell, which never dies but
+// is slow to reach the food. The cycle snakes across columns 1.. and comes
+// back up column 0, so it needs an even board height.
+class HamiltonianBot : public Bot {
+public:
+  Direction choose(const World &world, int self) override {
+    const Rules &rules = world.get_rules();
+    const Snake &snake = world.get_snake(self);
+    if (rules.height % 2 != 0 || rules.width < 2) { return fallback.choose(world, self); }
+
+    Point head = snake.get_head();
+    Direction along = cycle_direction(head, rules.width, rules.height);
+    Point next = world.wrap(step_towards(head, along));
+    if (!is_opposite(along, snake.get_direction()) && !world.is_blocked(next)) { return along; }
+    // Off the cycle, which only happens before the body has settled onto it
+    return fallback.choose(world, self);
+  }
+
+private:
+  static Direction cycle_direction(Point p, int width, int height) {
+    if (p.x == 0) { return p.y == 0 ? Direction::Right : Direction::Up; }
+    bool rightwards = p.y % 2 == 0;
+    if (rightwards) { return p.x == width - 1 ? Direction::Down : Direction::Right; }
+    if (p.x == 1) { return p.y == height - 1 ? Direction::Left : Direction::Down; }
+    return Direction::Left;
+  }
+
+  PathBot fallback;
+};
+
+// Looks ahead with the anytime search, a fixed number of nodes per tick.
+// In the game the search runs in frame-sized slices between ticks, so by
+// the time the tick comes the move is usually ready; headless tools, which
+// never call think(), search the whole budget in choose().
+class SearchBot : public Bot {
+public:
+  Direction choose(const World &world, int self) override {
+    if (!search.is_started() || search.get_root_tick() != world.get_tick()) {
+      on_tick(world, self);
+    }
+    search.resume(SearchClock::time_point::max(), SEARCH_NODE_BUDGET);
+    return search.get_best_move();
+  }
+
+  void on_tick(const World &world, int self) override { search.begin(world, self); }
+
+  void think(SearchClock::time_point until) override {
+    if (search.is_started()) { search.resume(until, SEARCH_NODE_BUDGET); }
+  }
+
+private:
+  AnytimeSearch search;
+};
+
+} // namespace
+
+std::vector<Direction> safe_moves(const World &world, int self) {
+  const Snake &snake = world.get_snake(self);
+  std::vector<Direction> moves;
+  for (Direction d : ALL_DIRECTIONS) {
+    if (is_opposite(d, snake.get_direction())) { continue; }
+    if (!world.is_blocked(step_towards(snake.get_head(), d))) { moves.push_back(d); }
+  }
+  return moves;
+}
+
+int reachable_cells(const World &world, Point start, int limit) {
+  const Rules &rules = world.get_rules();
+  start = world.wrap(start);
+  if (world.is_blocked(start)) { return 0; }
+  std::vector<uint8_t> seen(static_cast<size_t>(rules.width) * rules.height, 0);
+  std::vector<Point> stack = { start };
+  seen[start.y * rules.width + start.x] = 1;
+  int count = 0;
+  while (!stack.empty() && count < limit) {
+    Point cell = stack.back();
+    stack.pop_back();
+    ++count;
+    for (Direction d : ALL_DIRECTIONS) {
+      Point next = world.wrap(step_towards(cell, d));
+      if (world.is_blocked(next)) { continue; }
+      uint8_t &visited = seen[next.y * rules.width + next.x];
+      if (visited) { continue; }
+      visited = 1;
+      stack.push_back(next);
+    }
+  }
+  return count;
+}
+
+const std::vector<std::string> &bot_names() {
+  static const std::vector<std::string> names = { "random", "path", "hamiltonian", "search" };
+  return names;
+}
+
+std::unique_ptr<Bot> make_bot(const std::string &name) {
+  if (name.rfind("plugin:", 0) == 0) { return make_plugin_bot(name.substr(7)); }
+  if (name.rfind("shm:", 0) == 0) { return make_shm_bot(name.substr(4)); }
+  if (name.rfind("proc:", 0) == 0) { return make_process_bot(name.substr(5)); }
+  if (name == "random") { return std::make_unique<RandomBot>(); }
+  if (name == "path") { return std::make_unique<PathBot>(); }
+  if (name == "hamiltonian") { return std::make_unique<HamiltonianBot>(); }
+  if (name == "search") { return std::make_unique<SearchBot>(); }
+  return nullptr;
+}
+
+bool is_bot_name(const std::string &name) {
+  if (name.rfind("plugin:", 0) == 0) { return name.size() > 7; }
+  // Segment names become a single file under /dev/shm
+  if (name.rfind("shm:", 0) == 0) { return name.size() > 4 && name.find('/') == std::string::npos; }
+  if (name.rfind("proc:", 0) == 0) { return name.size() > 5; }
+  const std::vector<std::string> &builtin = bot_names();
+  return std::find(builtin.begin(), builtin.end(), name) != builtin.end();
+}
+
+bool is_single_instance_bot(const std::string &name) { return name.rfind("shm:", 0) == 0; }
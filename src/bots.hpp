@@ -0,0 +1,46 @@
+#pragma once
+
+// Computer players. A bot looks at the world before each tick and picks the
+// direction for the snake it controls.
+
+#include "core.hpp"
+
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+
+class Bot {
+public:
+  virtual ~Bot() = default;
+  virtual Direction choose(const World &world, int self) = 0;
+
+  // Called once a tick has been played, so bots that search can start on the
+  // next one straight away
+  virtual void on_tick(const World &world, int self) { (void)world; (void)self; }
+  // Lets a bot keep working between ticks until `until` at the latest. The
+  // game calls this once per frame with a slice of the frame.
+  virtual void think(std::chrono::steady_clock::time_point until) { (void)until; }
+};
+
+// Names of the built-in bots accepted by make_bot
+const std::vector<std::string> &bot_names();
+// Returns nullptr for unknown names. `plugin:PATH` loads a bot from a shared
+// object, see plugin.hpp, and `shm:NAME` hands the snake to an external
+// agent over shared memory, see shm_channel.hpp. `proc:COMMAND` runs a bot
+// process that speaks the text protocol in bot_process.hpp.
+std::unique_ptr<Bot> make_bot(const std::string &name);
+// True if `name` is one make_bot understands, checked without building the
+// bot, so no plugin is loaded, process spawned or segment created. Whether
+// a plugin, command or segment actually works shows once make_bot runs.
+bool is_bot_name(const std::string &name);
+// True for bots of which only one can play at a time, such as `shm:NAME`,
+// whose segment is created exclusively. Tools that run several games at
+// once reject them.
+bool is_single_instance_bot(const std::string &name);
+
+// Helpers shared by bots
+// Moves that are neither reversals nor into a blocked cell
+std::vector<Direction> safe_moves(const World &world, int self);
+// Number of free cells reachable from `start`, stopping once `limit` is hit
+int reachable_cells(const World &world, Point start, int limit);
@@ -0,0 +1,372 @@
+#include "capture.hpp"
+
+#include "gif_writer.hpp"
+
+#include <raylib.h>
+#include <rlgl.h>
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <ctime>
+#include <type_traits>
+
+// Provided by the GLFW that raylib is built on. Weak, so a raylib built on
+// another platform layer still links and falls back to blocking reads.
+extern "C" void *glfwGetProcAddress(const char *name) __attribute__((weak));
+
+namespace {
+
+constexpr size_t QUEUE_CAPACITY   = 8;
+constexpr size_t MAX_FRAMES       = QUEUE_CAPACITY + 2;  // Frames in flight at most
+constexpr int CLIP_SAMPLE_INTERVAL = 3;                  // Every third frame, 20 per second at 60 FPS
+
+constexpr unsigned GL_UNSIGNED_BYTE_            = 0x1401;
+constexpr unsigned GL_RGBA_                     = 0x1908;
+constexpr unsigned GL_PACK_ALIGNMENT_           = 0x0D05;
+constexpr unsigned GL_PIXEL_PACK_BUFFER_        = 0x88EB;
+constexpr unsigned GL_STREAM_READ_              = 0x88E1;
+constexpr unsigned GL_MAP_READ_BIT_             = 0x0001;
+constexpr unsigned GL_SYNC_GPU_COMMANDS_COMPLETE_ = 0x9117;
+constexpr unsigned GL_ALREADY_SIGNALED_         = 0x911A;
+constexpr unsigned GL_CONDITION_SATISFIED_      = 0x911C;
+
+} // namespace
+
+struct FrameCapture::GlFunctions {
+  void (*GenBuffers)(int, unsigned *);
+  void (*DeleteBuffers)(int, const unsigned *);
+  void (*BindBuffer)(unsigned, unsigned);
+  void (*BufferData)(unsigned, ptrdiff_t, const void *, unsigned);
+  void *(*MapBufferRange)(unsigned, ptrdiff_t, ptrdiff_t, unsigned);
+  unsigned char (*UnmapBuffer)(unsigned);
+  void (*ReadPixels)(int, int, int, int, unsigned, unsigned, void *);
+  void (*PixelStorei)(unsigned, int);
+  void *(*FenceSync)(unsigned, unsigned);
+  unsigned (*ClientWaitSync)(void *, unsigned, uint64_t);
+  void (*DeleteSync)(void *);
+
+  bool load() {
+    if (!glfwGetProcAddress) { return false; }
+    bool ok = true;
+    auto get = [&](auto &function, const char *name) {
+      function = reinterpret_cast<std::remove_reference_t<decltype(function)>>(glfwGetProcAddress(name));
+      ok = ok && function;
+    };
+    get(GenBuffers, "glGenBuffers");
+    get(DeleteBuffers, "glDeleteBuffers");
+    get(BindBuffer, "glBindBuffer");
+    get(BufferData, "glBufferData");
+    get(MapBufferRange, "glMapBufferRange");
+    get(UnmapBuffer, "glUnmapBuffer");
+    get(ReadPixels, "glReadPixels");
+    get(PixelStorei, "glPixelStorei");
+    get(FenceSync, "glFenceSync");
+    get(ClientWaitSync, "glClientWaitSync");
+    get(DeleteSync, "glDeleteSync");
+    return ok;
+  }
+};
+
+bool FrameCapture::FrameQueue::push(Frame *frame) {
+  size_t t = tail.load(std::memory_order_relaxed);
+  if (t - head.load(std::memory_order_acquire) == slots.size()) { return false; }
+  slots[t % slots.size()] = frame;
+  tail.store(t + 1, std::memory_order_release);
+  return true;
+}
+
+FrameCapture::Frame *FrameCapture::FrameQueue::pop() {
+  size_t h = head.load(std::memory_order_relaxed);
+  if (h == tail.load(std::memory_order_acquire)) { return nullptr; }
+  Frame *frame = slots[h % slots.size()];
+  head.store(h + 1, std::memory_order_release);
+  return frame;
+}
+
+FrameCapture::FrameCapture(std::string directory)
+  : directory(std::move(directory)),
+    queue(QUEUE_CAPACITY),
+    spares(MAX_FRAMES)
+{
+}
+
+FrameCapture::~FrameCapture() { shutdown(); }
+
+void FrameCapture::init() {
+  if (encoder.joinable()) { return; }
+  gl = std::make_unique<GlFunctions>();
+  if (!gl->load()) {
+    gl.reset();
+    TraceLog(LOG_WARNING, "CAPTURE: pixel buffer objects unavailable, screenshots will block and clips are off");
+  }
+  encoder = std::thread([this]() { run_encoder(); });
+}
+
+void FrameCapture::shutdown() {
+  if (!encoder.joinable()) { return; }
+  if (recording) { toggle_clip(); }
+  if (clip_end_pending) {
+    Frame *frame = take_spare();
+    if (frame) {
+      frame->kind = Kind::ClipEnd;
+      frame->path = clip_path;
+      clip_end_pending = !submit(frame);
+      if (clip_end_pending) { idle.push_back(frame); }
+    }
+  }
+  if (gl) {
+    for (int i = 0; i < 2; ++i) {
+      if (fence[i]) { gl->DeleteSync(fence[i]); }
+      fence[i] = nullptr;
+      pending[i] = false;
+    }
+    if (pbo[0]) { gl->DeleteBuffers(2, pbo); }
+    pbo[0] = pbo[1] = 0;
+  }
+  stopping = true;
+  wakeups.fetch_add(1, std::memory_order_release);
+  wakeups.notify_one();
+  encoder.join();
+}
+
+void FrameCapture::toggle_clip() {
+  if (!encoder.joinable()) { return; }
+  if (recording) {
+    recording = false;
+    clip_end_pending = true;
+    return;
+  }
+  if (!gl) { return; }
+  recording = true;
+  clip_path = next_path("clip", "gif");
+  frames_until_sample = 0;
+  last_clip_frame = std::chrono::steady_clock::now();
+}
+
+void FrameCapture::capture_frame() {
+  if (!encoder.joinable()) { return; }
+  finish_readback();
+  if (clip_end_pending) {
+    // Clip frames still being read back are dropped by the encoder
+    Frame *frame = take_spare();
+    if (frame) {
+      frame->kind = Kind::ClipEnd;
+      frame->path = clip_path;
+      if (submit(frame)) { clip_end_pending = false; }
+      else { idle.push_back(frame); }
+    }
+  }
+
+  if (screenshot_requested) {
+    if (!gl) {
+      // Blocking fallback
+      Frame *frame = take_spare();
+      if (!frame) { return; }
+      rlDrawRenderBatchActive();
+      frame->kind = Kind::Screenshot;
+      frame->width = GetRenderWidth();
+      frame->height = GetRenderHeight();
+      frame->bottom_up = false;
+      frame->path = next_path("capture", "png");
+      unsigned char *data = rlReadScreenPixels(frame->width, frame->height);
+      frame->pixels.assign(data, data + static_cast<size_t>(frame->width) * frame->height * 4);
+      MemFree(data);
+      if (submit(frame)) { screenshot_requested = false; }
+      return;
+    }
+    if (!pending[next_pbo]) {
+      start_readback(Kind::Screenshot);
+      screenshot_requested = false;
+    }
+    return;
+  }
+  if (recording && --frames_until_sample <= 0) {
+    frames_until_sample = CLIP_SAMPLE_INTERVAL;
+    if (pending[next_pbo]) {
+      // The readback from two samples ago is still not done
+      frames_dropped++;
+      return;
+    }
+    start_readback(Kind::ClipFrame);
+  }
+}
+
+void FrameCapture::start_readback(Kind kind) {
+  const int width = GetRenderWidth();
+  const int height = GetRenderHeight();
+  const ptrdiff_t size = static_cast<ptrdiff_t>(width) * height * 4;
+  if (width != pbo_width || height != pbo_height) {
+    if (!pbo[0]) { gl->GenBuffers(2, pbo); }
+    for (int i = 0; i < 2; ++i) {
+      gl->BindBuffer(GL_PIXEL_PACK_BUFFER_, pbo[i]);
+      gl->BufferData(GL_PIXEL_PACK_BUFFER_, size, nullptr, GL_STREAM_READ_);
+      if (fence[i]) { gl->DeleteSync(fence[i]); }
+      fence[i] = nullptr;
+      pending[i] = false;
+    }
+    pbo_width = width;
+    pbo_height = height;
+  }
+
+  // Everything raylib has batched up must reach the framebuffer first
+  rlDrawRenderBatchActive();
+  const int i = next_pbo;
+  gl->BindBuffer(GL_PIXEL_PACK_BUFFER_, pbo[i]);
+  gl->PixelStorei(GL_PACK_ALIGNMENT_, 4);
+  gl->ReadPixels(0, 0, width, height, GL_RGBA_, GL_UNSIGNED_BYTE_, nullptr);
+  gl->BindBuffer(GL_PIXEL_PACK_BUFFER_, 0);
+  fence[i] = gl->FenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE_, 0);
+  pending[i] = true;
+  pending_kind[i] = kind;
+  next_pbo = 1 - i;
+}
+
+void FrameCapture::finish_readback() {
+  if (!gl) { return; }
+  // Oldest first, so frames reach the encoder in order
+  for (int n = 0; n < 2; ++n) {
+    const int i = (next_pbo + n) % 2;
+    if (!pending[i]) { continue; }
+    unsigned status = gl->ClientWaitSync(fence[i], 0, 0);
+    if (status != GL_ALREADY_SIGNALED_ && status != GL_CONDITION_SATISFIED_) { return; }
+
+    Frame *frame = take_spare();
+    if (!frame) {
+      if (pending_kind[i] == Kind::Screenshot) { return; }  // Try again next frame
+      frames_dropped++;
+    } else {
+      const size_t size = static_cast<size_t>(pbo_width) * pbo_height * 4;
+      gl->BindBuffer(GL_PIXEL_PACK_BUFFER_, pbo[i]);
+      const void *mapped = gl->MapBufferRange(GL_PIXEL_PACK_BUFFER_, 0, static_cast<ptrdiff_t>(size), GL_MAP_READ_BIT_);
+      if (mapped) {
+        frame->pixels.resize(size);
+        std::memcpy(frame->pixels.data(), mapped, size);
+        gl->UnmapBuffer(GL_PIXEL_PACK_BUFFER_);
+      }
+      gl->BindBuffer(GL_PIXEL_PACK_BUFFER_, 0);
+      frame->kind = pending_kind[i];
+      frame->width = pbo_width;
+      frame->height = pbo_height;
+      frame->bottom_up = true;
+      if (frame->kind == Kind::Screenshot) {
+        frame->path = next_path("capture", "png");
+      } else {
+        auto now = std::chrono::steady_clock::now();
+        frame->delay_cs = static_cast<int>(
+            std::chrono::duration_cast<std::chrono::milliseconds>(now - last_clip_frame).count() / 10);
+        last_clip_frame = now;
+        frame->path = clip_path;
+      }
+      if (!mapped || !submit(frame)) {
+        idle.push_back(frame);
+        if (frame->kind == Kind::Screenshot) { screenshot_requested = true; }
+        else { frames_dropped++; }
+      }
+    }
+    gl->DeleteSync(fence[i]);
+    fence[i] = nullptr;
+    pending[i] = false;
+  }
+}
+
+bool FrameCapture::submit(Frame *frame) {
+  if (!queue.push(frame)) { return false; }
+  wakeups.fetch_add(1, std::memory_order_release);
+  wakeups.notify_one();
+  return true;
+}
+
+FrameCapture::Frame *FrameCapture::take_spare() {
+  if (!idle.empty()) {
+    Frame *frame = idle.back();
+    idle.pop_back();
+    return frame;
+  }
+  if (Frame *frame = spares.pop()) { return frame; }
+  if (frames.size() < MAX_FRAMES) {
+    frames.push_back(std::make_unique<Frame>());
+    return frames.back().get();
+  }
+  return nullptr;
+}
+
+void FrameCapture::run_encoder() {
+  GifWriter gif;
+  std::string gif_path;
+  std::string finished_path;  // Late frames of the last clip must not reopen it
+  std::vector<uint8_t> row;
+  for (;;) {
+    uint32_t seen = wakeups.load(std::memory_order_acquire);
+    Frame *frame = queue.pop();
+    if (!frame) {
+      if (stopping.load()) { break; }
+      wakeups.wait(seen, std::memory_order_acquire);
+      continue;
+    }
+
+    const size_t stride = static_cast<size_t>(frame->width) * 4;
+    if (frame->bottom_up && frame->kind != Kind::ClipEnd) {
+      row.resize(stride);
+      for (int y = 0; y < frame->height / 2; ++y) {
+        uint8_t *top = frame->pixels.data() + y * stride;
+        uint8_t *bottom = frame->pixels.data() + (frame->height - 1 - y) * stride;
+        std::memcpy(row.data(), top, stride);
+        std::memcpy(top, bottom, stride);
+        std::memcpy(bottom, row.data(), stride);
+      }
+    }
+
+    switch (frame->kind) {
+      case Kind::Screenshot: {
+        for (size_t i = 3; i < frame->pixels.size(); i += 4) { frame->pixels[i] = 255; }
+        Image image = { frame->pixels.data(), frame->width, frame->height, 1, PIXELFORMAT_UNCOMPRESSED_R8G8B8A8 };
+        ExportImage(image, frame->path.c_str());
+        screenshots++;
+        break;
+      }
+      case Kind::ClipFrame:
+        if (frame->path == finished_path) { break; }
+        if (gif_path != frame->path) {
+          gif.close();
+          gif_path = gif.open(frame->path, frame->width, frame->height) ? frame->path : "";
+          if (!gif_path.empty()) { clips++; }
+        }
+        if (!gif_path.empty()) {
+          gif.add_frame(frame->pixels.data(), std::max(2, frame->delay_cs));
+          frames_encoded++;
+        }
+        break;
+      case Kind::ClipEnd:
+        if (gif_path == frame->path) {
+          gif.close();
+          TraceLog(LOG_INFO, "CAPTURE: clip saved to %s (%d frames)", gif_path.c_str(), gif.get_frame_count());
+          finished_path = gif_path;
+          gif_path.clear();
+        }
+        break;
+    }
+    spares.push(frame);
+  }
+  gif.close();
+}
+
+std::string FrameCapture::next_path(const char *prefix, const char *extension) {
+  auto now = std::chrono::system_clock::now();
+  std::time_t seconds = std::chrono::system_clock::to_time_t(now);
+  int millis = static_cast<int>(
+      std::chrono::duration_cast<std::chrono::milliseconds>(now.time_since_epoch()).count() % 1000);
+  std::tm local{};
+  localtime_r(&seconds, &local);
+  char name[64];
+  std::strftime(name, sizeof(name), "%Y%m%d_%H%M%S", &local);
+  return directory + "/" + prefix + "_" + name + "_" + std::to_string(millis) + "." + extension;
+}
+
+FrameCapture::Stats FrameCapture::get_stats() const {
+  Stats stats;
+  stats.screenshots = screenshots.load();
+  stats.clips = clips.load();
+  stats.frames_encoded = frames_encoded.load();
+  stats.frames_dropped = frames_dropped.load();
+  return stats;
+}
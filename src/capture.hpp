@@ -0,0 +1,118 @@
+#pragma once
+
+// Screenshots and GIF clips of the game window that never stall a frame.
+// The back buffer is read into one of two pixel buffer objects and mapped
+// a frame later, once the GPU has finished with it, so the copy overlaps
+// with the next frame instead of waiting on it. Mapped frames go through a
+// bounded queue to an encoder thread that writes PNGs and GIFs. When the
+// encoder falls behind, or a readback is not ready yet, clip frames are
+// dropped rather than waited for; the next frame's delay covers the gap.
+//
+// Without pixel buffer objects (the GL functions cannot be looked up)
+// screenshots fall back to a blocking read and clips are unavailable.
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+class FrameCapture {
+public:
+  struct Stats {
+    uint64_t screenshots = 0;
+    uint64_t clips = 0;
+    uint64_t frames_encoded = 0;
+    uint64_t frames_dropped = 0;  // Encoder busy or readback not ready
+  };
+
+  // Files are named capture_<time>.png and clip_<time>.gif in `directory`
+  explicit FrameCapture(std::string directory = ".");
+  ~FrameCapture();
+
+  FrameCapture(const FrameCapture &) = delete;
+  FrameCapture &operator=(const FrameCapture &) = delete;
+
+  // Needs a current GL context, so call it after the window is open
+  void init();
+  // Releases the GL buffers and lets the encoder write out what is queued.
+  // Call it before the window closes.
+  void shutdown();
+
+  void request_screenshot() { screenshot_requested = true; }
+  // Starts a clip, or ends the running one
+  void toggle_clip();
+  bool is_recording() const { return recording; }
+
+  // Call once the frame is drawn, before EndDrawing swaps it away
+  void capture_frame();
+
+  Stats get_stats() const;
+
+private:
+  enum class Kind : uint8_t { Screenshot, ClipFrame, ClipEnd };
+
+  struct Frame {
+    Kind kind = Kind::ClipFrame;
+    int width = 0;
+    int height = 0;
+    bool bottom_up = true;  // Rows as glReadPixels returns them
+    int delay_cs = 0;       // Time since the previous clip frame
+    std::string path;
+    std::vector<uint8_t> pixels;
+  };
+
+  // Single producer, single consumer ring of frame pointers
+  class FrameQueue {
+  public:
+    explicit FrameQueue(size_t capacity) : slots(capacity) {}
+    bool push(Frame *frame);
+    Frame *pop();
+
+  private:
+    std::vector<Frame *> slots;
+    alignas(64) std::atomic<size_t> head{ 0 };  // Next to pop
+    alignas(64) std::atomic<size_t> tail{ 0 };  // Next to push
+  };
+
+  struct GlFunctions;
+
+  bool submit(Frame *frame);
+  Frame *take_spare();
+  void start_readback(Kind kind);
+  void finish_readback();
+  void run_encoder();
+  std::string next_path(const char *prefix, const char *extension);
+
+  std::string directory;
+  std::unique_ptr<GlFunctions> gl;
+  unsigned pbo[2] = { 0, 0 };
+  void *fence[2] = { nullptr, nullptr };
+  Kind pending_kind[2] = { Kind::ClipFrame, Kind::ClipFrame };
+  bool pending[2] = { false, false };
+  int pbo_width = 0;
+  int pbo_height = 0;
+  int next_pbo = 0;
+
+  bool screenshot_requested = false;
+  bool recording = false;
+  bool clip_end_pending = false;  // Retried every frame until queued
+  int frames_until_sample = 0;
+  std::chrono::steady_clock::time_point last_clip_frame;
+  std::string clip_path;
+
+  FrameQueue queue;               // Game thread to encoder
+  FrameQueue spares;              // Encoder back to the game thread
+  std::vector<Frame *> idle;      // Frames the queue had no room for
+  std::vector<std::unique_ptr<Frame>> frames;
+  std::atomic<uint32_t> wakeups{ 0 };
+  std::atomic<bool> stopping{ false };
+  std::thread encoder;
+
+  std::atomic<uint64_t> screenshots{ 0 };
+  std::atomic<uint64_t> clips{ 0 };
+  std::atomic<uint64_t> frames_encoded{ 0 };
+  std::atomic<uint64_t> frames_dropped{ 0 };
+};
@@ -0,0 +1,119 @@
+// snakey_codec_bench: compares the compressed replay codec with the plain
+// replay format.
+//
+//   snakey_codec_bench [--games N] [REPLAY...]
+//
+// Without replay files it plays N games with the built-in bots first.
+// Throughput is given in MB of plain-format replay data per second.
+
+#include "bots.hpp"
+#include "replay.hpp"
+#include "replay_codec.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+std::vector<Replay> generate(int games) {
+  std::vector<Replay> replays;
+  const char *names[] = { "path", "random", "hamiltonian" };
+  for (int i = 0; i < games; ++i) {
+    Rules rules;
+    rules.wrapping = i % 2 == 0;
+    rules.max_ticks = 20000;
+    rules.starvation_ticks = 2 * rules.width * rules.height;
+    std::unique_ptr<Bot> bot = make_bot(names[i % 3]);
+    World world(rules, 1000 + i);
+    world.set_recording(true);
+    while (!world.is_over()) {
+      world.set_direction(0, bot->choose(world, 0));
+      world.step();
+    }
+    replays.push_back(world.make_replay());
+  }
+  return replays;
+}
+
+// Runs `body` over and over for at least a fifth of a second, returning the
+// seconds one run took
+template <typename Body>
+double time_per_run(Body body) {
+  int runs = 0;
+  auto start = Clock::now();
+  double elapsed = 0.0;
+  do {
+    body();
+    ++runs;
+    elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+  } while (elapsed < 0.2);
+  return elapsed / runs;
+}
+
+bool same_events(const Replay &a, const Replay &b) {
+  if (a.events.size() != b.events.size()) { return false; }
+  for (size_t i = 0; i < a.events.size(); ++i) {
+    if (a.events[i].tick != b.events[i].tick || a.events[i].snake != b.events[i].snake ||
+        a.events[i].direction != b.events[i].direction) {
+      return false;
+    }
+  }
+  return a.ticks == b.ticks && a.seed == b.seed && a.final_lengths == b.final_lengths;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  int games = 200;
+  std::vector<Replay> replays;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg == "--games" && i + 1 < argc) { games = std::max(1, std::atoi(argv[++i])); continue; }
+    Replay replay;
+    std::string error;
+    if (!load_replay(arg, replay, &error)) {
+      std::fprintf(stderr, "skipping %s: %s\n", arg.c_str(), error.c_str());
+      continue;
+    }
+    replays.push_back(std::move(replay));
+  }
+  if (replays.empty()) { replays = generate(games); }
+
+  std::vector<std::vector<uint8_t>> plain(replays.size()), packed(replays.size());
+  size_t plain_bytes = 0, packed_bytes = 0, events = 0;
+  for (size_t i = 0; i < replays.size(); ++i) {
+    plain[i] = encode_replay(replays[i]);
+    packed[i] = compress_replay(replays[i]);
+    plain_bytes += plain[i].size();
+    packed_bytes += packed[i].size();
+    events += replays[i].events.size();
+    Replay decoded;
+    std::string error;
+    if (!decompress_replay(packed[i].data(), packed[i].size(), decoded, &error) || !same_events(replays[i], decoded)) {
+      std::fprintf(stderr, "round trip failed for replay %zu: %s\n", i, error.c_str());
+      return 1;
+    }
+  }
+
+  Replay scratch;
+  double plain_encode = time_per_run([&]() { for (const Replay &r : replays) { encode_replay(r); } });
+  double plain_decode = time_per_run([&]() { for (const auto &b : plain) { decode_replay(b.data(), b.size(), scratch); } });
+  double packed_encode = time_per_run([&]() { for (const Replay &r : replays) { compress_replay(r); } });
+  double packed_decode = time_per_run([&]() { for (const auto &b : packed) { decompress_replay(b.data(), b.size(), scratch); } });
+
+  const double mb = plain_bytes / 1e6;
+  std::printf("%zu replays, %zu events\n", replays.size(), events);
+  std::printf("%-11s %12s %10s %12s %12s\n", "format", "bytes", "bits/evt", "encode MB/s", "decode MB/s");
+  std::printf("%-11s %12zu %10.2f %12.1f %12.1f\n", "plain", plain_bytes,
+              events ? 8.0 * plain_bytes / events : 0.0, mb / plain_encode, mb / plain_decode);
+  std::printf("%-11s %12zu %10.2f %12.1f %12.1f\n", "compressed", packed_bytes,
+              events ? 8.0 * packed_bytes / events : 0.0, mb / packed_encode, mb / packed_decode);
+  std::printf("compression ratio %.2fx\n", double(plain_bytes) / std::max<size_t>(packed_bytes, 1));
+  return 0;
+}
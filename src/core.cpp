@@ -0,0 +1,155 @@
+#include "core.hpp"
+#include "perf_counters.hpp"
+#include "replay.hpp"
+
+const char *death_cause_name(DeathCause cause) {
+  switch (cause) {
+    case DeathCause::None:    return "none";
+    case DeathCause::Wall:    return "wall";
+    case DeathCause::Self:    return "self";
+    case DeathCause::Other:   return "other";
+    case DeathCause::Starved: return "starved";
+  }
+  return "unknown";
+}
+
+World::World(const Rules &rules, uint64_t seed, int snake_count)
+  : rules(rules),
+    seed(seed),
+    random_engine(seed),
+    death_causes(snake_count, DeathCause::None),
+    death_ticks(snake_count, 0),
+    last_meal_ticks(snake_count, 0),
+    occupancy(static_cast<size_t>(rules.width) * rules.height, 0),
+    food{ 0, 0 },
+    tick(0),
+    recording(false)
+{
+  const size_t capacity = static_cast<size_t>(rules.width) * rules.height + 1;
+  snakes.reserve(snake_count);
+  for (int i = 0; i < snake_count; ++i) {
+    // Snakes get their own rows, alternating heading so they start apart
+    Point head = { rules.width / 2, (i + 1) * rules.height / (snake_count + 1) };
+    Direction heading = spawn_heading(i);
+    snakes.emplace_back(rules.initial_length, head, heading, capacity);
+    recorded_directions.push_back(heading);
+    Snake &snake = snakes.back();
+    // A body longer than half the board trails across its edge
+    if (rules.wrapping) { snake.wrap_body(rules.width, rules.height); }
+    for (int age = 0; age < snake.get_length(); ++age) {
+      const Point &cell = snake.segment(age);
+      if (in_bounds(cell)) { occupancy[cell_index(cell)]++; }
+    }
+  }
+  respawn_food();
+}
+
+int World::alive_count() const {
+  int alive = 0;
+  for (DeathCause cause : death_causes) { alive += cause == DeathCause::None; }
+  return alive;
+}
+
+bool World::is_over() const {
+  if (rules.max_ticks > 0 && tick >= static_cast<uint32_t>(rules.max_ticks)) { return true; }
+  int alive = alive_count();
+  return snakes.size() > 1 ? alive <= 1 : alive == 0;
+}
+
+Point World::wrap(Point p) const {
+  if (!rules.wrapping) { return p; }
+  if (p.x < 0) { p.x = rules.width - 1; }
+  else if (p.x >= rules.width) { p.x = 0; }
+  if (p.y < 0) { p.y = rules.height - 1; }
+  else if (p.y >= rules.height) { p.y = 0; }
+  return p;
+}
+
+bool World::is_blocked(Point p) const {
+  p = wrap(p);
+  return !in_bounds(p) || occupancy[cell_index(p)] > 0;
+}
+
+void World::step() {
+  const int count = get_snake_count();
+
+  {
+    PerfScopeGuard measure(PerfScope::Update);
+    for (int i = 0; i < count; ++i) {
+      if (!is_alive(i)) { continue; }
+      Snake &snake = snakes[i];
+      if (recording && snake.get_direction() != recorded_directions[i]) {
+        events.push_back({ tick, static_cast<uint8_t>(i), snake.get_direction() });
+        recorded_directions[i] = snake.get_direction();
+      }
+      snake.update();
+      if (snake.did_tail_move() && in_bounds(snake.get_retired_tail())) {
+        occupancy[cell_index(snake.get_retired_tail())]--;
+      }
+      Point head = snake.get_head();
+      Point wrapped = wrap(head);
+      if (wrapped.x != head.x || wrapped.y != head.y) { snake.set_head(wrapped); }
+      if (in_bounds(wrapped)) { occupancy[cell_index(wrapped)]++; }
+    }
+  }
+
+  // Every snake moves before anyone dies, so head-on collisions take out both
+  std::vector<DeathCause> deaths(count, DeathCause::None);
+  {
+    PerfScopeGuard measure(PerfScope::Collision);
+    for (int i = 0; i < count; ++i) {
+      if (!is_alive(i)) { continue; }
+      const Snake &snake = snakes[i];
+      Point head = snake.get_head();
+      if (!in_bounds(head)) { deaths[i] = DeathCause::Wall; }
+      else if (occupancy[cell_index(head)] > 1) {
+        deaths[i] = snake.has_self_collision() ? DeathCause::Self : DeathCause::Other;
+      } else if (rules.starvation_ticks > 0 &&
+                 tick - last_meal_ticks[i] >= static_cast<uint32_t>(rules.starvation_ticks)) {
+        deaths[i] = DeathCause::Starved;
+      }
+    }
+    for (int i = 0; i < count; ++i) {
+      if (deaths[i] != DeathCause::None) { kill(i, deaths[i]); }
+    }
+  }
+
+  for (int i = 0; i < count; ++i) {
+    if (!is_alive(i)) { continue; }
+    Point head = snakes[i].get_head();
+    if (head.x == food.x && head.y == food.y) {
+      snakes[i].grow();
+      last_meal_ticks[i] = tick;
+      respawn_food();
+    }
+  }
+  ++tick;
+}
+
+void World::kill(int snake, DeathCause cause) {
+  death_causes[snake] = cause;
+  death_ticks[snake] = tick;
+  const Snake &body = snakes[snake];
+  for (int age = 0; age < body.get_length(); ++age) {
+    const Point &cell = body.segment(age);
+    if (in_bounds(cell)) { occupancy[cell_index(cell)]--; }
+  }
+}
+
+void World::respawn_food() {
+  PerfScopeGuard measure(PerfScope::Respawn);
+  // Plain modulo keeps placement identical across standard libraries
+  food.x = static_cast<int>(random_engine() % static_cast<uint64_t>(rules.width));
+  food.y = static_cast<int>(random_engine() % static_cast<uint64_t>(rules.height));
+}
+
+Replay World::make_replay() const {
+  Replay replay;
+  replay.rules = rules;
+  replay.seed = seed;
+  replay.snake_count = get_snake_count();
+  replay.ticks = tick;
+  for (const Snake &snake : snakes) { replay.final_lengths.push_back(snake.get_length()); }
+  replay.events = events;
+  return replay;
+}
@@ -0,0 +1,343 @@
+#pragma once
+
+// Headless game core shared by the game, the bots and the command line tools.
+// Nothing in here depends on raylib.
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+// Constants
+constexpr int GRID_WIDTH       = 40;   // 800 / 20
+constexpr int GRID_HEIGHT      = 30;   // 600 / 20
+
+struct Point {
+  int x;
+  int y;
+};
+
+enum class Direction {
+  Up,
+  Down,
+  Left,
+  Right
+};
+
+inline bool is_opposite(Direction a, Direction b) {
+  return (a == Direction::Up && b == Direction::Down) ||
+         (a == Direction::Down && b == Direction::Up) ||
+         (a == Direction::Left && b == Direction::Right) ||
+         (a == Direction::Right && b == Direction::Left);
+}
+
+inline Point step_towards(Point p, Direction direction) {
+  switch (direction) {
+    case Direction::Up:    p.y--; break;
+    case Direction::Down:  p.y++; break;
+    case Direction::Left:  p.x--; break;
+    case Direction::Right: p.x++; break;
+  }
+  return p;
+}
+
+// Sprites of the snake skin atlas, chosen from the directions of each
+// segment's neighbours
+enum class SnakeSprite : unsigned char {
+  HeadUp,
+  HeadDown,
+  HeadLeft,
+  HeadRight,
+  TailUp,       // Body continues upwards from the tail
+  TailDown,
+  TailLeft,
+  TailRight,
+  Horizontal,
+  Vertical,
+  CornerUpLeft, // Neighbours above and to the left
+  CornerUpRight,
+  CornerDownLeft,
+  CornerDownRight,
+  Count
+};
+
+// Direction of a step from one cell to an adjacent one, taking wrapping
+// across the board edges into account
+inline Direction direction_between(const Point &from, const Point &to) {
+  int dx = to.x - from.x;
+  int dy = to.y - from.y;
+  if (dx == 1 || dx < -1) { return Direction::Right; }
+  if (dx == -1 || dx > 1) { return Direction::Left; }
+  if (dy == 1 || dy < -1) { return Direction::Down; }
+  return Direction::Up;
+}
+
+// The Snake
+// Segments live in a fixed ring sized for a snake filling the whole board,
+// so moving never shifts or reallocates the body. Age 0 is the head and
+// each older segment sits one slot behind it in the ring.
+class Snake {
+public:
+  static constexpr size_t CAPACITY = GRID_WIDTH * GRID_HEIGHT + 1;
+
+  Snake() : Snake(1) {}
+
+  // Constructor with an initial length
+  Snake(int init_length)
+    : Snake(init_length, { GRID_WIDTH / 2, GRID_HEIGHT / 2 }, Direction::Right, CAPACITY) {}
+
+  // Constructor for a snake whose body trails behind `head`, sized for
+  // boards of `capacity - 1` cells
+  Snake(int init_length, Point head, Direction heading, size_t capacity)
+    : ring(capacity),
+      sprite_ring(capacity),
+      capacity(capacity),
+      head_slot(0),
+      length(0),
+      id(next_id++),
+      current_direction(heading),
+      grow_snake(false),
+      tail_moved(false)
+  {
+    Direction backwards = Direction::Left;
+    switch (heading) {
+      case Direction::Up:    backwards = Direction::Down; break;
+      case Direction::Down:  backwards = Direction::Up; break;
+      case Direction::Left:  backwards = Direction::Right; break;
+      case Direction::Right: backwards = Direction::Left; break;
+    }
+    // Lay the body down tail first so the head ends up in the newest slot
+    Point tail = head;
+    for (int i = 1; i < init_length; ++i) { tail = step_towards(tail, backwards); }
+    head_slot = capacity - 1;
+    Point cell = tail;
+    for (int i = 0; i < init_length; ++i) {
+      head_slot = (head_slot + 1) % capacity;
+      ring[head_slot] = cell;
+      ++length;
+      cell = step_towards(cell, heading);
+    }
+    for (size_t age = 0; age < length; ++age) { refresh_sprite(age); }
+  }
+
+  Point get_head() const { return ring[head_slot]; }
+
+  void update() {
+    Point new_head = step_towards(ring[head_slot], current_direction);
+    head_slot = (head_slot + 1) % capacity;
+    ring[head_slot] = new_head;
+    ++length;
+    if (!grow_snake) {
+      retired_tail = segment(length - 1);
+      --length;
+      tail_moved = true;
+    } else {
+      grow_snake = false;
+      tail_moved = false;
+    }
+    // Only the cells at either end change shape when the snake moves
+    refresh_sprite(0);
+    refresh_sprite(1);
+    refresh_sprite(length - 1);
+  }
+
+  void set_head(const Point &new_head) {
+    ring[head_slot] = new_head;
+    refresh_sprite(0);
+    refresh_sprite(1);
+  }
+
+  // Segment and cached sprite by age, 0 being the head
+  const Point &segment(size_t age) const { return ring[slot_of(age)]; }
+  SnakeSprite sprite(size_t age) const { return sprite_ring[slot_of(age)]; }
+
+  size_t slot_of(size_t age) const { return (head_slot + capacity - age) % capacity; }
+  size_t get_head_slot() const { return head_slot; }
+  size_t get_capacity() const { return capacity; }
+  const std::vector<Point> &get_ring() const { return ring; }
+
+  // Identifies this body, so renderers mirroring the ring notice a restart
+  uint64_t get_id() const { return id; }
+
+  // The cell vacated by the tail on the last move, if it moved at all
+  bool did_tail_move() const { return tail_moved; }
+  const Point &get_retired_tail() const { return retired_tail; }
+
+  Direction get_direction() const { return current_direction; }
+
+  void set_direction(Direction new_direction) {
+    if (is_opposite(current_direction, new_direction)) { return; }
+    current_direction = new_direction;
+  }
+
+  void grow() { grow_snake = true; }
+
+  // Moves every segment onto a wrapping board of `width` by `height` cells,
+  // for bodies laid down across its edge
+  void wrap_body(int width, int height) {
+    for (size_t age = 0; age < length; ++age) {
+      Point &cell = ring[slot_of(age)];
+      cell.x = (cell.x % width + width) % width;
+      cell.y = (cell.y % height + height) % height;
+    }
+  }
+
+  bool has_self_collision() const {
+    const auto head = get_head();
+    for (size_t age = 1; age < length; ++age) {
+      const Point &body = segment(age);
+      if (body.x == head.x && body.y == head.y) { return true; }
+    }
+    return false;
+  }
+
+  int get_length() const { return static_cast<int>(length); }
+
+private:
+  // Recomputes the cached sprite of a single segment from its neighbours
+  void refresh_sprite(size_t age) {
+    if (age >= length) { return; }
+    SnakeSprite &cached = sprite_ring[slot_of(age)];
+    if (age == 0) {
+      Direction heading = length > 1
+        ? direction_between(segment(1), segment(0))
+        : current_direction;
+      switch (heading) {
+        case Direction::Up:    cached = SnakeSprite::HeadUp; break;
+        case Direction::Down:  cached = SnakeSprite::HeadDown; break;
+        case Direction::Left:  cached = SnakeSprite::HeadLeft; break;
+        case Direction::Right: cached = SnakeSprite::HeadRight; break;
+      }
+      return;
+    }
+    Direction towards_head = direction_between(segment(age), segment(age - 1));
+    if (age == length - 1) {
+      switch (towards_head) {
+        case Direction::Up:    cached = SnakeSprite::TailUp; break;
+        case Direction::Down:  cached = SnakeSprite::TailDown; break;
+        case Direction::Left:  cached = SnakeSprite::TailLeft; break;
+        case Direction::Right: cached = SnakeSprite::TailRight; break;
+      }
+      return;
+    }
+    Direction towards_tail = direction_between(segment(age), segment(age + 1));
+    auto has = [&](Direction d) { return towards_head == d || towards_tail == d; };
+    if (has(Direction::Left) && has(Direction::Right)) { cached = SnakeSprite::Horizontal; }
+    else if (has(Direction::Up) && has(Direction::Down)) { cached = SnakeSprite::Vertical; }
+    else if (has(Direction::Up)) {
+      cached = has(Direction::Left) ? SnakeSprite::CornerUpLeft : SnakeSprite::CornerUpRight;
+    } else {
+      cached = has(Direction::Left) ? SnakeSprite::CornerDownLeft : SnakeSprite::CornerDownRight;
+    }
+  }
+
+  static inline std::atomic<uint64_t> next_id{ 1 };  // Snakes are built on worker threads too
+
+  std::vector<Point> ring;
+  std::vector<SnakeSprite> sprite_ring;  // Cached sprite of each segment
+  size_t capacity;
+  size_t head_slot;
+  size_t length;
+  uint64_t id;
+  Direction current_direction;
+  bool grow_snake;
+  bool tail_moved;
+  Point retired_tail{};
+};
+
+// Game rules, shared by human games, bots and replays
+struct Rules {
+  int width            = GRID_WIDTH;
+  int height           = GRID_HEIGHT;
+  int initial_length   = 3;
+  int tick_rate_ms     = 100;
+  bool wrapping        = true;
+  int max_ticks        = 0;   // Headless cap on the game length, 0 for none
+  int starvation_ticks = 0;   // Ticks a snake may go without food, 0 for none
+};
+
+enum class DeathCause : uint8_t {
+  None,
+  Wall,
+  Self,
+  Other,    // Another snake's body or head
+  Starved
+};
+
+const char *death_cause_name(DeathCause cause);
+
+// Direction each snake starts out in
+inline Direction spawn_heading(int snake) { return snake % 2 == 0 ? Direction::Right : Direction::Left; }
+
+struct ReplayEvent {
+  uint32_t tick;
+  uint8_t snake;
+  Direction direction;
+};
+
+struct Replay;
+
+// The World
+// One board with one or more snakes and a single piece of food. Food
+// placement is driven by a seeded generator, so a seed plus the directions
+// applied on each tick reproduce a game exactly.
+class World {
+public:
+  World(const Rules &rules, uint64_t seed, int snake_count = 1);
+
+  void set_direction(int snake, Direction direction) { snakes[snake].set_direction(direction); }
+
+  // Advances every living snake by one cell
+  void step();
+
+  // True once no snake is alive, or for games between several snakes once
+  // at most one is left
+  bool is_over() const;
+
+  const Rules &get_rules() const { return rules; }
+  // Lets the settings screen switch wrapping mid-game. Replays record the
+  // rules as they are at the end, so such a game does not replay exactly.
+  void set_wrapping(bool wrapping) { rules.wrapping = wrapping; }
+  uint64_t get_seed() const { return seed; }
+  uint32_t get_tick() const { return tick; }
+  int get_snake_count() const { return static_cast<int>(snakes.size()); }
+  const Snake &get_snake(int snake) const { return snakes[snake]; }
+  bool is_alive(int snake) const { return death_causes[snake] == DeathCause::None; }
+  DeathCause get_death_cause(int snake) const { return death_causes[snake]; }
+  uint32_t get_death_tick(int snake) const { return death_ticks[snake]; }
+  int alive_count() const;
+  const Point &get_food() const { return food; }
+  // Living segments per cell, row-major
+  const uint8_t *get_occupancy() const { return occupancy.data(); }
+
+  // Where a head moving onto `p` would end up, with wrapping applied
+  Point wrap(Point p) const;
+  bool in_bounds(Point p) const { return p.x >= 0 && p.x < rules.width && p.y >= 0 && p.y < rules.height; }
+  // True for walls and for cells covered by a living snake
+  bool is_blocked(Point p) const;
+
+  // Recording of the directions applied on each tick
+  void set_recording(bool enabled) { recording = enabled; }
+  const std::vector<ReplayEvent> &get_events() const { return events; }
+  Replay make_replay() const;
+
+private:
+  int cell_index(Point p) const { return p.y * rules.width + p.x; }
+  void kill(int snake, DeathCause cause);
+  void respawn_food();
+
+  Rules rules;
+  uint64_t seed;
+  std::mt19937_64 random_engine;
+  std::vector<Snake> snakes;
+  std::vector<DeathCause> death_causes;
+  std::vector<uint32_t> death_ticks;
+  std::vector<uint32_t> last_meal_ticks;
+  std::vector<Direction> recorded_directions;
+  std::vector<uint8_t> occupancy;  // Living segments per cell
+  Point food;
+  uint32_t tick;
+  bool recording;
+  std::vector<ReplayEvent> events;
+};
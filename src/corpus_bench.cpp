@@ -0,0 +1,243 @@
+// snakey_corpus_bench: replays a corpus of recorded games and tracks how
+// long each tick takes to simulate and to render.
+//
+//   snakey_corpus_bench [--baseline FILE] [--update-baseline] [--tolerance F]
+//                       [--frames N] [--repeat N] CORPUS_DIR_OR_REPLAY...
+//
+// Every replay is simulated headlessly, then rendered tick by tick with the
+// null and the software backend. The software backend draws every k-th
+// tick so no replay renders more than --frames frames. Per-tick times are
+// reported as percentiles. With --baseline the median and 90th percentile
+// of each replay and backend are compared against the stored ones and the
+// run fails if any is more than --tolerance slower. Baselines are specific
+// to the machine they were recorded on.
+
+#include "replay.hpp"
+#include "soft_render.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+using Clock = std::chrono::steady_clock;
+
+namespace {
+
+struct Result {
+  std::string replay;   // File name within the corpus
+  std::string backend;  // sim, null or software
+  uint64_t ticks = 0;   // Length of the game, to catch replays that changed
+  uint64_t samples = 0;
+  double p50 = 0, p90 = 0, p99 = 0, max = 0;  // Nanoseconds per tick
+};
+
+double percentile(std::vector<uint32_t> &samples, double fraction) {
+  if (samples.empty()) { return 0.0; }
+  size_t k = std::min(samples.size() - 1, static_cast<size_t>(fraction * samples.size()));
+  std::nth_element(samples.begin(), samples.begin() + k, samples.end());
+  return samples[k];
+}
+
+Result summarize(const std::string &replay, const std::string &backend, uint64_t ticks,
+                 std::vector<uint32_t> &samples) {
+  Result result = { replay, backend, ticks, samples.size() };
+  result.p50 = percentile(samples, 0.50);
+  result.p90 = percentile(samples, 0.90);
+  result.p99 = percentile(samples, 0.99);
+  result.max = samples.empty() ? 0.0 : *std::max_element(samples.begin(), samples.end());
+  return result;
+}
+
+uint32_t elapsed_ns(Clock::time_point start) {
+  return static_cast<uint32_t>(std::min<int64_t>(
+      UINT32_MAX, std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count()));
+}
+
+// Plays the replay once, timing each tick, and once more per backend with
+// the frame drawn after every `stride`-th tick
+std::vector<Result> bench_replay(const std::string &name, const Replay &replay, uint64_t frames, int repeat,
+                                 uint64_t &checksum) {
+  std::vector<Result> results;
+  std::vector<uint32_t> samples;
+  samples.reserve(replay.ticks * repeat);
+  for (int r = 0; r < repeat; ++r) {
+    ReplayPlayer player(replay);
+    for (;;) {
+      auto start = Clock::now();
+      if (!player.step()) { break; }
+      samples.push_back(elapsed_ns(start));
+    }
+    checksum += player.get_world().get_snake(0).get_length();
+  }
+  results.push_back(summarize(name, "sim", replay.ticks, samples));
+
+  NullRenderer null_renderer;
+  SoftwareRenderer software_renderer;
+  FrameRenderer *renderers[] = { &null_renderer, &software_renderer };
+  for (FrameRenderer *renderer : renderers) {
+    const uint64_t stride =
+        renderer == &null_renderer ? 1 : std::max<uint64_t>(1, (replay.ticks + frames - 1) / frames);
+    samples.clear();
+    for (int r = 0; r < repeat; ++r) {
+      ReplayPlayer player(replay);
+      for (uint64_t tick = 0; player.step(); ++tick) {
+        if (tick % stride != 0) { continue; }
+        auto start = Clock::now();
+        renderer->render(player.get_world());
+        samples.push_back(elapsed_ns(start));
+      }
+    }
+    checksum += renderer->checksum();
+    results.push_back(summarize(name, renderer->name(), replay.ticks, samples));
+  }
+  return results;
+}
+
+std::string key(const Result &result) { return result.replay + " " + result.backend; }
+
+std::map<std::string, Result> load_baseline(const std::string &path) {
+  std::map<std::string, Result> baseline;
+  std::ifstream in(path);
+  std::string line;
+  while (std::getline(in, line)) {
+    if (line.empty() || line[0] == '#') { continue; }
+    std::istringstream fields(line);
+    Result result;
+    if (fields >> result.replay >> result.backend >> result.ticks >> result.samples >> result.p50 >> result.p90 >>
+        result.p99 >> result.max) {
+      baseline[key(result)] = result;
+    }
+  }
+  return baseline;
+}
+
+bool save_baseline(const std::string &path, const std::vector<Result> &results) {
+  std::ofstream out(path);
+  out.setf(std::ios::fixed);
+  out.precision(0);
+  out << "# replay backend ticks samples p50_ns p90_ns p99_ns max_ns\n";
+  for (const Result &r : results) {
+    out << r.replay << ' ' << r.backend << ' ' << r.ticks << ' ' << r.samples << ' ' << r.p50 << ' ' << r.p90 << ' '
+        << r.p99 << ' ' << r.max << '\n';
+  }
+  return bool(out);
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  std::string baseline_path;
+  bool update_baseline = false;
+  double tolerance = 0.25;
+  uint64_t frames = 5000;
+  int repeat = 1;
+  std::vector<std::string> inputs;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    bool has_value = i + 1 < argc;
+    if (arg == "--baseline" && has_value) { baseline_path = argv[++i]; }
+    else if (arg == "--update-baseline") { update_baseline = true; }
+    else if (arg == "--tolerance" && has_value) { tolerance = std::atof(argv[++i]); }
+    else if (arg == "--frames" && has_value) { frames = std::max(1ull, std::strtoull(argv[++i], nullptr, 10)); }
+    else if (arg == "--repeat" && has_value) { repeat = std::max(1, std::atoi(argv[++i])); }
+    else { inputs.push_back(arg); }
+  }
+  if (inputs.empty() || (update_baseline && baseline_path.empty())) {
+    std::fprintf(stderr, "usage: snakey_corpus_bench [--baseline FILE] [--update-baseline] [--tolerance F] "
+                         "[--frames N] [--repeat N] CORPUS_DIR_OR_REPLAY...\n");
+    return 1;
+  }
+
+  std::vector<std::string> paths;
+  for (const std::string &input : inputs) {
+    std::error_code ec;
+    if (fs::is_directory(input, ec)) {
+      for (const auto &entry : fs::directory_iterator(input, ec)) {
+        if (entry.is_regular_file() && entry.path().extension() == ".snr") { paths.push_back(entry.path().string()); }
+      }
+    } else {
+      paths.push_back(input);
+    }
+  }
+  std::sort(paths.begin(), paths.end());
+
+  std::vector<Result> results;
+  uint64_t checksum = 0;
+  std::printf("%-28s %-9s %8s %8s %9s %9s %9s %9s\n", "replay", "backend", "ticks", "samples", "p50 ns", "p90 ns",
+              "p99 ns", "max ns");
+  for (const std::string &path : paths) {
+    Replay replay;
+    std::string error;
+    if (!load_replay(path, replay, &error)) {
+      std::fprintf(stderr, "%s: %s\n", path.c_str(), error.c_str());
+      return 1;
+    }
+    for (Result &result : bench_replay(fs::path(path).filename().string(), replay, frames, repeat, checksum)) {
+      std::printf("%-28s %-9s %8llu %8llu %9.0f %9.0f %9.0f %9.0f\n", result.replay.c_str(), result.backend.c_str(),
+                  (unsigned long long)result.ticks, (unsigned long long)result.samples, result.p50, result.p90,
+                  result.p99, result.max);
+      results.push_back(std::move(result));
+    }
+  }
+  std::printf("checksum %llx\n", (unsigned long long)checksum);
+
+  if (baseline_path.empty()) { return 0; }
+  if (update_baseline) {
+    if (!save_baseline(baseline_path, results)) {
+      std::fprintf(stderr, "cannot write %s\n", baseline_path.c_str());
+      return 1;
+    }
+    std::printf("baseline written to %s\n", baseline_path.c_str());
+    return 0;
+  }
+
+  std::map<std::string, Result> baseline = load_baseline(baseline_path);
+  int regressions = 0;
+  for (const Result &result : results) {
+    auto found = baseline.find(key(result));
+    if (found == baseline.end()) {
+      std::printf("new       %s (no baseline)\n", key(result).c_str());
+      continue;
+    }
+    const Result &base = found->second;
+    if (base.ticks != result.ticks) {
+      std::printf("MISMATCH  %s: %llu ticks, baseline has %llu\n", key(result).c_str(),
+                  (unsigned long long)result.ticks, (unsigned long long)base.ticks);
+      ++regressions;
+      continue;
+    }
+    // Percentiles over a different number of samples, as from another
+    // --repeat or --frames, are not comparable
+    if (base.samples != result.samples) {
+      std::printf("MISMATCH  %s: %llu samples, baseline has %llu (recorded with other --repeat or --frames?)\n",
+                  key(result).c_str(), (unsigned long long)result.samples, (unsigned long long)base.samples);
+      ++regressions;
+      continue;
+    }
+    auto check = [&](const char *what, double now, double before) {
+      if (before <= 0) { return; }
+      double change = now / before - 1.0;
+      if (change > tolerance) {
+        std::printf("SLOWER    %s %s: %.0f ns vs %.0f ns (%+.0f%%)\n", key(result).c_str(), what, now, before,
+                    change * 100);
+        ++regressions;
+      } else if (change < -tolerance) {
+        std::printf("faster    %s %s: %.0f ns vs %.0f ns (%+.0f%%)\n", key(result).c_str(), what, now, before,
+                    change * 100);
+      }
+    };
+    check("p50", result.p50, base.p50);
+    check("p90", result.p90, base.p90);
+  }
+  std::printf("%d regression%s against %s (tolerance %.0f%%)\n", regressions, regressions == 1 ? "" : "s",
+              baseline_path.c_str(), tolerance * 100);
+  return regressions == 0 ? 0 : 1;
+}
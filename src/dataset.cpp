@@ -0,0 +1,257 @@
+#include "dataset.hpp"
+#include "util.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+// Records start on a page boundary so the mapped array is page-aligned
+constexpr uint64_t RECORDS_OFFSET = 4096;
+
+struct ShardHeader {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t record_size;
+  uint16_t width;
+  uint16_t height;
+  uint32_t game_count;
+  uint64_t record_count;
+  uint64_t records_offset;
+  uint64_t index_offset;   // Game entries, then the name table
+  uint64_t names_size;
+};
+
+// Size of DatasetShardWriter::GameEntry in the file
+constexpr uint64_t GAME_ENTRY_SIZE = 16;
+
+void set_cell(DatasetRecord &record, Point p, DatasetCell cell) {
+  int i = p.y * GRID_WIDTH + p.x;
+  record.cells[i / 2] = static_cast<uint8_t>((record.cells[i / 2] & (0xf0 >> (i % 2 * 4))) |
+                                             (static_cast<uint8_t>(cell) << (i % 2 * 4)));
+}
+
+// Fills in what happened to `self` on the tick just played. A snake only
+// grows on the tick after it eats, so eating is told by the head landing
+// on the food as it was before the tick.
+void settle(const World &world, int self, Point food_before, DatasetRecord &record) {
+  const Snake &snake = world.get_snake(self);
+  bool died = !world.is_alive(self);
+  bool ate = snake.get_head().x == food_before.x && snake.get_head().y == food_before.y;
+  record.action = static_cast<uint8_t>(snake.get_direction());
+  record.reward = died ? -1.0f : (ate ? 1.0f : 0.0f);
+  record.done = died || world.is_over();
+}
+
+} // namespace
+
+void observe(const World &world, int self, DatasetRecord &record) {
+  std::memset(&record, 0, sizeof(record));
+  const Snake &snake = world.get_snake(self);
+  record.tick = world.get_tick();
+  record.direction = static_cast<uint8_t>(snake.get_direction());
+  record.self = static_cast<uint8_t>(self);
+  record.length = static_cast<uint16_t>(snake.get_length());
+
+  set_cell(record, world.get_food(), DatasetCell::Food);
+  for (int s = 0; s < world.get_snake_count(); ++s) {
+    if (!world.is_alive(s)) { continue; }
+    const Snake &other = world.get_snake(s);
+    DatasetCell body = s == self ? DatasetCell::Body : DatasetCell::OtherBody;
+    for (int age = other.get_length() - 1; age > 0; --age) { set_cell(record, other.segment(age), body); }
+  }
+  // Heads last, so they win where they overlap a body
+  for (int s = 0; s < world.get_snake_count(); ++s) {
+    if (!world.is_alive(s)) { continue; }
+    set_cell(record, world.get_snake(s).get_head(), s == self ? DatasetCell::Head : DatasetCell::OtherHead);
+  }
+}
+
+std::vector<DatasetRecord> record_bot_game(const Rules &rules, uint64_t seed, Bot &bot) {
+  Rules board = rules;
+  board.width = GRID_WIDTH;
+  board.height = GRID_HEIGHT;
+  World world(board, seed);
+  std::vector<DatasetRecord> records;
+  while (!world.is_over()) {
+    DatasetRecord &record = records.emplace_back();
+    observe(world, 0, record);
+    world.set_direction(0, bot.choose(world, 0));
+    const Point food = world.get_food();
+    world.step();
+    bot.on_tick(world, 0);
+    settle(world, 0, food, record);
+  }
+  return records;
+}
+
+bool record_replay(const Replay &replay, std::vector<DatasetRecord> &records, std::string *error) {
+  if (replay.rules.width != GRID_WIDTH || replay.rules.height != GRID_HEIGHT) {
+    return fail(error, "board size does not fit a record");
+  }
+  ReplayPlayer player(replay);
+  std::vector<size_t> pending;
+  for (;;) {
+    const World &world = player.get_world();
+    pending.clear();
+    for (int s = 0; s < world.get_snake_count(); ++s) {
+      if (!world.is_alive(s)) { continue; }
+      pending.push_back(records.size());
+      observe(world, s, records.emplace_back());
+    }
+    const Point food = world.get_food();
+    if (!player.step()) {
+      records.resize(records.size() - pending.size());
+      return true;
+    }
+    for (size_t i : pending) { settle(world, records[i].self, food, records[i]); }
+  }
+}
+
+DatasetShardWriter::~DatasetShardWriter() { close(); }
+
+bool DatasetShardWriter::open(const std::string &path) {
+  close();
+  file = std::fopen(path.c_str(), "wb");
+  if (!file) { return false; }
+  std::setvbuf(file, nullptr, _IOFBF, 1 << 20);
+  record_count = 0;
+  games.clear();
+  names.clear();
+  // The header is written on close; skip ahead to the records
+  return std::fseek(file, static_cast<long>(RECORDS_OFFSET), SEEK_SET) == 0;
+}
+
+bool DatasetShardWriter::add_game(std::vector<DatasetRecord> &records, const std::string &source) {
+  if (!file || records.empty()) { return file != nullptr; }
+  uint32_t name = static_cast<uint32_t>(names.size());
+  names.append(source).push_back('\0');
+  games.push_back({ record_count, static_cast<uint32_t>(records.size()), name });
+  for (DatasetRecord &record : records) { record.game = games.size() - 1; }
+  record_count += records.size();
+  return std::fwrite(records.data(), sizeof(DatasetRecord), records.size(), file) == records.size();
+}
+
+bool DatasetShardWriter::close() {
+  static_assert(sizeof(GameEntry) == GAME_ENTRY_SIZE);
+  if (!file) { return true; }
+  ShardHeader header = { DATASET_MAGIC,
+                         DATASET_VERSION,
+                         static_cast<uint16_t>(sizeof(DatasetRecord)),
+                         GRID_WIDTH,
+                         GRID_HEIGHT,
+                         static_cast<uint32_t>(games.size()),
+                         record_count,
+                         RECORDS_OFFSET,
+                         RECORDS_OFFSET + record_count * sizeof(DatasetRecord),
+                         names.size() };
+  bool ok = std::fwrite(games.data(), GAME_ENTRY_SIZE, games.size(), file) == games.size() &&
+            std::fwrite(names.data(), 1, names.size(), file) == names.size() &&
+            std::fseek(file, 0, SEEK_SET) == 0 && std::fwrite(&header, sizeof(header), 1, file) == 1;
+  ok = std::fclose(file) == 0 && ok;
+  file = nullptr;
+  return ok;
+}
+
+DatasetReader::~DatasetReader() {
+  for (Shard &shard : shards) { munmap(shard.mapping, shard.mapping_size); }
+}
+
+bool DatasetReader::add_shard(const std::string &path, std::string *error) {
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0) { return fail(error, "cannot open shard"); }
+  struct stat info;
+  if (fstat(fd, &info) != 0 || info.st_size < static_cast<off_t>(RECORDS_OFFSET)) {
+    ::close(fd);
+    return fail(error, "shard too small");
+  }
+  size_t size = static_cast<size_t>(info.st_size);
+  void *mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+  if (mapping == MAP_FAILED) { return fail(error, "cannot map shard"); }
+
+  ShardHeader header;
+  std::memcpy(&header, mapping, sizeof(header));
+  const char *problem = nullptr;
+  if (header.magic != DATASET_MAGIC) { problem = "not a dataset shard"; }
+  else if (header.version != DATASET_VERSION) { problem = "unsupported shard version"; }
+  else if (header.record_size != sizeof(DatasetRecord) || header.width != GRID_WIDTH ||
+           header.height != GRID_HEIGHT) {
+    problem = "shard was written for another record layout";
+  } else if (header.records_offset != RECORDS_OFFSET ||
+             header.record_count > (size - RECORDS_OFFSET) / sizeof(DatasetRecord) ||
+             header.index_offset != RECORDS_OFFSET + header.record_count * sizeof(DatasetRecord) ||
+             header.game_count > (size - header.index_offset) / GAME_ENTRY_SIZE ||
+             header.names_size != size - header.index_offset - header.game_count * GAME_ENTRY_SIZE) {
+    problem = "truncated shard";
+  }
+  if (problem) {
+    munmap(mapping, size);
+    return fail(error, problem);
+  }
+
+  // Pages are touched in random order by the sampler
+  madvise(mapping, size, MADV_RANDOM);
+  const auto *bytes = static_cast<const uint8_t *>(mapping);
+  shards.push_back({ mapping, size, reinterpret_cast<const DatasetRecord *>(bytes + RECORDS_OFFSET),
+                     header.record_count, total, header.game_count });
+  total += header.record_count;
+  return true;
+}
+
+uint64_t DatasetReader::game_count() const {
+  uint64_t games = 0;
+  for (const Shard &shard : shards) { games += shard.game_count; }
+  return games;
+}
+
+const DatasetRecord &DatasetReader::operator[](uint64_t i) const {
+  auto shard = std::upper_bound(shards.begin(), shards.end(), i,
+                                [](uint64_t i, const Shard &shard) { return i < shard.first; }) - 1;
+  return shard->records[i - shard->first];
+}
+
+BatchSampler::BatchSampler(const DatasetReader &reader, size_t batch_size, uint64_t seed)
+  : reader(reader), batch_size(std::max<size_t>(1, batch_size)), rng(seed) {
+  while ((uint64_t(1) << (2 * half_bits)) < reader.size()) { ++half_bits; }
+  start_epoch();
+}
+
+void BatchSampler::start_epoch() {
+  for (uint64_t &key : keys) { key = rng(); }
+  position = 0;
+}
+
+// Four-round Feistel network over 2 * half_bits bits, walking the cycle
+// until the result falls inside the dataset
+uint64_t BatchSampler::permute(uint64_t i) const {
+  const uint64_t mask = (uint64_t(1) << half_bits) - 1;
+  do {
+    uint64_t left = i >> half_bits, right = i & mask;
+    for (uint64_t key : keys) {
+      uint64_t mix = (right ^ key) * 0x9e3779b97f4a7c15ull;
+      mix ^= mix >> 29;
+      uint64_t next = left ^ (mix & mask);
+      left = right;
+      right = next;
+    }
+    i = (left << half_bits) | right;
+  } while (i >= reader.size());
+  return i;
+}
+
+bool BatchSampler::next(std::vector<const DatasetRecord *> &batch) {
+  batch.clear();
+  if (position >= reader.size()) {
+    ++epoch;
+    start_epoch();
+    return false;
+  }
+  uint64_t end = std::min<uint64_t>(reader.size(), position + batch_size);
+  for (; position < end; ++position) { batch.push_back(&reader[permute(position)]); }
+  return true;
+}
@@ -0,0 +1,141 @@
+#pragma once
+
+// Transition datasets for imitation and offline learning.
+// A dataset is a set of shard files, each holding fixed-size records of
+// (observation, action, reward, done) followed by an index of the games
+// they came from. Readers map shards and hand out pointers into them, so
+// records are never copied. Records are in the byte order of the machine
+// that wrote them.
+
+#include "bots.hpp"
+#include "replay.hpp"
+
+#include <cstdint>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+constexpr uint32_t DATASET_MAGIC   = 0x444b4e53;  // "SNKD" little-endian
+constexpr uint16_t DATASET_VERSION = 1;
+
+// What a cell holds, from the point of view of the recorded snake
+enum class DatasetCell : uint8_t { Empty, Food, Head, Body, OtherHead, OtherBody };
+
+constexpr size_t DATASET_CELL_BYTES = (GRID_WIDTH * GRID_HEIGHT + 1) / 2;
+
+struct DatasetRecord {
+  uint64_t game;        // Game number within the shard
+  uint32_t tick;
+  float reward;         // +1 for eating, -1 for dying, 0 otherwise
+  uint8_t action;       // Direction the snake moved in on this tick
+  uint8_t done;         // The snake died or the game ended on this tick
+  uint8_t direction;    // Heading before the move
+  uint8_t self;         // Snake index in the game
+  uint16_t length;      // Length before the move
+  uint8_t reserved[4];
+  // Board before the move: one DatasetCell per nibble, row-major, even
+  // cells in the low nibble
+  uint8_t cells[DATASET_CELL_BYTES];
+
+  DatasetCell cell(int x, int y) const {
+    int i = y * GRID_WIDTH + x;
+    return static_cast<DatasetCell>((cells[i / 2] >> (i % 2 * 4)) & 0xf);
+  }
+};
+static_assert(sizeof(DatasetRecord) % 8 == 0, "records must stay 8-byte aligned back to back");
+
+// Fills in the observation of `self` in `world`, leaving the outcome fields
+void observe(const World &world, int self, DatasetRecord &record);
+
+// Plays a solo game with `bot` and returns its transitions
+std::vector<DatasetRecord> record_bot_game(const Rules &rules, uint64_t seed, Bot &bot);
+// Replays a recorded game, human or bot, and returns the transitions of
+// every snake. Only boards of GRID_WIDTH x GRID_HEIGHT fit in a record.
+bool record_replay(const Replay &replay, std::vector<DatasetRecord> &records, std::string *error = nullptr);
+
+// Writes one shard. Games are appended whole; the index goes at the end and
+// the header is patched on close.
+class DatasetShardWriter {
+public:
+  DatasetShardWriter() = default;
+  ~DatasetShardWriter();
+  DatasetShardWriter(const DatasetShardWriter &) = delete;
+  DatasetShardWriter &operator=(const DatasetShardWriter &) = delete;
+
+  bool open(const std::string &path);
+  // Numbers the records with their game in this shard and writes them.
+  // `source` names the bot or replay the game came from.
+  bool add_game(std::vector<DatasetRecord> &records, const std::string &source);
+  bool close();
+
+  bool is_open() const { return file != nullptr; }
+  uint64_t get_record_count() const { return record_count; }
+
+private:
+  struct GameEntry {
+    uint64_t first_record;
+    uint32_t records;
+    uint32_t source;      // Offset of the source name in the name table
+  };
+
+  FILE *file = nullptr;
+  uint64_t record_count = 0;
+  std::vector<GameEntry> games;
+  std::string names;
+};
+
+// Read-only view of all shards of a dataset
+class DatasetReader {
+public:
+  DatasetReader() = default;
+  ~DatasetReader();
+  DatasetReader(const DatasetReader &) = delete;
+  DatasetReader &operator=(const DatasetReader &) = delete;
+
+  // Maps a shard; records are numbered across shards in the order added
+  bool add_shard(const std::string &path, std::string *error = nullptr);
+
+  uint64_t size() const { return total; }
+  uint64_t game_count() const;
+  const DatasetRecord &operator[](uint64_t i) const;
+
+private:
+  struct Shard {
+    void *mapping;
+    size_t mapping_size;
+    const DatasetRecord *records;
+    uint64_t record_count;
+    uint64_t first;       // Number of the shard's first record
+    uint32_t game_count;
+  };
+
+  std::vector<Shard> shards;
+  uint64_t total = 0;
+};
+
+// Hands out every record once per epoch in shuffled order. The order is a
+// keyed permutation of the record numbers, so it takes no memory however
+// large the dataset is.
+class BatchSampler {
+public:
+  BatchSampler(const DatasetReader &reader, size_t batch_size, uint64_t seed);
+
+  // Fills `batch` with pointers to the next records; false once the epoch
+  // is over, after which the next call starts a new epoch
+  bool next(std::vector<const DatasetRecord *> &batch);
+
+  uint64_t get_epoch() const { return epoch; }
+
+private:
+  uint64_t permute(uint64_t i) const;
+  void start_epoch();
+
+  const DatasetReader &reader;
+  size_t batch_size;
+  std::mt19937_64 rng;
+  uint64_t keys[4] = {};
+  unsigned half_bits = 1;  // The permutation works on 2 * half_bits bits
+  uint64_t position = 0;
+  uint64_t epoch = 0;
+};
@@ -0,0 +1,202 @@
+// snakey_dataset: generates transition datasets and reads them back.
+//
+//   snakey_dataset generate OUT_DIR [--games N] [--bots a,b] [--seed N]
+//                  [--threads N] [--shard-records N] [REPLAY_OR_DIR...]
+//   snakey_dataset read DATASET_DIR [--batch N] [--epochs N] [--seed N]
+//
+// generate plays solo games with the given bots, cycling through them, and
+// converts any replays given, human or bot. Every thread writes its own
+// shards, starting a new one once --shard-records is reached, so the
+// output grows without any coordination. read samples shuffled batches
+// from all shards in a directory and reports what it saw.
+
+#include "dataset.hpp"
+#include "util.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+std::vector<std::string> find_files(const std::string &input, const std::string &extension) {
+  std::vector<std::string> paths;
+  std::error_code ec;
+  if (fs::is_directory(input, ec)) {
+    for (const auto &entry : fs::recursive_directory_iterator(input, ec)) {
+      if (entry.is_regular_file() && entry.path().extension() == extension) { paths.push_back(entry.path().string()); }
+    }
+  } else {
+    paths.push_back(input);
+  }
+  std::sort(paths.begin(), paths.end());
+  return paths;
+}
+
+int generate(int argc, char **argv) {
+  int games = 1000;
+  std::vector<std::string> bots = { "path" };
+  uint64_t seed = 1;
+  int threads = std::max(1u, std::thread::hardware_concurrency());
+  uint64_t shard_records = 1 << 20;
+  std::string out;
+  std::vector<std::string> replays;
+  for (int i = 2; i < argc; ++i) {
+    std::string arg = argv[i];
+    bool has_value = i + 1 < argc;
+    if (arg == "--games" && has_value) { games = std::max(0, std::atoi(argv[++i])); }
+    else if (arg == "--bots" && has_value) { bots = split(argv[++i]); }
+    else if (arg == "--seed" && has_value) { seed = std::strtoull(argv[++i], nullptr, 10); }
+    else if (arg == "--threads" && has_value) { threads = std::max(1, std::atoi(argv[++i])); }
+    else if (arg == "--shard-records" && has_value) { shard_records = std::max(1ull, std::strtoull(argv[++i], nullptr, 10)); }
+    else if (out.empty()) { out = arg; }
+    else {
+      for (std::string &path : find_files(arg, ".snr")) { replays.push_back(std::move(path)); }
+    }
+  }
+  if (out.empty()) {
+    std::fprintf(stderr, "usage: snakey_dataset generate OUT_DIR [--games N] [--bots a,b] [--seed N] "
+                         "[--threads N] [--shard-records N] [REPLAY_OR_DIR...]\n");
+    return 1;
+  }
+  for (const std::string &name : bots) {
+    if (!make_bot(name)) { std::fprintf(stderr, "unknown bot %s\n", name.c_str()); return 1; }
+    if (is_single_instance_bot(name) && threads > 1) {
+      std::fprintf(stderr, "%s plays one game at a time; use --threads 1\n", name.c_str());
+      return 1;
+    }
+  }
+  std::error_code ec;
+  fs::create_directories(out, ec);
+
+  Rules rules;
+  rules.max_ticks = 10000;
+  rules.starvation_ticks = 2 * rules.width * rules.height;
+
+  const size_t jobs = static_cast<size_t>(games) + replays.size();
+  std::atomic<size_t> next{ 0 };
+  std::atomic<uint64_t> records{ 0 }, failures{ 0 };
+  std::atomic<int> shards{ 0 };
+  auto start = std::chrono::steady_clock::now();
+  std::vector<std::thread> workers;
+  for (int t = 0; t < threads; ++t) {
+    workers.emplace_back([&, t]() {
+      DatasetShardWriter writer;
+      int shard = 0;
+      std::vector<DatasetRecord> game;
+      for (size_t job = next++; job < jobs; job = next++) {
+        std::string source;
+        if (job < static_cast<size_t>(games)) {
+          source = bots[job % bots.size()];
+          std::unique_ptr<Bot> bot = make_bot(source);
+          game = record_bot_game(rules, seed + job, *bot);
+        } else {
+          source = replays[job - games];
+          Replay replay;
+          std::string error;
+          game.clear();
+          if (!load_replay(source, replay, &error) || !record_replay(replay, game, &error)) {
+            std::fprintf(stderr, "skipping %s: %s\n", source.c_str(), error.c_str());
+            ++failures;
+            continue;
+          }
+        }
+        if (writer.is_open() && writer.get_record_count() >= shard_records) { writer.close(); }
+        if (!writer.is_open()) {
+          std::string path = out + "/shard-" + std::to_string(t) + "-" + std::to_string(shard++) + ".snd";
+          if (!writer.open(path)) {
+            std::fprintf(stderr, "cannot write %s\n", path.c_str());
+            ++failures;
+            return;
+          }
+          ++shards;
+        }
+        if (!writer.add_game(game, source)) { ++failures; }
+        records += game.size();
+      }
+      if (!writer.close()) { ++failures; }
+    });
+  }
+  for (auto &worker : workers) { worker.join(); }
+  double seconds = std::max(1e-9, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+
+  std::printf("%zu games, %llu transitions in %d shards, %.2fs on %d threads (%.0f transitions/s)\n",
+              jobs - failures.load(), (unsigned long long)records.load(), shards.load(), seconds, threads,
+              records.load() / seconds);
+  return failures.load() == 0 ? 0 : 1;
+}
+
+int read(int argc, char **argv) {
+  size_t batch_size = 256;
+  int epochs = 1;
+  uint64_t seed = 1;
+  std::string dir;
+  for (int i = 2; i < argc; ++i) {
+    std::string arg = argv[i];
+    bool has_value = i + 1 < argc;
+    if (arg == "--batch" && has_value) { batch_size = std::max(1, std::atoi(argv[++i])); }
+    else if (arg == "--epochs" && has_value) { epochs = std::max(1, std::atoi(argv[++i])); }
+    else if (arg == "--seed" && has_value) { seed = std::strtoull(argv[++i], nullptr, 10); }
+    else { dir = arg; }
+  }
+  if (dir.empty()) {
+    std::fprintf(stderr, "usage: snakey_dataset read DATASET_DIR [--batch N] [--epochs N] [--seed N]\n");
+    return 1;
+  }
+
+  DatasetReader reader;
+  for (const std::string &path : find_files(dir, ".snd")) {
+    std::string error;
+    if (!reader.add_shard(path, &error)) {
+      std::fprintf(stderr, "%s: %s\n", path.c_str(), error.c_str());
+      return 1;
+    }
+  }
+  std::printf("%llu transitions from %llu games\n", (unsigned long long)reader.size(),
+              (unsigned long long)reader.game_count());
+  if (reader.size() == 0) { return 0; }
+
+  BatchSampler sampler(reader, batch_size, seed);
+  std::vector<const DatasetRecord *> batch;
+  uint64_t seen = 0, done = 0, food = 0, deaths = 0, actions[4] = {};
+  uint64_t cells = 0;  // Touches the observation, as a trainer would
+  auto start = std::chrono::steady_clock::now();
+  for (int epoch = 0; epoch < epochs; ++epoch) {
+    while (sampler.next(batch)) {
+      for (const DatasetRecord *record : batch) {
+        ++seen;
+        done += record->done;
+        food += record->reward > 0;
+        deaths += record->reward < 0;
+        actions[record->action & 3]++;
+        for (uint8_t byte : record->cells) { cells += byte != 0; }
+      }
+    }
+  }
+  double seconds = std::max(1e-9, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+  std::printf("%llu samples in %d epochs: %llu done, %llu meals, %llu deaths, actions U/D/L/R %llu/%llu/%llu/%llu\n",
+              (unsigned long long)seen, epochs, (unsigned long long)done, (unsigned long long)food,
+              (unsigned long long)deaths, (unsigned long long)actions[0], (unsigned long long)actions[1],
+              (unsigned long long)actions[2], (unsigned long long)actions[3]);
+  std::printf("%.2fs, %.0f samples/s, %.1f occupied cell pairs per sample\n", seconds, seen / seconds,
+              double(cells) / seen);
+  return 0;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  std::string command = argc > 1 ? argv[1] : "";
+  if (command == "generate") { return generate(argc, argv); }
+  if (command == "read") { return read(argc, argv); }
+  std::fprintf(stderr, "usage: snakey_dataset generate|read ...\n");
+  return 1;
+}
@@ -0,0 +1,415 @@
+#include "game_server.hpp"
+
+#include "server_registry.hpp"
+#include "util.hpp"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+namespace {
+
+constexpr size_t CHUNK_SESSIONS = 1024;
+constexpr int MAX_EVENTS = 512;
+constexpr size_t READ_BYTES = 4096;
+// Upper bound on one epoll wait, so stop() and reports are noticed
+constexpr int MAX_WAIT_MS = 100;
+constexpr uint64_t LISTEN_TAG = ~uint64_t(0);
+
+} // namespace
+
+struct GameServer::Session {
+  uint32_t id = 0;
+  uint32_t generation = 0;  // Tells events for an earlier client of the slot apart
+  int fd = -1;
+  bool joined = false;
+  bool watching_writes = false;
+  bool closing = false;
+  Rules rules;
+  std::optional<World> world;
+  uint64_t seed = 0;
+  uint32_t game = 0;
+  uint64_t joined_us = 0;
+  uint64_t next_tick_us = 0;
+  bool has_input = false;
+  Direction input = Direction::Right;
+  uint32_t last_input = 0;
+  std::string received;
+  std::string output;
+  size_t output_offset = 0;
+
+  uint64_t tag() const { return uint64_t(generation) << 32 | id; }
+};
+
+// Sessions in chunks that never move, so references stay valid as the pool
+// grows; freed slots keep their buffers for the next client
+class GameServer::SessionPool {
+public:
+  explicit SessionPool(size_t limit) : limit(limit) {}
+
+  Session *acquire() {
+    if (free_ids.empty()) {
+      if (capacity() >= limit) { return nullptr; }
+      size_t first = capacity();
+      chunks.push_back(std::make_unique<Session[]>(CHUNK_SESSIONS));
+      for (size_t i = CHUNK_SESSIONS; i-- > 0;) {
+        if (first + i < limit) { free_ids.push_back(static_cast<uint32_t>(first + i)); }
+        chunks.back()[i].id = static_cast<uint32_t>(first + i);
+      }
+    }
+    Session &session = at(free_ids.back());
+    free_ids.pop_back();
+    ++in_use;
+    return &session;
+  }
+
+  void release(Session &session) {
+    session.fd = -1;
+    session.joined = false;
+    session.watching_writes = false;
+    session.closing = false;
+    session.world.reset();
+    session.has_input = false;
+    session.last_input = 0;
+    session.game = 0;
+    session.received.clear();
+    session.output.clear();
+    session.output_offset = 0;
+    session.generation++;
+    free_ids.push_back(session.id);
+    --in_use;
+  }
+
+  Session &at(uint32_t id) { return chunks[id / CHUNK_SESSIONS][id % CHUNK_SESSIONS]; }
+  size_t capacity() const { return chunks.size() * CHUNK_SESSIONS; }
+  size_t size() const { return in_use; }
+
+  template <typename F>
+  void for_each_open(F &&f) {
+    for (size_t i = 0; i < capacity(); ++i) {
+      Session &session = at(static_cast<uint32_t>(i));
+      if (session.fd >= 0) { f(session); }
+    }
+  }
+
+private:
+  size_t limit;
+  size_t in_use = 0;
+  std::vector<std::unique_ptr<Session[]>> chunks;
+  std::vector<uint32_t> free_ids;
+};
+
+GameServer::GameServer(ServerOptions options)
+  : options(std::move(options)),
+    epoch(std::chrono::steady_clock::now()),
+    sessions(std::make_unique<SessionPool>(this->options.max_sessions)),
+    wheel(0) {}
+
+GameServer::~GameServer() {
+  sessions->for_each_open([&](Session &session) { close(session.fd); });
+  if (listen_fd >= 0) { close(listen_fd); }
+  if (epoll_fd >= 0) { close(epoll_fd); }
+}
+
+uint64_t GameServer::now_us() const {
+  return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - epoch).count();
+}
+
+bool GameServer::start(std::string *error) {
+  listen_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (listen_fd < 0) { return fail_errno(error, "socket"); }
+  int on = 1;
+  setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+  if (options.reuse_port && setsockopt(listen_fd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on)) != 0) {
+    return fail_errno(error, "SO_REUSEPORT");
+  }
+  sockaddr_in address{};
+  address.sin_family = AF_INET;
+  address.sin_port = htons(options.port);
+  if (inet_pton(AF_INET, options.address.c_str(), &address.sin_addr) != 1) {
+    errno = EINVAL;
+    return fail_errno(error, "address " + options.address);
+  }
+  if (bind(listen_fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0) {
+    return fail_errno(error, "bind " + options.address + ":" + std::to_string(options.port));
+  }
+  if (listen(listen_fd, SOMAXCONN) != 0) { return fail_errno(error, "listen"); }
+  socklen_t length = sizeof(address);
+  getsockname(listen_fd, reinterpret_cast<sockaddr *>(&address), &length);
+  port = ntohs(address.sin_port);
+
+  epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  if (epoll_fd < 0) { return fail_errno(error, "epoll_create1"); }
+  epoll_event event{};
+  event.events = EPOLLIN;
+  event.data.u64 = LISTEN_TAG;
+  if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, listen_fd, &event) != 0) { return fail_errno(error, "epoll_ctl"); }
+  return true;
+}
+
+void GameServer::run(int report_ms, const Report &report) {
+  epoll_event events[MAX_EVENTS];
+  uint64_t next_report_us = report_ms > 0 ? now_us() + uint64_t(report_ms) * 1000 : ~uint64_t(0);
+  while (!stopping) {
+    uint64_t now_ms = now_us() / 1000;
+    int timeout = MAX_WAIT_MS;
+    uint64_t wakeup = wheel.next_wakeup();
+    if (wakeup != TimerWheel::NEVER) { timeout = static_cast<int>(std::min<uint64_t>(timeout, wakeup > now_ms ? wakeup - now_ms : 0)); }
+    int count = epoll_wait(epoll_fd, events, MAX_EVENTS, timeout);
+    if (count < 0 && errno != EINTR) { break; }
+
+    for (int i = 0; i < count; ++i) {
+      const epoll_event &event = events[i];
+      if (event.data.u64 == LISTEN_TAG) {
+        accept_clients();
+        continue;
+      }
+      Session &session = sessions->at(static_cast<uint32_t>(event.data.u64));
+      if (session.fd < 0 || session.tag() != event.data.u64 || session.closing) { continue; }
+      if (event.events & (EPOLLERR | EPOLLHUP)) {
+        close_session(session);
+        continue;
+      }
+      if (event.events & EPOLLIN) { handle_readable(session); }
+      if ((event.events & EPOLLOUT) && session.fd >= 0 && !session.closing) { flush(session); }
+    }
+
+    wheel.advance(now_us() / 1000, [&](const uint32_t *ids, size_t n) { play_ticks(ids, n); });
+    // A slot closed directly may have been taken by a new client since
+    for (uint64_t tag : dying) {
+      Session &session = sessions->at(static_cast<uint32_t>(tag));
+      if (session.tag() == tag) { close_session(session); }
+    }
+    dying.clear();
+
+    if (now_us() >= next_report_us) {
+      stats.sessions = sessions->size();
+      if (report) { report(stats); }
+      stats = ServerStats();
+      next_report_us += uint64_t(report_ms) * 1000;
+    }
+  }
+}
+
+void GameServer::accept_clients() {
+  for (;;) {
+    int fd = accept4(listen_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd < 0) { return; }
+    Session *session = sessions->acquire();
+    if (!session) {
+      std::string refusal;
+      put_refused(refusal, RefuseReason::Full);
+      send(fd, refusal.data(), refusal.size(), MSG_NOSIGNAL | MSG_DONTWAIT);
+      close(fd);
+      stats.refused++;
+      continue;
+    }
+    int on = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    session->fd = fd;
+    epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.u64 = session->tag();
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event) != 0) {
+      close(fd);
+      sessions->release(*session);
+      continue;
+    }
+    // Until the client joins, the session's timer is its join deadline
+    wheel.resize(sessions->capacity());
+    wheel.schedule(session->id, now_us() / 1000 + uint64_t(std::max(1, options.join_timeout_ms)));
+    stats.accepted++;
+  }
+}
+
+void GameServer::handle_readable(Session &session) {
+  char buffer[READ_BYTES];
+  for (;;) {
+    ssize_t n = recv(session.fd, buffer, sizeof(buffer), 0);
+    if (n > 0) {
+      session.received.append(buffer, static_cast<size_t>(n));
+      continue;
+    }
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) { break; }
+    if (n < 0 && errno == EINTR) { continue; }
+    close_session(session);  // Closed by the client, or broken
+    return;
+  }
+
+  size_t offset = 0;
+  const auto *data = reinterpret_cast<const uint8_t *>(session.received.data());
+  while (!session.closing) {
+    NetFrame frame;
+    ptrdiff_t taken = next_frame(data + offset, session.received.size() - offset, frame);
+    if (taken == 0) { break; }
+    if (taken < 0 || !handle_message(session, frame)) {
+      stats.bad_messages++;
+      put_refused(session.output, RefuseReason::BadMessage);
+      flush(session);
+      close_session(session);
+      return;
+    }
+    offset += static_cast<size_t>(taken);
+  }
+  if (!session.closing) { session.received.erase(0, offset); }
+}
+
+bool GameServer::handle_message(Session &session, const NetFrame &frame) {
+  switch (frame.type) {
+    case NetMessage::Join: {
+      JoinMessage message;
+      if (session.joined || !get_join(frame, message)) { return false; }
+      join(session, message.tick_rate_ms, message.wrapping, message.seed);
+      return true;
+    }
+    case NetMessage::Input: {
+      InputMessage message;
+      if (!session.joined || !get_input(frame, message)) { return false; }
+      session.has_input = true;
+      session.input = message.direction;
+      session.last_input = message.sequence;
+      stats.inputs++;
+      return true;
+    }
+    case NetMessage::Leave:
+      // Closed after the current batch, so a pending flush still goes out
+      session.closing = true;
+      dying.push_back(session.tag());
+      return true;
+    default:
+      return false;
+  }
+}
+
+void GameServer::join(Session &session, uint16_t tick_rate_ms, bool wrapping, uint64_t seed) {
+  session.rules = net_session_rules(std::clamp<int>(tick_rate_ms, options.min_tick_rate_ms, options.max_tick_rate_ms),
+                                    wrapping);
+  session.seed = seed;
+  session.joined_us = now_us();
+  session.world.emplace(session.rules, seed);
+  session.joined = true;
+  record_session(session);
+  const uint32_t id = options.registry ? ServerRegistry::global_id(options.worker, session.id) : session.id;
+  put_joined(session.output, { id, static_cast<uint8_t>(session.rules.width),
+                               static_cast<uint8_t>(session.rules.height),
+                               static_cast<uint16_t>(session.rules.tick_rate_ms) });
+  flush(session);
+  session.next_tick_us = now_us() + uint64_t(session.rules.tick_rate_ms) * 1000;
+  wheel.schedule(session.id, (session.next_tick_us + 999) / 1000);
+}
+
+void GameServer::play_ticks(const uint32_t *ids, size_t count) {
+  const uint64_t now = now_us();
+  // Step the whole slot first, then write it out
+  for (size_t i = 0; i < count; ++i) {
+    Session &session = sessions->at(ids[i]);
+    if (session.fd < 0 || session.closing) { continue; }
+    if (!session.joined) {
+      session.closing = true;
+      dying.push_back(session.tag());
+      stats.timed_out++;
+      continue;
+    }
+    World &world = *session.world;
+    stats.lateness_us.add(now > session.next_tick_us ? now - session.next_tick_us : 0);
+    stats.ticks++;
+
+    if (session.has_input) {
+      world.set_direction(0, session.input);
+      session.has_input = false;
+    }
+    world.step();
+    const Snake &snake = world.get_snake(0);
+    put_tick(session.output, { session.game, world.get_tick(), session.last_input,
+                               static_cast<uint8_t>(snake.get_head().x), static_cast<uint8_t>(snake.get_head().y),
+                               static_cast<uint8_t>(world.get_food().x), static_cast<uint8_t>(world.get_food().y),
+                               static_cast<uint16_t>(snake.get_length()), world.get_death_cause(0) });
+    if (world.is_over()) {
+      session.world.emplace(session.rules, session.seed + ++session.game);
+      record_session(session);
+    }
+
+    // Keep the cadence, unless a whole tick was missed
+    const uint64_t period = uint64_t(session.rules.tick_rate_ms) * 1000;
+    session.next_tick_us += period;
+    if (session.next_tick_us + period < now) {
+      stats.overruns++;
+      session.next_tick_us = now + period;
+    }
+    wheel.schedule(session.id, (session.next_tick_us + 999) / 1000);
+  }
+  for (size_t i = 0; i < count; ++i) {
+    Session &session = sessions->at(ids[i]);
+    if (session.fd >= 0 && !session.closing) { flush(session); }
+  }
+}
+
+void GameServer::flush(Session &session) {
+  while (session.output_offset < session.output.size()) {
+    ssize_t n = send(session.fd, session.output.data() + session.output_offset,
+                     session.output.size() - session.output_offset, MSG_NOSIGNAL | MSG_DONTWAIT);
+    if (n > 0) {
+      session.output_offset += static_cast<size_t>(n);
+      stats.bytes_out += static_cast<uint64_t>(n);
+      continue;
+    }
+    if (n < 0 && errno == EINTR) { continue; }
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      if (session.output.size() - session.output_offset > options.max_backlog_bytes) {
+        session.closing = true;
+        dying.push_back(session.tag());
+        return;
+      }
+      watch_writable(session, true);
+      return;
+    }
+    session.closing = true;
+    dying.push_back(session.tag());
+    return;
+  }
+  session.output.clear();
+  session.output_offset = 0;
+  watch_writable(session, false);
+}
+
+void GameServer::watch_writable(Session &session, bool writable) {
+  if (session.watching_writes == writable) { return; }
+  epoll_event event{};
+  event.events = writable ? EPOLLIN | EPOLLOUT : EPOLLIN;
+  event.data.u64 = session.tag();
+  epoll_ctl(epoll_fd, EPOLL_CTL_MOD, session.fd, &event);
+  session.watching_writes = writable;
+}
+
+void GameServer::close_session(Session &session) {
+  if (session.fd < 0) { return; }
+  wheel.cancel(session.id);
+  epoll_ctl(epoll_fd, EPOLL_CTL_DEL, session.fd, nullptr);
+  close(session.fd);
+  const bool joined = session.joined;
+  sessions->release(session);
+  if (joined) { record_session(session); }
+  stats.closed++;
+}
+
+void GameServer::record_session(const Session &session) {
+  if (!options.registry) { return; }
+  SessionRecord record;
+  if (session.joined) {
+    record.session = ServerRegistry::global_id(options.worker, session.id);
+    record.open = true;
+    record.wrapping = session.rules.wrapping;
+    record.tick_rate_ms = static_cast<uint16_t>(session.rules.tick_rate_ms);
+    record.game = session.game;
+    record.seed = session.seed;
+    record.joined_us = session.joined_us;
+  }
+  options.registry->put_session(options.worker, session.id, record);
+}
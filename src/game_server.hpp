@@ -0,0 +1,104 @@
+#pragma once
+
+// Hosts many remote games in one thread. Clients connect over TCP and speak
+// the protocol in net_protocol.hpp; each session plays its own game at its
+// own tick rate. Sockets are non-blocking and multiplexed with epoll, and
+// ticks are scheduled on a timer wheel, so a tick costs the same with ten
+// sessions as with ten thousand. Sessions due in the same millisecond are
+// stepped together and only then written out. Sessions live in a pool of
+// fixed-size chunks whose slots, buffers included, are reused as clients
+// come and go.
+
+#include "core.hpp"
+#include "histogram.hpp"
+#include "net_protocol.hpp"
+#include "timer_wheel.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+class ServerRegistry;
+
+struct ServerOptions {
+  std::string address = "127.0.0.1";
+  uint16_t port = 7777;
+  size_t max_sessions = 16384;
+  int min_tick_rate_ms = 5;
+  int max_tick_rate_ms = 10000;
+  size_t max_backlog_bytes = 1 << 16;  // Unsent output before a client counts as gone
+  int join_timeout_ms = 5000;          // Connections that have not joined by then are closed
+  // For one of several worker processes sharing the port: the listening
+  // socket is bound with SO_REUSEPORT, and sessions are recorded in the
+  // registry under ids that carry the worker index
+  bool reuse_port = false;
+  ServerRegistry *registry = nullptr;
+  int worker = 0;
+};
+
+// Counts since the last report
+struct ServerStats {
+  uint64_t sessions = 0;      // Open at the time of the report
+  uint64_t accepted = 0;
+  uint64_t refused = 0;
+  uint64_t closed = 0;
+  uint64_t ticks = 0;
+  uint64_t inputs = 0;
+  uint64_t bad_messages = 0;
+  uint64_t timed_out = 0;     // Closed for not joining in time
+  uint64_t bytes_out = 0;
+  uint64_t overruns = 0;      // Ticks more than a whole tick late, rescheduled from now
+  Histogram lateness_us;      // How late ticks ran against their schedule
+};
+
+class GameServer {
+public:
+  explicit GameServer(ServerOptions options);
+  ~GameServer();
+  GameServer(const GameServer &) = delete;
+  GameServer &operator=(const GameServer &) = delete;
+
+  // Binds the listening socket; false with the reason in `error` on failure
+  bool start(std::string *error = nullptr);
+
+  // Serves until stop(), calling `report` every `report_ms` with the counts
+  // since the previous call
+  using Report = std::function<void(const ServerStats &stats)>;
+  void run(int report_ms = 0, const Report &report = nullptr);
+
+  // Safe to call from a signal handler
+  void stop() { stopping = true; }
+
+  uint16_t get_port() const { return port; }
+
+private:
+  struct Session;
+  class SessionPool;
+
+  uint64_t now_us() const;
+  void accept_clients();
+  void handle_readable(Session &session);
+  bool handle_message(Session &session, const NetFrame &frame);
+  void join(Session &session, uint16_t tick_rate_ms, bool wrapping, uint64_t seed);
+  void play_ticks(const uint32_t *ids, size_t count);
+  void flush(Session &session);
+  void watch_writable(Session &session, bool writable);
+  void close_session(Session &session);
+  void record_session(const Session &session);
+
+  ServerOptions options;
+  int listen_fd = -1;
+  int epoll_fd = -1;
+  uint16_t port = 0;
+  std::chrono::steady_clock::time_point epoch;
+  std::unique_ptr<SessionPool> sessions;
+  TimerWheel wheel;
+  ServerStats stats;
+  std::vector<uint64_t> dying;  // Tags of sessions to close once the current batch is done
+  std::atomic<bool> stopping{ false };
+};
@@ -0,0 +1,224 @@
+#include "gif_writer.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+constexpr int MIN_CODE_SIZE = 8;
+constexpr int CLEAR_CODE    = 1 << MIN_CODE_SIZE;
+constexpr int END_CODE      = CLEAR_CODE + 1;
+constexpr int MAX_CODES     = 4096;
+
+void put_u16(FILE *file, int v) {
+  std::fputc(v & 0xff, file);
+  std::fputc((v >> 8) & 0xff, file);
+}
+
+// Packs variable-width codes least significant bit first
+class BitPacker {
+public:
+  explicit BitPacker(std::vector<uint8_t> &out) : out(out) {}
+
+  void put(int code, int size) {
+    buffer |= uint32_t(code) << bits;
+    bits += size;
+    while (bits >= 8) {
+      out.push_back(uint8_t(buffer));
+      buffer >>= 8;
+      bits -= 8;
+    }
+  }
+
+  void flush() {
+    if (bits > 0) { out.push_back(uint8_t(buffer)); }
+    buffer = 0;
+    bits = 0;
+  }
+
+private:
+  std::vector<uint8_t> &out;
+  uint32_t buffer = 0;
+  int bits = 0;
+};
+
+// String table of the LZW encoder, keyed by (prefix code, next index)
+class CodeTable {
+public:
+  static constexpr size_t SIZE = 8192;  // Power of two, twice MAX_CODES
+
+  void clear() { ++generation; }  // O(1): stale entries are told apart by generation
+
+  int find(int prefix, uint8_t index) const {
+    uint32_t key = uint32_t(prefix) << 8 | index;
+    for (size_t slot = hash(key);; slot = (slot + 1) & (SIZE - 1)) {
+      const Entry &entry = entries[slot];
+      if (entry.generation != generation) { return -1; }
+      if (entry.key == key) { return entry.code; }
+    }
+  }
+
+  void insert(int prefix, uint8_t index, int code) {
+    uint32_t key = uint32_t(prefix) << 8 | index;
+    size_t slot = hash(key);
+    while (entries[slot].generation == generation) { slot = (slot + 1) & (SIZE - 1); }
+    entries[slot] = { key, static_cast<uint16_t>(code), generation };
+  }
+
+private:
+  struct Entry {
+    uint32_t key = 0;
+    uint16_t code = 0;
+    uint32_t generation = 0;
+  };
+
+  static size_t hash(uint32_t key) { return (key * 2654435761u) >> 19; }
+
+  std::vector<Entry> entries = std::vector<Entry>(SIZE);
+  uint32_t generation = 1;
+};
+
+} // namespace
+
+GifWriter::~GifWriter() { close(); }
+
+bool GifWriter::open(const std::string &path, int width, int height) {
+  close();
+  file = std::fopen(path.c_str(), "wb");
+  if (!file) { return false; }
+  this->width = width;
+  this->height = height;
+  frames = 0;
+  palette.assign(256 * 3, 0);
+  indices.resize(static_cast<size_t>(width) * height);
+
+  std::fwrite("GIF89a", 1, 6, file);
+  put_u16(file, width);
+  put_u16(file, height);
+  std::fputc(0x70, file);  // No global colour table, 8 bits of colour resolution
+  std::fputc(0, file);     // Background colour
+  std::fputc(0, file);     // Square pixels
+  // Loop forever
+  static const uint8_t looping[] = { 0x21, 0xff, 0x0b, 'N', 'E', 'T', 'S', 'C', 'A', 'P', 'E', '2', '.', '0',
+                                     0x03, 0x01, 0x00, 0x00, 0x00 };
+  std::fwrite(looping, 1, sizeof(looping), file);
+  return !std::ferror(file);
+}
+
+bool GifWriter::add_frame(const uint8_t *rgba, int delay_cs) {
+  if (!file) { return false; }
+  build_palette(rgba);
+
+  // Graphic control extension with the frame delay
+  std::fputc(0x21, file);
+  std::fputc(0xf9, file);
+  std::fputc(4, file);
+  std::fputc(0, file);
+  put_u16(file, std::clamp(delay_cs, 0, 0xffff));
+  std::fputc(0, file);
+  std::fputc(0, file);
+
+  // Image descriptor with a local table of 256 colours
+  std::fputc(0x2c, file);
+  put_u16(file, 0);
+  put_u16(file, 0);
+  put_u16(file, width);
+  put_u16(file, height);
+  std::fputc(0x87, file);
+  std::fwrite(palette.data(), 1, palette.size(), file);
+
+  write_image_data();
+  ++frames;
+  return !std::ferror(file);
+}
+
+bool GifWriter::close() {
+  if (!file) { return true; }
+  std::fputc(0x3b, file);
+  bool ok = !std::ferror(file);
+  ok = std::fclose(file) == 0 && ok;
+  file = nullptr;
+  return ok;
+}
+
+void GifWriter::build_palette(const uint8_t *rgba) {
+  // Exact colours first, in an open-addressed table of packed RGB values
+  constexpr size_t SLOTS = 1024;
+  uint32_t keys[SLOTS];
+  int16_t values[SLOTS];
+  std::fill(values, values + SLOTS, int16_t(-1));
+  int colours = 0;
+  const size_t pixels = indices.size();
+  size_t i = 0;
+  for (; i < pixels; ++i) {
+    const uint8_t *p = rgba + i * 4;
+    uint32_t rgb = uint32_t(p[0]) | uint32_t(p[1]) << 8 | uint32_t(p[2]) << 16;
+    size_t slot = (rgb * 2654435761u) >> 22;
+    while (values[slot] >= 0 && keys[slot] != rgb) { slot = (slot + 1) & (SLOTS - 1); }
+    if (values[slot] < 0) {
+      if (colours == 256) { break; }
+      keys[slot] = rgb;
+      values[slot] = static_cast<int16_t>(colours);
+      std::memcpy(&palette[colours * 3], p, 3);
+      ++colours;
+    }
+    indices[i] = static_cast<uint8_t>(values[slot]);
+  }
+  if (i == pixels) { return; }
+
+  // Too many colours: fall back to the colour cube
+  for (int c = 0; c < 216; ++c) {
+    palette[c * 3 + 0] = static_cast<uint8_t>(c / 36 * 51);
+    palette[c * 3 + 1] = static_cast<uint8_t>(c / 6 % 6 * 51);
+    palette[c * 3 + 2] = static_cast<uint8_t>(c % 6 * 51);
+  }
+  std::fill(palette.begin() + 216 * 3, palette.end(), 0);
+  auto level = [](uint8_t v) { return (v + 25) / 51; };
+  for (i = 0; i < pixels; ++i) {
+    const uint8_t *p = rgba + i * 4;
+    indices[i] = static_cast<uint8_t>(level(p[0]) * 36 + level(p[1]) * 6 + level(p[2]));
+  }
+}
+
+void GifWriter::write_image_data() {
+  CodeTable table;
+  packed.clear();
+  BitPacker bits(packed);
+  int code_size = MIN_CODE_SIZE + 1;
+  int next_code = END_CODE + 1;
+  table.clear();
+  bits.put(CLEAR_CODE, code_size);
+
+  int prefix = indices[0];
+  for (size_t i = 1; i < indices.size(); ++i) {
+    uint8_t index = indices[i];
+    int code = table.find(prefix, index);
+    if (code >= 0) {
+      prefix = code;
+      continue;
+    }
+    bits.put(prefix, code_size);
+    if (next_code < MAX_CODES) {
+      table.insert(prefix, index, next_code++);
+      // The decoder widens its codes once the last code of a width is taken
+      if (next_code > (1 << code_size) && code_size < 12) { ++code_size; }
+    } else {
+      bits.put(CLEAR_CODE, code_size);
+      table.clear();
+      code_size = MIN_CODE_SIZE + 1;
+      next_code = END_CODE + 1;
+    }
+    prefix = index;
+  }
+  bits.put(prefix, code_size);
+  bits.put(END_CODE, code_size);
+  bits.flush();
+
+  std::fputc(MIN_CODE_SIZE, file);
+  for (size_t offset = 0; offset < packed.size(); offset += 255) {
+    size_t block = std::min<size_t>(255, packed.size() - offset);
+    std::fputc(static_cast<int>(block), file);
+    std::fwrite(packed.data() + offset, 1, block, file);
+  }
+  std::fputc(0, file);
+}
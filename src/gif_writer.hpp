@@ -0,0 +1,41 @@
+#pragma once
+
+// Animated GIF output for gameplay clips.
+// Frames are RGBA and get their own colour table: the exact colours when a
+// frame has at most 256 of them, which covers the flat colours of the game,
+// otherwise the nearest entries of a 6x6x6 colour cube. Frames are written
+// as they come, so a clip never has to be held in memory.
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+class GifWriter {
+public:
+  GifWriter() = default;
+  ~GifWriter();
+  GifWriter(const GifWriter &) = delete;
+  GifWriter &operator=(const GifWriter &) = delete;
+
+  bool open(const std::string &path, int width, int height);
+  // Appends a frame shown for `delay_cs` hundredths of a second. `rgba`
+  // holds width * height pixels, top row first.
+  bool add_frame(const uint8_t *rgba, int delay_cs);
+  bool close();
+
+  bool is_open() const { return file != nullptr; }
+  int get_frame_count() const { return frames; }
+
+private:
+  void build_palette(const uint8_t *rgba);
+  void write_image_data();
+
+  FILE *file = nullptr;
+  int width = 0;
+  int height = 0;
+  int frames = 0;
+  std::vector<uint8_t> palette;  // 256 RGB entries
+  std::vector<uint8_t> indices;  // Palette index per pixel
+  std::vector<uint8_t> packed;   // LZW output before it is cut into blocks
+};
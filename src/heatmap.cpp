@@ -0,0 +1,196 @@
+#include "heatmap.hpp"
+#include "util.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <thread>
+
+namespace {
+
+constexpr int LAYER_COUNT = static_cast<int>(HeatLayer::Count);
+
+void put_varint(std::vector<uint8_t> &out, uint64_t v) {
+  while (v >= 0x80) {
+    out.push_back(uint8_t(v) | 0x80);
+    v >>= 7;
+  }
+  out.push_back(uint8_t(v));
+}
+
+class VarintReader {
+public:
+  VarintReader(const uint8_t *data, size_t size) : data(data), size(size) {}
+  bool ok() const { return !overrun; }
+  bool at_end() const { return offset == size; }
+  size_t remaining() const { return size - offset; }
+
+  uint64_t fixed(int bytes) {
+    if (overrun || size - offset < static_cast<size_t>(bytes)) { overrun = true; return 0; }
+    uint64_t v = 0;
+    for (int i = 0; i < bytes; ++i) { v |= uint64_t(data[offset++]) << (8 * i); }
+    return v;
+  }
+
+  uint64_t varint() {
+    uint64_t v = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+      if (overrun || offset == size) { overrun = true; return 0; }
+      uint8_t byte = data[offset++];
+      v |= uint64_t(byte & 0x7f) << shift;
+      if (!(byte & 0x80)) { return v; }
+    }
+    overrun = true;
+    return 0;
+  }
+
+private:
+  const uint8_t *data;
+  size_t size;
+  size_t offset = 0;
+  bool overrun = false;
+};
+
+} // namespace
+
+const char *heat_layer_name(HeatLayer layer) {
+  switch (layer) {
+    case HeatLayer::Visits: return "visits";
+    case HeatLayer::Deaths: return "deaths";
+    case HeatLayer::Food:   return "food";
+    case HeatLayer::Count:  break;
+  }
+  return "?";
+}
+
+Heatmap::Heatmap(int width, int height)
+  : width(width),
+    height(height),
+    counts(static_cast<size_t>(LAYER_COUNT) * width * height, 0)
+{
+}
+
+uint64_t Heatmap::max(HeatLayer layer) const {
+  auto begin = counts.begin() + index(layer, 0, 0);
+  return *std::max_element(begin, begin + static_cast<size_t>(width) * height);
+}
+
+uint64_t Heatmap::total(HeatLayer layer) const {
+  auto begin = counts.begin() + index(layer, 0, 0);
+  uint64_t sum = 0;
+  for (auto it = begin; it != begin + static_cast<size_t>(width) * height; ++it) { sum += *it; }
+  return sum;
+}
+
+void Heatmap::merge(const Heatmap &other) {
+  for (size_t i = 0; i < counts.size(); ++i) { counts[i] += other.counts[i]; }
+  games += other.games;
+}
+
+HeatmapRecorder::HeatmapRecorder(Heatmap &heatmap, const World &world)
+  : heatmap(heatmap),
+    food(world.get_food()),
+    alive(world.get_snake_count(), true)
+{
+  heatmap.add_games(1);
+}
+
+void HeatmapRecorder::observe(const World &world) {
+  const Rules &rules = world.get_rules();
+  for (int i = 0; i < world.get_snake_count(); ++i) {
+    if (!alive[i]) { continue; }
+    Point head = world.get_snake(i).get_head();
+    // Heads that ran into a wall are counted on the edge they left
+    head = { std::clamp(head.x, 0, rules.width - 1), std::clamp(head.y, 0, rules.height - 1) };
+    if (!world.is_alive(i)) {
+      heatmap.add(HeatLayer::Deaths, head);
+      alive[i] = false;
+      continue;
+    }
+    heatmap.add(HeatLayer::Visits, head);
+    if (head.x == food.x && head.y == food.y) { heatmap.add(HeatLayer::Food, head); }
+  }
+  food = world.get_food();
+}
+
+Heatmap merge_heatmaps(const std::vector<Heatmap> &parts, int threads) {
+  if (parts.empty()) { return Heatmap(); }
+  Heatmap merged(parts[0].width, parts[0].height);
+  for (const Heatmap &part : parts) { merged.games += part.games; }
+  const size_t cells = merged.counts.size();
+  threads = std::clamp(threads, 1, static_cast<int>(std::max<size_t>(1, cells / 4096)));
+  // Each thread sums every part over its own slice, so no two threads ever
+  // write the same cell
+  auto sum_slice = [&](size_t begin, size_t end) {
+    for (const Heatmap &part : parts) {
+      for (size_t i = begin; i < end; ++i) { merged.counts[i] += part.counts[i]; }
+    }
+  };
+  std::vector<std::thread> workers;
+  for (int t = 1; t < threads; ++t) {
+    workers.emplace_back(sum_slice, cells * t / threads, cells * (t + 1) / threads);
+  }
+  sum_slice(0, cells / threads);
+  for (std::thread &worker : workers) { worker.join(); }
+  return merged;
+}
+
+void encode_heatmap(const Heatmap &heatmap, std::vector<uint8_t> &bytes) {
+  bytes.clear();
+  put_fixed(bytes, HEATMAP_MAGIC, 4);
+  put_fixed(bytes, HEATMAP_VERSION, 2);
+  put_fixed(bytes, heatmap.get_width(), 2);
+  put_fixed(bytes, heatmap.get_height(), 2);
+  put_fixed(bytes, LAYER_COUNT, 1);
+  put_fixed(bytes, heatmap.get_games(), 8);
+  for (int layer = 0; layer < LAYER_COUNT; ++layer) {
+    for (int y = 0; y < heatmap.get_height(); ++y) {
+      for (int x = 0; x < heatmap.get_width(); ++x) {
+        put_varint(bytes, heatmap.at(static_cast<HeatLayer>(layer), x, y));
+      }
+    }
+  }
+}
+
+bool decode_heatmap(const uint8_t *data, size_t size, Heatmap &heatmap, std::string *error) {
+  VarintReader r(data, size);
+  if (r.fixed(4) != HEATMAP_MAGIC) { return fail(error, "not a heatmap"); }
+  if (r.fixed(2) != HEATMAP_VERSION) { return fail(error, "unsupported heatmap version"); }
+  int width = static_cast<int>(r.fixed(2));
+  int height = static_cast<int>(r.fixed(2));
+  if (r.fixed(1) != LAYER_COUNT) { return fail(error, "unexpected layer count"); }
+  uint64_t games = r.fixed(8);
+  if (!r.ok() || width < 1 || height < 1) { return fail(error, "truncated header"); }
+  const int64_t cells = int64_t(width) * height;
+  if (cells > HEATMAP_MAX_CELLS) { return fail(error, "board too large"); }
+  // Every count takes at least a byte, so check the size before allocating
+  if (uint64_t(cells) * LAYER_COUNT > r.remaining()) { return fail(error, "truncated counts"); }
+  Heatmap loaded(width, height);
+  loaded.games = games;
+  for (uint64_t &count : loaded.counts) { count = r.varint(); }
+  if (!r.ok()) { return fail(error, "truncated counts"); }
+  if (!r.at_end()) { return fail(error, "trailing bytes"); }
+  heatmap = std::move(loaded);
+  return true;
+}
+
+bool save_heatmap(const Heatmap &heatmap, const std::string &path) {
+  std::vector<uint8_t> bytes;
+  encode_heatmap(heatmap, bytes);
+  FILE *file = std::fopen(path.c_str(), "wb");
+  if (!file) { return false; }
+  bool ok = std::fwrite(bytes.data(), 1, bytes.size(), file) == bytes.size();
+  return std::fclose(file) == 0 && ok;
+}
+
+bool load_heatmap(const std::string &path, Heatmap &heatmap, std::string *error) {
+  FILE *file = std::fopen(path.c_str(), "rb");
+  if (!file) { return fail(error, "cannot open file"); }
+  std::vector<uint8_t> bytes;
+  uint8_t buffer[4096];
+  size_t n;
+  while ((n = std::fread(buffer, 1, sizeof(buffer), file)) > 0) {
+    bytes.insert(bytes.end(), buffer, buffer + n);
+  }
+  std::fclose(file);
+  return decode_heatmap(bytes.data(), bytes.size(), heatmap, error);
+}
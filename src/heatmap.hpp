@@ -0,0 +1,82 @@
+#pragma once
+
+// Where snakes go, die and eat, counted per cell over many games.
+// Every worker fills its own heatmap and the maps are summed once at the
+// end, so counting never needs atomics. Files hold each layer as LEB128
+// varints, which keeps the mostly small counts to a byte or two per cell.
+
+#include "core.hpp"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+constexpr uint32_t HEATMAP_MAGIC   = 0x484b4e53;  // "SNKH" little-endian
+constexpr uint16_t HEATMAP_VERSION = 1;
+// Largest board a heatmap file may describe, in cells
+constexpr int64_t HEATMAP_MAX_CELLS = int64_t(1) << 22;
+
+enum class HeatLayer : uint8_t {
+  Visits,  // Ticks a living head spent on the cell
+  Deaths,  // Where heads were when their snake died
+  Food,    // Food eaten
+  Count
+};
+
+const char *heat_layer_name(HeatLayer layer);
+
+class Heatmap {
+public:
+  Heatmap() = default;
+  Heatmap(int width, int height);
+
+  int get_width() const { return width; }
+  int get_height() const { return height; }
+  bool empty() const { return counts.empty(); }
+
+  uint64_t get_games() const { return games; }
+  void add_games(uint64_t n) { games += n; }
+
+  void add(HeatLayer layer, Point p) { counts[index(layer, p.x, p.y)]++; }
+  uint64_t at(HeatLayer layer, int x, int y) const { return counts[index(layer, x, y)]; }
+  uint64_t max(HeatLayer layer) const;
+  uint64_t total(HeatLayer layer) const;
+
+  // Adds the counts of a heatmap of the same size
+  void merge(const Heatmap &other);
+
+private:
+  friend Heatmap merge_heatmaps(const std::vector<Heatmap> &parts, int threads);
+  friend bool decode_heatmap(const uint8_t *data, size_t size, Heatmap &heatmap, std::string *error);
+
+  size_t index(HeatLayer layer, int x, int y) const {
+    return (static_cast<size_t>(layer) * height + y) * width + x;
+  }
+
+  int width = 0;
+  int height = 0;
+  uint64_t games = 0;
+  std::vector<uint64_t> counts;  // Layer by layer, row-major
+};
+
+// Adds one game to a heatmap as it is played. Construct it on the fresh
+// world and call observe after every step.
+class HeatmapRecorder {
+public:
+  HeatmapRecorder(Heatmap &heatmap, const World &world);
+  void observe(const World &world);
+
+private:
+  Heatmap &heatmap;
+  Point food;
+  std::vector<bool> alive;
+};
+
+// Sums heatmaps of the same size, each thread taking a slice of the cells
+Heatmap merge_heatmaps(const std::vector<Heatmap> &parts, int threads);
+
+bool save_heatmap(const Heatmap &heatmap, const std::string &path);
+bool load_heatmap(const std::string &path, Heatmap &heatmap, std::string *error = nullptr);
+// The file format in memory, for sending heatmaps between processes
+void encode_heatmap(const Heatmap &heatmap, std::vector<uint8_t> &bytes);
+bool decode_heatmap(const uint8_t *data, size_t size, Heatmap &heatmap, std::string *error = nullptr);
@@ -0,0 +1,74 @@
+#include "histogram.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+int Histogram::bucket_of(uint64_t value) {
+  if (value < SUB_BUCKETS) { return static_cast<int>(value); }
+  int exponent = 63 - __builtin_clzll(value);  // 4 or more
+  return (exponent - 3) * SUB_BUCKETS + static_cast<int>((value >> (exponent - 4)) & (SUB_BUCKETS - 1));
+}
+
+uint64_t Histogram::bucket_upper(int bucket) {
+  if (bucket < SUB_BUCKETS) { return static_cast<uint64_t>(bucket); }
+  int exponent = bucket / SUB_BUCKETS + 3;
+  uint64_t lower = uint64_t(SUB_BUCKETS + bucket % SUB_BUCKETS) << (exponent - 4);
+  return lower + (uint64_t(1) << (exponent - 4)) - 1;
+}
+
+void Histogram::add(uint64_t value) {
+  counts[bucket_of(value)]++;
+  total++;
+  sum += value;
+  largest = std::max(largest, value);
+}
+
+void Histogram::merge(const Histogram &other) {
+  for (int i = 0; i < BUCKETS; ++i) { counts[i] += other.counts[i]; }
+  total += other.total;
+  sum += other.sum;
+  largest = std::max(largest, other.largest);
+}
+
+void Histogram::clear() { *this = Histogram(); }
+
+uint64_t Histogram::percentile(double p) const {
+  if (total == 0) { return 0; }
+  uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(p * total)));
+  uint64_t seen = 0;
+  for (int i = 0; i < BUCKETS; ++i) {
+    seen += counts[i];
+    if (seen >= rank) { return std::min(bucket_upper(i), largest); }
+  }
+  return largest;
+}
+
+std::string Histogram::summary(double scale, const char *unit) const {
+  char text[256];
+  std::snprintf(text, sizeof(text), "n=%llu mean=%.1f%s p50=%.1f%s p90=%.1f%s p99=%.1f%s p99.9=%.1f%s max=%.1f%s",
+                (unsigned long long)total, mean() / scale, unit, percentile(0.5) / scale, unit,
+                percentile(0.9) / scale, unit, percentile(0.99) / scale, unit, percentile(0.999) / scale, unit,
+                largest / scale, unit);
+  return text;
+}
+
+void Histogram::print(FILE *out, double scale, const char *unit) const {
+  constexpr int BAR_WIDTH = 40;
+  if (total == 0) { return; }
+  // Buckets below 16 are folded into the first row
+  uint64_t rows[64] = {};
+  for (int i = 0; i < BUCKETS; ++i) {
+    int row = i < SUB_BUCKETS ? 0 : i / SUB_BUCKETS;
+    rows[row] += counts[i];
+  }
+  int first = 0;
+  int last = 63;
+  while (first < 63 && rows[first] == 0) { ++first; }
+  while (last > first && rows[last] == 0) { --last; }
+  for (int row = first; row <= last; ++row) {
+    uint64_t upper = row == 0 ? SUB_BUCKETS - 1 : bucket_upper(row * SUB_BUCKETS + SUB_BUCKETS - 1);
+    int bar = static_cast<int>(double(rows[row]) / total * BAR_WIDTH + 0.5);
+    std::fprintf(out, "  <= %10.1f%-3s %10llu %5.1f%% %.*s\n", upper / scale, unit, (unsigned long long)rows[row],
+                 100.0 * rows[row] / total, bar, "########################################");
+  }
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+// Histogram of non-negative integers such as latencies in nanoseconds.
+// Values below 16 get their own bucket; above that each power of two is
+// split into 16 buckets, so percentiles are within 1/16 of the true value
+// from nanoseconds to hours in a fixed few KB. Histograms merge by adding
+// counts, so every thread or process can keep its own.
+
+#include <array>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+class Histogram {
+public:
+  void add(uint64_t value);
+  void merge(const Histogram &other);
+  void clear();
+
+  uint64_t count() const { return total; }
+  uint64_t max() const { return largest; }
+  double mean() const { return total ? double(sum) / total : 0.0; }
+  // Upper end of the bucket holding the p-th fraction of the values
+  uint64_t percentile(double p) const;
+
+  // "n=... mean=... p50=... p90=... p99=... p99.9=... max=..." with values
+  // divided by `scale`
+  std::string summary(double scale, const char *unit) const;
+  // One row per power of two that holds values, with a bar of its share
+  void print(FILE *out, double scale, const char *unit) const;
+
+private:
+  static constexpr int SUB_BUCKETS = 16;
+  static constexpr int BUCKETS = SUB_BUCKETS * 61;
+
+  static int bucket_of(uint64_t value);
+  static uint64_t bucket_upper(int bucket);
+
+  std::array<uint64_t, BUCKETS> counts{};
+  uint64_t total = 0;
+  uint64_t sum = 0;
+  uint64_t largest = 0;
+};
@@ -0,0 +1,83 @@
+// snakey_index: builds a columnar index of replay summaries.
+//
+//   snakey_index [--threads N] OUT.idx REPLAY_OR_DIR...
+//
+// Directories are searched recursively for .snr files. Each replay is
+// simulated once here, so queries never have to.
+
+#include "replay_index.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+int main(int argc, char **argv) {
+  int threads = std::max(1u, std::thread::hardware_concurrency());
+  std::vector<std::string> inputs;
+  std::string output;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg == "--threads" && i + 1 < argc) { threads = std::max(1, std::atoi(argv[++i])); }
+    else if (output.empty()) { output = arg; }
+    else { inputs.push_back(arg); }
+  }
+  if (output.empty() || inputs.empty()) {
+    std::fprintf(stderr, "usage: snakey_index [--threads N] OUT.idx REPLAY_OR_DIR...\n");
+    return 1;
+  }
+
+  std::vector<std::string> paths;
+  for (const std::string &input : inputs) {
+    std::error_code ec;
+    if (fs::is_directory(input, ec)) {
+      for (const auto &entry : fs::recursive_directory_iterator(input, ec)) {
+        if (entry.is_regular_file() && entry.path().extension() == ".snr") { paths.push_back(entry.path().string()); }
+      }
+    } else {
+      paths.push_back(input);
+    }
+  }
+  std::sort(paths.begin(), paths.end());
+
+  auto start = std::chrono::steady_clock::now();
+  std::vector<ReplayIndexColumns> parts(paths.size());
+  std::vector<std::string> errors(paths.size());
+  std::atomic<size_t> next{ 0 };
+  std::vector<std::thread> workers;
+  for (int t = 0; t < threads; ++t) {
+    workers.emplace_back([&]() {
+      for (size_t i = next++; i < paths.size(); i = next++) {
+        if (!index_replay(paths[i], parts[i], &errors[i]) && errors[i].empty()) { errors[i] = "unreadable"; }
+      }
+    });
+  }
+  for (auto &worker : workers) { worker.join(); }
+
+  // Merge in path order so the index does not depend on scheduling
+  ReplayIndexColumns columns;
+  size_t skipped = 0;
+  for (size_t i = 0; i < paths.size(); ++i) {
+    if (!errors[i].empty()) {
+      std::fprintf(stderr, "skipping %s: %s\n", paths[i].c_str(), errors[i].c_str());
+      ++skipped;
+      continue;
+    }
+    columns.append(parts[i]);
+  }
+  if (!write_replay_index(columns, output)) {
+    std::fprintf(stderr, "failed to write %s\n", output.c_str());
+    return 1;
+  }
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  std::printf("indexed %zu replays (%zu skipped): %zu game rows, %zu tick rows in %.2fs\n",
+              paths.size() - skipped, skipped, columns.game_tick_rate.size(), columns.tick_game.size(), seconds);
+  return 0;
+}
@@ -0,0 +1,169 @@
+#include "infinite.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+ChunkPool::~ChunkPool() {
+  for (OccupancyChunk *chunk : spare) { delete chunk; }
+}
+
+OccupancyChunk *ChunkPool::acquire(int32_t x, int32_t y) {
+  OccupancyChunk *chunk;
+  if (spare.empty()) {
+    chunk = new OccupancyChunk;
+  } else {
+    chunk = spare.back();
+    spare.pop_back();
+  }
+  std::memset(chunk->rows, 0, sizeof(chunk->rows));
+  chunk->x = x;
+  chunk->y = y;
+  chunk->population = 0;
+  return chunk;
+}
+
+void ChunkPool::release(OccupancyChunk *chunk) {
+  if (spare.size() < MAX_SPARE) { spare.push_back(chunk); }
+  else { delete chunk; }
+}
+
+SparseOccupancy::~SparseOccupancy() {
+  for (auto &[key, chunk] : chunks) { delete chunk; }
+}
+
+OccupancyChunk *SparseOccupancy::find(Point p) const {
+  int32_t cx = p.x >> CHUNK_SHIFT, cy = p.y >> CHUNK_SHIFT;
+  if (last && last->x == cx && last->y == cy) { return last; }
+  auto found = chunks.find(key(cx, cy));
+  if (found == chunks.end()) { return nullptr; }
+  last = found->second;
+  return last;
+}
+
+bool SparseOccupancy::test(Point p) const {
+  const OccupancyChunk *chunk = find(p);
+  return chunk && (chunk->rows[p.y & (CHUNK_SIZE - 1)] >> (p.x & (CHUNK_SIZE - 1)) & 1);
+}
+
+void SparseOccupancy::set(Point p) {
+  OccupancyChunk *chunk = find(p);
+  if (!chunk) {
+    chunk = pool.acquire(p.x >> CHUNK_SHIFT, p.y >> CHUNK_SHIFT);
+    chunks.emplace(key(chunk->x, chunk->y), chunk);
+    last = chunk;
+  }
+  uint64_t &row = chunk->rows[p.y & (CHUNK_SIZE - 1)];
+  uint64_t bit = uint64_t(1) << (p.x & (CHUNK_SIZE - 1));
+  if (!(row & bit)) {
+    row |= bit;
+    ++chunk->population;
+  }
+}
+
+void SparseOccupancy::clear(Point p) {
+  OccupancyChunk *chunk = find(p);
+  if (!chunk) { return; }
+  uint64_t &row = chunk->rows[p.y & (CHUNK_SIZE - 1)];
+  uint64_t bit = uint64_t(1) << (p.x & (CHUNK_SIZE - 1));
+  if (!(row & bit)) { return; }
+  row &= ~bit;
+  if (--chunk->population == 0) {
+    chunks.erase(key(chunk->x, chunk->y));
+    if (last == chunk) { last = nullptr; }
+    pool.release(chunk);
+  }
+}
+
+InfiniteWorld::InfiniteWorld(const Rules &rules, uint64_t seed, bool endless)
+  : rules(rules),
+    endless(endless),
+    bounds{ { -rules.width / 2, -rules.height / 2 },
+            { rules.width - rules.width / 2 - 1, rules.height - rules.height / 2 - 1 } },
+    seed(seed),
+    random_engine(seed),
+    food{ 0, 0 }
+{
+  for (int i = 0; i < std::max(1, rules.initial_length); ++i) {
+    body.push_back({ -i, 0 });
+    occupancy.set(body.back());
+  }
+  respawn_food();
+}
+
+void InfiniteWorld::set_direction(Direction new_direction) {
+  if (is_opposite(direction, new_direction)) { return; }
+  direction = new_direction;
+}
+
+bool InfiniteWorld::is_over() const {
+  if (rules.max_ticks > 0 && tick >= static_cast<uint32_t>(rules.max_ticks)) { return true; }
+  return death_cause != DeathCause::None;
+}
+
+void InfiniteWorld::step() {
+  if (is_over()) { return; }
+  if (endless) { grow_bounds(); }
+  Point head = step_towards(body.front(), direction);
+  if (endless && !bounds.contains(head)) {
+    if (!rules.wrapping) {
+      death_cause = DeathCause::Wall;
+      ++tick;
+      return;
+    }
+    if (head.x < bounds.min.x) { head.x = bounds.max.x; }
+    else if (head.x > bounds.max.x) { head.x = bounds.min.x; }
+    if (head.y < bounds.min.y) { head.y = bounds.max.y; }
+    else if (head.y > bounds.max.y) { head.y = bounds.min.y; }
+  }
+  if (!growing) {
+    occupancy.clear(body.back());
+    body.pop_back();
+  }
+  growing = false;
+  body.push_front(head);
+  if (occupancy.test(head)) {
+    death_cause = DeathCause::Self;
+  } else {
+    occupancy.set(head);
+    if (rules.starvation_ticks > 0 && tick - last_meal >= static_cast<uint32_t>(rules.starvation_ticks)) {
+      death_cause = DeathCause::Starved;
+    } else if (head.x == food.x && head.y == food.y) {
+      growing = true;
+      last_meal = tick;
+      respawn_food();
+    }
+  }
+  ++tick;
+}
+
+void InfiniteWorld::grow_bounds() {
+  if (bounds.area() >= int64_t(get_length()) * GROWTH_FACTOR) { return; }
+  switch (next_edge) {
+    case 0: ++bounds.max.x; break;
+    case 1: ++bounds.max.y; break;
+    case 2: --bounds.min.x; break;
+    case 3: --bounds.min.y; break;
+  }
+  next_edge = (next_edge + 1) % 4;
+}
+
+void InfiniteWorld::respawn_food() {
+  // Widen the search if the neighbourhood is crowded with body
+  Point head = body.front();
+  for (int range = FOOD_RANGE;; range *= 2) {
+    Point min = { head.x - range, head.y - range };
+    Point max = { head.x + range, head.y + range };
+    if (endless) {
+      min = { std::max(min.x, bounds.min.x), std::max(min.y, bounds.min.y) };
+      max = { std::min(max.x, bounds.max.x), std::min(max.y, bounds.max.y) };
+    }
+    for (int attempt = 0; attempt < 64; ++attempt) {
+      Point p = { min.x + static_cast<int>(random_engine() % static_cast<uint64_t>(max.x - min.x + 1)),
+                  min.y + static_cast<int>(random_engine() % static_cast<uint64_t>(max.y - min.y + 1)) };
+      if (!occupancy.test(p)) {
+        food = p;
+        return;
+      }
+    }
+  }
+}
@@ -0,0 +1,149 @@
+#pragma once
+
+// Unbounded board.
+// Coordinates may grow in every direction, so occupancy cannot be one flat
+// array. It is kept as 64x64 bitset chunks in a hash map instead: a chunk
+// is taken from a pool the first time one of its cells is covered and
+// handed back once its last cell is freed, so memory follows the snake's
+// footprint rather than the distance it has travelled.
+
+#include "core.hpp"
+
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <random>
+#include <unordered_map>
+#include <vector>
+
+constexpr int CHUNK_SHIFT = 6;
+constexpr int CHUNK_SIZE  = 1 << CHUNK_SHIFT;
+
+struct OccupancyChunk {
+  uint64_t rows[CHUNK_SIZE];  // Bit x of row y covers cell (x, y) of the chunk
+  int32_t x;                  // Chunk coordinates, cell coordinates >> CHUNK_SHIFT
+  int32_t y;
+  uint32_t population;        // Cells set
+};
+
+// Hands out zeroed chunks, keeping a few released ones for reuse
+class ChunkPool {
+public:
+  ~ChunkPool();
+
+  OccupancyChunk *acquire(int32_t x, int32_t y);
+  void release(OccupancyChunk *chunk);
+
+  size_t spare_count() const { return spare.size(); }
+
+private:
+  static constexpr size_t MAX_SPARE = 64;
+  std::vector<OccupancyChunk *> spare;
+};
+
+class SparseOccupancy {
+public:
+  SparseOccupancy() = default;
+  ~SparseOccupancy();
+  SparseOccupancy(const SparseOccupancy &) = delete;
+  SparseOccupancy &operator=(const SparseOccupancy &) = delete;
+
+  bool test(Point p) const;
+  void set(Point p);
+  void clear(Point p);
+
+  size_t resident_chunks() const { return chunks.size(); }
+  size_t spare_chunks() const { return pool.spare_count(); }
+  size_t memory_bytes() const { return (resident_chunks() + spare_chunks()) * sizeof(OccupancyChunk); }
+
+  // Calls `visit(chunk)` for every resident chunk overlapping the cells
+  // from `min` to `max` inclusive
+  template <typename Visit>
+  void for_each_chunk_in(Point min, Point max, Visit visit) const {
+    for (int32_t cy = min.y >> CHUNK_SHIFT; cy <= max.y >> CHUNK_SHIFT; ++cy) {
+      for (int32_t cx = min.x >> CHUNK_SHIFT; cx <= max.x >> CHUNK_SHIFT; ++cx) {
+        auto found = chunks.find(key(cx, cy));
+        if (found != chunks.end()) { visit(*found->second); }
+      }
+    }
+  }
+
+private:
+  static uint64_t key(int32_t cx, int32_t cy) {
+    return (uint64_t(uint32_t(cx)) << 32) | uint32_t(cy);
+  }
+  OccupancyChunk *find(Point p) const;
+
+  std::unordered_map<uint64_t, OccupancyChunk *> chunks;
+  // The snake mostly touches the chunk it touched last
+  mutable OccupancyChunk *last = nullptr;
+  ChunkPool pool;
+};
+
+// Walls of an endless board, inclusive
+struct BoardBounds {
+  Point min;
+  Point max;
+
+  bool contains(Point p) const { return p.x >= min.x && p.x <= max.x && p.y >= min.y && p.y <= max.y; }
+  int64_t area() const { return int64_t(max.x - min.x + 1) * (max.y - min.y + 1); }
+};
+
+// A single snake on an unbounded board. Food appears within FOOD_RANGE
+// cells of the head; without walls the snake only dies by running into
+// itself or starving.
+//
+// In endless mode the board starts at the usual size around the origin and
+// its walls move outwards as the snake gets longer, keeping at least
+// GROWTH_FACTOR cells per segment. The walls move one edge per tick, so no
+// tick pays for more than a single row or column. Cells keep their
+// coordinates when the board grows and occupancy is chunked, so nothing is
+// copied or remapped. The body is a deque for the same reason: it grows a
+// block at a time instead of reallocating.
+class InfiniteWorld {
+public:
+  static constexpr int FOOD_RANGE = 12;
+  static constexpr int GROWTH_FACTOR = 4;
+
+  InfiniteWorld(const Rules &rules, uint64_t seed, bool endless = false);
+
+  void set_direction(Direction direction);
+  // Only matters for an endless board, whose edge either wraps or kills
+  void set_wrapping(bool wrapping) { rules.wrapping = wrapping; }
+  void step();
+  bool is_over() const;
+
+  const Rules &get_rules() const { return rules; }
+  uint64_t get_seed() const { return seed; }
+
+  Point get_head() const { return body.front(); }
+  int get_length() const { return static_cast<int>(body.size()); }
+  Direction get_direction() const { return direction; }
+  const Point &get_food() const { return food; }
+  uint32_t get_tick() const { return tick; }
+  DeathCause get_death_cause() const { return death_cause; }
+  const SparseOccupancy &get_occupancy() const { return occupancy; }
+  bool is_blocked(Point p) const { return (endless && !bounds.contains(p)) || occupancy.test(p); }
+
+  bool is_endless() const { return endless; }
+  const BoardBounds &get_bounds() const { return bounds; }
+
+private:
+  void grow_bounds();
+  void respawn_food();
+
+  Rules rules;
+  bool endless;
+  BoardBounds bounds;
+  uint64_t seed;
+  std::mt19937_64 random_engine;
+  std::deque<Point> body;  // Head first
+  Direction direction = Direction::Right;
+  bool growing = false;    // Keep the tail on the next move
+  SparseOccupancy occupancy;
+  Point food;
+  uint32_t tick = 0;
+  uint32_t last_meal = 0;
+  int next_edge = 0;       // Edge the walls move out on next
+  DeathCause death_cause = DeathCause::None;
+};
@@ -0,0 +1,228 @@
+// snakey_ipc_bench: compares ways of handing the game to an agent process.
+//
+//   snakey_ipc_bench [--steps N] [--transport shm,pipe] [--seed N]
+//
+// A forked child plays the part of the agent. For every step the game
+// publishes the state of a real game, the agent reads it and answers with a
+// direction, and the game waits for the answer before stepping. The shm
+// transport uses ShmChannel; the pipe transport sends the same ShmState and
+// ShmAction through a pair of pipes. Round trips are timed on the game side.
+
+#include "shm_channel.hpp"
+#include "util.hpp"
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+constexpr int64_t AGENT_TIMEOUT_US = 2000000;
+
+// Answers with the direction the snake already has, turning now and then so
+// the game keeps changing
+Direction agent_policy(const ShmState &state) {
+  Direction direction = static_cast<Direction>(state.direction);
+  if (state.tick % 17 != 16) { return direction; }
+  return direction == Direction::Up || direction == Direction::Down ? Direction::Right : Direction::Down;
+}
+
+bool read_all(int fd, void *data, size_t size) {
+  auto *bytes = static_cast<char *>(data);
+  while (size > 0) {
+    ssize_t n = read(fd, bytes, size);
+    if (n <= 0) { return false; }
+    bytes += n;
+    size -= static_cast<size_t>(n);
+  }
+  return true;
+}
+
+bool write_all(int fd, const void *data, size_t size) {
+  auto *bytes = static_cast<const char *>(data);
+  while (size > 0) {
+    ssize_t n = write(fd, bytes, size);
+    if (n <= 0) { return false; }
+    bytes += n;
+    size -= static_cast<size_t>(n);
+  }
+  return true;
+}
+
+// The game half of a transport
+class Transport {
+public:
+  virtual ~Transport() = default;
+  virtual bool exchange(const ShmState &state, Direction &answer) = 0;
+};
+
+class ShmTransport : public Transport {
+public:
+  explicit ShmTransport(std::unique_ptr<ShmChannel> channel) : channel(std::move(channel)) {}
+
+  bool exchange(const ShmState &state, Direction &answer) override {
+    channel->publish(state);
+    return channel->take_action(state.tick, answer, AGENT_TIMEOUT_US);
+  }
+
+private:
+  std::unique_ptr<ShmChannel> channel;
+};
+
+class PipeTransport : public Transport {
+public:
+  PipeTransport(int to_agent, int from_agent) : to_agent(to_agent), from_agent(from_agent) {}
+  ~PipeTransport() override {
+    close(to_agent);
+    close(from_agent);
+  }
+
+  bool exchange(const ShmState &state, Direction &answer) override {
+    ShmAction action;
+    if (!write_all(to_agent, &state, sizeof(state)) || !read_all(from_agent, &action, sizeof(action))) { return false; }
+    answer = static_cast<Direction>(action.direction);
+    return true;
+  }
+
+private:
+  int to_agent;
+  int from_agent;
+};
+
+void run_shm_agent(const std::string &name, uint64_t steps) {
+  std::string error;
+  auto channel = ShmChannel::attach(name, &error);
+  if (!channel) { std::fprintf(stderr, "agent: %s\n", error.c_str()); _exit(1); }
+  ShmState state;
+  uint32_t sequence = 0;
+  for (uint64_t i = 0; i < steps; ++i) {
+    if (!channel->read_state(state, &sequence, AGENT_TIMEOUT_US)) { _exit(1); }
+    while (!channel->send_action(state.tick, agent_policy(state))) {}
+  }
+  _exit(0);
+}
+
+void run_pipe_agent(int from_game, int to_game, uint64_t steps) {
+  ShmState state;
+  for (uint64_t i = 0; i < steps; ++i) {
+    if (!read_all(from_game, &state, sizeof(state))) { _exit(1); }
+    ShmAction action = { state.tick, static_cast<uint32_t>(agent_policy(state)) };
+    if (!write_all(to_game, &action, sizeof(action))) { _exit(1); }
+  }
+  _exit(0);
+}
+
+struct Result {
+  uint64_t steps = 0;
+  double seconds = 0.0;
+  std::vector<uint64_t> round_trip_ns;
+};
+
+bool play(Transport &transport, uint64_t steps, uint64_t seed, Result &result) {
+  Rules rules;
+  World world(rules, seed);
+  ShmState state{};
+  uint32_t game = 0;
+  result.round_trip_ns.reserve(steps);
+  auto start = Clock::now();
+  for (uint64_t i = 0; i < steps; ++i) {
+    if (world.is_over()) { world = World(rules, seed + ++game); }
+    auto sent = Clock::now();
+    ShmChannel::fill_state(world, 0, game, state);
+    Direction answer;
+    if (!transport.exchange(state, answer)) { return false; }
+    result.round_trip_ns.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - sent).count());
+    world.set_direction(0, answer);
+    world.step();
+    ++result.steps;
+  }
+  result.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+  return true;
+}
+
+bool run_transport(const std::string &kind, uint64_t steps, uint64_t seed, Result &result) {
+  std::unique_ptr<Transport> transport;
+  pid_t child = -1;
+  if (kind == "shm") {
+    std::string name = "ipc-bench-" + std::to_string(getpid());
+    std::string error;
+    auto channel = ShmChannel::create(name, &error);
+    if (!channel) { std::fprintf(stderr, "%s\n", error.c_str()); return false; }
+    child = fork();
+    if (child == 0) { run_shm_agent(name, steps); }
+    transport = std::make_unique<ShmTransport>(std::move(channel));
+  } else if (kind == "pipe") {
+    int to_agent[2];
+    int from_agent[2];
+    if (pipe(to_agent) != 0 || pipe(from_agent) != 0) { std::perror("pipe"); return false; }
+    child = fork();
+    if (child == 0) {
+      close(to_agent[1]);
+      close(from_agent[0]);
+      run_pipe_agent(to_agent[0], from_agent[1], steps);
+    }
+    close(to_agent[0]);
+    close(from_agent[1]);
+    transport = std::make_unique<PipeTransport>(to_agent[1], from_agent[0]);
+  } else {
+    std::fprintf(stderr, "unknown transport %s\n", kind.c_str());
+    return false;
+  }
+  if (child < 0) { std::perror("fork"); return false; }
+
+  bool ok = play(*transport, steps, seed, result);
+  transport.reset();
+  int status = 0;
+  waitpid(child, &status, 0);
+  return ok && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+void print_result(const std::string &kind, Result &result) {
+  auto &samples = result.round_trip_ns;
+  std::sort(samples.begin(), samples.end());
+  auto percentile = [&](double p) {
+    return samples.empty() ? 0.0 : samples[std::min(samples.size() - 1, size_t(p * samples.size()))] / 1000.0;
+  };
+  std::printf("%-5s %10llu %12.0f %9.2f %9.2f %9.2f %9.2f\n", kind.c_str(), (unsigned long long)result.steps,
+              result.seconds > 0 ? result.steps / result.seconds : 0.0, percentile(0.5), percentile(0.9),
+              percentile(0.99), samples.empty() ? 0.0 : samples.back() / 1000.0);
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  uint64_t steps = 100000;
+  uint64_t seed = 1;
+  std::vector<std::string> transports = { "shm", "pipe" };
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    bool has_value = i + 1 < argc;
+    if (arg == "--steps" && has_value) { steps = std::strtoull(argv[++i], nullptr, 10); }
+    else if (arg == "--transport" && has_value) { transports = split(argv[++i]); }
+    else if (arg == "--seed" && has_value) { seed = std::strtoull(argv[++i], nullptr, 10); }
+    else {
+      std::fprintf(stderr, "usage: %s [--steps N] [--transport shm,pipe] [--seed N]\n", argv[0]);
+      return 1;
+    }
+  }
+
+  std::printf("state %zu bytes, action %zu bytes\n", sizeof(ShmState), sizeof(ShmAction));
+  std::printf("%-5s %10s %12s %9s %9s %9s %9s\n", "", "steps", "steps/s", "p50 us", "p90 us", "p99 us", "max us");
+  for (const std::string &kind : transports) {
+    Result result;
+    if (!run_transport(kind, steps, seed, result)) {
+      std::fprintf(stderr, "%s: the agent did not keep up\n", kind.c_str());
+      return 1;
+    }
+    print_result(kind, result);
+  }
+  return 0;
+}
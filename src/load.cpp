@@ -0,0 +1,579 @@
+// snakey_load: puts a snakey_server under synthetic load from one machine.
+//
+//   snakey_load [--address A] [--port N] [--clients N] [--ramp SECONDS:CLIENTS,...]
+//               [--tick-rate MS[,MS...]] [--bot NAME] [--seed N]
+//               [--duration SECONDS] [--report SECONDS]
+//
+// Every client joins with the next tick rate from the list and plays its
+// game with a bot. The server only sends the head, food and length, so each
+// client mirrors its game locally from the seed and the acked inputs, lets
+// the bot choose on the mirror and checks every tick against it; a mismatch
+// counts as a desync and the client reconnects.
+//
+// Without --ramp all clients connect at once. A ramp is a list of points
+// the number of connected clients is interpolated between, starting from
+// none at 0s; `10:1000,40:1000,60:5000` climbs to 1000 clients in 10s,
+// holds them for 30s and then climbs to 5000. Clients above the target
+// leave. The run lasts until the last point, or 30s without a ramp.
+//
+// Reported as histograms: input-to-ack latency (an input sent right after a
+// tick is acked by the next one, so expect about one tick period), tick
+// jitter (how far the gap between two ticks is from the tick rate) and the
+// time from connecting to being joined.
+
+#include "bots.hpp"
+#include "histogram.hpp"
+#include "net_protocol.hpp"
+#include "util.hpp"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+constexpr int MAX_EVENTS = 512;
+constexpr int WAIT_MS = 10;
+// Connects started per pass of the loop, so a big step in the ramp does not
+// starve the clients already playing
+constexpr int CONNECTS_PER_PASS = 64;
+constexpr size_t READ_BYTES = 4096;
+constexpr size_t PENDING_INPUTS = 64;
+
+volatile std::sig_atomic_t interrupted = 0;
+
+void handle_signal(int) { interrupted = 1; }
+
+struct RampPoint {
+  double seconds;
+  size_t clients;
+};
+
+bool parse_ramp(const std::string &text, std::vector<RampPoint> &ramp) {
+  ramp.clear();
+  for (const std::string &part : split(text)) {
+    size_t colon = part.find(':');
+    if (colon == std::string::npos) { return false; }
+    RampPoint point{ std::atof(part.substr(0, colon).c_str()),
+                     std::strtoull(part.substr(colon + 1).c_str(), nullptr, 10) };
+    if (point.seconds < 0 || (!ramp.empty() && point.seconds < ramp.back().seconds)) { return false; }
+    ramp.push_back(point);
+  }
+  return !ramp.empty();
+}
+
+size_t ramp_target(const std::vector<RampPoint> &ramp, double seconds) {
+  RampPoint from{ 0.0, 0 };
+  for (const RampPoint &to : ramp) {
+    if (seconds < to.seconds) {
+      double share = (seconds - from.seconds) / (to.seconds - from.seconds);
+      return static_cast<size_t>(double(from.clients) + share * (double(to.clients) - double(from.clients)));
+    }
+    from = to;
+  }
+  return from.clients;
+}
+
+enum class ClientState {
+  Free,
+  Connecting,
+  Joining,
+  Playing
+};
+
+struct PendingInput {
+  uint32_t sequence = 0;
+  Direction direction = Direction::Right;
+  uint64_t sent_us = 0;
+};
+
+struct Client {
+  uint32_t id = 0;
+  uint32_t generation = 0;
+  int fd = -1;
+  ClientState state = ClientState::Free;
+  bool watching_writes = false;
+  uint16_t tick_rate_ms = 0;
+  uint64_t seed = 0;
+  uint64_t connect_us = 0;
+  uint64_t last_tick_us = 0;
+  Rules rules;
+  std::optional<World> world;
+  std::unique_ptr<Bot> bot;
+  uint32_t game = 0;
+  uint32_t acked = 0;
+  uint32_t next_sequence = 1;
+  std::array<PendingInput, PENDING_INPUTS> pending;
+  std::string received;
+  std::string output;
+
+  uint64_t tag() const { return uint64_t(generation) << 32 | id; }
+};
+
+// Counts since the last report
+struct LoadStats {
+  uint64_t connected = 0;
+  uint64_t left = 0;
+  uint64_t failed = 0;    // Connect errors and connections the server dropped
+  uint64_t refused = 0;
+  uint64_t desynced = 0;
+  uint64_t ticks = 0;
+  uint64_t inputs = 0;
+  uint64_t games = 0;
+  uint64_t bytes_in = 0;
+  uint64_t bytes_out = 0;
+  Histogram ack_us;
+  Histogram jitter_us;
+  Histogram join_us;
+
+  void merge(const LoadStats &other) {
+    connected += other.connected;
+    left += other.left;
+    failed += other.failed;
+    refused += other.refused;
+    desynced += other.desynced;
+    ticks += other.ticks;
+    inputs += other.inputs;
+    games += other.games;
+    bytes_in += other.bytes_in;
+    bytes_out += other.bytes_out;
+    ack_us.merge(other.ack_us);
+    jitter_us.merge(other.jitter_us);
+    join_us.merge(other.join_us);
+  }
+};
+
+struct LoadOptions {
+  sockaddr_in address{};
+  std::vector<uint16_t> tick_rates{ 100 };
+  std::string bot = "random";
+  uint64_t seed = 1;
+};
+
+class LoadGenerator {
+public:
+  explicit LoadGenerator(LoadOptions options)
+    : options(std::move(options)), epoch(Clock::now()), epoll_fd(epoll_create1(EPOLL_CLOEXEC)) {}
+
+  ~LoadGenerator() {
+    for (auto &client : clients) {
+      if (client->fd >= 0) { close(client->fd); }
+    }
+    if (epoll_fd >= 0) { close(epoll_fd); }
+  }
+
+  bool is_ready() const { return epoll_fd >= 0; }
+
+  uint64_t now_us() const {
+    return std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - epoch).count();
+  }
+
+  size_t get_open() const { return open; }
+  LoadStats &get_stats() { return stats; }
+
+  // Connects or drops clients towards `target`, then handles one batch of
+  // events
+  void poll(size_t target) {
+    for (int i = 0; i < CONNECTS_PER_PASS && open < target; ++i) { connect_client(); }
+    while (open > target) { leave(last_open()); }
+
+    epoll_event events[MAX_EVENTS];
+    int count = epoll_wait(epoll_fd, events, MAX_EVENTS, WAIT_MS);
+    for (int i = 0; i < count; ++i) {
+      const epoll_event &event = events[i];
+      Client &client = *clients[static_cast<uint32_t>(event.data.u64)];
+      if (client.fd < 0 || client.tag() != event.data.u64) { continue; }
+      if (client.state == ClientState::Connecting) {
+        connected(client, event.events);
+        continue;
+      }
+      if (event.events & EPOLLIN) { handle_readable(client); }
+      if (client.fd >= 0 && (event.events & (EPOLLERR | EPOLLHUP)) && !(event.events & EPOLLIN)) {
+        stats.failed++;
+        drop(client);
+      }
+      if (client.fd >= 0 && (event.events & EPOLLOUT)) { flush(client); }
+    }
+  }
+
+  void leave_all() {
+    while (open > 0) { leave(last_open()); }
+  }
+
+private:
+  void connect_client() {
+    Client *client = nullptr;
+    if (free_ids.empty()) {
+      clients.push_back(std::make_unique<Client>());
+      client = clients.back().get();
+      client->id = static_cast<uint32_t>(clients.size() - 1);
+    } else {
+      client = clients[free_ids.back()].get();
+      free_ids.pop_back();
+    }
+    open++;
+    client->state = ClientState::Connecting;
+    client->connect_us = now_us();
+    client->tick_rate_ms = options.tick_rates[started % options.tick_rates.size()];
+    client->seed = options.seed + started * 1000003;
+    started++;
+
+    client->fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (client->fd < 0) {
+      stats.failed++;
+      release(*client);
+      return;
+    }
+    int on = 1;
+    setsockopt(client->fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    const auto *address = reinterpret_cast<const sockaddr *>(&options.address);
+    if (connect(client->fd, address, sizeof(options.address)) != 0 && errno != EINPROGRESS) {
+      stats.failed++;
+      drop(*client);
+      return;
+    }
+    epoll_event event{};
+    event.events = EPOLLOUT;
+    event.data.u64 = client->tag();
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, client->fd, &event);
+  }
+
+  void connected(Client &client, uint32_t events) {
+    int error = 0;
+    socklen_t length = sizeof(error);
+    getsockopt(client.fd, SOL_SOCKET, SO_ERROR, &error, &length);
+    if (error != 0 || (events & EPOLLERR)) {
+      stats.failed++;
+      drop(client);
+      return;
+    }
+    client.state = ClientState::Joining;
+    epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.u64 = client.tag();
+    epoll_ctl(epoll_fd, EPOLL_CTL_MOD, client.fd, &event);
+    put_join(client.output, { client.tick_rate_ms, true, client.seed });
+    flush(client);
+  }
+
+  void handle_readable(Client &client) {
+    char buffer[READ_BYTES];
+    for (;;) {
+      ssize_t n = recv(client.fd, buffer, sizeof(buffer), 0);
+      if (n > 0) {
+        client.received.append(buffer, static_cast<size_t>(n));
+        stats.bytes_in += static_cast<uint64_t>(n);
+        continue;
+      }
+      if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) { break; }
+      if (n < 0 && errno == EINTR) { continue; }
+      stats.failed++;
+      drop(client);
+      return;
+    }
+
+    size_t offset = 0;
+    const uint64_t now = now_us();
+    while (client.fd >= 0) {
+      NetFrame frame;
+      const auto *data = reinterpret_cast<const uint8_t *>(client.received.data());
+      ptrdiff_t taken = next_frame(data + offset, client.received.size() - offset, frame);
+      if (taken == 0) { break; }
+      if (taken < 0 || !handle_message(client, frame, now)) { return; }
+      offset += static_cast<size_t>(taken);
+    }
+    if (client.fd >= 0) { client.received.erase(0, offset); }
+    if (client.fd >= 0) { flush(client); }
+  }
+
+  // False once the client is gone
+  bool handle_message(Client &client, const NetFrame &frame, uint64_t now) {
+    JoinedMessage joined;
+    TickMessage tick;
+    if (client.state == ClientState::Joining && get_joined(frame, joined)) {
+      client.state = ClientState::Playing;
+      client.rules = net_session_rules(joined.tick_rate_ms, true);
+      client.world.emplace(client.rules, client.seed);
+      client.bot = make_bot(options.bot);
+      client.last_tick_us = now;
+      stats.join_us.add(now - client.connect_us);
+      stats.connected++;
+      return true;
+    }
+    if (client.state == ClientState::Playing && get_tick(frame, tick)) {
+      play_tick(client, tick, now);
+      return client.fd >= 0;
+    }
+    if (frame.type == NetMessage::Refused) {
+      stats.refused++;
+    } else {
+      stats.failed++;
+    }
+    drop(client);
+    return false;
+  }
+
+  void play_tick(Client &client, const TickMessage &tick, uint64_t now) {
+    stats.ticks++;
+    const uint64_t gap = now - client.last_tick_us;
+    const uint64_t period = uint64_t(client.rules.tick_rate_ms) * 1000;
+    stats.jitter_us.add(gap > period ? gap - period : period - gap);
+    client.last_tick_us = now;
+
+    // Replay on the mirror what the server applied before this tick
+    World &world = *client.world;
+    if (tick.acked != client.acked) {
+      const PendingInput &input = client.pending[tick.acked % PENDING_INPUTS];
+      if (input.sequence != tick.acked) {
+        desync(client);
+        return;
+      }
+      stats.ack_us.add(now - input.sent_us);
+      world.set_direction(0, input.direction);
+      client.acked = tick.acked;
+    }
+    world.step();
+    const Snake &snake = world.get_snake(0);
+    if (tick.game != client.game || tick.tick != world.get_tick() || tick.head_x != snake.get_head().x ||
+        tick.head_y != snake.get_head().y || tick.length != snake.get_length() ||
+        tick.death_cause != world.get_death_cause(0)) {
+      desync(client);
+      return;
+    }
+    if (world.is_over()) {
+      stats.games++;
+      client.world.emplace(client.rules, client.seed + ++client.game);
+      client.bot = make_bot(options.bot);
+    } else {
+      client.bot->on_tick(world, 0);
+    }
+
+    PendingInput &input = client.pending[client.next_sequence % PENDING_INPUTS];
+    input.sequence = client.next_sequence++;
+    input.direction = client.bot->choose(*client.world, 0);
+    input.sent_us = now;
+    put_input(client.output, { input.sequence, input.direction });
+    stats.inputs++;
+  }
+
+  void desync(Client &client) {
+    stats.desynced++;
+    drop(client);
+  }
+
+  void flush(Client &client) {
+    while (!client.output.empty()) {
+      ssize_t n = send(client.fd, client.output.data(), client.output.size(), MSG_NOSIGNAL | MSG_DONTWAIT);
+      if (n > 0) {
+        client.output.erase(0, static_cast<size_t>(n));
+        stats.bytes_out += static_cast<uint64_t>(n);
+        continue;
+      }
+      if (n < 0 && errno == EINTR) { continue; }
+      if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+        watch_writable(client, true);
+        return;
+      }
+      stats.failed++;
+      drop(client);
+      return;
+    }
+    watch_writable(client, false);
+  }
+
+  void watch_writable(Client &client, bool writable) {
+    if (client.watching_writes == writable) { return; }
+    epoll_event event{};
+    event.events = writable ? EPOLLIN | EPOLLOUT : EPOLLIN;
+    event.data.u64 = client.tag();
+    epoll_ctl(epoll_fd, EPOLL_CTL_MOD, client.fd, &event);
+    client.watching_writes = writable;
+  }
+
+  Client &last_open() {
+    for (size_t i = clients.size(); i-- > 0;) {
+      if (clients[i]->state != ClientState::Free) { return *clients[i]; }
+    }
+    return *clients.front();
+  }
+
+  void leave(Client &client) {
+    if (client.state == ClientState::Playing) {
+      put_leave(client.output);
+      send(client.fd, client.output.data(), client.output.size(), MSG_NOSIGNAL | MSG_DONTWAIT);
+    }
+    stats.left++;
+    drop(client);
+  }
+
+  void drop(Client &client) {
+    if (client.fd >= 0) {
+      epoll_ctl(epoll_fd, EPOLL_CTL_DEL, client.fd, nullptr);
+      close(client.fd);
+    }
+    release(client);
+  }
+
+  void release(Client &client) {
+    client.fd = -1;
+    client.state = ClientState::Free;
+    client.watching_writes = false;
+    client.world.reset();
+    client.bot.reset();
+    client.game = 0;
+    client.acked = 0;
+    client.next_sequence = 1;
+    client.pending.fill(PendingInput());
+    client.received.clear();
+    client.output.clear();
+    client.generation++;
+    free_ids.push_back(client.id);
+    open--;
+  }
+
+  LoadOptions options;
+  Clock::time_point epoch;
+  int epoll_fd;
+  std::vector<std::unique_ptr<Client>> clients;
+  std::vector<uint32_t> free_ids;
+  size_t open = 0;
+  uint64_t started = 0;
+  LoadStats stats;
+};
+
+void raise_file_limit() {
+  rlimit limit;
+  if (getrlimit(RLIMIT_NOFILE, &limit) != 0) { return; }
+  limit.rlim_cur = limit.rlim_max;
+  setrlimit(RLIMIT_NOFILE, &limit);
+}
+
+void print_report(double at, size_t open, size_t target, const LoadStats &stats, double seconds) {
+  std::printf("[%5.0fs] %zu/%zu clients (+%llu -%llu, %llu failed, %llu refused, %llu desynced), %.0f ticks/s, "
+              "%.0f inputs/s, %.1f KB/s in\n",
+              at, open, target, (unsigned long long)stats.connected, (unsigned long long)stats.left,
+              (unsigned long long)stats.failed, (unsigned long long)stats.refused,
+              (unsigned long long)stats.desynced, stats.ticks / seconds, stats.inputs / seconds,
+              stats.bytes_in / seconds / 1024.0);
+  if (stats.ack_us.count() > 0) { std::printf("  ack    %s\n", stats.ack_us.summary(1000.0, "ms").c_str()); }
+  if (stats.jitter_us.count() > 0) { std::printf("  jitter %s\n", stats.jitter_us.summary(1000.0, "ms").c_str()); }
+  std::fflush(stdout);
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  LoadOptions options;
+  std::string address = "127.0.0.1";
+  int port = 7777;
+  std::vector<RampPoint> ramp{ { 0.0, 1000 } };
+  bool has_ramp = false;
+  double duration = -1.0;
+  int report_seconds = 5;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    bool has_value = i + 1 < argc;
+    if (arg == "--address" && has_value) { address = argv[++i]; }
+    else if (arg == "--port" && has_value) { port = std::atoi(argv[++i]); }
+    else if (arg == "--clients" && has_value) { ramp = { { 0.0, std::strtoull(argv[++i], nullptr, 10) } }; }
+    else if (arg == "--ramp" && has_value && parse_ramp(argv[i + 1], ramp)) {
+      has_ramp = true;
+      ++i;
+    }
+    else if (arg == "--tick-rate" && has_value) {
+      options.tick_rates.clear();
+      for (const std::string &rate : split(argv[++i])) {
+        options.tick_rates.push_back(static_cast<uint16_t>(std::clamp(std::atoi(rate.c_str()), 1, 65535)));
+      }
+    }
+    else if (arg == "--bot" && has_value) { options.bot = argv[++i]; }
+    else if (arg == "--seed" && has_value) { options.seed = std::strtoull(argv[++i], nullptr, 10); }
+    else if (arg == "--duration" && has_value) { duration = std::atof(argv[++i]); }
+    else if (arg == "--report" && has_value) { report_seconds = std::max(1, std::atoi(argv[++i])); }
+    else {
+      std::fprintf(stderr, "usage: snakey_load [--address A] [--port N] [--clients N] [--ramp SECONDS:CLIENTS,...]\n"
+                           "                   [--tick-rate MS[,MS...]] [--bot NAME] [--seed N]\n"
+                           "                   [--duration SECONDS] [--report SECONDS]\n");
+      return 1;
+    }
+  }
+  if (options.tick_rates.empty()) {
+    std::fprintf(stderr, "no tick rates given\n");
+    return 1;
+  }
+  if (!make_bot(options.bot)) {
+    std::fprintf(stderr, "unknown bot '%s'\n", options.bot.c_str());
+    return 1;
+  }
+  if (is_single_instance_bot(options.bot)) {
+    std::fprintf(stderr, "%s plays one game at a time and cannot drive several clients\n", options.bot.c_str());
+    return 1;
+  }
+  options.address.sin_family = AF_INET;
+  options.address.sin_port = htons(static_cast<uint16_t>(port));
+  if (inet_pton(AF_INET, address.c_str(), &options.address.sin_addr) != 1) {
+    std::fprintf(stderr, "bad address '%s'\n", address.c_str());
+    return 1;
+  }
+  if (duration < 0) { duration = has_ramp ? ramp.back().seconds : 30.0; }
+
+  raise_file_limit();
+  LoadGenerator load(options);
+  if (!load.is_ready()) {
+    std::perror("epoll_create1");
+    return 1;
+  }
+  std::signal(SIGINT, handle_signal);
+  std::signal(SIGTERM, handle_signal);
+
+  LoadStats total;
+  const uint64_t report_us = uint64_t(report_seconds) * 1000000;
+  uint64_t next_report_us = report_us;
+  double seconds = 0.0;
+  size_t target = 0;
+  while (!interrupted && seconds < duration) {
+    target = ramp_target(ramp, seconds);
+    load.poll(target);
+    const uint64_t now = load.now_us();
+    seconds = now / 1e6;
+    if (now >= next_report_us) {
+      print_report(seconds, load.get_open(), target, load.get_stats(), report_seconds);
+      total.merge(load.get_stats());
+      load.get_stats() = LoadStats();
+      next_report_us += report_us;
+    }
+  }
+  load.leave_all();
+  total.merge(load.get_stats());
+
+  std::printf("\n%.1fs: %llu joins, %llu games, %llu ticks (%.0f/s), %llu inputs, %llu failed, %llu refused, "
+              "%llu desynced\n",
+              seconds, (unsigned long long)total.connected, (unsigned long long)total.games,
+              (unsigned long long)total.ticks, total.ticks / seconds, (unsigned long long)total.inputs,
+              (unsigned long long)total.failed, (unsigned long long)total.refused,
+              (unsigned long long)total.desynced);
+  std::printf("input to ack: %s\n", total.ack_us.summary(1000.0, "ms").c_str());
+  total.ack_us.print(stdout, 1000.0, "ms");
+  std::printf("tick jitter: %s\n", total.jitter_us.summary(1.0, "us").c_str());
+  total.jitter_us.print(stdout, 1.0, "us");
+  std::printf("connect to joined: %s\n", total.join_us.summary(1000.0, "ms").c_str());
+  return 0;
+}
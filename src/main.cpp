@@ -1,9 +1,27 @@
+#include "core.hpp"
+#include "infinite.hpp"
+#include "bots.hpp"
+#include "capture.hpp"
+#include "heatmap.hpp"
+#include "perf_counters.hpp"
+#include "bot_process.hpp"
+#include "plugin.hpp"
+#include "profiler.hpp"
+#include "watchdog.hpp"
+
 #include <raylib.h>
+#include <rlgl.h>
+#include <raymath.h>
+#include <cmath>
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
 #include <vector>
 #include <random>
 #include <chrono>
 #include <string>
 #include <algorithm>
+#include <memory>
 
 std::string key_code_to_string(int key) {
   switch (key) {
@@ -28,11 +46,16 @@ Color get_button_color(const Rectangle &rect) {
 
 // Constants
 constexpr int BLOCK_SIZE       = 20;
-constexpr int GRID_WIDTH       = 40;   // 800 / 20
-constexpr int GRID_HEIGHT      = 30;   // 600 / 20
 constexpr int SCREEN_WIDTH     = GRID_WIDTH * BLOCK_SIZE;
 constexpr int SCREEN_HEIGHT    = GRID_HEIGHT * BLOCK_SIZE;
 
+constexpr int TARGET_FPS       = 60;
+
+// Share of each frame an autopilot may spend thinking
+constexpr auto AUTOPILOT_FRAME_SLICE = std::chrono::microseconds(1000000 / TARGET_FPS / 2);
+// Frames longer than this count as overruns for the watchdog
+constexpr double FRAME_BUDGET_MS = 2 * 1000.0 / TARGET_FPS;
+
 constexpr int BUTTON_WIDTH     = 200;
 constexpr int BUTTON_HEIGHT    = 50;
 
@@ -48,17 +71,34 @@ enum class GameState {
   GameOver
 };
 
-struct Point {
-  int x;
-  int y;
-};
+// Tags for the sampling profiler
+const char *game_state_name(GameState state) {
+  switch (state) {
+    case GameState::StartMenu:       return "StartMenu";
+    case GameState::Settings:        return "Settings";
+    case GameState::Keybinds:        return "Keybinds";
+    case GameState::Countdown:       return "Countdown";
+    case GameState::Playing:         return "Playing";
+    case GameState::Pause:           return "Pause";
+    case GameState::ConfirmRestart:  return "ConfirmRestart";
+    case GameState::ConfirmMainMenu: return "ConfirmMainMenu";
+    case GameState::GameOver:        return "GameOver";
+  }
+  return "Unknown";
+}
 
-enum class Direction {
-  Up,
-  Down,
-  Left,
-  Right
-};
+// Writes the stacks sampled so far and says where they went
+void write_profile(const std::string &path) {
+  std::string error;
+  if (!profiler_write_folded(path, &error)) {
+    std::fprintf(stderr, "%s\n", error.c_str());
+    return;
+  }
+  ProfilerStats stats = profiler_stats();
+  std::printf("profile: %llu samples (%llu dropped) in %llu stacks written to %s\n",
+              (unsigned long long)stats.samples, (unsigned long long)stats.dropped,
+              (unsigned long long)stats.stacks, path.c_str());
+}
 
 // Structure for key bindings
 struct KeyBindings {
@@ -79,106 +119,258 @@ struct KeyBindings {
   }
 };
 
-// The Snake
-class Snake {
+// Snake skin
+// Every sprite lives in a single atlas texture, so the whole body goes out
+// in one batched draw call
+class SnakeSkin {
 public:
-  Snake()
-    : current_direction(Direction::Right),
-      grow_snake(false)
-  {
-    int init_x = GRID_WIDTH / 2;
-    int init_y = GRID_HEIGHT / 2;
-    segments.push_back({ init_x, init_y });
-  }
+  static constexpr int ATLAS_COLUMNS = 4;
 
-  // Constructor with an initial length
-  Snake(int init_length)
-    : current_direction(Direction::Right),
-      grow_snake(false)
-  {
-    int init_x = GRID_WIDTH / 2;
-    int init_y = GRID_HEIGHT / 2;
-    for (int i = 0; i < init_length; ++i) {
-      segments.push_back({ init_x - i, init_y });
+  void load() {
+    int rows = (static_cast<int>(SnakeSprite::Count) + ATLAS_COLUMNS - 1) / ATLAS_COLUMNS;
+    Image atlas = GenImageColor(ATLAS_COLUMNS * BLOCK_SIZE, rows * BLOCK_SIZE, BLANK);
+    for (int i = 0; i < static_cast<int>(SnakeSprite::Count); ++i) {
+      paint_sprite(&atlas, static_cast<SnakeSprite>(i));
     }
+    texture = LoadTextureFromImage(atlas);
+    UnloadImage(atlas);
   }
 
-  Point get_head() const { return segments.front(); }
+  void unload() { UnloadTexture(texture); }
 
-  void update() {
-    Point new_head = segments.front();
-    switch (current_direction) {
-      case Direction::Up:    new_head.y--; break;
-      case Direction::Down:  new_head.y++; break;
-      case Direction::Left:  new_head.x--; break;
-      case Direction::Right: new_head.x++; break;
-    }
-    segments.insert(segments.begin(), new_head);
-    if (!grow_snake) {
-      segments.pop_back();
-    } else {
-      grow_snake = false;
+  void draw(const Snake &snake) const {
+    for (int age = 0; age < snake.get_length(); ++age) {
+      const Point &segment = snake.segment(age);
+      Vector2 position = { (float)(segment.x * BLOCK_SIZE), (float)(segment.y * BLOCK_SIZE) };
+      DrawTextureRec(texture, source_rect(snake.sprite(age)), position, WHITE);
     }
   }
 
-  void set_head(const Point &new_head) { segments.front() = new_head; }
+private:
+  static Rectangle source_rect(SnakeSprite sprite) {
+    int index = static_cast<int>(sprite);
+    return { (float)(index % ATLAS_COLUMNS * BLOCK_SIZE), (float)(index / ATLAS_COLUMNS * BLOCK_SIZE),
+             (float)BLOCK_SIZE, (float)BLOCK_SIZE };
+  }
 
-  void draw() const {
-    for (const auto &segment : segments) {
-      DrawRectangle(segment.x * BLOCK_SIZE, segment.y * BLOCK_SIZE,
-                      BLOCK_SIZE, BLOCK_SIZE, GREEN);
+  // Draws the band of the body from the middle of a cell out to one edge
+  static void paint_arm(Image *atlas, int x, int y, Direction direction) {
+    const int inset = BLOCK_SIZE / 6;
+    const int half = BLOCK_SIZE / 2;
+    const int band = BLOCK_SIZE - 2 * inset;
+    switch (direction) {
+      case Direction::Up:    ImageDrawRectangle(atlas, x + inset, y, band, half, GREEN); break;
+      case Direction::Down:  ImageDrawRectangle(atlas, x + inset, y + half, band, half, GREEN); break;
+      case Direction::Left:  ImageDrawRectangle(atlas, x, y + inset, half, band, GREEN); break;
+      case Direction::Right: ImageDrawRectangle(atlas, x + half, y + inset, half, band, GREEN); break;
     }
   }
 
-  void set_direction(Direction new_direction) {
-    if ((current_direction == Direction::Up && new_direction == Direction::Down) ||
-        (current_direction == Direction::Down && new_direction == Direction::Up) ||
-        (current_direction == Direction::Left && new_direction == Direction::Right) ||
-        (current_direction == Direction::Right && new_direction == Direction::Left))
-    {
-      return;
+  static void paint_sprite(Image *atlas, SnakeSprite sprite) {
+    Rectangle cell = source_rect(sprite);
+    const int x = (int)cell.x, y = (int)cell.y;
+    const int inset = BLOCK_SIZE / 6;
+    const int half = BLOCK_SIZE / 2;
+    const int band = BLOCK_SIZE - 2 * inset;
+    auto paint_head = [&](Direction neck, int eye_dx, int eye_dy) {
+      paint_arm(atlas, x, y, neck);
+      ImageDrawCircle(atlas, x + half, y + half, half - 1, GREEN);
+      // Eyes sit side by side, pushed towards the heading
+      int side_x = eye_dy != 0 ? BLOCK_SIZE / 5 : 0;
+      int side_y = eye_dx != 0 ? BLOCK_SIZE / 5 : 0;
+      int eye_r = std::max(1, BLOCK_SIZE / 10);
+      ImageDrawCircle(atlas, x + half + eye_dx + side_x, y + half + eye_dy + side_y, eye_r, BLACK);
+      ImageDrawCircle(atlas, x + half + eye_dx - side_x, y + half + eye_dy - side_y, eye_r, BLACK);
+    };
+    auto paint_tail = [&](Direction towards_head) {
+      paint_arm(atlas, x, y, towards_head);
+      ImageDrawCircle(atlas, x + half, y + half, band / 2, GREEN);
+    };
+    const int eye = BLOCK_SIZE / 5;
+    switch (sprite) {
+      case SnakeSprite::HeadUp:    paint_head(Direction::Down, 0, -eye); break;
+      case SnakeSprite::HeadDown:  paint_head(Direction::Up, 0, eye); break;
+      case SnakeSprite::HeadLeft:  paint_head(Direction::Right, -eye, 0); break;
+      case SnakeSprite::HeadRight: paint_head(Direction::Left, eye, 0); break;
+      case SnakeSprite::TailUp:    paint_tail(Direction::Up); break;
+      case SnakeSprite::TailDown:  paint_tail(Direction::Down); break;
+      case SnakeSprite::TailLeft:  paint_tail(Direction::Left); break;
+      case SnakeSprite::TailRight: paint_tail(Direction::Right); break;
+      case SnakeSprite::Horizontal:
+        ImageDrawRectangle(atlas, x, y + inset, BLOCK_SIZE, band, GREEN);
+        break;
+      case SnakeSprite::Vertical:
+        ImageDrawRectangle(atlas, x + inset, y, band, BLOCK_SIZE, GREEN);
+        break;
+      case SnakeSprite::CornerUpLeft:
+      case SnakeSprite::CornerUpRight:
+      case SnakeSprite::CornerDownLeft:
+      case SnakeSprite::CornerDownRight: {
+        bool up = sprite == SnakeSprite::CornerUpLeft || sprite == SnakeSprite::CornerUpRight;
+        bool left = sprite == SnakeSprite::CornerUpLeft || sprite == SnakeSprite::CornerDownLeft;
+        ImageDrawRectangle(atlas, x + inset, y + inset, band, band, GREEN);
+        paint_arm(atlas, x, y, up ? Direction::Up : Direction::Down);
+        paint_arm(atlas, x, y, left ? Direction::Left : Direction::Right);
+        break;
+      }
+      case SnakeSprite::Count: break;
     }
-    current_direction = new_direction;
   }
 
-  void grow() { grow_snake = true; }
+  Texture2D texture{};
+};
 
-  bool has_self_collision() const {
-    const auto head = segments.front();
-    for (size_t i = 1; i < segments.size(); ++i) {
-      if (segments[i].x == head.x && segments[i].y == head.y) { return true; }
-    }
-    return false;
+// Smooth snake body
+// The body is drawn as a rounded tube whose mesh sits in a GPU ring buffer
+// laid out slot for slot like the snake's segment ring. Each slot holds the
+// joint disc of its segment plus the link back to the next older segment,
+// written once when that segment becomes the head. Retiring the tail just
+// shrinks the drawn range, so a tick costs one block upload at any length.
+// The head and tail links are drawn separately to slide them between cells.
+class SnakeTube {
+public:
+  static constexpr int JOINT_TRIANGLES  = 12;
+  static constexpr int BLOCK_VERTICES   = JOINT_TRIANGLES * 3 + 6;
+  static constexpr int FLOATS_PER_BLOCK = BLOCK_VERTICES * 2;
+  static constexpr float RADIUS         = BLOCK_SIZE * 0.4f;
+
+  void load() {
+    std::vector<float> zeroes(Snake::CAPACITY * FLOATS_PER_BLOCK, 0.0f);
+    vao = rlLoadVertexArray();
+    rlEnableVertexArray(vao);
+    vbo = rlLoadVertexBuffer(zeroes.data(), (int)(zeroes.size() * sizeof(float)), true);
+    rlSetVertexAttribute(RL_DEFAULT_SHADER_ATTRIB_LOCATION_POSITION, 2, RL_FLOAT, false, 0, 0);
+    rlEnableVertexAttribute(RL_DEFAULT_SHADER_ATTRIB_LOCATION_POSITION);
+    rlDisableVertexArray();
+  }
+
+  void unload() {
+    rlUnloadVertexArray(vao);
+    rlUnloadVertexBuffer(vbo);
   }
 
-  int get_length() const { return static_cast<int>(segments.size()); }
+  // alpha is how far the current tick has progressed, from 0 to 1
+  void draw(const Snake &snake, float alpha) {
+    sync(snake);
+    alpha = std::clamp(alpha, 0.0f, 1.0f);
+    const size_t length = snake.get_length();
+
+    // Blocks for ages 1 .. length - 2 are static between ticks
+    if (length > 2) {
+      size_t first = snake.slot_of(length - 2);
+      size_t count = length - 2;
+      draw_slots(first, count, snake.get_capacity());
+    }
+
+    // Tail end, sliding out of the cell it just left
+    const Point &tail = snake.segment(length - 1);
+    draw_joint(cell_center(tail));
+    if (snake.did_tail_move() && are_adjacent(snake.get_retired_tail(), tail)) {
+      Vector2 end = Vector2Lerp(cell_center(snake.get_retired_tail()), cell_center(tail), alpha);
+      draw_link(cell_center(tail), end);
+      draw_joint(end);
+    }
+
+    // Head end, sliding into its new cell
+    Vector2 head = cell_center(snake.get_head());
+    if (length > 1) {
+      const Point &neck = snake.segment(1);
+      if (are_adjacent(neck, snake.get_head())) {
+        head = Vector2Lerp(cell_center(neck), head, alpha);
+        draw_link(cell_center(neck), head);
+      }
+    }
+    draw_joint(head);
+    DrawCircleV(head, RADIUS * 0.25f, DARKGREEN);
+  }
 
 private:
-  std::vector<Point> segments;
-  Direction current_direction;
-  bool grow_snake;
-};
+  static Vector2 cell_center(const Point &p) {
+    return { (p.x + 0.5f) * BLOCK_SIZE, (p.y + 0.5f) * BLOCK_SIZE };
+  }
 
-// The Food
-class Food {
-public:
-  Food() { respawn(); }
-  const Point &get_position() const { return position; }
-  void respawn() {
-    static std::mt19937 random_engine{ std::random_device{}() };
-    std::uniform_int_distribution<int> dist_x(0, GRID_WIDTH - 1);
-    std::uniform_int_distribution<int> dist_y(0, GRID_HEIGHT - 1);
-    position.x = dist_x(random_engine);
-    position.y = dist_y(random_engine);
+  static bool are_adjacent(const Point &a, const Point &b) {
+    return std::abs(a.x - b.x) + std::abs(a.y - b.y) == 1;
   }
 
-  void draw() const {
-    DrawRectangle(position.x * BLOCK_SIZE, position.y * BLOCK_SIZE,
-                  BLOCK_SIZE, BLOCK_SIZE, RED);
+  static void draw_joint(Vector2 center) { DrawCircleV(center, RADIUS, GREEN); }
+
+  static void draw_link(Vector2 from, Vector2 to) { DrawLineEx(from, to, RADIUS * 2.0f, GREEN); }
+
+  // Brings the GPU ring up to date with the snake, normally one new block
+  void sync(const Snake &snake) {
+    const size_t head_slot = snake.get_head_slot();
+    if (snake.get_id() != synced_id) {
+      for (size_t age = snake.get_length(); age-- > 0;) { write_block(snake, age); }
+    } else {
+      size_t pending = (head_slot + snake.get_capacity() - synced_head_slot) % snake.get_capacity();
+      for (size_t age = pending; age-- > 0;) { write_block(snake, age); }
+    }
+    synced_id = snake.get_id();
+    synced_head_slot = head_slot;
   }
 
-private:
-  Point position;
+  void write_block(const Snake &snake, size_t age) {
+    float block[FLOATS_PER_BLOCK];
+    float *out = block;
+    auto emit = [&](Vector2 v) { *out++ = v.x; *out++ = v.y; };
+
+    const Point &cell = snake.segment(age);
+    Vector2 center = cell_center(cell);
+    for (int i = 0; i < JOINT_TRIANGLES; ++i) {
+      float a0 = 2.0f * PI * i / JOINT_TRIANGLES;
+      float a1 = 2.0f * PI * (i + 1) / JOINT_TRIANGLES;
+      emit(center);
+      emit({ center.x + RADIUS * std::cos(a1), center.y + RADIUS * std::sin(a1) });
+      emit({ center.x + RADIUS * std::cos(a0), center.y + RADIUS * std::sin(a0) });
+    }
+
+    // Links across a wrapped edge collapse to nothing
+    Vector2 older = center;
+    if (age + 1 < (size_t)snake.get_length() && are_adjacent(cell, snake.segment(age + 1))) {
+      older = cell_center(snake.segment(age + 1));
+    }
+    Vector2 side = { 0.0f, 0.0f };
+    if (older.x != center.x) { side.y = RADIUS; } else if (older.y != center.y) { side.x = RADIUS; }
+    Vector2 a = { center.x - side.x, center.y - side.y }, b = { center.x + side.x, center.y + side.y };
+    Vector2 c = { older.x + side.x, older.y + side.y }, d = { older.x - side.x, older.y - side.y };
+    emit(a); emit(b); emit(c);
+    emit(a); emit(c); emit(d);
+
+    size_t slot = snake.slot_of(age);
+    rlUpdateVertexBuffer(vbo, block, sizeof(block), (int)(slot * sizeof(block)));
+  }
+
+  // Draws a run of ring slots, split in two where it wraps around
+  void draw_slots(size_t first, size_t count, size_t capacity) {
+    rlDrawRenderBatchActive();  // Keep ordering with anything batched before
+    rlEnableShader(rlGetShaderIdDefault());
+    int *locs = rlGetShaderLocsDefault();
+    Matrix mvp = MatrixMultiply(rlGetMatrixModelview(), rlGetMatrixProjection());
+    rlSetUniformMatrix(locs[RL_SHADER_LOC_MATRIX_MVP], mvp);
+    float tint[4] = { GREEN.r / 255.0f, GREEN.g / 255.0f, GREEN.b / 255.0f, 1.0f };
+    rlSetUniform(locs[RL_SHADER_LOC_COLOR_DIFFUSE], tint, RL_SHADER_UNIFORM_VEC4, 1);
+    float white[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+    rlSetVertexAttributeDefault(locs[RL_SHADER_LOC_VERTEX_COLOR], white, RL_SHADER_ATTRIB_VEC4, 4);
+    rlActiveTextureSlot(0);
+    rlEnableTexture(rlGetTextureIdDefault());
+    rlEnableVertexArray(vao);
+
+    size_t first_run = std::min(count, capacity - first);
+    rlDrawVertexArray((int)(first * BLOCK_VERTICES), (int)(first_run * BLOCK_VERTICES));
+    if (first_run < count) {
+      rlDrawVertexArray(0, (int)((count - first_run) * BLOCK_VERTICES));
+    }
+
+    rlDisableVertexArray();
+    rlDisableTexture();
+    rlDisableShader();
+  }
+
+  unsigned int vao = 0;
+  unsigned int vbo = 0;
+  uint64_t synced_id = 0;
+  size_t synced_head_slot = 0;
 };
 
 // The Main Game
@@ -189,15 +381,30 @@ private:
   int initial_snake_length;
   int tick_rate_ms;
   bool wrapping_enabled;
+  bool smooth_body_enabled;
+  bool infinite_board_enabled;
+  bool endless_mode_enabled;
   int best_length;
   const int countdown_duration_ms;
   std::chrono::steady_clock::time_point countdown_start_time;
-  Snake snake{ initial_snake_length };
-  Food food;
+  World world{ current_rules(), new_seed() };
+  std::unique_ptr<InfiniteWorld> infinite_world;  // Set while playing on the unbounded or endless board
   std::chrono::steady_clock::time_point last_move_time;
   KeyBindings key_bindings;
   int current_edit_action;  // Used for keybind editing
   RenderTexture2D pause_texture;
+  std::unique_ptr<Bot> autopilot;  // Steers the snake instead of the keyboard
+  bool perf_overlay_visible;       // Toggled with F3 once counters are enabled
+  Heatmap heatmap;                 // Loaded with --heatmap
+  int heatmap_layer;               // HeatLayer drawn under the board, -1 for none; H cycles
+  Texture2D heatmap_texture;
+  FrameCapture capture;            // F10 saves a screenshot, F9 starts and stops a GIF clip
+  std::string profile_path;        // Folded stacks go here on F8 and at exit, when profiling
+  std::unique_ptr<Watchdog> watchdog;  // Dumps diagnostics for slow ticks and frames, with --watchdog
+  uint64_t frame_count = 0;
+  double last_tick_ms = -1;        // Time the tick stepped in this frame took, -1 for none
+  SnakeSkin snake_skin;
+  SnakeTube snake_tube;
 
 public:
   Game()
@@ -206,26 +413,67 @@ public:
       initial_snake_length(3),
       tick_rate_ms(100),
       wrapping_enabled(true),
+      smooth_body_enabled(false),
+      infinite_board_enabled(false),
+      endless_mode_enabled(false),
       best_length(0),
       countdown_duration_ms(3000),
       countdown_start_time(std::chrono::steady_clock::now()),
-      current_edit_action(-1)
+      current_edit_action(-1),
+      perf_overlay_visible(true),
+      heatmap_layer(-1),
+      heatmap_texture{}
   {
     InitWindow(SCREEN_WIDTH, SCREEN_HEIGHT, "SNAKEY");
-    SetTargetFPS(60);
+    SetTargetFPS(TARGET_FPS);
     SetExitKey(0);  // Disable ESC from closing the window
+    capture.init();
+    snake_skin.load();
+    snake_tube.load();
   }
 
   ~Game() {
+    snake_skin.unload();
+    snake_tube.unload();
     UnloadRenderTexture(pause_texture);
+    if (heatmap_texture.id != 0) { UnloadTexture(heatmap_texture); }
+    capture.shutdown();
+    FrameCapture::Stats stats = capture.get_stats();
+    if (stats.screenshots > 0 || stats.clips > 0) {
+      std::printf("captured %llu screenshots and %llu clips (%llu clip frames, %llu dropped)\n",
+                  (unsigned long long)stats.screenshots, (unsigned long long)stats.clips,
+                  (unsigned long long)stats.frames_encoded, (unsigned long long)stats.frames_dropped);
+    }
     CloseWindow();
   }
 
+  void set_autopilot(std::unique_ptr<Bot> bot) { autopilot = std::move(bot); }
+  void set_heatmap(Heatmap map) { heatmap = std::move(map); }
+  void set_profile_path(std::string path) { profile_path = std::move(path); }
+  void set_watchdog(std::unique_ptr<Watchdog> dog) { watchdog = std::move(dog); }
+
   void run() {
+    using Clock = std::chrono::steady_clock;
+    auto frame_start = Clock::now();
     while (!WindowShouldClose()) {
+      const auto now = Clock::now();
+      const double frame_ms = std::chrono::duration<double, std::milli>(now - frame_start).count();
+      frame_start = now;
+      last_tick_ms = -1;
       update();
+      if (watchdog) {
+        const double update_ms = std::chrono::duration<double, std::milli>(Clock::now() - now).count();
+        watchdog->record_frame({ frame_count, float(frame_ms), float(update_ms), float(last_tick_ms),
+                                 game_state_name(app_state) });
+        auto snapshot = [&] { return state_json(); };
+        if (last_tick_ms >= 0) { watchdog->check("tick", last_tick_ms, tick_rate_ms, snapshot); }
+        // The first frame also covers window setup
+        if (frame_count > 0) { watchdog->check("frame", frame_ms, FRAME_BUDGET_MS, snapshot); }
+      }
       draw();
+      frame_count++;
     }
+    if (watchdog) { watchdog->print_stats(stdout); }
   }
 
 private:
@@ -245,6 +493,9 @@ private:
 
   // Update functions for each state.
   void update() {
+    if (IsKeyPressed(KEY_F10)) { capture.request_screenshot(); }
+    if (IsKeyPressed(KEY_F9)) { capture.toggle_clip(); }
+    if (IsKeyPressed(KEY_F8) && !profile_path.empty()) { write_profile(profile_path); }
     switch (app_state) {
       case GameState::StartMenu:      update_start_menu(); break;
       case GameState::Settings:       update_settings(); break;
@@ -256,6 +507,7 @@ private:
       case GameState::ConfirmMainMenu:update_confirm_main_menu(); break;
       case GameState::GameOver:       update_game_over(); break;
     }
+    profiler_set_tag(game_state_name(app_state));
   }
 
   void update_start_menu() {
@@ -286,6 +538,9 @@ private:
     Rectangle tick_rate_slider = { 100, 250, 200, 10 };
     Rectangle wrapping_checkbox = { 100, 350, 20, 20 };
     Rectangle keybinds_button = { 100, 410, 200, 40 };
+    Rectangle smooth_body_checkbox = { 100, 480, 20, 20 };
+    Rectangle infinite_board_checkbox = { 100, 520, 20, 20 };
+    Rectangle endless_mode_checkbox = { 100, 560, 20, 20 };
     Vector2 mouse_pos = GetMousePosition();
     if (IsMouseButtonDown(MOUSE_LEFT_BUTTON)) {
       if (CheckCollisionPointRec(mouse_pos, snake_length_slider)) {
@@ -301,7 +556,19 @@ private:
     }
     if (IsMouseButtonPressed(MOUSE_LEFT_BUTTON)) {
       if (is_mouse_in_rect(wrapping_checkbox)) {
+        // Applies to the game in progress as well as the next one
         wrapping_enabled = !wrapping_enabled;
+        world.set_wrapping(wrapping_enabled);
+        if (infinite_world) { infinite_world->set_wrapping(wrapping_enabled); }
+      }
+      if (is_mouse_in_rect(smooth_body_checkbox)) {
+        smooth_body_enabled = !smooth_body_enabled;
+      }
+      if (is_mouse_in_rect(infinite_board_checkbox)) {
+        infinite_board_enabled = !infinite_board_enabled;
+      }
+      if (is_mouse_in_rect(endless_mode_checkbox)) {
+        endless_mode_enabled = !endless_mode_enabled;
       }
       if (is_mouse_in_rect(keybinds_button)) {
         app_state = GameState::Keybinds;
@@ -344,39 +611,81 @@ private:
     auto now = std::chrono::steady_clock::now();
     int elapsed_ms = int(std::chrono::duration_cast<std::chrono::milliseconds>(now - countdown_start_time).count());
     if (elapsed_ms >= countdown_duration_ms) {
-      snake = Snake(initial_snake_length);
-      food.respawn();
-      last_move_time = std::chrono::steady_clock::now();
+      start_game();
       app_state = GameState::Playing;
     }
   }
 
   void update_playing() {
     if (is_action_pressed(key_bindings.pause)) { app_state = GameState::Pause; return; }
-    if (is_action_down(key_bindings.up)) { snake.set_direction(Direction::Up); }
-    else if (is_action_down(key_bindings.down)) { snake.set_direction(Direction::Down); }
-    else if (is_action_down(key_bindings.left)) { snake.set_direction(Direction::Left); }
-    else if (is_action_down(key_bindings.right)) { snake.set_direction(Direction::Right); }
+    if (IsKeyPressed(KEY_F3)) { perf_overlay_visible = !perf_overlay_visible; }
+    if (IsKeyPressed(KEY_H) && !heatmap.empty()) { cycle_heatmap_layer(); }
+    if (infinite_world) { update_infinite(); return; }
+    if (is_action_down(key_bindings.up)) { world.set_direction(0, Direction::Up); }
+    else if (is_action_down(key_bindings.down)) { world.set_direction(0, Direction::Down); }
+    else if (is_action_down(key_bindings.left)) { world.set_direction(0, Direction::Left); }
+    else if (is_action_down(key_bindings.right)) { world.set_direction(0, Direction::Right); }
     auto now = std::chrono::steady_clock::now();
+    if (autopilot) { autopilot->think(now + AUTOPILOT_FRAME_SLICE); }
     if (now - last_move_time >= std::chrono::milliseconds(tick_rate_ms)) {
-      snake.update();
+      if (autopilot) { world.set_direction(0, autopilot->choose(world, 0)); }
+      world.step();
       last_move_time = now;
-      Point head = snake.get_head();
-      if (wrapping_enabled) {
-        bool wrapped = false;
-        if (head.x < 0) { head.x = GRID_WIDTH - 1; wrapped = true; }
-        else if (head.x >= GRID_WIDTH) { head.x = 0; wrapped = true; }
-        if (head.y < 0) { head.y = GRID_HEIGHT - 1; wrapped = true; }
-        else if (head.y >= GRID_HEIGHT) { head.y = 0; wrapped = true; }
-        if (wrapped) { snake.set_head(head); }
-      } else {
-        if (head.x < 0 || head.x >= GRID_WIDTH || head.y < 0 || head.y >= GRID_HEIGHT) { game_over(); return; }
+      if (world.is_over()) {
+        last_tick_ms = ms_since(now);
+        game_over();
+        return;
       }
-      if (snake.has_self_collision()) { game_over(); return; }
-      if (head.x == food.get_position().x && head.y == food.get_position().y) {
-        snake.grow(); food.respawn();
+      if (autopilot) { autopilot->on_tick(world, 0); }
+      last_tick_ms = ms_since(now);
+    }
+  }
+
+  // Steps through the layers and back to none, colouring cells on a log
+  // scale so the rare cells still show next to the busy ones
+  void cycle_heatmap_layer() {
+    heatmap_layer = (heatmap_layer + 2) % (static_cast<int>(HeatLayer::Count) + 1) - 1;
+    if (heatmap_texture.id != 0) {
+      UnloadTexture(heatmap_texture);
+      heatmap_texture = {};
+    }
+    if (heatmap_layer < 0) { return; }
+    const HeatLayer layer = static_cast<HeatLayer>(heatmap_layer);
+    const float top = std::log1p(float(std::max<uint64_t>(1, heatmap.max(layer))));
+    auto mix = [](Color a, Color b, float t) {
+      return Color{ static_cast<unsigned char>(a.r + (b.r - a.r) * t), static_cast<unsigned char>(a.g + (b.g - a.g) * t),
+                    static_cast<unsigned char>(a.b + (b.b - a.b) * t), 255 };
+    };
+    std::vector<Color> pixels(static_cast<size_t>(heatmap.get_width()) * heatmap.get_height());
+    for (int y = 0; y < heatmap.get_height(); ++y) {
+      for (int x = 0; x < heatmap.get_width(); ++x) {
+        uint64_t count = heatmap.at(layer, x, y);
+        float t = std::log1p(float(count)) / top;
+        // Blue through yellow to red
+        Color color = t < 0.5f ? mix(BLUE, YELLOW, t * 2) : mix(YELLOW, RED, t * 2 - 1);
+        color.a = count ? static_cast<unsigned char>(60 + 150 * t) : 0;
+        pixels[static_cast<size_t>(y) * heatmap.get_width() + x] = color;
       }
     }
+    Image image = { pixels.data(), heatmap.get_width(), heatmap.get_height(), 1, PIXELFORMAT_UNCOMPRESSED_R8G8B8A8 };
+    heatmap_texture = LoadTextureFromImage(image);
+    SetTextureFilter(heatmap_texture, TEXTURE_FILTER_POINT);
+  }
+
+  // Human play on the unbounded or endless board; bots only know fixed
+  // size worlds
+  void update_infinite() {
+    if (is_action_down(key_bindings.up)) { infinite_world->set_direction(Direction::Up); }
+    else if (is_action_down(key_bindings.down)) { infinite_world->set_direction(Direction::Down); }
+    else if (is_action_down(key_bindings.left)) { infinite_world->set_direction(Direction::Left); }
+    else if (is_action_down(key_bindings.right)) { infinite_world->set_direction(Direction::Right); }
+    auto now = std::chrono::steady_clock::now();
+    if (now - last_move_time >= std::chrono::milliseconds(tick_rate_ms)) {
+      infinite_world->step();
+      last_move_time = now;
+      last_tick_ms = ms_since(now);
+      if (infinite_world->is_over()) { game_over(); }
+    }
   }
 
 void update_pause() {
@@ -416,9 +725,7 @@ void update_pause() {
                             BUTTON_WIDTH, BUTTON_HEIGHT };
     if (IsMouseButtonPressed(MOUSE_LEFT_BUTTON)) {
       if (is_mouse_in_rect(yes_button)) {
-        snake = Snake(initial_snake_length);
-        food.respawn();
-        last_move_time = std::chrono::steady_clock::now();
+        start_game();
         app_state = GameState::Playing;
       } else if (is_mouse_in_rect(no_button)) { app_state = GameState::Pause; }
     }
@@ -441,12 +748,64 @@ void update_pause() {
     if (IsMouseButtonPressed(MOUSE_LEFT_BUTTON)) { app_state = GameState::StartMenu; }
   }
 
+  Rules current_rules() const {
+    Rules rules;
+    rules.initial_length = initial_snake_length;
+    rules.tick_rate_ms = tick_rate_ms;
+    rules.wrapping = wrapping_enabled;
+    return rules;
+  }
+
+  static uint64_t new_seed() {
+    static std::mt19937_64 seeder{ std::random_device{}() };
+    return seeder();
+  }
+
+  void start_game() {
+    world = World(current_rules(), new_seed());
+    infinite_world = infinite_board_enabled || endless_mode_enabled
+      ? std::make_unique<InfiniteWorld>(current_rules(), new_seed(), endless_mode_enabled)
+      : nullptr;
+    last_move_time = std::chrono::steady_clock::now();
+    perf_counters_reset();
+    if (autopilot) { autopilot->on_tick(world, 0); }
+  }
+
   void game_over() {
-    int current_length = snake.get_length();
+    int current_length = snake_length();
     best_length = std::max(best_length, current_length);
     app_state = GameState::GameOver;
   }
 
+  static double ms_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+  }
+
+  // What the watchdog records about the game along with an overrun
+  std::string state_json() const {
+    const bool infinite = infinite_world != nullptr;
+    const Point head = infinite ? infinite_world->get_head() : world.get_snake(0).get_head();
+    const Point food = infinite ? infinite_world->get_food() : world.get_food();
+    const Rules &rules = infinite ? infinite_world->get_rules() : world.get_rules();
+    std::string json = std::string("{\"state\": \"") + game_state_name(app_state) + "\"" +
+                       ", \"board\": \"" + (!infinite ? "fixed" : endless_mode_enabled ? "endless" : "infinite") + "\"" +
+                       ", \"tick_rate_ms\": " + std::to_string(tick_rate_ms) +
+                       ", \"wrapping\": " + (rules.wrapping ? "true" : "false") +
+                       ", \"seed\": " + std::to_string(infinite ? infinite_world->get_seed() : world.get_seed()) +
+                       ", \"tick\": " + std::to_string(infinite ? infinite_world->get_tick() : world.get_tick()) +
+                       ", \"length\": " + std::to_string(snake_length()) +
+                       ", \"head\": [" + std::to_string(head.x) + ", " + std::to_string(head.y) + "]" +
+                       ", \"food\": [" + std::to_string(food.x) + ", " + std::to_string(food.y) + "]" +
+                       ", \"autopilot\": " + (autopilot ? "true" : "false") +
+                       ", \"recording_clip\": " + (capture.is_recording() ? "true" : "false");
+    if (perf_counters_on.load()) { json += ", \"perf\": " + perf_counters_json(); }
+    return json + "}";
+  }
+
+  int snake_length() const {
+    return infinite_world ? infinite_world->get_length() : world.get_snake(0).get_length();
+  }
+
   // Drawing functions
   void draw() {
     BeginDrawing();
@@ -462,6 +821,11 @@ void update_pause() {
       case GameState::ConfirmMainMenu:draw_confirm_main_menu(); break;
       case GameState::GameOver:       draw_game_over(); break;
     }
+    capture.capture_frame();
+    // Drawn after the capture so it stays out of the clip
+    if (capture.is_recording()) {
+      DrawCircle(SCREEN_WIDTH - 20, 20, 8, RED);
+    }
     EndDrawing();
   }
 
@@ -542,6 +906,36 @@ void draw_settings() {
       DrawLine(wrapping_checkbox.x, wrapping_checkbox.y + wrapping_checkbox.height,
                wrapping_checkbox.x + wrapping_checkbox.width, wrapping_checkbox.y, DARKBLUE);
     }
+    DrawText("SMOOTH BODY", 140, 480, 20, DARKGRAY);
+    Rectangle smooth_body_checkbox = { 100, 480, 20, 20 };
+    DrawRectangleRec(smooth_body_checkbox, LIGHTGRAY);
+    if (smooth_body_enabled) {
+      DrawLine(smooth_body_checkbox.x, smooth_body_checkbox.y,
+               smooth_body_checkbox.x + smooth_body_checkbox.width,
+               smooth_body_checkbox.y + smooth_body_checkbox.height, DARKBLUE);
+      DrawLine(smooth_body_checkbox.x, smooth_body_checkbox.y + smooth_body_checkbox.height,
+               smooth_body_checkbox.x + smooth_body_checkbox.width, smooth_body_checkbox.y, DARKBLUE);
+    }
+    DrawText("ENDLESS MODE", 140, 560, 20, DARKGRAY);
+    Rectangle endless_mode_checkbox = { 100, 560, 20, 20 };
+    DrawRectangleRec(endless_mode_checkbox, LIGHTGRAY);
+    if (endless_mode_enabled) {
+      DrawLine(endless_mode_checkbox.x, endless_mode_checkbox.y,
+               endless_mode_checkbox.x + endless_mode_checkbox.width,
+               endless_mode_checkbox.y + endless_mode_checkbox.height, DARKBLUE);
+      DrawLine(endless_mode_checkbox.x, endless_mode_checkbox.y + endless_mode_checkbox.height,
+               endless_mode_checkbox.x + endless_mode_checkbox.width, endless_mode_checkbox.y, DARKBLUE);
+    }
+    DrawText("INFINITE BOARD", 140, 520, 20, DARKGRAY);
+    Rectangle infinite_board_checkbox = { 100, 520, 20, 20 };
+    DrawRectangleRec(infinite_board_checkbox, LIGHTGRAY);
+    if (infinite_board_enabled) {
+      DrawLine(infinite_board_checkbox.x, infinite_board_checkbox.y,
+               infinite_board_checkbox.x + infinite_board_checkbox.width,
+               infinite_board_checkbox.y + infinite_board_checkbox.height, DARKBLUE);
+      DrawLine(infinite_board_checkbox.x, infinite_board_checkbox.y + infinite_board_checkbox.height,
+               infinite_board_checkbox.x + infinite_board_checkbox.width, infinite_board_checkbox.y, DARKBLUE);
+    }
     Rectangle keybinds_button = { 100, 410, 200, 40 };
     DrawRectangleRec(keybinds_button, get_button_color(keybinds_button));
 
@@ -604,8 +998,97 @@ void draw_settings() {
   }
 
   void draw_playing() {
-    food.draw();
-    snake.draw();
+    if (infinite_world) {
+      draw_infinite();
+      if (perf_counters_on && perf_overlay_visible) { draw_perf_overlay(); }
+      return;
+    }
+    if (heatmap_texture.id != 0 && heatmap.get_width() == world.get_rules().width &&
+        heatmap.get_height() == world.get_rules().height) {
+      DrawTexturePro(heatmap_texture, { 0, 0, float(heatmap.get_width()), float(heatmap.get_height()) },
+                     { 0, 0, float(heatmap.get_width() * BLOCK_SIZE), float(heatmap.get_height() * BLOCK_SIZE) },
+                     { 0, 0 }, 0, WHITE);
+      std::string label = std::string("heatmap: ") + heat_layer_name(static_cast<HeatLayer>(heatmap_layer)) +
+                          " over " + std::to_string(heatmap.get_games()) + " games (H)";
+      DrawText(label.c_str(), 10, SCREEN_HEIGHT - 25, 20, DARKGRAY);
+    }
+    const Point &food = world.get_food();
+    DrawRectangle(food.x * BLOCK_SIZE, food.y * BLOCK_SIZE, BLOCK_SIZE, BLOCK_SIZE, RED);
+    {
+      PerfScopeGuard measure(PerfScope::Draw);
+      if (smooth_body_enabled) {
+        auto since_tick = std::chrono::steady_clock::now() - last_move_time;
+        float alpha = std::chrono::duration<float, std::milli>(since_tick).count() / tick_rate_ms;
+        snake_tube.draw(world.get_snake(0), alpha);
+      } else {
+        snake_skin.draw(world.get_snake(0));
+      }
+    }
+    if (perf_counters_on && perf_overlay_visible) { draw_perf_overlay(); }
+  }
+
+  // The camera follows the head; only chunks overlapping the view are
+  // looked at, however far the snake has travelled
+  void draw_infinite() {
+    const Point head = infinite_world->get_head();
+    const Point min = { head.x - GRID_WIDTH / 2, head.y - GRID_HEIGHT / 2 };
+    const Point max = { min.x + GRID_WIDTH - 1, min.y + GRID_HEIGHT - 1 };
+    auto draw_cell = [&](Point p, Color color) {
+      DrawRectangle((p.x - min.x) * BLOCK_SIZE, (p.y - min.y) * BLOCK_SIZE, BLOCK_SIZE, BLOCK_SIZE, color);
+    };
+
+    if (infinite_world->is_endless()) {
+      // Everything beyond the walls is drawn as wall
+      const BoardBounds &bounds = infinite_world->get_bounds();
+      const int x0 = std::max(bounds.min.x, min.x) - min.x, y0 = std::max(bounds.min.y, min.y) - min.y;
+      const int x1 = std::min(bounds.max.x, max.x) - min.x, y1 = std::min(bounds.max.y, max.y) - min.y;
+      DrawRectangle(0, 0, SCREEN_WIDTH, SCREEN_HEIGHT, LIGHTGRAY);
+      if (x0 <= x1 && y0 <= y1) {
+        DrawRectangle(x0 * BLOCK_SIZE, y0 * BLOCK_SIZE, (x1 - x0 + 1) * BLOCK_SIZE, (y1 - y0 + 1) * BLOCK_SIZE, RAYWHITE);
+      }
+    }
+    const Point &food = infinite_world->get_food();
+    if (food.x >= min.x && food.x <= max.x && food.y >= min.y && food.y <= max.y) { draw_cell(food, RED); }
+    {
+      PerfScopeGuard measure(PerfScope::Draw);
+      const SparseOccupancy &occupancy = infinite_world->get_occupancy();
+      occupancy.for_each_chunk_in(min, max, [&](const OccupancyChunk &chunk) {
+        const int base_x = chunk.x * CHUNK_SIZE, base_y = chunk.y * CHUNK_SIZE;
+        const int x0 = std::max(min.x, base_x) - base_x, x1 = std::min(max.x, base_x + CHUNK_SIZE - 1) - base_x;
+        const uint64_t columns = (x1 == CHUNK_SIZE - 1 ? ~uint64_t(0) : (uint64_t(1) << (x1 + 1)) - 1) &
+                                 ~((uint64_t(1) << x0) - 1);
+        for (int y = std::max(min.y, base_y); y <= std::min(max.y, base_y + CHUNK_SIZE - 1); ++y) {
+          for (uint64_t bits = chunk.rows[y - base_y] & columns; bits; bits &= bits - 1) {
+            draw_cell({ base_x + __builtin_ctzll(bits), y }, GREEN);
+          }
+        }
+      });
+      draw_cell(head, DARKGREEN);
+    }
+    const char *position = TextFormat("%d, %d   %zu chunks", head.x, head.y, infinite_world->get_occupancy().resident_chunks());
+    DrawText(position, 10, SCREEN_HEIGHT - 25, 20, DARKGRAY);
+  }
+
+  // Per-call averages of each measured scope since the game started
+  void draw_perf_overlay() {
+    DrawRectangle(5, 5, 470, 20 + 16 * int(PERF_SCOPE_COUNT), Fade(BLACK, 0.6f));
+    std::string header = "length " + std::to_string(snake_length()) + "  (F3 hides)";
+    if (!perf_counters_status().empty()) { header += "  no hw counters"; }
+    DrawText(header.c_str(), 10, 9, 14, RAYWHITE);
+    for (size_t s = 0; s < PERF_SCOPE_COUNT; ++s) {
+      PerfTotals t = perf_totals(static_cast<PerfScope>(s));
+      if (t.calls == 0) { continue; }
+      auto per_call = [&](PerfEvent event) { return double(t.events[static_cast<size_t>(event)]) / t.calls; };
+      char line[160];
+      int n = std::snprintf(line, sizeof(line), "%-9s %7.0fns", perf_scope_name(static_cast<PerfScope>(s)),
+                            double(t.ns) / t.calls);
+      if (perf_event_available(PerfEvent::Cycles)) {
+        std::snprintf(line + n, sizeof(line) - n, "  cyc %.0f  ipc %.2f  llc %.1f  br %.1f", per_call(PerfEvent::Cycles),
+                      per_call(PerfEvent::Instructions) / std::max(1.0, per_call(PerfEvent::Cycles)),
+                      per_call(PerfEvent::CacheMisses), per_call(PerfEvent::BranchMisses));
+      }
+      DrawText(line, 10, 25 + 16 * int(s), 14, RAYWHITE);
+    }
   }
 
 void draw_pause() {
@@ -684,7 +1167,7 @@ void draw_pause() {
     std::string game_over_text = "GAME OVER";
     int game_over_width = MeasureText(game_over_text.c_str(), 60);
     DrawText(game_over_text.c_str(), SCREEN_WIDTH/2 - game_over_width/2, 100, 60, MAROON);
-    std::string last_length = "Length: " + std::to_string(snake.get_length());
+    std::string last_length = "Length: " + std::to_string(snake_length());
     int last_length_width = MeasureText(last_length.c_str(), 30);
     DrawText(last_length.c_str(), SCREEN_WIDTH/2 - last_length_width/2, 200, 30, DARKBLUE);
     std::string best_length_str = "BEST LENGTH: " + std::to_string(best_length);
@@ -694,8 +1177,60 @@ void draw_pause() {
   }
 };
 
-int main() {
+int main(int argc, char **argv) {
+  std::unique_ptr<Bot> bot;
+  Heatmap heatmap;
+  std::string profile_path;
+  int profile_hz = PROFILER_DEFAULT_HZ;
+  WatchdogOptions watchdog_options;
+  bool watchdog_enabled = false;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg == "--bot" && i + 1 < argc) {
+      bot = make_bot(argv[++i]);
+      if (!bot) { std::fprintf(stderr, "unknown bot %s\n", argv[i]); return 1; }
+    } else if (arg == "--heatmap" && i + 1 < argc) {
+      std::string error;
+      if (!load_heatmap(argv[++i], heatmap, &error)) {
+        std::fprintf(stderr, "%s: %s\n", argv[i], error.c_str());
+        return 1;
+      }
+    } else if (arg == "--perf") {
+      if (!perf_counters_enable()) {
+        std::fprintf(stderr, "hardware counters unavailable (%s), timing only\n", perf_counters_status().c_str());
+      }
+    } else if (arg == "--profile" && i + 1 < argc) {
+      profile_path = argv[++i];
+    } else if (arg == "--profile-hz" && i + 1 < argc) {
+      profile_hz = std::max(1, std::atoi(argv[++i]));
+    } else if (arg == "--watchdog" && i + 1 < argc) {
+      watchdog_options.directory = argv[++i];
+      watchdog_enabled = true;
+    } else {
+      std::fprintf(stderr, "usage: snakey [--bot NAME | --bot plugin:PATH] [--perf] [--heatmap FILE]\n"
+                           "              [--profile FILE] [--profile-hz N] [--watchdog DIR]\n");
+      return 1;
+    }
+  }
+  if (!profile_path.empty()) {
+    std::string error;
+    if (!profiler_start(profile_hz, &error)) {
+      std::fprintf(stderr, "%s\n", error.c_str());
+      return 1;
+    }
+  }
+
   Game game;
+  game.set_autopilot(std::move(bot));
+  game.set_heatmap(std::move(heatmap));
+  game.set_profile_path(profile_path);
+  if (watchdog_enabled) { game.set_watchdog(std::make_unique<Watchdog>(watchdog_options)); }
   game.run();
+  if (!profile_path.empty()) {
+    profiler_stop();
+    write_profile(profile_path);
+  }
+  print_plugin_stats(stdout);
+  print_process_stats(stdout);
   return 0;
 }
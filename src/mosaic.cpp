@@ -0,0 +1,217 @@
+// snakey_mosaic: watches many bot games at once.
+//
+//   snakey_mosaic [--games N] [--bots a,b,...] [--threads N] [--tick-rate MS]
+//                 [--seed N] [--no-wrap]
+//
+// The games run on worker threads (see mosaic_sim.hpp). Every board is one
+// tile of a single atlas texture with one texel per cell; tiles that
+// changed since the last frame are rewritten, the texture is uploaded once
+// and the whole mosaic goes out in one draw call. Clicking a tile zooms in
+// on that game, clicking again returns to the mosaic.
+
+#include "bot_process.hpp"
+#include "bots.hpp"
+#include "mosaic_sim.hpp"
+#include "plugin.hpp"
+#include "util.hpp"
+
+#include <raylib.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+namespace {
+
+constexpr int WINDOW_WIDTH  = 1280;
+constexpr int WINDOW_HEIGHT = 800;
+constexpr int STATUS_HEIGHT = 30;
+
+Color cell_color(TileCell cell) {
+  switch (cell) {
+    case TileCell::Body:  return GREEN;
+    case TileCell::Head:  return DARKGREEN;
+    case TileCell::Food:  return RED;
+    case TileCell::Empty: break;
+  }
+  return RAYWHITE;
+}
+
+// Largest rectangle of the given aspect centred in the area
+Rectangle fit(float width, float height, Rectangle area) {
+  float scale = std::min(area.width / width, area.height / height);
+  return { area.x + (area.width - width * scale) / 2, area.y + (area.height - height * scale) / 2,
+           width * scale, height * scale };
+}
+
+class Mosaic {
+public:
+  explicit Mosaic(MosaicSim &sim)
+    : sim(sim),
+      board_width(sim.get_rules().width),
+      board_height(sim.get_rules().height),
+      columns(static_cast<int>(std::ceil(std::sqrt(double(sim.get_game_count()))))),
+      rows((sim.get_game_count() + columns - 1) / columns),
+      // One texel of gutter to the right of and below each board
+      atlas_width(columns * (board_width + 1)),
+      atlas_height(rows * (board_height + 1)),
+      pixels(static_cast<size_t>(atlas_width) * atlas_height, DARKGRAY)
+  {
+    Image image = { pixels.data(), atlas_width, atlas_height, 1, PIXELFORMAT_UNCOMPRESSED_R8G8B8A8 };
+    atlas = LoadTextureFromImage(image);
+    SetTextureFilter(atlas, TEXTURE_FILTER_POINT);
+  }
+
+  ~Mosaic() { UnloadTexture(atlas); }
+
+  void update() {
+    bool dirty = false;
+    for (int game = 0; game < sim.get_game_count(); ++game) {
+      const TileSnapshot *snapshot = sim.acquire(game);
+      if (!snapshot) { continue; }
+      const Rectangle tile = tile_rect(game);
+      for (int y = 0; y < board_height; ++y) {
+        Color *row = pixels.data() + (static_cast<size_t>(tile.y) + y) * atlas_width + static_cast<size_t>(tile.x);
+        const TileCell *cells = snapshot->cells.data() + static_cast<size_t>(y) * board_width;
+        for (int x = 0; x < board_width; ++x) { row[x] = cell_color(cells[x]); }
+      }
+      dirty = true;
+    }
+    if (dirty) { UpdateTexture(atlas, pixels.data()); }
+
+    if (IsMouseButtonPressed(MOUSE_LEFT_BUTTON)) {
+      zoomed = zoomed >= 0 ? -1 : tile_at(GetMousePosition());
+    }
+  }
+
+  void draw() {
+    const Rectangle area = { 0, 0, float(GetScreenWidth()), float(GetScreenHeight() - STATUS_HEIGHT) };
+    if (zoomed >= 0) {
+      Rectangle source = tile_rect(zoomed);
+      DrawTexturePro(atlas, source, fit(source.width, source.height, area), { 0, 0 }, 0, WHITE);
+      const TileSnapshot &snapshot = sim.latest(zoomed);
+      std::string status = "game " + std::to_string(zoomed) + "  " + sim.get_bot_name(zoomed) +
+                           "  seed " + std::to_string(snapshot.seed) + "  length " + std::to_string(snapshot.length) +
+                           "  tick " + std::to_string(snapshot.tick) + "  finished " +
+                           std::to_string(snapshot.games_played) + "  (click to go back)";
+      DrawText(status.c_str(), 10, GetScreenHeight() - STATUS_HEIGHT + 5, 20, DARKGRAY);
+      return;
+    }
+
+    DrawTexturePro(atlas, { 0, 0, float(atlas_width), float(atlas_height) }, mosaic_rect(), { 0, 0 }, 0, WHITE);
+    int hovered = tile_at(GetMousePosition());
+    if (hovered >= 0) {
+      Rectangle screen = tile_on_screen(hovered);
+      DrawRectangleLinesEx(screen, 2, DARKBLUE);
+    }
+
+    uint64_t total_ticks = 0;
+    for (int game = 0; game < sim.get_game_count(); ++game) { total_ticks += sim.latest(game).total_ticks; }
+    double now = GetTime();
+    if (now - rate_time >= 1.0) {
+      ticks_per_second = (total_ticks - rate_ticks) / (now - rate_time);
+      rate_ticks = total_ticks;
+      rate_time = now;
+    }
+    std::string status = std::to_string(sim.get_game_count()) + " games on " + std::to_string(sim.get_thread_count()) +
+                         " threads  " + std::to_string(static_cast<long long>(ticks_per_second)) + " ticks/s  " +
+                         std::to_string(GetFPS()) + " fps";
+    DrawText(status.c_str(), 10, GetScreenHeight() - STATUS_HEIGHT + 5, 20, DARKGRAY);
+  }
+
+private:
+  // Where `game` sits in the atlas, gutter excluded
+  Rectangle tile_rect(int game) const {
+    return { float((game % columns) * (board_width + 1)), float((game / columns) * (board_height + 1)),
+             float(board_width), float(board_height) };
+  }
+
+  Rectangle mosaic_rect() const {
+    const Rectangle area = { 0, 0, float(GetScreenWidth()), float(GetScreenHeight() - STATUS_HEIGHT) };
+    return fit(float(atlas_width), float(atlas_height), area);
+  }
+
+  Rectangle tile_on_screen(int game) const {
+    const Rectangle dest = mosaic_rect();
+    const float scale = dest.width / atlas_width;
+    const Rectangle tile = tile_rect(game);
+    return { dest.x + tile.x * scale, dest.y + tile.y * scale, tile.width * scale, tile.height * scale };
+  }
+
+  int tile_at(Vector2 mouse) const {
+    const Rectangle dest = mosaic_rect();
+    if (!CheckCollisionPointRec(mouse, dest)) { return -1; }
+    const float scale = dest.width / atlas_width;
+    int column = static_cast<int>((mouse.x - dest.x) / scale) / (board_width + 1);
+    int row = static_cast<int>((mouse.y - dest.y) / scale) / (board_height + 1);
+    int game = row * columns + column;
+    return column < columns && game < sim.get_game_count() ? game : -1;
+  }
+
+  MosaicSim &sim;
+  const int board_width;
+  const int board_height;
+  const int columns;
+  const int rows;
+  const int atlas_width;
+  const int atlas_height;
+  std::vector<Color> pixels;  // CPU copy of the atlas
+  Texture2D atlas;
+  int zoomed = -1;
+  double rate_time = 0;
+  uint64_t rate_ticks = 0;
+  double ticks_per_second = 0;
+};
+
+} // namespace
+
+int main(int argc, char **argv) {
+  MosaicSim::Options options;
+  options.rules.max_ticks = 10000;
+  options.rules.starvation_ticks = 2 * options.rules.width * options.rules.height;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    bool has_value = i + 1 < argc;
+    if (arg == "--games" && has_value) { options.games = std::clamp(std::atoi(argv[++i]), 1, 256); }
+    else if (arg == "--bots" && has_value) { options.bots = split(argv[++i]); }
+    else if (arg == "--threads" && has_value) { options.threads = std::atoi(argv[++i]); }
+    else if (arg == "--tick-rate" && has_value) { options.tick_rate_ms = std::max(0, std::atoi(argv[++i])); }
+    else if (arg == "--seed" && has_value) { options.base_seed = std::strtoull(argv[++i], nullptr, 10); }
+    else if (arg == "--no-wrap") { options.rules.wrapping = false; }
+    else {
+      std::fprintf(stderr, "usage: snakey_mosaic [--games N] [--bots a,b,...] [--threads N] [--tick-rate MS] "
+                           "[--seed N] [--no-wrap]\n");
+      return 1;
+    }
+  }
+  for (const std::string &name : options.bots) {
+    if (!make_bot(name)) { std::fprintf(stderr, "unknown bot %s\n", name.c_str()); return 1; }
+    if (is_single_instance_bot(name) && options.games > 1) {
+      std::fprintf(stderr, "%s plays one game at a time; use --games 1\n", name.c_str());
+      return 1;
+    }
+  }
+
+  MosaicSim sim(options);
+  SetConfigFlags(FLAG_WINDOW_RESIZABLE);
+  InitWindow(WINDOW_WIDTH, WINDOW_HEIGHT, "Snakey mosaic");
+  SetTargetFPS(60);
+  {
+    Mosaic mosaic(sim);
+    sim.start();
+    while (!WindowShouldClose()) {
+      mosaic.update();
+      BeginDrawing();
+      ClearBackground(RAYWHITE);
+      mosaic.draw();
+      EndDrawing();
+    }
+    sim.stop();
+  }
+  CloseWindow();
+  print_plugin_stats(stdout);
+  print_process_stats(stdout);
+  return 0;
+}
@@ -0,0 +1,108 @@
+#include "mosaic_sim.hpp"
+
+#include "bots.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <memory>
+
+MosaicSim::MosaicSim(Options options)
+  : options(std::move(options)),
+    tiles(std::max(1, this->options.games))
+{
+  this->options.games = static_cast<int>(tiles.size());
+  if (this->options.bots.empty()) { this->options.bots = { "path" }; }
+  if (this->options.threads < 1) { this->options.threads = std::max(1u, std::thread::hardware_concurrency()); }
+  this->options.threads = std::min(this->options.threads, this->options.games);
+  const size_t cells = static_cast<size_t>(this->options.rules.width) * this->options.rules.height;
+  for (Tile &tile : tiles) {
+    for (TileSnapshot &buffer : tile.buffers) { buffer.cells.assign(cells, TileCell::Empty); }
+  }
+}
+
+MosaicSim::~MosaicSim() { stop(); }
+
+void MosaicSim::start() {
+  if (running.exchange(true)) { return; }
+  for (int t = 0; t < options.threads; ++t) {
+    workers.emplace_back([this, t]() { run_worker(t); });
+  }
+}
+
+void MosaicSim::stop() {
+  running = false;
+  for (std::thread &worker : workers) { worker.join(); }
+  workers.clear();
+}
+
+const TileSnapshot *MosaicSim::acquire(int game) {
+  Tile &tile = tiles[game];
+  if (!(tile.middle.load(std::memory_order_relaxed) & FRESH)) { return nullptr; }
+  tile.front = tile.middle.exchange(tile.front, std::memory_order_acq_rel) & INDEX_MASK;
+  return &tile.buffers[tile.front];
+}
+
+const TileSnapshot &MosaicSim::latest(int game) const {
+  const Tile &tile = tiles[game];
+  return tile.buffers[tile.front];
+}
+
+void MosaicSim::run_worker(int worker) {
+  // Boards worker, worker + threads, worker + 2 * threads, ...
+  struct Board {
+    int game;
+    std::unique_ptr<Bot> bot;
+    World world;
+    uint32_t games_played;
+    uint64_t total_ticks;
+  };
+  auto seed_for = [&](int game, uint32_t played) {
+    return options.base_seed + static_cast<uint64_t>(played) * options.games + game;
+  };
+  std::vector<Board> boards;
+  for (int game = worker; game < options.games; game += options.threads) {
+    boards.push_back({ game, make_bot(get_bot_name(game)), World(options.rules, seed_for(game, 0)), 0, 0 });
+  }
+
+  const auto tick = std::chrono::milliseconds(options.tick_rate_ms);
+  auto next_tick = std::chrono::steady_clock::now();
+  while (running.load(std::memory_order_relaxed)) {
+    for (Board &board : boards) {
+      if (board.world.is_over()) {
+        ++board.games_played;
+        board.world = World(options.rules, seed_for(board.game, board.games_played));
+        board.bot = make_bot(get_bot_name(board.game));
+      } else {
+        if (board.bot) { board.world.set_direction(0, board.bot->choose(board.world, 0)); }
+        board.world.step();
+        if (board.bot) { board.bot->on_tick(board.world, 0); }
+        ++board.total_ticks;
+      }
+
+      Tile &tile = tiles[board.game];
+      TileSnapshot &snapshot = tile.buffers[tile.back];
+      const World &world = board.world;
+      const uint8_t *occupancy = world.get_occupancy();
+      for (size_t i = 0; i < snapshot.cells.size(); ++i) {
+        snapshot.cells[i] = occupancy[i] ? TileCell::Body : TileCell::Empty;
+      }
+      const Rules &rules = world.get_rules();
+      const Point &food = world.get_food();
+      snapshot.cells[food.y * rules.width + food.x] = TileCell::Food;
+      if (world.is_alive(0)) {
+        const Point head = world.get_snake(0).get_head();
+        if (world.in_bounds(head)) { snapshot.cells[head.y * rules.width + head.x] = TileCell::Head; }
+      }
+      snapshot.length = world.get_snake(0).get_length();
+      snapshot.tick = world.get_tick();
+      snapshot.games_played = board.games_played;
+      snapshot.seed = world.get_seed();
+      snapshot.total_ticks = board.total_ticks;
+      tile.back = tile.middle.exchange(tile.back | FRESH, std::memory_order_acq_rel) & INDEX_MASK;
+    }
+    if (options.tick_rate_ms > 0) {
+      next_tick += tick;
+      std::this_thread::sleep_until(next_tick);
+    }
+  }
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+// Many bot games running at once, for watching side by side.
+// Worker threads each own a share of the boards and step them on their own
+// clock, restarting finished games with the next seed. After every tick a
+// worker writes the board into a snapshot and publishes it through a
+// per-board triple buffer, so the viewer always finds the newest complete
+// frame without either side ever waiting on the other.
+
+#include "core.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+
+enum class TileCell : uint8_t {
+  Empty,
+  Body,
+  Head,
+  Food
+};
+
+// One board as the viewer sees it
+struct TileSnapshot {
+  std::vector<TileCell> cells;  // Row-major, rules.width by rules.height
+  int length = 0;
+  uint32_t tick = 0;
+  uint32_t games_played = 0;    // Finished games on this tile so far
+  uint64_t seed = 0;
+  uint64_t total_ticks = 0;     // Over every game played on this tile
+};
+
+class MosaicSim {
+public:
+  struct Options {
+    int games = 64;
+    std::vector<std::string> bots;  // Handed out to the boards in turn
+    int threads = 0;                // 0 for all cores
+    int tick_rate_ms = 50;          // 0 steps as fast as the bots allow
+    uint64_t base_seed = 1;
+    Rules rules;
+  };
+
+  explicit MosaicSim(Options options);
+  ~MosaicSim();
+
+  MosaicSim(const MosaicSim &) = delete;
+  MosaicSim &operator=(const MosaicSim &) = delete;
+
+  void start();
+  void stop();
+
+  int get_game_count() const { return options.games; }
+  int get_thread_count() const { return options.threads; }
+  const Rules &get_rules() const { return options.rules; }
+  const std::string &get_bot_name(int game) const { return options.bots[game % options.bots.size()]; }
+
+  // The newest snapshot of `game` if one was published since the last call,
+  // otherwise nullptr. Only one thread may read snapshots.
+  const TileSnapshot *acquire(int game);
+  // The snapshot last returned by acquire
+  const TileSnapshot &latest(int game) const;
+
+private:
+  static constexpr uint8_t INDEX_MASK = 3;
+  static constexpr uint8_t FRESH = 4;
+
+  // Three snapshots rotate between the worker (back), the hand-over slot
+  // (middle) and the viewer (front). Each side only ever swaps its own
+  // buffer with the middle one.
+  struct alignas(64) Tile {
+    TileSnapshot buffers[3];
+    std::atomic<uint8_t> middle{ 1 };
+    uint8_t back = 0;   // Worker only
+    uint8_t front = 2;  // Viewer only
+  };
+
+  void run_worker(int worker);
+
+  Options options;
+  std::vector<Tile> tiles;
+  std::vector<std::thread> workers;
+  std::atomic<bool> running{ false };
+};
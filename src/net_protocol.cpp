@@ -0,0 +1,121 @@
+#include "net_protocol.hpp"
+#include "util.hpp"
+
+namespace {
+
+uint64_t get_fixed(const uint8_t *&p, int bytes) {
+  uint64_t v = 0;
+  for (int i = 0; i < bytes; ++i) { v |= uint64_t(*p++) << (8 * i); }
+  return v;
+}
+
+void put_header(std::string &out, NetMessage type, size_t payload) {
+  put_fixed(out, payload + 1, 2);
+  put_fixed(out, static_cast<uint8_t>(type), 1);
+}
+
+} // namespace
+
+Rules net_session_rules(int tick_rate_ms, bool wrapping) {
+  Rules rules;
+  rules.tick_rate_ms = tick_rate_ms;
+  rules.wrapping = wrapping;
+  rules.starvation_ticks = 2 * rules.width * rules.height;
+  return rules;
+}
+
+void put_join(std::string &out, const JoinMessage &message) {
+  put_header(out, NetMessage::Join, 11);
+  put_fixed(out, message.tick_rate_ms, 2);
+  put_fixed(out, message.wrapping ? 1 : 0, 1);
+  put_fixed(out, message.seed, 8);
+}
+
+void put_input(std::string &out, const InputMessage &message) {
+  put_header(out, NetMessage::Input, 5);
+  put_fixed(out, message.sequence, 4);
+  put_fixed(out, static_cast<uint8_t>(message.direction), 1);
+}
+
+void put_leave(std::string &out) { put_header(out, NetMessage::Leave, 0); }
+
+void put_joined(std::string &out, const JoinedMessage &message) {
+  put_header(out, NetMessage::Joined, 8);
+  put_fixed(out, message.session, 4);
+  put_fixed(out, message.width, 1);
+  put_fixed(out, message.height, 1);
+  put_fixed(out, message.tick_rate_ms, 2);
+}
+
+void put_tick(std::string &out, const TickMessage &message) {
+  put_header(out, NetMessage::Tick, 19);
+  put_fixed(out, message.game, 4);
+  put_fixed(out, message.tick, 4);
+  put_fixed(out, message.acked, 4);
+  put_fixed(out, message.head_x, 1);
+  put_fixed(out, message.head_y, 1);
+  put_fixed(out, message.food_x, 1);
+  put_fixed(out, message.food_y, 1);
+  put_fixed(out, message.length, 2);
+  put_fixed(out, static_cast<uint8_t>(message.death_cause), 1);
+}
+
+void put_refused(std::string &out, RefuseReason reason) {
+  put_header(out, NetMessage::Refused, 1);
+  put_fixed(out, static_cast<uint8_t>(reason), 1);
+}
+
+ptrdiff_t next_frame(const uint8_t *data, size_t size, NetFrame &frame) {
+  if (size < 2) { return 0; }
+  size_t length = size_t(data[0]) | size_t(data[1]) << 8;
+  if (length == 0 || length + 2 > NET_MAX_MESSAGE) { return -1; }
+  if (size < length + 2) { return 0; }
+  frame.type = static_cast<NetMessage>(data[2]);
+  frame.payload = data + NET_HEADER_BYTES;
+  frame.size = length - 1;
+  return static_cast<ptrdiff_t>(length + 2);
+}
+
+bool get_join(const NetFrame &frame, JoinMessage &message) {
+  if (frame.type != NetMessage::Join || frame.size != 11) { return false; }
+  const uint8_t *p = frame.payload;
+  message.tick_rate_ms = static_cast<uint16_t>(get_fixed(p, 2));
+  message.wrapping = get_fixed(p, 1) != 0;
+  message.seed = get_fixed(p, 8);
+  return true;
+}
+
+bool get_input(const NetFrame &frame, InputMessage &message) {
+  if (frame.type != NetMessage::Input || frame.size != 5) { return false; }
+  const uint8_t *p = frame.payload;
+  message.sequence = static_cast<uint32_t>(get_fixed(p, 4));
+  uint64_t direction = get_fixed(p, 1);
+  if (direction > static_cast<uint8_t>(Direction::Right)) { return false; }
+  message.direction = static_cast<Direction>(direction);
+  return true;
+}
+
+bool get_joined(const NetFrame &frame, JoinedMessage &message) {
+  if (frame.type != NetMessage::Joined || frame.size != 8) { return false; }
+  const uint8_t *p = frame.payload;
+  message.session = static_cast<uint32_t>(get_fixed(p, 4));
+  message.width = static_cast<uint8_t>(get_fixed(p, 1));
+  message.height = static_cast<uint8_t>(get_fixed(p, 1));
+  message.tick_rate_ms = static_cast<uint16_t>(get_fixed(p, 2));
+  return true;
+}
+
+bool get_tick(const NetFrame &frame, TickMessage &message) {
+  if (frame.type != NetMessage::Tick || frame.size != 19) { return false; }
+  const uint8_t *p = frame.payload;
+  message.game = static_cast<uint32_t>(get_fixed(p, 4));
+  message.tick = static_cast<uint32_t>(get_fixed(p, 4));
+  message.acked = static_cast<uint32_t>(get_fixed(p, 4));
+  message.head_x = static_cast<uint8_t>(get_fixed(p, 1));
+  message.head_y = static_cast<uint8_t>(get_fixed(p, 1));
+  message.food_x = static_cast<uint8_t>(get_fixed(p, 1));
+  message.food_y = static_cast<uint8_t>(get_fixed(p, 1));
+  message.length = static_cast<uint16_t>(get_fixed(p, 2));
+  message.death_cause = static_cast<DeathCause>(get_fixed(p, 1));
+  return true;
+}
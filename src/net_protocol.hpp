@@ -0,0 +1,100 @@
+#pragma once
+
+// Messages between snakey_server and its clients. Every message is a
+// little-endian u16 size of what follows, a u8 type and the payload:
+//
+//   Join      client  u16 tick_rate_ms, u8 wrapping, u64 seed
+//   Input     client  u32 sequence, u8 direction (Direction in core.hpp)
+//   Leave     client  -
+//   Joined    server  u32 session, u8 width, u8 height, u16 tick_rate_ms
+//   Tick      server  u32 game, u32 tick, u32 acked, u8 head_x, u8 head_y,
+//                     u8 food_x, u8 food_y, u16 length, u8 death_cause
+//   Refused   server  u8 reason
+//
+// A client joins once and then sends inputs whenever it likes; the server
+// applies the last one before each tick and reports its sequence number as
+// `acked` in that tick. When a game ends the session carries on with a new
+// game on the next seed. Since a game is reproduced by its seed and the
+// directions applied, a client can mirror it from the acked inputs alone.
+
+#include "core.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+enum class NetMessage : uint8_t {
+  Join = 1,
+  Input = 2,
+  Leave = 3,
+  Joined = 16,
+  Tick = 17,
+  Refused = 18
+};
+
+enum class RefuseReason : uint8_t {
+  Full = 1,
+  BadMessage = 2,
+  ShuttingDown = 3
+};
+
+constexpr size_t NET_HEADER_BYTES = 3;
+constexpr size_t NET_MAX_MESSAGE = 64;  // Nothing legitimate is longer
+
+struct JoinMessage {
+  uint16_t tick_rate_ms;
+  bool wrapping;
+  uint64_t seed;
+};
+
+struct InputMessage {
+  uint32_t sequence;
+  Direction direction;
+};
+
+struct JoinedMessage {
+  uint32_t session;
+  uint8_t width;
+  uint8_t height;
+  uint16_t tick_rate_ms;
+};
+
+struct TickMessage {
+  uint32_t game;
+  uint32_t tick;
+  uint32_t acked;
+  uint8_t head_x;
+  uint8_t head_y;
+  uint8_t food_x;
+  uint8_t food_y;
+  uint16_t length;
+  DeathCause death_cause;
+};
+
+// Rules of a session's games; the tick rate is whatever the server granted
+Rules net_session_rules(int tick_rate_ms, bool wrapping);
+
+// Appenders for the outgoing side
+void put_join(std::string &out, const JoinMessage &message);
+void put_input(std::string &out, const InputMessage &message);
+void put_leave(std::string &out);
+void put_joined(std::string &out, const JoinedMessage &message);
+void put_tick(std::string &out, const TickMessage &message);
+void put_refused(std::string &out, RefuseReason reason);
+
+// A message cut from the front of a receive buffer
+struct NetFrame {
+  NetMessage type;
+  const uint8_t *payload;
+  size_t size;
+};
+
+// Returns the bytes taken by the first complete message, 0 if it is still
+// incomplete, or -1 if the buffer does not start with a sane message
+ptrdiff_t next_frame(const uint8_t *data, size_t size, NetFrame &frame);
+
+// Payload decoders; false when the payload has the wrong size or values
+bool get_join(const NetFrame &frame, JoinMessage &message);
+bool get_input(const NetFrame &frame, InputMessage &message);
+bool get_joined(const NetFrame &frame, JoinedMessage &message);
+bool get_tick(const NetFrame &frame, TickMessage &message);
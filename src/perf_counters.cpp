@@ -0,0 +1,211 @@
+#include "perf_counters.hpp"
+
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <linux/perf_event.h>
+#include <mutex>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr uint64_t EVENT_CONFIGS[PERF_EVENT_COUNT] = {
+  PERF_COUNT_HW_CPU_CYCLES,
+  PERF_COUNT_HW_INSTRUCTIONS,
+  PERF_COUNT_HW_CACHE_MISSES,
+  PERF_COUNT_HW_BRANCH_MISSES,
+};
+
+struct ScopeTotals {
+  std::atomic<uint64_t> calls{ 0 };
+  std::atomic<uint64_t> ns{ 0 };
+  std::atomic<uint64_t> events[PERF_EVENT_COUNT] = {};
+};
+
+ScopeTotals totals[PERF_SCOPE_COUNT];
+std::atomic<bool> available[PERF_EVENT_COUNT] = {};
+std::atomic<bool> hardware_wanted{ true };
+std::mutex status_mutex;
+std::string status = "not enabled";
+
+uint64_t now_ns() {
+  return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+int open_event(uint64_t config, int group) {
+  perf_event_attr attr;
+  std::memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = PERF_TYPE_HARDWARE;
+  attr.config = config;
+  attr.disabled = group < 0;
+  attr.exclude_kernel = 1;  // Allowed at perf_event_paranoid 2
+  attr.exclude_hv = 1;
+  attr.read_format = PERF_FORMAT_GROUP;
+  return static_cast<int>(syscall(__NR_perf_event_open, &attr, 0, -1, group, 0));
+}
+
+// The calling thread's counters, opened as one group so a single read
+// returns all of them
+class ThreadCounters {
+public:
+  ThreadCounters() {
+    if (!hardware_wanted.load()) { return; }
+    std::string problems;
+    for (size_t e = 0; e < PERF_EVENT_COUNT; ++e) {
+      int fd = open_event(EVENT_CONFIGS[e], leader);
+      if (fd < 0) {
+        problems += std::string(problems.empty() ? "" : ", ") + perf_event_name(static_cast<PerfEvent>(e)) +
+                    ": " + std::strerror(errno);
+        continue;
+      }
+      if (leader < 0) { leader = fd; }
+      fds[e] = fd;
+      position[e] = count++;
+      available[e].store(true, std::memory_order_relaxed);
+    }
+    if (leader >= 0) {
+      ioctl(leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+      ioctl(leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    }
+    std::lock_guard<std::mutex> lock(status_mutex);
+    status = problems;
+  }
+
+  ~ThreadCounters() {
+    for (int fd : fds) {
+      if (fd >= 0) { close(fd); }
+    }
+  }
+
+  // Fills `values` with the current counts, leaving missing events at zero
+  void read_all(uint64_t *values) const {
+    if (leader < 0) { return; }
+    uint64_t buffer[1 + PERF_EVENT_COUNT];
+    if (read(leader, buffer, sizeof(buffer)) < static_cast<ssize_t>(sizeof(uint64_t) * (1 + count))) { return; }
+    for (size_t e = 0; e < PERF_EVENT_COUNT; ++e) {
+      if (fds[e] >= 0) { values[e] = buffer[1 + position[e]]; }
+    }
+  }
+
+private:
+  int leader = -1;
+  int fds[PERF_EVENT_COUNT] = { -1, -1, -1, -1 };
+  int position[PERF_EVENT_COUNT] = {};
+  int count = 0;
+};
+
+ThreadCounters &thread_counters() {
+  thread_local ThreadCounters counters;
+  return counters;
+}
+
+} // namespace
+
+const char *perf_scope_name(PerfScope scope) {
+  switch (scope) {
+    case PerfScope::Update:    return "update";
+    case PerfScope::Collision: return "collision";
+    case PerfScope::Respawn:   return "respawn";
+    case PerfScope::Draw:      return "draw";
+    case PerfScope::Count:     break;
+  }
+  return "unknown";
+}
+
+const char *perf_event_name(PerfEvent event) {
+  switch (event) {
+    case PerfEvent::Cycles:       return "cycles";
+    case PerfEvent::Instructions: return "instructions";
+    case PerfEvent::CacheMisses:  return "cache_misses";
+    case PerfEvent::BranchMisses: return "branch_misses";
+    case PerfEvent::Count:        break;
+  }
+  return "unknown";
+}
+
+bool perf_counters_enable(bool hardware) {
+  hardware_wanted.store(hardware);
+  if (!hardware) {
+    std::lock_guard<std::mutex> lock(status_mutex);
+    status = "hardware counters disabled";
+  }
+  thread_counters();  // Opens the counters now rather than in the first scope
+  perf_counters_on.store(true);
+  for (const auto &event : available) {
+    if (event.load()) { return true; }
+  }
+  return false;
+}
+
+std::string perf_counters_status() {
+  std::lock_guard<std::mutex> lock(status_mutex);
+  return status;
+}
+
+bool perf_event_available(PerfEvent event) { return available[static_cast<size_t>(event)].load(); }
+
+PerfTotals perf_totals(PerfScope scope) {
+  const ScopeTotals &source = totals[static_cast<size_t>(scope)];
+  PerfTotals result;
+  result.calls = source.calls.load(std::memory_order_relaxed);
+  result.ns = source.ns.load(std::memory_order_relaxed);
+  for (size_t e = 0; e < PERF_EVENT_COUNT; ++e) { result.events[e] = source.events[e].load(std::memory_order_relaxed); }
+  return result;
+}
+
+void perf_counters_reset() {
+  for (ScopeTotals &scope : totals) {
+    scope.calls = 0;
+    scope.ns = 0;
+    for (auto &event : scope.events) { event = 0; }
+  }
+}
+
+std::string perf_counters_json() {
+  std::string status_text = perf_counters_status();
+  std::string json = "{\"available\": [";
+  bool first = true;
+  for (size_t e = 0; e < PERF_EVENT_COUNT; ++e) {
+    if (!available[e].load()) { continue; }
+    json += std::string(first ? "" : ", ") + "\"" + perf_event_name(static_cast<PerfEvent>(e)) + "\"";
+    first = false;
+  }
+  json += "], \"status\": \"";
+  for (char c : status_text) {
+    if (c == '"' || c == '\\') { json += '\\'; }
+    json += c;
+  }
+  json += "\", \"scopes\": {";
+  for (size_t s = 0; s < PERF_SCOPE_COUNT; ++s) {
+    PerfTotals t = perf_totals(static_cast<PerfScope>(s));
+    json += std::string(s ? ", " : "") + "\"" + perf_scope_name(static_cast<PerfScope>(s)) +
+            "\": {\"calls\": " + std::to_string(t.calls) + ", \"ns\": " + std::to_string(t.ns);
+    for (size_t e = 0; e < PERF_EVENT_COUNT; ++e) {
+      if (!available[e].load()) { continue; }
+      json += std::string(", \"") + perf_event_name(static_cast<PerfEvent>(e)) + "\": " + std::to_string(t.events[e]);
+    }
+    json += "}";
+  }
+  return json + "}}";
+}
+
+void PerfScopeGuard::begin() {
+  thread_counters().read_all(start);
+  start_ns = now_ns();
+}
+
+void PerfScopeGuard::end() {
+  uint64_t end_ns = now_ns();
+  uint64_t stop[PERF_EVENT_COUNT] = {};
+  thread_counters().read_all(stop);
+  ScopeTotals &target = totals[static_cast<size_t>(scope)];
+  target.calls.fetch_add(1, std::memory_order_relaxed);
+  target.ns.fetch_add(end_ns - start_ns, std::memory_order_relaxed);
+  for (size_t e = 0; e < PERF_EVENT_COUNT; ++e) {
+    target.events[e].fetch_add(stop[e] - start[e], std::memory_order_relaxed);
+  }
+}
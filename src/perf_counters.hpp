@@ -0,0 +1,64 @@
+#pragma once
+
+// Hardware performance counters around the hot parts of a tick.
+// Instrumentation stays off until perf_counters_enable() is called. Each
+// scope then reads the calling thread's counter group on entry and exit and
+// adds the difference to process-wide totals. Counters the kernel refuses,
+// as is common in containers, are left out; with none at all only wall
+// time is kept.
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+enum class PerfScope : uint8_t { Update, Collision, Respawn, Draw, Count };
+enum class PerfEvent : uint8_t { Cycles, Instructions, CacheMisses, BranchMisses, Count };
+
+constexpr size_t PERF_SCOPE_COUNT = static_cast<size_t>(PerfScope::Count);
+constexpr size_t PERF_EVENT_COUNT = static_cast<size_t>(PerfEvent::Count);
+
+const char *perf_scope_name(PerfScope scope);
+const char *perf_event_name(PerfEvent event);
+
+struct PerfTotals {
+  uint64_t calls = 0;
+  uint64_t ns = 0;
+  uint64_t events[PERF_EVENT_COUNT] = {};
+};
+
+// Turns instrumentation on. Returns false if no hardware counter could be
+// opened, in which case scopes still measure wall time. With `hardware`
+// off no counters are opened at all.
+bool perf_counters_enable(bool hardware = true);
+// Checked by every scope, so disabled instrumentation costs one load
+inline std::atomic<bool> perf_counters_on{ false };
+// Why counters are missing, or empty when all of them work
+std::string perf_counters_status();
+bool perf_event_available(PerfEvent event);
+
+PerfTotals perf_totals(PerfScope scope);
+void perf_counters_reset();
+// Availability and the totals of every scope as a JSON object
+std::string perf_counters_json();
+
+// Measures the enclosing block when instrumentation is on
+class PerfScopeGuard {
+public:
+  explicit PerfScopeGuard(PerfScope scope) : scope(scope), active(perf_counters_on.load(std::memory_order_relaxed)) {
+    if (active) { begin(); }
+  }
+  ~PerfScopeGuard() {
+    if (active) { end(); }
+  }
+  PerfScopeGuard(const PerfScopeGuard &) = delete;
+  PerfScopeGuard &operator=(const PerfScopeGuard &) = delete;
+
+private:
+  void begin();
+  void end();
+
+  PerfScope scope;
+  bool active;
+  uint64_t start_ns = 0;
+  uint64_t start[PERF_EVENT_COUNT] = {};
+};
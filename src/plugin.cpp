@@ -0,0 +1,270 @@
+#include "plugin.hpp"
+#include "snakey_plugin.h"
+
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <vector>
+
+static_assert(sizeof(Point) == sizeof(snakey_point), "body rings are handed to plugins as is");
+static_assert(offsetof(Point, y) == offsetof(snakey_point, y), "body rings are handed to plugins as is");
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// How often the file is checked for changes
+constexpr auto RELOAD_CHECK_INTERVAL = std::chrono::milliseconds(250);
+
+// One dlopen of the library. A reload creates a new generation; the old one
+// is closed once the last bot using it lets go.
+struct PluginGeneration {
+  void *handle = nullptr;
+  const snakey_plugin *plugin = nullptr;
+  uint64_t number = 0;
+  int fd = -1;  // The in-memory copy the library was loaded from
+
+  ~PluginGeneration() {
+    if (handle) { dlclose(handle); }
+    if (fd >= 0) { close(fd); }
+  }
+};
+
+struct PluginStats {
+  std::atomic<uint64_t> calls{ 0 };
+  std::atomic<uint64_t> call_ns{ 0 };
+  std::atomic<uint64_t> max_call_ns{ 0 };
+  std::atomic<uint64_t> view_ns{ 0 };      // Building the state view
+  std::atomic<uint64_t> overruns{ 0 };     // Answers dropped for being late
+  std::atomic<uint64_t> invalid{ 0 };      // Answers that were not a direction
+  std::atomic<uint64_t> reloads{ 0 };
+};
+
+class PluginLibrary {
+public:
+  explicit PluginLibrary(std::string path) : path(std::move(path)) {}
+
+  // Returns the current generation, reloading first if the file changed
+  std::shared_ptr<PluginGeneration> current() {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto now = Clock::now();
+    if (generation && now - last_check < RELOAD_CHECK_INTERVAL) { return generation; }
+    last_check = now;
+    struct stat info;
+    if (stat(path.c_str(), &info) != 0) { return generation; }
+    if (generation && info.st_mtim.tv_sec == loaded_mtime.tv_sec &&
+        info.st_mtim.tv_nsec == loaded_mtime.tv_nsec && info.st_ino == loaded_inode) {
+      return generation;
+    }
+    auto fresh = load();
+    if (fresh) {
+      if (generation) { stats.reloads++; }
+      generation = std::move(fresh);
+      loaded_mtime = info.st_mtim;
+      loaded_inode = info.st_ino;
+    }
+    return generation;
+  }
+
+  const std::string path;
+  PluginStats stats;
+
+private:
+  std::shared_ptr<PluginGeneration> load() {
+    // dlopen hands back the already mapped object for a path it has seen, so
+    // each generation is loaded from its own anonymous in-memory copy. The
+    // copy stays open with its generation, which keeps its /proc/self/fd
+    // name from being reused while the library is loaded. Nothing touches a
+    // shared directory, so no other user can swap the file before dlopen.
+    auto generation = std::make_shared<PluginGeneration>();
+    generation->fd = copy_to_memory(path);
+    if (generation->fd < 0) {
+      std::fprintf(stderr, "plugin %s: cannot copy: %s\n", path.c_str(), std::strerror(errno));
+      return nullptr;
+    }
+    std::string copy = "/proc/self/fd/" + std::to_string(generation->fd);
+    void *handle = dlopen(copy.c_str(), RTLD_NOW | RTLD_LOCAL);
+    if (!handle) {
+      std::fprintf(stderr, "plugin %s: %s\n", path.c_str(), dlerror());
+      return nullptr;
+    }
+    generation->handle = handle;
+    generation->number = next_generation++;
+    auto entry = reinterpret_cast<snakey_plugin_entry_fn>(dlsym(handle, SNAKEY_PLUGIN_ENTRY));
+    const snakey_plugin *plugin = entry ? entry() : nullptr;
+    if (!plugin || !plugin->choose) {
+      std::fprintf(stderr, "plugin %s: no usable %s\n", path.c_str(), SNAKEY_PLUGIN_ENTRY);
+      return nullptr;
+    }
+    if (plugin->abi_version != SNAKEY_PLUGIN_ABI_VERSION) {
+      std::fprintf(stderr, "plugin %s: ABI version %u, expected %u\n", path.c_str(),
+                   plugin->abi_version, SNAKEY_PLUGIN_ABI_VERSION);
+      return nullptr;
+    }
+    generation->plugin = plugin;
+    return generation;
+  }
+
+  // Returns a memfd holding the contents of `from`, or -1
+  static int copy_to_memory(const std::string &from) {
+    int in = open(from.c_str(), O_RDONLY | O_CLOEXEC);
+    if (in < 0) { return -1; }
+    int out = memfd_create("snakey_plugin", MFD_CLOEXEC);
+    if (out < 0) {
+      close(in);
+      return -1;
+    }
+    char buffer[1 << 16];
+    ssize_t n;
+    while ((n = read(in, buffer, sizeof(buffer))) > 0) {
+      for (ssize_t done = 0; done < n;) {
+        ssize_t written = write(out, buffer + done, size_t(n - done));
+        if (written < 0) {
+          n = -1;
+          break;
+        }
+        done += written;
+      }
+      if (n < 0) { break; }
+    }
+    const int saved_errno = errno;
+    close(in);
+    if (n < 0) {
+      close(out);
+      errno = saved_errno;
+      return -1;
+    }
+    return out;
+  }
+
+  std::mutex mutex;
+  std::shared_ptr<PluginGeneration> generation;
+  Clock::time_point last_check{};
+  struct timespec loaded_mtime{};
+  ino_t loaded_inode = 0;
+  uint64_t next_generation = 0;
+};
+
+std::mutex registry_mutex;
+std::map<std::string, std::shared_ptr<PluginLibrary>> registry;
+
+std::shared_ptr<PluginLibrary> library_for(const std::string &path) {
+  std::lock_guard<std::mutex> lock(registry_mutex);
+  auto &library = registry[path];
+  if (!library) { library = std::make_shared<PluginLibrary>(path); }
+  return library;
+}
+
+uint64_t elapsed_ns(Clock::time_point since) {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - since).count();
+}
+
+class PluginBot : public Bot {
+public:
+  explicit PluginBot(std::shared_ptr<PluginLibrary> library) : library(std::move(library)) {}
+
+  ~PluginBot() override { release(); }
+
+  bool attach() {
+    auto latest = library->current();
+    if (!latest) { return false; }
+    if (latest != generation) {
+      release();
+      generation = latest;
+      instance = generation->plugin->create ? generation->plugin->create() : nullptr;
+    }
+    return true;
+  }
+
+  Direction choose(const World &world, int self) override {
+    const Direction fallback = world.get_snake(self).get_direction();
+    if (!attach()) { return fallback; }
+    PluginStats &stats = library->stats;
+
+    auto view_start = Clock::now();
+    const Rules &rules = world.get_rules();
+    snakes.resize(world.get_snake_count());
+    for (int i = 0; i < world.get_snake_count(); ++i) {
+      const Snake &snake = world.get_snake(i);
+      snakey_snake &view = snakes[i];
+      view.ring = reinterpret_cast<const snakey_point *>(snake.get_ring().data());
+      view.capacity = static_cast<uint32_t>(snake.get_capacity());
+      view.head_slot = static_cast<uint32_t>(snake.get_head_slot());
+      view.length = static_cast<uint32_t>(snake.get_length());
+      view.direction = static_cast<int32_t>(snake.get_direction());
+      view.alive = world.is_alive(i) ? 1 : 0;
+    }
+    snakey_state state{};
+    state.abi_version = SNAKEY_PLUGIN_ABI_VERSION;
+    state.tick = world.get_tick();
+    state.width = rules.width;
+    state.height = rules.height;
+    state.wrapping = rules.wrapping ? 1 : 0;
+    state.tick_rate_ms = rules.tick_rate_ms;
+    state.occupancy = world.get_occupancy();
+    state.food = { world.get_food().x, world.get_food().y };
+    state.snakes = snakes.data();
+    state.snake_count = world.get_snake_count();
+    state.self = self;
+    // Half the tick is left for the game itself
+    state.budget_us = static_cast<uint32_t>(std::max(1, rules.tick_rate_ms) * 500);
+    stats.view_ns += elapsed_ns(view_start);
+
+    auto call_start = Clock::now();
+    int32_t answer = generation->plugin->choose(instance, &state);
+    uint64_t call_ns = elapsed_ns(call_start);
+    stats.calls++;
+    stats.call_ns += call_ns;
+    uint64_t max = stats.max_call_ns.load();
+    while (call_ns > max && !stats.max_call_ns.compare_exchange_weak(max, call_ns)) {}
+
+    if (call_ns > uint64_t(state.budget_us) * 1000) { stats.overruns++; return fallback; }
+    if (answer < SNAKEY_UP || answer > SNAKEY_RIGHT) { stats.invalid++; return fallback; }
+    return static_cast<Direction>(answer);
+  }
+
+private:
+  void release() {
+    if (generation && instance && generation->plugin->destroy) { generation->plugin->destroy(instance); }
+    instance = nullptr;
+  }
+
+  std::shared_ptr<PluginLibrary> library;
+  std::shared_ptr<PluginGeneration> generation;
+  void *instance = nullptr;
+  std::vector<snakey_snake> snakes;
+};
+
+} // namespace
+
+std::unique_ptr<Bot> make_plugin_bot(const std::string &path) {
+  auto bot = std::make_unique<PluginBot>(library_for(path));
+  if (!bot->attach()) { return nullptr; }
+  return bot;
+}
+
+void print_plugin_stats(FILE *out) {
+  std::lock_guard<std::mutex> lock(registry_mutex);
+  for (const auto &[path, library] : registry) {
+    const PluginStats &s = library->stats;
+    uint64_t calls = s.calls.load();
+    std::fprintf(out, "plugin %s: %llu calls, %.0f ns/call (max %.0f), view %.0f ns/call, "
+                      "%llu over budget, %llu invalid, %llu reloads\n",
+                 path.c_str(), (unsigned long long)calls,
+                 calls ? double(s.call_ns) / calls : 0.0, double(s.max_call_ns),
+                 calls ? double(s.view_ns) / calls : 0.0,
+                 (unsigned long long)s.overruns.load(), (unsigned long long)s.invalid.load(),
+                 (unsigned long long)s.reloads.load());
+  }
+}
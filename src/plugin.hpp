@@ -0,0 +1,19 @@
+#pragma once
+
+// Loads bots from shared objects through the C ABI in snakey_plugin.h.
+// Libraries are shared between every bot using the same path and reloaded
+// when the file on disk changes. Each call is timed against a per-tick
+// budget and answers arriving late are dropped.
+
+#include "bots.hpp"
+
+#include <cstdio>
+#include <memory>
+#include <string>
+
+// Returns nullptr, with the reason on stderr, when the library cannot be
+// loaded or does not speak the current ABI version
+std::unique_ptr<Bot> make_plugin_bot(const std::string &path);
+
+// Prints call counts, timings and reloads for every plugin loaded so far
+void print_plugin_stats(FILE *out);
@@ -0,0 +1,238 @@
+#include "profiler.hpp"
+#include "util.hpp"
+
+#include <cxxabi.h>
+#include <dlfcn.h>
+#include <execinfo.h>
+#include <signal.h>
+#include <sys/time.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+
+constexpr int MAX_DEPTH = 48;
+// The handler and the signal trampoline
+constexpr int SKIPPED_FRAMES = 2;
+constexpr size_t RING_SAMPLES = 4096;
+constexpr auto DRAIN_INTERVAL = std::chrono::milliseconds(100);
+
+struct Sample {
+  std::atomic<bool> ready{ false };
+  const char *tag;
+  int depth;
+  void *frames[MAX_DEPTH];
+};
+
+// Filled from the signal handler: slots are claimed by advancing `claimed`
+// and published with `ready`, so handlers running on several threads at
+// once never share a slot. Only drain() advances `drained`.
+Sample ring[RING_SAMPLES];
+std::atomic<uint64_t> claimed{ 0 };
+std::atomic<uint64_t> drained{ 0 };
+std::atomic<uint64_t> dropped{ 0 };
+std::atomic<const char *> current_tag{ nullptr };
+std::atomic<bool> running{ false };
+
+// Aggregated by the drain thread; the key is the tag pointer followed by
+// the frames
+std::mutex counts_mutex;
+std::unordered_map<std::string, uint64_t> counts;
+uint64_t samples = 0;
+
+std::mutex drain_mutex;
+std::condition_variable drain_wake;
+std::thread drain_thread;
+bool drain_stopping = false;
+
+void handle_sigprof(int) {
+  const int saved_errno = errno;
+  // Claim a slot only while the ring has room, so a full ring never
+  // overwrites a sample the drain thread has not read
+  uint64_t index = claimed.load(std::memory_order_relaxed);
+  do {
+    if (index - drained.load(std::memory_order_acquire) >= RING_SAMPLES) {
+      dropped.fetch_add(1, std::memory_order_relaxed);
+      errno = saved_errno;
+      return;
+    }
+  } while (!claimed.compare_exchange_weak(index, index + 1, std::memory_order_relaxed));
+  Sample &sample = ring[index % RING_SAMPLES];
+  sample.tag = current_tag.load(std::memory_order_relaxed);
+  sample.depth = backtrace(sample.frames, MAX_DEPTH);
+  sample.ready.store(true, std::memory_order_release);
+  errno = saved_errno;
+}
+
+void drain() {
+  std::lock_guard<std::mutex> lock(counts_mutex);
+  uint64_t next = drained.load(std::memory_order_relaxed);
+  const uint64_t end = claimed.load(std::memory_order_acquire);
+  std::string key;
+  for (; next < end; ++next) {
+    Sample &sample = ring[next % RING_SAMPLES];
+    // A handler that claimed the slot may still be filling it in
+    if (!sample.ready.load(std::memory_order_acquire)) { break; }
+    if (sample.depth > SKIPPED_FRAMES) {
+      key.assign(reinterpret_cast<const char *>(&sample.tag), sizeof(sample.tag));
+      key.append(reinterpret_cast<const char *>(sample.frames + SKIPPED_FRAMES),
+                 sizeof(void *) * size_t(sample.depth - SKIPPED_FRAMES));
+      counts[key]++;
+      samples++;
+    }
+    sample.ready.store(false, std::memory_order_relaxed);
+    drained.store(next + 1, std::memory_order_release);
+  }
+}
+
+void drain_loop() {
+  std::unique_lock<std::mutex> lock(drain_mutex);
+  while (!drain_stopping) {
+    drain_wake.wait_for(lock, DRAIN_INTERVAL);
+    drain();
+  }
+}
+
+std::string symbol_name(void *address, bool return_address) {
+  // A return address points after the call; look up the call itself
+  const auto *pc = static_cast<const char *>(address) - (return_address ? 1 : 0);
+  Dl_info info;
+  if (dladdr(pc, &info) == 0) {
+    char text[32];
+    std::snprintf(text, sizeof(text), "%p", address);
+    return text;
+  }
+  std::string name;
+  if (info.dli_sname) {
+    int status = 0;
+    std::unique_ptr<char, void (*)(void *)> demangled(abi::__cxa_demangle(info.dli_sname, nullptr, nullptr, &status),
+                                                      std::free);
+    name = status == 0 && demangled ? demangled.get() : info.dli_sname;
+  } else {
+    std::string_view module = info.dli_fname ? info.dli_fname : "?";
+    module = module.substr(module.find_last_of('/') + 1);
+    char offset[32];
+    std::snprintf(offset, sizeof(offset), "+0x%zx", size_t(pc - static_cast<const char *>(info.dli_fbase)));
+    name = std::string(module) + offset;
+  }
+  // Semicolons separate frames in the folded format
+  std::replace(name.begin(), name.end(), ';', ':');
+  return name;
+}
+
+} // namespace
+
+bool profiler_start(int hz, std::string *error) {
+  if (running.exchange(true)) {
+    errno = EBUSY;
+    return fail_errno(error, "profiler");
+  }
+  // The first backtrace() loads the unwinder, which must not happen inside
+  // the signal handler
+  void *warm_up[4];
+  backtrace(warm_up, 4);
+
+  struct sigaction action {};
+  action.sa_handler = handle_sigprof;
+  action.sa_flags = SA_RESTART;
+  sigemptyset(&action.sa_mask);
+  if (sigaction(SIGPROF, &action, nullptr) != 0) {
+    running = false;
+    return fail_errno(error, "sigaction SIGPROF");
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(drain_mutex);
+    drain_stopping = false;
+  }
+  drain_thread = std::thread(drain_loop);
+
+  const long interval_us = std::max(1L, 1000000L / std::max(1, hz));
+  itimerval timer{};
+  timer.it_interval.tv_sec = interval_us / 1000000;
+  timer.it_interval.tv_usec = interval_us % 1000000;
+  timer.it_value = timer.it_interval;
+  if (setitimer(ITIMER_PROF, &timer, nullptr) != 0) {
+    const int saved_errno = errno;
+    profiler_stop();
+    errno = saved_errno;
+    return fail_errno(error, "setitimer ITIMER_PROF");
+  }
+  return true;
+}
+
+void profiler_stop() {
+  if (!running.load()) { return; }
+  itimerval timer{};
+  setitimer(ITIMER_PROF, &timer, nullptr);
+  {
+    std::lock_guard<std::mutex> lock(drain_mutex);
+    drain_stopping = true;
+  }
+  drain_wake.notify_one();
+  if (drain_thread.joinable()) { drain_thread.join(); }
+  // Signals already pending are ignored rather than left to the default
+  // action, which would end the process
+  signal(SIGPROF, SIG_IGN);
+  drain();
+  running = false;
+}
+
+bool profiler_running() { return running.load(); }
+
+void profiler_set_tag(const char *tag) { current_tag.store(tag, std::memory_order_relaxed); }
+
+bool profiler_write_folded(const std::string &path, std::string *error) {
+  drain();
+  std::map<std::string, uint64_t> lines;  // Sorted, so repeated dumps diff well
+  {
+    std::lock_guard<std::mutex> lock(counts_mutex);
+    std::unordered_map<void *, std::string> names;
+    for (const auto &[key, count] : counts) {
+      const char *tag;
+      std::memcpy(&tag, key.data(), sizeof(tag));
+      const size_t depth = (key.size() - sizeof(tag)) / sizeof(void *);
+      std::string line = tag ? tag : "-";
+      // Stored innermost first; folded stacks start at the root
+      for (size_t i = depth; i-- > 0;) {
+        void *frame;
+        std::memcpy(&frame, key.data() + sizeof(tag) + i * sizeof(void *), sizeof(frame));
+        auto found = names.find(frame);
+        if (found == names.end()) { found = names.emplace(frame, symbol_name(frame, i > 0)).first; }
+        line += ';';
+        line += found->second;
+      }
+      lines[line] += count;
+    }
+  }
+
+  FILE *out = std::fopen(path.c_str(), "w");
+  if (!out) { return fail_errno(error, path); }
+  for (const auto &[line, count] : lines) { std::fprintf(out, "%s %llu\n", line.c_str(), (unsigned long long)count); }
+  if (std::fclose(out) != 0) { return fail_errno(error, path); }
+  return true;
+}
+
+ProfilerStats profiler_stats() {
+  drain();
+  ProfilerStats stats;
+  std::lock_guard<std::mutex> lock(counts_mutex);
+  stats.samples = samples;
+  stats.dropped = dropped.load();
+  stats.stacks = counts.size();
+  return stats;
+}
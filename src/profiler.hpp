@@ -0,0 +1,39 @@
+#pragma once
+
+// Sampling profiler that can stay compiled into release builds. Once
+// started, a SIGPROF timer interrupts whichever thread is burning CPU
+// `hz` times per CPU second; the handler records the stack and the current
+// tag into a preallocated ring without locks or allocation. A background
+// thread folds the ring into per-stack counts, and profiler_write_folded()
+// writes them as "tag;outer;...;inner count" lines, the input of
+// flamegraph.pl and speedscope. Tags split the profile by what the program
+// was doing, such as the game state.
+//
+// Symbols come from dladdr, so executables need -rdynamic for their own
+// functions to get names; frames without one are written as module+offset.
+
+#include <cstdint>
+#include <string>
+
+constexpr int PROFILER_DEFAULT_HZ = 99;  // Off the round rates timers and frames run at
+
+struct ProfilerStats {
+  uint64_t samples = 0;
+  uint64_t dropped = 0;  // Lost because the ring was full
+  uint64_t stacks = 0;   // Distinct tag and stack pairs
+};
+
+// Installs the handler and arms the timer. Returns false with the reason in
+// `error` if it is already running or the timer cannot be set.
+bool profiler_start(int hz = PROFILER_DEFAULT_HZ, std::string *error = nullptr);
+// Disarms the timer; the counts stay until the next start
+void profiler_stop();
+bool profiler_running();
+
+// Tag of the samples from now on; must point to a string that outlives the
+// profiler, typically a literal. nullptr leaves samples untagged.
+void profiler_set_tag(const char *tag);
+
+// Writes everything counted so far; the profiler keeps running
+bool profiler_write_folded(const std::string &path, std::string *error = nullptr);
+ProfilerStats profiler_stats();
@@ -0,0 +1,191 @@
+// snakey_query: answers questions about a replay index built by snakey_index.
+//
+//   snakey_query INDEX COMMAND [filters]
+//
+// Commands scan whole columns with branch-free loops over a row mask, which
+// the compiler turns into vector code.
+
+#include "core.hpp"
+#include "replay_index.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace {
+
+struct Filters {
+  int tick_rate = -1;
+  int wrapping = -1;
+  int snakes = -1;
+  int min_length = 0;
+  int max_free_moves = 1;   // near-death threshold
+  int limit = 10;
+};
+
+void print_usage() {
+  std::printf("usage: snakey_query INDEX COMMAND [filters]\n"
+              "commands:\n"
+              "  summary               row counts and overall averages\n"
+              "  length-by-tick-rate   average final length per tick rate\n"
+              "  deaths                games by death cause\n"
+              "  near-death            ticks with at most --free N ways out (default 1)\n"
+              "filters:\n"
+              "  --tick-rate MS  --wrap  --no-wrap  --snakes N  --min-length N\n"
+              "  --free N        --limit N (near-death examples to list, default 10)\n");
+}
+
+// Game rows passing the filters, as 0/1 bytes
+std::vector<uint8_t> select_games(const MappedReplayIndex &index, const Filters &filters) {
+  const uint64_t rows = index.game_rows();
+  const int32_t *tick_rate = index.column<int32_t>(IndexColumn::GameTickRate);
+  const uint8_t *wrapping = index.column<uint8_t>(IndexColumn::GameWrapping);
+  const uint8_t *snakes = index.column<uint8_t>(IndexColumn::GameSnakeCount);
+  const int32_t *length = index.column<int32_t>(IndexColumn::GameFinalLength);
+  std::vector<uint8_t> mask(rows, 1);
+  uint8_t *m = mask.data();
+  if (filters.tick_rate >= 0) {
+    for (uint64_t i = 0; i < rows; ++i) { m[i] &= tick_rate[i] == filters.tick_rate; }
+  }
+  if (filters.wrapping >= 0) {
+    for (uint64_t i = 0; i < rows; ++i) { m[i] &= wrapping[i] == filters.wrapping; }
+  }
+  if (filters.snakes >= 0) {
+    for (uint64_t i = 0; i < rows; ++i) { m[i] &= snakes[i] == filters.snakes; }
+  }
+  if (filters.min_length > 0) {
+    for (uint64_t i = 0; i < rows; ++i) { m[i] &= length[i] >= filters.min_length; }
+  }
+  return mask;
+}
+
+void summary(const MappedReplayIndex &index, const std::vector<uint8_t> &mask) {
+  const int32_t *length = index.column<int32_t>(IndexColumn::GameFinalLength);
+  const uint32_t *ticks = index.column<uint32_t>(IndexColumn::GameTicks);
+  uint64_t games = 0, total_length = 0, total_ticks = 0;
+  for (uint64_t i = 0; i < index.game_rows(); ++i) {
+    games += mask[i];
+    total_length += uint64_t(length[i]) * mask[i];
+    total_ticks += uint64_t(ticks[i]) * mask[i];
+  }
+  std::printf("%llu of %llu games, %llu tick rows\n", (unsigned long long)games,
+              (unsigned long long)index.game_rows(), (unsigned long long)index.tick_rows());
+  if (games) {
+    std::printf("average length %.2f, average ticks %.1f\n", double(total_length) / games,
+                double(total_ticks) / games);
+  }
+}
+
+void length_by_tick_rate(const MappedReplayIndex &index, const std::vector<uint8_t> &mask) {
+  const uint64_t rows = index.game_rows();
+  const int32_t *tick_rate = index.column<int32_t>(IndexColumn::GameTickRate);
+  const int32_t *length = index.column<int32_t>(IndexColumn::GameFinalLength);
+  // Keyed by rate rather than indexed by it: rates come from the file and
+  // may be anything an int32 holds
+  struct Totals {
+    uint64_t sum = 0;
+    uint64_t count = 0;
+  };
+  std::map<int32_t, Totals> by_rate;
+  for (uint64_t i = 0; i < rows; ++i) {
+    if (!mask[i]) { continue; }
+    Totals &totals = by_rate[tick_rate[i]];
+    totals.sum += uint64_t(length[i]);
+    totals.count++;
+  }
+  std::printf("%10s %10s %12s\n", "tick ms", "games", "avg length");
+  for (const auto &[rate, totals] : by_rate) {
+    std::printf("%10d %10llu %12.2f\n", rate, (unsigned long long)totals.count, double(totals.sum) / totals.count);
+  }
+}
+
+void deaths(const MappedReplayIndex &index, const std::vector<uint8_t> &mask) {
+  const uint8_t *cause = index.column<uint8_t>(IndexColumn::GameDeathCause);
+  uint64_t count[256] = {};
+  uint64_t total = 0;
+  for (uint64_t i = 0; i < index.game_rows(); ++i) {
+    count[cause[i]] += mask[i];
+    total += mask[i];
+  }
+  std::printf("%-10s %10s %8s\n", "cause", "games", "share");
+  for (int c = 0; c <= static_cast<int>(DeathCause::Starved); ++c) {
+    const char *name = c == 0 ? "survived" : death_cause_name(static_cast<DeathCause>(c));
+    std::printf("%-10s %10llu %7.1f%%\n", name, (unsigned long long)count[c], total ? 100.0 * count[c] / total : 0.0);
+  }
+}
+
+void near_death(const MappedReplayIndex &index, const std::vector<uint8_t> &mask, const Filters &filters) {
+  const uint64_t rows = index.tick_rows();
+  const uint32_t *game = index.column<uint32_t>(IndexColumn::TickGame);
+  const uint32_t *tick = index.column<uint32_t>(IndexColumn::TickNumber);
+  const uint16_t *length = index.column<uint16_t>(IndexColumn::TickLength);
+  const uint8_t *free_moves = index.column<uint8_t>(IndexColumn::TickFreeMoves);
+  const uint8_t *cause = index.column<uint8_t>(IndexColumn::GameDeathCause);
+
+  std::vector<uint8_t> hit(rows);
+  uint64_t hits = 0;
+  for (uint64_t i = 0; i < rows; ++i) {
+    hit[i] = (free_moves[i] <= filters.max_free_moves) & mask[game[i]];
+    hits += hit[i];
+  }
+  // Games that had a close call; a game is counted once however many it had
+  std::vector<uint8_t> game_hit(index.game_rows(), 0);
+  for (uint64_t i = 0; i < rows; ++i) { game_hit[game[i]] |= hit[i]; }
+  uint64_t games = 0, survived = 0;
+  for (uint64_t i = 0; i < index.game_rows(); ++i) {
+    games += game_hit[i];
+    survived += game_hit[i] & (cause[i] == 0);
+  }
+  std::printf("%llu ticks with at most %d free moves, in %llu games (%llu of them survived)\n",
+              (unsigned long long)hits, filters.max_free_moves, (unsigned long long)games,
+              (unsigned long long)survived);
+  int listed = 0;
+  for (uint64_t i = 0; i < rows && listed < filters.limit; ++i) {
+    if (!hit[i]) { continue; }
+    std::printf("  %s tick %u length %u free %u\n", index.game_name(game[i]), tick[i], length[i], free_moves[i]);
+    ++listed;
+  }
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  if (argc < 3) { print_usage(); return 1; }
+  std::string path = argv[1], command = argv[2];
+  Filters filters;
+  for (int i = 3; i < argc; ++i) {
+    std::string arg = argv[i];
+    auto value = [&]() { return i + 1 < argc ? std::atoi(argv[++i]) : 0; };
+    if (arg == "--tick-rate") { filters.tick_rate = value(); }
+    else if (arg == "--wrap") { filters.wrapping = 1; }
+    else if (arg == "--no-wrap") { filters.wrapping = 0; }
+    else if (arg == "--snakes") { filters.snakes = value(); }
+    else if (arg == "--min-length") { filters.min_length = value(); }
+    else if (arg == "--free") { filters.max_free_moves = value(); }
+    else if (arg == "--limit") { filters.limit = value(); }
+    else { print_usage(); return 1; }
+  }
+
+  MappedReplayIndex index;
+  std::string error;
+  if (!index.open(path, &error)) {
+    std::fprintf(stderr, "%s: %s\n", path.c_str(), error.c_str());
+    return 1;
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  std::vector<uint8_t> mask = select_games(index, filters);
+  if (command == "summary") { summary(index, mask); }
+  else if (command == "length-by-tick-rate") { length_by_tick_rate(index, mask); }
+  else if (command == "deaths") { deaths(index, mask); }
+  else if (command == "near-death") { near_death(index, mask, filters); }
+  else { print_usage(); return 1; }
+  double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+  std::printf("(%.2f ms)\n", ms);
+  return 0;
+}
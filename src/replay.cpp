@@ -0,0 +1,176 @@
+#include "replay.hpp"
+#include "replay_codec.hpp"
+#include "util.hpp"
+
+#include <cstdio>
+
+namespace {
+
+// Fields are written one by one in little-endian order, so files are the same
+// on every platform regardless of struct layout
+class ByteWriter {
+public:
+  explicit ByteWriter(std::vector<uint8_t> &out) : out(out) {}
+  void u8(uint8_t v) { out.push_back(v); }
+  void u16(uint16_t v) { for (int i = 0; i < 2; ++i) { out.push_back(uint8_t(v >> (8 * i))); } }
+  void u32(uint32_t v) { for (int i = 0; i < 4; ++i) { out.push_back(uint8_t(v >> (8 * i))); } }
+  void u64(uint64_t v) { for (int i = 0; i < 8; ++i) { out.push_back(uint8_t(v >> (8 * i))); } }
+  void i32(int32_t v) { u32(static_cast<uint32_t>(v)); }
+
+private:
+  std::vector<uint8_t> &out;
+};
+
+class ByteReader {
+public:
+  ByteReader(const uint8_t *data, size_t size) : data(data), size(size), offset(0) {}
+  bool ok() const { return !overrun; }
+  size_t remaining() const { return size - offset; }
+  uint8_t u8() { return static_cast<uint8_t>(read(1)); }
+  uint16_t u16() { return static_cast<uint16_t>(read(2)); }
+  uint32_t u32() { return static_cast<uint32_t>(read(4)); }
+  uint64_t u64() { return read(8); }
+  int32_t i32() { return static_cast<int32_t>(u32()); }
+
+private:
+  uint64_t read(size_t bytes) {
+    if (overrun || remaining() < bytes) { overrun = true; return 0; }
+    uint64_t v = 0;
+    for (size_t i = 0; i < bytes; ++i) { v |= uint64_t(data[offset + i]) << (8 * i); }
+    offset += bytes;
+    return v;
+  }
+
+  const uint8_t *data;
+  size_t size;
+  size_t offset;
+  bool overrun = false;
+};
+
+} // namespace
+
+std::vector<uint8_t> encode_replay(const Replay &replay) {
+  std::vector<uint8_t> out;
+  out.reserve(64 + replay.events.size() * 6);
+  ByteWriter w(out);
+  w.u32(REPLAY_MAGIC);
+  w.u16(REPLAY_VERSION);
+  w.u16(static_cast<uint16_t>(replay.snake_count));
+  w.u64(replay.seed);
+  w.i32(replay.rules.width);
+  w.i32(replay.rules.height);
+  w.i32(replay.rules.initial_length);
+  w.i32(replay.rules.tick_rate_ms);
+  w.u8(replay.rules.wrapping ? 1 : 0);
+  w.i32(replay.rules.max_ticks);
+  w.i32(replay.rules.starvation_ticks);
+  w.u32(replay.ticks);
+  for (int32_t length : replay.final_lengths) { w.i32(length); }
+  w.u32(static_cast<uint32_t>(replay.events.size()));
+  for (const ReplayEvent &event : replay.events) {
+    w.u32(event.tick);
+    w.u8(event.snake);
+    w.u8(static_cast<uint8_t>(event.direction));
+  }
+  return out;
+}
+
+bool decode_replay(const uint8_t *data, size_t size, Replay &replay, std::string *error) {
+  if (size >= 4 && ByteReader(data, 4).u32() == COMPRESSED_REPLAY_MAGIC) {
+    return decompress_replay(data, size, replay, error);
+  }
+  return decode_plain_replay(data, size, replay, error);
+}
+
+bool decode_plain_replay(const uint8_t *data, size_t size, Replay &replay, std::string *error) {
+  ByteReader r(data, size);
+  if (r.u32() != REPLAY_MAGIC) { return fail(error, "not a replay file"); }
+  if (r.u16() != REPLAY_VERSION) { return fail(error, "unsupported replay version"); }
+  replay.snake_count = r.u16();
+  replay.seed = r.u64();
+  replay.rules.width = r.i32();
+  replay.rules.height = r.i32();
+  replay.rules.initial_length = r.i32();
+  replay.rules.tick_rate_ms = r.i32();
+  replay.rules.wrapping = r.u8() != 0;
+  replay.rules.max_ticks = r.i32();
+  replay.rules.starvation_ticks = r.i32();
+  replay.ticks = r.u32();
+  if (!r.ok()) { return fail(error, "truncated header"); }
+
+  const Rules &rules = replay.rules;
+  if (rules.width < 1 || rules.height < 1 || rules.width > 4096 || rules.height > 4096) {
+    return fail(error, "board size out of range");
+  }
+  if (replay.snake_count < 1 || replay.snake_count > 255) { return fail(error, "snake count out of range"); }
+  if (int64_t(rules.width) * rules.height * replay.snake_count > REPLAY_MAX_CELLS) {
+    return fail(error, "board too large for its snakes");
+  }
+  if (rules.initial_length < 1 || rules.initial_length > rules.width * rules.height) {
+    return fail(error, "initial length out of range");
+  }
+  if (rules.max_ticks < 0 || rules.starvation_ticks < 0 || rules.tick_rate_ms < 0) {
+    return fail(error, "negative rule value");
+  }
+
+  replay.final_lengths.assign(replay.snake_count, 0);
+  for (int32_t &length : replay.final_lengths) { length = r.i32(); }
+  uint32_t event_count = r.u32();
+  if (!r.ok()) { return fail(error, "truncated header"); }
+  if (event_count > r.remaining() / 6) { return fail(error, "truncated events"); }
+
+  replay.events.clear();
+  replay.events.reserve(event_count);
+  uint32_t previous_tick = 0;
+  for (uint32_t i = 0; i < event_count; ++i) {
+    ReplayEvent event;
+    event.tick = r.u32();
+    event.snake = r.u8();
+    uint8_t direction = r.u8();
+    if (event.tick < previous_tick || event.tick >= replay.ticks) { return fail(error, "event out of order"); }
+    if (event.snake >= replay.snake_count) { return fail(error, "event for unknown snake"); }
+    if (direction > static_cast<uint8_t>(Direction::Right)) { return fail(error, "invalid direction"); }
+    event.direction = static_cast<Direction>(direction);
+    previous_tick = event.tick;
+    replay.events.push_back(event);
+  }
+  if (r.remaining() != 0) { return fail(error, "trailing data"); }
+  return true;
+}
+
+bool save_replay(const Replay &replay, const std::string &path, bool compressed) {
+  std::vector<uint8_t> bytes = compressed ? compress_replay(replay) : encode_replay(replay);
+  FILE *file = std::fopen(path.c_str(), "wb");
+  if (!file) { return false; }
+  bool ok = std::fwrite(bytes.data(), 1, bytes.size(), file) == bytes.size();
+  return std::fclose(file) == 0 && ok;
+}
+
+bool load_replay(const std::string &path, Replay &replay, std::string *error) {
+  FILE *file = std::fopen(path.c_str(), "rb");
+  if (!file) { return fail(error, "cannot open file"); }
+  std::vector<uint8_t> bytes;
+  uint8_t buffer[4096];
+  size_t n;
+  while ((n = std::fread(buffer, 1, sizeof(buffer), file)) > 0) {
+    bytes.insert(bytes.end(), buffer, buffer + n);
+  }
+  std::fclose(file);
+  return decode_replay(bytes.data(), bytes.size(), replay, error);
+}
+
+bool ReplayPlayer::step() {
+  if (world.get_tick() >= replay.ticks || world.is_over()) { return false; }
+  while (next_event < replay.events.size() && replay.events[next_event].tick == world.get_tick()) {
+    const ReplayEvent &event = replay.events[next_event++];
+    world.set_direction(event.snake, event.direction);
+  }
+  world.step();
+  return true;
+}
+
+World play_replay(const Replay &replay) {
+  ReplayPlayer player(replay);
+  while (player.step()) {}
+  return player.get_world();
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+// Replays store the rules, the seed and the directions applied on each tick.
+// Replaying them through a World with the same seed reproduces the game.
+
+#include "core.hpp"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+constexpr uint32_t REPLAY_MAGIC   = 0x524b4e53;  // "SNKR" little-endian
+constexpr uint16_t REPLAY_VERSION = 1;
+// Replaying builds a board and, per snake, a body ring the size of the
+// board; headers asking for more cells than this in total are rejected
+constexpr int64_t REPLAY_MAX_CELLS = int64_t(1) << 22;
+
+struct Replay {
+  Rules rules;
+  uint64_t seed = 0;
+  int snake_count = 1;
+  uint32_t ticks = 0;                 // Ticks played until the game ended
+  std::vector<int32_t> final_lengths; // One per snake
+  std::vector<ReplayEvent> events;    // Sorted by tick
+};
+
+std::vector<uint8_t> encode_replay(const Replay &replay);
+// Rejects truncated or inconsistent data, describing the problem in `error`.
+// Accepts both the plain format and the compressed one from replay_codec.hpp.
+bool decode_replay(const uint8_t *data, size_t size, Replay &replay, std::string *error = nullptr);
+// The plain format only
+bool decode_plain_replay(const uint8_t *data, size_t size, Replay &replay, std::string *error = nullptr);
+
+bool save_replay(const Replay &replay, const std::string &path, bool compressed = false);
+bool load_replay(const std::string &path, Replay &replay, std::string *error = nullptr);
+
+// Steps a replay forward one tick at a time, applying its recorded
+// directions, so callers can look at every intermediate state
+class ReplayPlayer {
+public:
+  explicit ReplayPlayer(const Replay &replay)
+    : replay(replay), world(replay.rules, replay.seed, replay.snake_count), next_event(0) {}
+
+  // Plays the next tick; false once the replay has run out
+  bool step();
+
+  const World &get_world() const { return world; }
+
+private:
+  const Replay &replay;
+  World world;
+  size_t next_event;
+};
+
+// Re-simulates a replay, returning the world in the state it ended in
+World play_replay(const Replay &replay);
@@ -0,0 +1,303 @@
+#include "replay_codec.hpp"
+#include "util.hpp"
+
+#include <algorithm>
+#include <array>
+
+namespace {
+
+// LZMA-style binary range coder with 11-bit probabilities
+constexpr int PROBABILITY_BITS = 11;
+constexpr uint16_t PROBABILITY_HALF = 1 << (PROBABILITY_BITS - 1);
+constexpr int ADAPT_SHIFT = 4;
+constexpr uint32_t TOP = 1u << 24;
+
+class RangeEncoder {
+public:
+  explicit RangeEncoder(std::vector<uint8_t> &out) : out(out) {}
+
+  void encode(uint16_t &probability, int bit) {
+    uint32_t bound = (range >> PROBABILITY_BITS) * probability;
+    if (!bit) {
+      range = bound;
+      probability += ((1 << PROBABILITY_BITS) - probability) >> ADAPT_SHIFT;
+    } else {
+      low += bound;
+      range -= bound;
+      probability -= probability >> ADAPT_SHIFT;
+    }
+    while (range < TOP) {
+      range <<= 8;
+      shift_low();
+    }
+  }
+
+  void finish() {
+    for (int i = 0; i < 5; ++i) { shift_low(); }
+  }
+
+private:
+  void shift_low() {
+    if (static_cast<uint32_t>(low) < 0xff000000u || (low >> 32) != 0) {
+      uint8_t carry = static_cast<uint8_t>(low >> 32);
+      if (has_cache) { out.push_back(static_cast<uint8_t>(cache + carry)); }
+      for (; pending_ff > 0; --pending_ff) { out.push_back(static_cast<uint8_t>(0xff + carry)); }
+      cache = static_cast<uint8_t>(low >> 24);
+      has_cache = true;
+    } else {
+      ++pending_ff;
+    }
+    low = (low & 0x00ffffffu) << 8;
+  }
+
+  std::vector<uint8_t> &out;
+  uint64_t low = 0;
+  uint32_t range = 0xffffffffu;
+  uint8_t cache = 0;
+  bool has_cache = false;
+  uint64_t pending_ff = 0;
+};
+
+class RangeDecoder {
+public:
+  RangeDecoder(const uint8_t *data, size_t size) : data(data), size(size) {
+    for (int i = 0; i < 4; ++i) { code = (code << 8) | next_byte(); }
+  }
+
+  int decode(uint16_t &probability) {
+    uint32_t bound = (range >> PROBABILITY_BITS) * probability;
+    int bit;
+    if (code < bound) {
+      range = bound;
+      probability += ((1 << PROBABILITY_BITS) - probability) >> ADAPT_SHIFT;
+      bit = 0;
+    } else {
+      code -= bound;
+      range -= bound;
+      probability -= probability >> ADAPT_SHIFT;
+      bit = 1;
+    }
+    while (range < TOP) {
+      range <<= 8;
+      code = (code << 8) | next_byte();
+    }
+    return bit;
+  }
+
+  // Reading well past the end means the stream was cut short or is garbage
+  bool overran() const { return offset > size + 8; }
+  size_t remaining() const { return offset < size ? size - offset : 0; }
+
+private:
+  uint8_t next_byte() { return offset < size ? data[offset++] : (++offset, 0); }
+
+  const uint8_t *data;
+  size_t size;
+  size_t offset = 0;
+  uint32_t range = 0xffffffffu;
+  uint32_t code = 0;
+};
+
+enum Turn { Straight = 0, Left = 1, Right = 2, Back = 3, NoTurn = 4 };
+
+Direction turn_left(Direction d) {
+  switch (d) {
+    case Direction::Up:    return Direction::Left;
+    case Direction::Left:  return Direction::Down;
+    case Direction::Down:  return Direction::Right;
+    case Direction::Right: return Direction::Up;
+  }
+  return d;
+}
+
+Direction apply_turn(Direction d, int turn) {
+  switch (turn) {
+    case Left:  return turn_left(d);
+    case Right: return turn_left(turn_left(turn_left(d)));
+    case Back:  return turn_left(turn_left(d));
+    default:    return d;
+  }
+}
+
+int relative_turn(Direction from, Direction to) {
+  for (int turn = Straight; turn <= Back; ++turn) {
+    if (apply_turn(from, turn) == to) { return turn; }
+  }
+  return Straight;
+}
+
+constexpr int NUMBER_BITS = 33;  // Values up to 2^32
+
+// Adaptive model for non-negative numbers: the bit length in unary, then the
+// bits below the leading one, each with its own probability
+struct NumberModel {
+  std::array<uint16_t, NUMBER_BITS> length;
+  std::array<std::array<uint16_t, NUMBER_BITS>, NUMBER_BITS> mantissa;
+
+  NumberModel() {
+    length.fill(PROBABILITY_HALF);
+    for (auto &row : mantissa) { row.fill(PROBABILITY_HALF); }
+  }
+};
+
+int bit_length(uint64_t v) {
+  int n = 0;
+  while (v) { ++n; v >>= 1; }
+  return n;
+}
+
+void encode_number(RangeEncoder &rc, NumberModel &model, uint64_t value) {
+  uint64_t v = value + 1;
+  int n = bit_length(v);
+  for (int i = 1; i < n; ++i) { rc.encode(model.length[i], 1); }
+  if (n < NUMBER_BITS) { rc.encode(model.length[n], 0); }
+  for (int i = n - 2; i >= 0; --i) { rc.encode(model.mantissa[n][i], (v >> i) & 1); }
+}
+
+bool decode_number(RangeDecoder &rc, NumberModel &model, uint64_t &value) {
+  int n = 1;
+  while (n < NUMBER_BITS && rc.decode(model.length[n])) { ++n; }
+  if (n >= NUMBER_BITS) { return false; }
+  uint64_t v = 1;
+  for (int i = n - 2; i >= 0; --i) { v = (v << 1) | static_cast<uint64_t>(rc.decode(model.mantissa[n][i])); }
+  value = v - 1;
+  return true;
+}
+
+// Run lengths are modelled on the size class of the previous run
+constexpr int RUN_CONTEXTS = 16;
+
+struct TurnModel {
+  // Binary tree over the four turns, one tree per previous turn
+  std::array<std::array<uint16_t, 3>, 5> turn;
+  std::array<NumberModel, RUN_CONTEXTS> run;
+  NumberModel count;
+
+  TurnModel() {
+    for (auto &tree : turn) { tree.fill(PROBABILITY_HALF); }
+  }
+};
+
+int run_context(uint64_t previous_run) { return std::min(bit_length(previous_run), RUN_CONTEXTS - 1); }
+
+// An event takes at least five decisions (a run of one and a turn), and a
+// saturated probability still costs about 0.0106 bits per decision, so no
+// stream holds more than about 151 events per byte
+constexpr uint64_t MAX_EVENTS_PER_BYTE = 160;
+
+void put_u32(std::vector<uint8_t> &out, uint32_t v) {
+  for (int i = 0; i < 4; ++i) { out.push_back(static_cast<uint8_t>(v >> (8 * i))); }
+}
+
+uint32_t get_u32(const uint8_t *p) {
+  return uint32_t(p[0]) | uint32_t(p[1]) << 8 | uint32_t(p[2]) << 16 | uint32_t(p[3]) << 24;
+}
+
+} // namespace
+
+std::vector<uint8_t> compress_replay(const Replay &replay) {
+  Replay header_only = replay;
+  header_only.events.clear();
+  std::vector<uint8_t> header = encode_replay(header_only);
+
+  std::vector<uint8_t> out;
+  put_u32(out, COMPRESSED_REPLAY_MAGIC);
+  put_u32(out, static_cast<uint32_t>(header.size()));
+  out.insert(out.end(), header.begin(), header.end());
+
+  RangeEncoder rc(out);
+  TurnModel model;
+  for (int snake = 0; snake < replay.snake_count; ++snake) {
+    uint64_t count = 0;
+    for (const ReplayEvent &event : replay.events) { count += event.snake == snake; }
+    encode_number(rc, model.count, count);
+
+    Direction heading = spawn_heading(snake);
+    int64_t previous_tick = -1;
+    uint64_t previous_run = 0;
+    int previous_turn = NoTurn;
+    for (const ReplayEvent &event : replay.events) {
+      if (event.snake != snake) { continue; }
+      uint64_t run = static_cast<uint64_t>(event.tick - previous_tick);
+      encode_number(rc, model.run[run_context(previous_run)], run);
+      int turn = relative_turn(heading, event.direction);
+      auto &tree = model.turn[previous_turn];
+      rc.encode(tree[0], turn >> 1);
+      rc.encode(tree[1 + (turn >> 1)], turn & 1);
+      heading = event.direction;
+      previous_tick = event.tick;
+      previous_run = run;
+      previous_turn = turn;
+    }
+  }
+  rc.finish();
+  return out;
+}
+
+bool decompress_replay(const uint8_t *data, size_t size, Replay &replay, std::string *error) {
+  if (size < 8 || get_u32(data) != COMPRESSED_REPLAY_MAGIC) { return fail(error, "not a compressed replay"); }
+  uint32_t header_size = get_u32(data + 4);
+  if (header_size > size - 8) { return fail(error, "truncated header"); }
+  // The header is always plain; going back through decode_replay would let
+  // nested compressed headers recurse without bound
+  if (header_size >= 4 && get_u32(data + 8) == COMPRESSED_REPLAY_MAGIC) {
+    return fail(error, "compressed replay inside a compressed replay");
+  }
+  if (!decode_plain_replay(data + 8, header_size, replay, error)) { return false; }
+  if (!replay.events.empty()) { return fail(error, "events in compressed header"); }
+
+  RangeDecoder rc(data + 8 + header_size, size - 8 - header_size);
+  TurnModel model;
+  std::vector<std::vector<ReplayEvent>> streams(replay.snake_count);
+  size_t total = 0;
+  for (int snake = 0; snake < replay.snake_count; ++snake) {
+    uint64_t count;
+    if (!decode_number(rc, model.count, count)) { return fail(error, "corrupt event count"); }
+    // A snake changes direction at most once per tick, and each event
+    // takes some of the input, so a count the rest of the stream cannot
+    // hold is rejected before anything is allocated for it
+    if (count > replay.ticks || count > (rc.remaining() + 8) * MAX_EVENTS_PER_BYTE) {
+      return fail(error, "corrupt event count");
+    }
+    total += count;
+
+    Direction heading = spawn_heading(snake);
+    int64_t tick = -1;
+    uint64_t previous_run = 0;
+    int previous_turn = NoTurn;
+    streams[snake].reserve(count);
+    for (uint64_t i = 0; i < count; ++i) {
+      uint64_t run;
+      // Events come at most once per tick, so runs are at least one; past
+      // the end the decoder reads zeros, which would decode as runs of zero
+      if (!decode_number(rc, model.run[run_context(previous_run)], run) || run == 0) {
+        return fail(error, "corrupt run");
+      }
+      auto &tree = model.turn[previous_turn];
+      int high = rc.decode(tree[0]);
+      int turn = (high << 1) | rc.decode(tree[1 + high]);
+      tick += static_cast<int64_t>(run);
+      if (tick < 0 || tick >= static_cast<int64_t>(replay.ticks)) { return fail(error, "event out of range"); }
+      heading = apply_turn(heading, turn);
+      streams[snake].push_back({ static_cast<uint32_t>(tick), static_cast<uint8_t>(snake), heading });
+      previous_run = run;
+      previous_turn = turn;
+      if (rc.overran()) { return fail(error, "truncated events"); }
+    }
+    if (rc.overran()) { return fail(error, "truncated events"); }
+  }
+
+  // Interleave the per-snake streams back into tick order
+  replay.events.clear();
+  replay.events.reserve(total);
+  std::vector<size_t> cursor(replay.snake_count, 0);
+  while (replay.events.size() < total) {
+    int next = -1;
+    for (int snake = 0; snake < replay.snake_count; ++snake) {
+      if (cursor[snake] == streams[snake].size()) { continue; }
+      if (next < 0 || streams[snake][cursor[snake]].tick < streams[next][cursor[next]].tick) { next = snake; }
+    }
+    replay.events.push_back(streams[next][cursor[next]++]);
+  }
+  return true;
+}
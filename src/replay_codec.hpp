@@ -0,0 +1,19 @@
+#pragma once
+
+// Compressed replay codec.
+// Each snake's directions become relative turns (straight, left, right,
+// back) separated by run lengths of ticks, coded with an adaptive binary
+// range coder. Turns are modelled on the previous turn and run lengths on
+// the size of the previous run. The header is the plain replay header, so
+// everything but the events is stored as is.
+
+#include "replay.hpp"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+constexpr uint32_t COMPRESSED_REPLAY_MAGIC = 0x5a4b4e53;  // "SNKZ" little-endian
+
+std::vector<uint8_t> compress_replay(const Replay &replay);
+bool decompress_replay(const uint8_t *data, size_t size, Replay &replay, std::string *error = nullptr);
@@ -0,0 +1,246 @@
+#include "replay_index.hpp"
+#include "replay.hpp"
+#include "util.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+namespace {
+
+constexpr size_t COLUMN_ALIGNMENT = 64;
+constexpr size_t COLUMN_COUNT = static_cast<size_t>(IndexColumn::Count);
+
+struct FileHeader {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t column_count;
+  uint64_t game_rows;
+  uint64_t tick_rows;
+};
+
+struct ColumnEntry {
+  uint16_t id;
+  uint16_t element_size;
+  uint32_t reserved;
+  uint64_t offset;
+  uint64_t count;
+};
+
+struct ColumnData {
+  IndexColumn id;
+  const void *data;
+  size_t element_size;
+  size_t count;
+};
+
+template <typename T>
+ColumnData describe(IndexColumn id, const std::vector<T> &values) {
+  return { id, values.data(), sizeof(T), values.size() };
+}
+
+// Element size each column must have, used to validate files on open
+size_t expected_element_size(IndexColumn id) {
+  switch (id) {
+    case IndexColumn::GameWrapping:
+    case IndexColumn::GameSnakeCount:
+    case IndexColumn::GameDeathCause:
+    case IndexColumn::GameNames:
+    case IndexColumn::TickFreeMoves:
+      return 1;
+    case IndexColumn::TickLength:
+    case IndexColumn::TickFoodDistance:
+      return 2;
+    default:
+      return 4;
+  }
+}
+
+bool is_game_column(IndexColumn id) { return id < IndexColumn::TickGame && id != IndexColumn::GameNames; }
+
+} // namespace
+
+void ReplayIndexColumns::append(const ReplayIndexColumns &other) {
+  const uint32_t game_base = static_cast<uint32_t>(game_tick_rate.size());
+  const uint32_t name_base = static_cast<uint32_t>(game_names.size());
+  auto concat = [](auto &to, const auto &from) { to.insert(to.end(), from.begin(), from.end()); };
+  concat(game_tick_rate, other.game_tick_rate);
+  concat(game_wrapping, other.game_wrapping);
+  concat(game_snake_count, other.game_snake_count);
+  concat(game_initial_length, other.game_initial_length);
+  concat(game_final_length, other.game_final_length);
+  concat(game_ticks, other.game_ticks);
+  concat(game_death_cause, other.game_death_cause);
+  for (uint32_t offset : other.game_name_offset) { game_name_offset.push_back(name_base + offset); }
+  game_names += other.game_names;
+  for (uint32_t game : other.tick_game) { tick_game.push_back(game_base + game); }
+  concat(tick_number, other.tick_number);
+  concat(tick_length, other.tick_length);
+  concat(tick_free_moves, other.tick_free_moves);
+  concat(tick_food_distance, other.tick_food_distance);
+}
+
+bool index_replay(const std::string &path, ReplayIndexColumns &columns, std::string *error) {
+  Replay replay;
+  if (!load_replay(path, replay, error)) { return false; }
+
+  const uint32_t first_row = static_cast<uint32_t>(columns.game_tick_rate.size());
+  const Rules &rules = replay.rules;
+  ReplayPlayer player(replay);
+  while (player.step()) {
+    const World &world = player.get_world();
+    const Point food = world.get_food();
+    for (int s = 0; s < world.get_snake_count(); ++s) {
+      if (!world.is_alive(s)) { continue; }
+      const Snake &snake = world.get_snake(s);
+      const Point head = snake.get_head();
+      uint8_t free_moves = 0;
+      for (Direction d : { Direction::Up, Direction::Down, Direction::Left, Direction::Right }) {
+        if (!is_opposite(d, snake.get_direction()) && !world.is_blocked(step_towards(head, d))) { ++free_moves; }
+      }
+      int dx = std::abs(head.x - food.x), dy = std::abs(head.y - food.y);
+      if (rules.wrapping) {
+        dx = std::min(dx, rules.width - dx);
+        dy = std::min(dy, rules.height - dy);
+      }
+      columns.tick_game.push_back(first_row + s);
+      columns.tick_number.push_back(world.get_tick());
+      columns.tick_length.push_back(static_cast<uint16_t>(std::min(snake.get_length(), 0xffff)));
+      columns.tick_free_moves.push_back(free_moves);
+      columns.tick_food_distance.push_back(static_cast<uint16_t>(std::min(dx + dy, 0xffff)));
+    }
+  }
+
+  const World &world = player.get_world();
+  const uint32_t name_offset = static_cast<uint32_t>(columns.game_names.size());
+  columns.game_names += path;
+  columns.game_names.push_back('\0');
+  for (int s = 0; s < world.get_snake_count(); ++s) {
+    columns.game_tick_rate.push_back(rules.tick_rate_ms);
+    columns.game_wrapping.push_back(rules.wrapping ? 1 : 0);
+    columns.game_snake_count.push_back(static_cast<uint8_t>(world.get_snake_count()));
+    columns.game_initial_length.push_back(rules.initial_length);
+    columns.game_final_length.push_back(world.get_snake(s).get_length());
+    columns.game_ticks.push_back(world.is_alive(s) ? world.get_tick() : world.get_death_tick(s));
+    columns.game_death_cause.push_back(static_cast<uint8_t>(world.get_death_cause(s)));
+    columns.game_name_offset.push_back(name_offset);
+  }
+  return true;
+}
+
+bool write_replay_index(const ReplayIndexColumns &columns, const std::string &path) {
+  const std::vector<ColumnData> data = {
+    describe(IndexColumn::GameTickRate, columns.game_tick_rate),
+    describe(IndexColumn::GameWrapping, columns.game_wrapping),
+    describe(IndexColumn::GameSnakeCount, columns.game_snake_count),
+    describe(IndexColumn::GameInitialLength, columns.game_initial_length),
+    describe(IndexColumn::GameFinalLength, columns.game_final_length),
+    describe(IndexColumn::GameTicks, columns.game_ticks),
+    describe(IndexColumn::GameDeathCause, columns.game_death_cause),
+    describe(IndexColumn::GameNameOffset, columns.game_name_offset),
+    { IndexColumn::GameNames, columns.game_names.data(), 1, columns.game_names.size() },
+    describe(IndexColumn::TickGame, columns.tick_game),
+    describe(IndexColumn::TickNumber, columns.tick_number),
+    describe(IndexColumn::TickLength, columns.tick_length),
+    describe(IndexColumn::TickFreeMoves, columns.tick_free_moves),
+    describe(IndexColumn::TickFoodDistance, columns.tick_food_distance),
+  };
+
+  FileHeader header = { REPLAY_INDEX_MAGIC, REPLAY_INDEX_VERSION, static_cast<uint16_t>(data.size()),
+                        columns.game_tick_rate.size(), columns.tick_game.size() };
+  std::vector<ColumnEntry> entries;
+  uint64_t offset = sizeof(FileHeader) + data.size() * sizeof(ColumnEntry);
+  for (const ColumnData &column : data) {
+    offset = (offset + COLUMN_ALIGNMENT - 1) / COLUMN_ALIGNMENT * COLUMN_ALIGNMENT;
+    entries.push_back({ static_cast<uint16_t>(column.id), static_cast<uint16_t>(column.element_size), 0,
+                        offset, column.count });
+    offset += column.element_size * column.count;
+  }
+
+  FILE *file = std::fopen(path.c_str(), "wb");
+  if (!file) { return false; }
+  bool ok = std::fwrite(&header, sizeof(header), 1, file) == 1 &&
+            std::fwrite(entries.data(), sizeof(ColumnEntry), entries.size(), file) == entries.size();
+  uint64_t position = sizeof(FileHeader) + data.size() * sizeof(ColumnEntry);
+  static const char padding[COLUMN_ALIGNMENT] = {};
+  for (size_t i = 0; ok && i < data.size(); ++i) {
+    ok = std::fwrite(padding, 1, entries[i].offset - position, file) == entries[i].offset - position;
+    size_t bytes = data[i].element_size * data[i].count;
+    ok = ok && (bytes == 0 || std::fwrite(data[i].data, 1, bytes, file) == bytes);
+    position = entries[i].offset + bytes;
+  }
+  return std::fclose(file) == 0 && ok;
+}
+
+MappedReplayIndex::~MappedReplayIndex() {
+  if (mapping) { munmap(mapping, mapping_size); }
+}
+
+bool MappedReplayIndex::open(const std::string &path, std::string *error) {
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0) { return fail(error, "cannot open index"); }
+  struct stat info;
+  if (fstat(fd, &info) != 0 || info.st_size < static_cast<off_t>(sizeof(FileHeader))) {
+    ::close(fd);
+    return fail(error, "index too small");
+  }
+  mapping_size = static_cast<size_t>(info.st_size);
+  mapping = mmap(nullptr, mapping_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+  if (mapping == MAP_FAILED) { mapping = nullptr; return fail(error, "cannot map index"); }
+
+  const auto *bytes = static_cast<const uint8_t *>(mapping);
+  FileHeader header;
+  std::memcpy(&header, bytes, sizeof(header));
+  if (header.magic != REPLAY_INDEX_MAGIC) { return fail(error, "not a replay index"); }
+  if (header.version != REPLAY_INDEX_VERSION) { return fail(error, "unsupported index version"); }
+  if (mapping_size < sizeof(FileHeader) + header.column_count * sizeof(ColumnEntry)) {
+    return fail(error, "truncated column table");
+  }
+  games = header.game_rows;
+  ticks = header.tick_rows;
+
+  for (uint16_t i = 0; i < header.column_count; ++i) {
+    ColumnEntry entry;
+    std::memcpy(&entry, bytes + sizeof(FileHeader) + i * sizeof(ColumnEntry), sizeof(entry));
+    if (entry.id >= COLUMN_COUNT) { continue; }  // Column from a newer writer
+    IndexColumn id = static_cast<IndexColumn>(entry.id);
+    if (entry.element_size != expected_element_size(id) || entry.offset % COLUMN_ALIGNMENT != 0 ||
+        entry.offset > mapping_size || entry.count > (mapping_size - entry.offset) / entry.element_size) {
+      return fail(error, "corrupt column table");
+    }
+    uint64_t rows = is_game_column(id) ? games : (id >= IndexColumn::TickGame ? ticks : entry.count);
+    if (entry.count != rows) { return fail(error, "column length mismatch"); }
+    columns[entry.id] = bytes + entry.offset;
+  }
+  for (size_t i = 0; i < COLUMN_COUNT; ++i) {
+    if (!columns[i]) { return fail(error, "missing column"); }
+  }
+
+  // Names are looked up by offset, so every offset has to land on a name
+  const uint64_t names_size = [&]() {
+    ColumnEntry entry;
+    for (uint16_t i = 0; i < header.column_count; ++i) {
+      std::memcpy(&entry, bytes + sizeof(FileHeader) + i * sizeof(ColumnEntry), sizeof(entry));
+      if (entry.id == static_cast<uint16_t>(IndexColumn::GameNames)) { return entry.count; }
+    }
+    return uint64_t(0);
+  }();
+  const char *names = column<char>(IndexColumn::GameNames);
+  if (names_size > 0 && names[names_size - 1] != '\0') { return fail(error, "corrupt names"); }
+  const uint32_t *name_offsets = column<uint32_t>(IndexColumn::GameNameOffset);
+  for (uint64_t row = 0; row < games; ++row) {
+    if (name_offsets[row] >= names_size) { return fail(error, "corrupt names"); }
+  }
+  const uint32_t *tick_games = column<uint32_t>(IndexColumn::TickGame);
+  for (uint64_t row = 0; row < ticks; ++row) {
+    if (tick_games[row] >= games) { return fail(error, "corrupt tick rows"); }
+  }
+  return true;
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+// Columnar index of replay summaries.
+// Each column is one flat array in the file, aligned so the reader can map
+// the file and scan columns in place. There is one game row per snake per
+// replay and one tick row per snake per tick it was alive. Columns are in
+// the byte order of the machine that wrote them.
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+constexpr uint32_t REPLAY_INDEX_MAGIC   = 0x494b4e53;  // "SNKI" little-endian
+constexpr uint16_t REPLAY_INDEX_VERSION = 1;
+
+enum class IndexColumn : uint16_t {
+  // Game rows
+  GameTickRate,
+  GameWrapping,
+  GameSnakeCount,
+  GameInitialLength,
+  GameFinalLength,
+  GameTicks,
+  GameDeathCause,
+  GameNameOffset,   // Offset of the replay's path in GameNames
+  GameNames,        // Nul-terminated paths, one per replay
+  // Tick rows
+  TickGame,         // Game row the tick belongs to
+  TickNumber,
+  TickLength,
+  TickFreeMoves,    // Moves that do not run straight into something
+  TickFoodDistance,
+  Count
+};
+
+// Columns as built by the indexer
+struct ReplayIndexColumns {
+  std::vector<int32_t> game_tick_rate;
+  std::vector<uint8_t> game_wrapping;
+  std::vector<uint8_t> game_snake_count;
+  std::vector<int32_t> game_initial_length;
+  std::vector<int32_t> game_final_length;
+  std::vector<uint32_t> game_ticks;
+  std::vector<uint8_t> game_death_cause;
+  std::vector<uint32_t> game_name_offset;
+  std::string game_names;
+
+  std::vector<uint32_t> tick_game;
+  std::vector<uint32_t> tick_number;
+  std::vector<uint16_t> tick_length;
+  std::vector<uint8_t> tick_free_moves;
+  std::vector<uint16_t> tick_food_distance;
+
+  // Appends another set of rows, renumbering its game references
+  void append(const ReplayIndexColumns &other);
+};
+
+// Simulates a replay file and appends its rows. Returns false, leaving the
+// columns untouched, if the replay cannot be read.
+bool index_replay(const std::string &path, ReplayIndexColumns &columns, std::string *error = nullptr);
+
+bool write_replay_index(const ReplayIndexColumns &columns, const std::string &path);
+
+// Read-only view of an index file mapped into memory
+class MappedReplayIndex {
+public:
+  MappedReplayIndex() = default;
+  ~MappedReplayIndex();
+  MappedReplayIndex(const MappedReplayIndex &) = delete;
+  MappedReplayIndex &operator=(const MappedReplayIndex &) = delete;
+
+  bool open(const std::string &path, std::string *error = nullptr);
+
+  uint64_t game_rows() const { return games; }
+  uint64_t tick_rows() const { return ticks; }
+
+  template <typename T>
+  const T *column(IndexColumn id) const { return static_cast<const T *>(columns[static_cast<size_t>(id)]); }
+
+  const char *game_name(uint64_t row) const {
+    return column<char>(IndexColumn::GameNames) + column<uint32_t>(IndexColumn::GameNameOffset)[row];
+  }
+
+private:
+  void *mapping = nullptr;
+  size_t mapping_size = 0;
+  uint64_t games = 0;
+  uint64_t ticks = 0;
+  const void *columns[static_cast<size_t>(IndexColumn::Count)] = {};
+};
@@ -0,0 +1,104 @@
+#include "search.hpp"
+#include "bots.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <limits>
+
+namespace {
+
+constexpr Direction ALL_DIRECTIONS[] = { Direction::Up, Direction::Down, Direction::Left, Direction::Right };
+constexpr double DEAD = -1e9;
+// The clock is only read every this many nodes
+constexpr uint64_t CLOCK_CHECK_INTERVAL = 64;
+
+} // namespace
+
+void AnytimeSearch::begin(const World &world, int self_index) {
+  self = self_index;
+  stack[0].world = world;
+  root_tick = world.get_tick();
+  depth_limit = 1;
+  top = -1;
+  started = true;
+  exhausted = false;
+  completed_depth = 0;
+  searched = 0;
+  std::vector<Direction> moves = safe_moves(world, self);
+  best_move = moves.empty() ? world.get_snake(self).get_direction() : moves.front();
+}
+
+bool AnytimeSearch::resume(SearchClock::time_point until, uint64_t node_limit) {
+  if (!started || exhausted) { return true; }
+  while (depth_limit <= MAX_DEPTH) {
+    if (top < 0) {
+      // Start the next iteration from the root
+      stack[0].next_move = 0;
+      stack[0].value = -std::numeric_limits<double>::infinity();
+      iteration_best = best_move;
+      top = 0;
+    }
+    while (top >= 0) {
+      if (searched >= node_limit) { return false; }
+      ++searched;
+      if (++nodes % CLOCK_CHECK_INTERVAL == 0 && SearchClock::now() >= until) { return false; }
+      Node &node = stack[top];
+      if (top == depth_limit || !node.world.is_alive(self) || node.world.is_over()) {
+        finish(evaluate(node.world));
+        continue;
+      }
+      if (node.next_move == 4) {
+        finish(node.value);
+        continue;
+      }
+      Direction move = ALL_DIRECTIONS[node.next_move++];
+      if (is_opposite(move, node.world.get_snake(self).get_direction())) { continue; }
+      Node &child = stack[top + 1];
+      child.world = node.world;
+      child.world.set_direction(self, move);
+      child.world.step();
+      child.next_move = 0;
+      child.value = -std::numeric_limits<double>::infinity();
+      ++top;
+    }
+    best_move = iteration_best;
+    completed_depth = depth_limit++;
+  }
+  exhausted = true;
+  return true;
+}
+
+// Hands a node's value up to its parent, popping it off the stack
+void AnytimeSearch::finish(double value) {
+  if (top == 0) { top = -1; return; }
+  Node &parent = stack[top - 1];
+  if (value > parent.value) {
+    parent.value = value;
+    if (top == 1) { iteration_best = ALL_DIRECTIONS[parent.next_move - 1]; }
+  }
+  --top;
+}
+
+// Length first, then room to move, then closeness to the food. Dying late
+// beats dying early.
+double AnytimeSearch::evaluate(const World &world) const {
+  const Snake &snake = world.get_snake(self);
+  if (!world.is_alive(self)) { return DEAD + world.get_tick(); }
+  const Rules &rules = world.get_rules();
+  const Point head = snake.get_head();
+  const Point food = world.get_food();
+
+  int room = 0;
+  for (Direction d : ALL_DIRECTIONS) {
+    room = std::max(room, reachable_cells(world, step_towards(head, d), snake.get_length() + 8));
+  }
+  int dx = std::abs(head.x - food.x), dy = std::abs(head.y - food.y);
+  if (rules.wrapping) {
+    dx = std::min(dx, rules.width - dx);
+    dy = std::min(dy, rules.height - dy);
+  }
+  double value = snake.get_length() * 1000.0 - (dx + dy);
+  // Being boxed into less room than the body needs is nearly as bad as dying
+  if (room < snake.get_length()) { value -= 1e6 * (snake.get_length() - room); }
+  return value;
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+// Anytime search for bots.
+// The search deepens one ply at a time and can be suspended at any node and
+// resumed later, keeping its stack between calls. After the first ply there
+// is always a best move ready, so callers can spread the work over several
+// frames and take whatever is best when the tick comes around.
+
+#include "core.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+using SearchClock = std::chrono::steady_clock;
+
+// Nodes a bot searches per tick, enough for five plies. A count rather
+// than a time, so a bot plays the same game on any machine and under any
+// load, and tournaments stay reproducible.
+constexpr uint64_t SEARCH_NODE_BUDGET = 512;
+
+class AnytimeSearch {
+public:
+  static constexpr int MAX_DEPTH = 10;
+
+  AnytimeSearch() : stack(MAX_DEPTH + 1) {}
+
+  // Starts over on a new position, forgetting any unfinished work
+  void begin(const World &world, int self);
+
+  // Searches until `until` or until `node_limit` nodes have been searched
+  // since begin(). Returns true once there is nothing left to search.
+  bool resume(SearchClock::time_point until, uint64_t node_limit = UINT64_MAX);
+
+  bool is_started() const { return started; }
+  uint32_t get_root_tick() const { return root_tick; }
+  Direction get_best_move() const { return best_move; }
+  int get_completed_depth() const { return completed_depth; }
+  uint64_t get_nodes() const { return nodes; }
+
+private:
+  // One level of the explicit search stack
+  struct Node {
+    World world{ Rules{}, 0 };
+    int next_move = 0;
+    double value = 0.0;
+  };
+
+  double evaluate(const World &world) const;
+  void finish(double value);
+
+  std::vector<Node> stack;
+  int self = 0;
+  int depth_limit = 1;
+  int top = -1;            // Current stack depth, -1 between iterations
+  bool started = false;
+  bool exhausted = false;
+  uint32_t root_tick = 0;
+  Direction best_move = Direction::Right;
+  Direction iteration_best = Direction::Right;
+  int completed_depth = 0;
+  uint64_t nodes = 0;
+  uint64_t searched = 0;
+};
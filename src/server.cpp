@@ -0,0 +1,235 @@
+// snakey_server: hosts remote games for clients speaking the protocol in
+// net_protocol.hpp.
+//
+//   snakey_server [--address A] [--port N] [--max-sessions N]
+//                 [--min-tick-rate MS] [--join-timeout MS] [--report SECONDS]
+//                 [--workers N]
+//
+// Connections that have not sent Join within --join-timeout (5000 ms by
+// default) are closed, so idle sockets cannot use up the sessions.
+//
+// Every report line gives the open sessions, ticks and inputs per second and
+// how late ticks ran against their schedule.
+//
+// With --workers the server forks N worker processes that each bind the
+// port with SO_REUSEPORT, so the kernel spreads connections over them, and
+// each runs its own event loop, sessions and timer wheel. They share
+// nothing but a ServerRegistry, through which this process collects their
+// stats and session counts. --max-sessions is then per worker. A worker
+// that dies is restarted; its clients are disconnected.
+
+#include "game_server.hpp"
+#include "server_registry.hpp"
+
+#include <sys/prctl.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+// Exit status of a worker that could not start; not worth restarting
+constexpr int WORKER_START_FAILED = 3;
+constexpr int SUPERVISE_INTERVAL_MS = 50;
+
+GameServer *running_server = nullptr;
+volatile std::sig_atomic_t stopping = 0;
+
+void handle_signal(int) {
+  stopping = 1;
+  if (running_server) { running_server->stop(); }
+}
+
+// Every session is a socket, so ask for as many descriptors as allowed
+void raise_file_limit() {
+  rlimit limit;
+  if (getrlimit(RLIMIT_NOFILE, &limit) != 0) { return; }
+  limit.rlim_cur = limit.rlim_max;
+  setrlimit(RLIMIT_NOFILE, &limit);
+}
+
+void print_report(const ServerStats &stats, double seconds) {
+  std::printf("%llu sessions (+%llu -%llu, %llu refused), %.0f ticks/s, %.0f inputs/s, %.1f KB/s out, "
+              "%llu overruns, %llu bad, %llu timed out\n",
+              (unsigned long long)stats.sessions, (unsigned long long)stats.accepted,
+              (unsigned long long)stats.closed, (unsigned long long)stats.refused, stats.ticks / seconds,
+              stats.inputs / seconds, stats.bytes_out / seconds / 1024.0, (unsigned long long)stats.overruns,
+              (unsigned long long)stats.bad_messages, (unsigned long long)stats.timed_out);
+  if (stats.lateness_us.count() > 0) {
+    std::printf("  tick lateness %s\n", stats.lateness_us.summary(1000.0, "ms").c_str());
+  }
+  std::fflush(stdout);
+}
+
+// Serves in this process until a signal arrives; returns the exit status
+int serve(const ServerOptions &options, int report_seconds, bool worker) {
+  GameServer server(options);
+  std::string error;
+  if (!server.start(&error)) {
+    std::fprintf(stderr, "%s\n", error.c_str());
+    return worker ? WORKER_START_FAILED : 1;
+  }
+  running_server = &server;
+  if (stopping) { server.stop(); }
+  if (!worker) {
+    std::printf("listening on %s:%u\n", options.address.c_str(), server.get_port());
+    std::fflush(stdout);
+  }
+  server.run(report_seconds * 1000, [&](const ServerStats &stats) {
+    if (worker) {
+      options.registry->publish_stats(options.worker, stats);
+    } else {
+      print_report(stats, report_seconds);
+    }
+  });
+  running_server = nullptr;
+  return 0;
+}
+
+pid_t start_worker(ServerOptions options, int worker, int report_seconds) {
+  std::fflush(stdout);
+  pid_t pid = fork();
+  if (pid != 0) { return pid; }
+  // Go down with the supervisor, however it ends
+  prctl(PR_SET_PDEATHSIG, SIGTERM);
+  if (stopping || getppid() == 1) { _exit(0); }
+  options.worker = worker;
+  _exit(serve(options, report_seconds, true));
+}
+
+int supervise(ServerOptions options, int workers, int report_seconds) {
+  if (options.port == 0) {
+    std::fprintf(stderr, "--workers needs a fixed --port\n");
+    return 1;
+  }
+  std::string error;
+  auto registry = ServerRegistry::create(workers, options.max_sessions, &error);
+  if (!registry) {
+    std::fprintf(stderr, "%s\n", error.c_str());
+    return 1;
+  }
+  options.reuse_port = true;
+  options.registry = registry.get();
+
+  std::vector<pid_t> pids(workers, -1);
+  for (int i = 0; i < workers; ++i) {
+    pids[i] = start_worker(options, i, report_seconds);
+    if (pids[i] < 0) {
+      std::perror("fork");
+      stopping = 1;
+    }
+  }
+  if (!stopping) {
+    std::printf("started %d workers on %s:%u\n", workers, options.address.c_str(), options.port);
+    std::fflush(stdout);
+  }
+
+  int status_code = 0;
+  std::vector<uint64_t> seen(workers, 0);
+  using Clock = std::chrono::steady_clock;
+  // Read half an interval after the workers publish
+  const auto interval = std::chrono::seconds(report_seconds);
+  auto next_report = Clock::now() + interval + interval / 2;
+  while (!stopping) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(SUPERVISE_INTERVAL_MS));
+    int status = 0;
+    pid_t pid;
+    while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+      int worker = 0;
+      while (worker < workers && pids[worker] != pid) { ++worker; }
+      if (worker == workers) { continue; }
+      pids[worker] = -1;
+      if (stopping) { continue; }
+      if (WIFEXITED(status) && WEXITSTATUS(status) == WORKER_START_FAILED) {
+        status_code = 1;
+        stopping = 1;
+        break;
+      }
+      const size_t lost = registry->count_sessions(worker);
+      registry->clear_worker(worker);
+      if (WIFSIGNALED(status)) {
+        std::printf("worker %d killed by signal %d, %zu sessions lost; restarting\n", worker, WTERMSIG(status), lost);
+      } else {
+        std::printf("worker %d exited with %d, %zu sessions lost; restarting\n", worker, WEXITSTATUS(status), lost);
+      }
+      std::fflush(stdout);
+      pids[worker] = start_worker(options, worker, report_seconds);
+    }
+
+    if (report_seconds > 0 && Clock::now() >= next_report) {
+      next_report += interval;
+      ServerStats total;
+      std::string per_worker;
+      for (int i = 0; i < workers; ++i) {
+        ServerStats stats;
+        if (registry->take_stats(i, &seen[i], stats)) {
+          total.sessions += stats.sessions;
+          total.accepted += stats.accepted;
+          total.refused += stats.refused;
+          total.closed += stats.closed;
+          total.ticks += stats.ticks;
+          total.inputs += stats.inputs;
+          total.bad_messages += stats.bad_messages;
+          total.timed_out += stats.timed_out;
+          total.bytes_out += stats.bytes_out;
+          total.overruns += stats.overruns;
+          total.lateness_us.merge(stats.lateness_us);
+        }
+        per_worker += ' ';
+        per_worker += std::to_string(registry->count_sessions(i));
+      }
+      print_report(total, report_seconds);
+      std::printf("  sessions per worker:%s\n", per_worker.c_str());
+      std::fflush(stdout);
+    }
+  }
+
+  for (pid_t pid : pids) {
+    if (pid > 0) { kill(pid, SIGTERM); }
+  }
+  for (pid_t pid : pids) {
+    if (pid > 0) { waitpid(pid, nullptr, 0); }
+  }
+  return status_code;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  ServerOptions options;
+  int report_seconds = 5;
+  int workers = 0;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    bool has_value = i + 1 < argc;
+    if (arg == "--address" && has_value) { options.address = argv[++i]; }
+    else if (arg == "--port" && has_value) { options.port = static_cast<uint16_t>(std::atoi(argv[++i])); }
+    else if (arg == "--max-sessions" && has_value) { options.max_sessions = std::strtoull(argv[++i], nullptr, 10); }
+    else if (arg == "--min-tick-rate" && has_value) { options.min_tick_rate_ms = std::max(1, std::atoi(argv[++i])); }
+    else if (arg == "--join-timeout" && has_value) { options.join_timeout_ms = std::max(1, std::atoi(argv[++i])); }
+    else if (arg == "--report" && has_value) { report_seconds = std::max(0, std::atoi(argv[++i])); }
+    else if (arg == "--workers" && has_value) {
+      workers = std::clamp(std::atoi(argv[++i]), 0, REGISTRY_MAX_WORKERS);
+    }
+    else {
+      std::fprintf(stderr, "usage: snakey_server [--address A] [--port N] [--max-sessions N] "
+                           "[--min-tick-rate MS] [--join-timeout MS] [--report SECONDS] [--workers N]\n");
+      return 1;
+    }
+  }
+
+  raise_file_limit();
+  std::signal(SIGINT, handle_signal);
+  std::signal(SIGTERM, handle_signal);
+  if (workers > 0) { return supervise(options, workers, report_seconds); }
+  return serve(options, report_seconds, false);
+}
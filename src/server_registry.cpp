@@ -0,0 +1,143 @@
+#include "server_registry.hpp"
+#include "util.hpp"
+
+#include <sys/mman.h>
+
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+
+namespace {
+
+constexpr size_t STATS_WORDS = (sizeof(ServerStats) + 7) / 8;
+constexpr size_t RECORD_WORDS = (sizeof(SessionRecord) + 7) / 8;
+constexpr int READ_ATTEMPTS = 1 << 16;
+
+struct RecordEntry {
+  uint64_t sequence;  // Odd while the owner writes
+  uint64_t words[RECORD_WORDS];
+};
+
+template <typename T>
+std::atomic_ref<T> shared(T &value) { return std::atomic_ref<T>(value); }
+
+// Single-writer sequence lock over a run of words
+void write_words(uint64_t &sequence, uint64_t *words, const void *value, size_t bytes) {
+  uint64_t copy[STATS_WORDS > RECORD_WORDS ? STATS_WORDS : RECORD_WORDS] = {};
+  std::memcpy(copy, value, bytes);
+  auto current = shared(sequence);
+  const uint64_t before = current.load(std::memory_order_relaxed);
+  current.store(before + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  for (size_t i = 0; i < (bytes + 7) / 8; ++i) { shared(words[i]).store(copy[i], std::memory_order_relaxed); }
+  current.store(before + 2, std::memory_order_release);
+}
+
+// False if no consistent copy could be made, as when the writer died in the
+// middle of a write
+bool read_words(uint64_t &sequence, uint64_t *words, void *value, size_t bytes, uint64_t *consistent = nullptr) {
+  uint64_t copy[STATS_WORDS > RECORD_WORDS ? STATS_WORDS : RECORD_WORDS];
+  auto current = shared(sequence);
+  for (int attempt = 0; attempt < READ_ATTEMPTS; ++attempt) {
+    const uint64_t before = current.load(std::memory_order_acquire);
+    if (before & 1) { continue; }
+    for (size_t i = 0; i < (bytes + 7) / 8; ++i) { copy[i] = shared(words[i]).load(std::memory_order_relaxed); }
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (current.load(std::memory_order_relaxed) == before) {
+      std::memcpy(value, copy, bytes);
+      if (consistent) { *consistent = before; }
+      return true;
+    }
+  }
+  return false;
+}
+
+} // namespace
+
+struct ServerRegistry::Slot {
+  alignas(64) uint64_t sequence;  // Odd while the worker writes; counts publications otherwise
+  uint64_t words[STATS_WORDS];
+};
+
+std::unique_ptr<ServerRegistry> ServerRegistry::create(int workers, size_t sessions_per_worker,
+                                                       std::string *error) {
+  if (workers < 1 || workers > REGISTRY_MAX_WORKERS || sessions_per_worker > REGISTRY_LOCAL_MASK + size_t(1)) {
+    errno = EINVAL;
+    fail_errno(error, "registry for " + std::to_string(workers) + " workers");
+    return nullptr;
+  }
+  // Pages are only touched as sessions are used, so sizing for the
+  // maximum costs address space, not memory
+  const size_t size = sizeof(Slot) * workers + sizeof(RecordEntry) * workers * sessions_per_worker;
+  void *memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if (memory == MAP_FAILED) {
+    fail_errno(error, "mmap registry");
+    return nullptr;
+  }
+  return std::unique_ptr<ServerRegistry>(new ServerRegistry(memory, size, workers, sessions_per_worker));
+}
+
+ServerRegistry::~ServerRegistry() { munmap(memory, size); }
+
+ServerRegistry::Slot *ServerRegistry::slot(int worker) const { return static_cast<Slot *>(memory) + worker; }
+
+uint64_t *ServerRegistry::record_sequence(int worker, uint32_t local) const {
+  auto *records = reinterpret_cast<RecordEntry *>(static_cast<Slot *>(memory) + workers);
+  return &records[size_t(worker) * sessions_per_worker + local].sequence;
+}
+
+void ServerRegistry::put_session(int worker, uint32_t local, const SessionRecord &record) {
+  if (worker < 0 || worker >= workers || local >= sessions_per_worker) { return; }
+  uint64_t *sequence = record_sequence(worker, local);
+  write_words(*sequence, sequence + 1, &record, sizeof(record));
+}
+
+void ServerRegistry::publish_stats(int worker, const ServerStats &stats) {
+  if (worker < 0 || worker >= workers) { return; }
+  Slot *target = slot(worker);
+  write_words(target->sequence, target->words, &stats, sizeof(stats));
+}
+
+bool ServerRegistry::find_session(uint32_t session, SessionRecord &record) const {
+  const int worker = static_cast<int>(session >> REGISTRY_LOCAL_BITS);
+  const uint32_t local = session & REGISTRY_LOCAL_MASK;
+  if (worker >= workers || local >= sessions_per_worker) { return false; }
+  uint64_t *sequence = record_sequence(worker, local);
+  return read_words(*sequence, sequence + 1, &record, sizeof(record)) && record.open && record.session == session;
+}
+
+size_t ServerRegistry::count_sessions(int worker) const {
+  if (worker < 0 || worker >= workers) { return 0; }
+  size_t open = 0;
+  SessionRecord record;
+  for (uint32_t local = 0; local < sessions_per_worker; ++local) {
+    uint64_t *sequence = record_sequence(worker, local);
+    // Slots never used are still all zero; skip them without a copy
+    if (shared(*sequence).load(std::memory_order_acquire) == 0) { continue; }
+    if (read_words(*sequence, sequence + 1, &record, sizeof(record)) && record.open) { open++; }
+  }
+  return open;
+}
+
+void ServerRegistry::clear_worker(int worker) {
+  if (worker < 0 || worker >= workers) { return; }
+  SessionRecord closed;
+  for (uint32_t local = 0; local < sessions_per_worker; ++local) {
+    uint64_t *sequence = record_sequence(worker, local);
+    if (shared(*sequence).load(std::memory_order_acquire) == 0) { continue; }
+    // A worker killed mid-write leaves the sequence odd; even it up first
+    uint64_t value = shared(*sequence).load(std::memory_order_relaxed);
+    if (value & 1) { shared(*sequence).store(value + 1, std::memory_order_relaxed); }
+    write_words(*sequence, sequence + 1, &closed, sizeof(closed));
+  }
+  Slot *target = slot(worker);
+  uint64_t value = shared(target->sequence).load(std::memory_order_relaxed);
+  if (value & 1) { shared(target->sequence).store(value + 1, std::memory_order_relaxed); }
+}
+
+bool ServerRegistry::take_stats(int worker, uint64_t *seen, ServerStats &stats) const {
+  if (worker < 0 || worker >= workers) { return false; }
+  Slot *source = slot(worker);
+  if (shared(source->sequence).load(std::memory_order_acquire) == *seen) { return false; }
+  return read_words(source->sequence, source->words, &stats, sizeof(stats), seen);
+}
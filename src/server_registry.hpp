@@ -0,0 +1,84 @@
+#pragma once
+
+// Shared memory between the worker processes of a sharded snakey_server.
+// Every worker owns its own listening socket (SO_REUSEPORT), sessions and
+// timer wheel; the registry only lets the others see what it is doing. Each
+// worker writes its own stats slot and its own range of session records and
+// nothing else, so there are no locks: readers copy under a per-slot
+// sequence number and retry if a write overlapped. Records are written on
+// join, game over and close, never per tick.
+//
+// A session id seen by clients is the worker index in the top bits and the
+// worker's local slot below, so finding a session is an index, not a search.
+
+#include "game_server.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <type_traits>
+
+constexpr int REGISTRY_LOCAL_BITS = 24;
+constexpr uint32_t REGISTRY_LOCAL_MASK = (1u << REGISTRY_LOCAL_BITS) - 1;
+constexpr int REGISTRY_MAX_WORKERS = 255;
+
+struct SessionRecord {
+  uint32_t session = 0;     // Global id
+  bool open = false;
+  bool wrapping = false;
+  uint16_t tick_rate_ms = 0;
+  uint32_t game = 0;
+  uint64_t seed = 0;
+  uint64_t joined_us = 0;   // Worker clock at the join
+};
+static_assert(std::is_trivially_copyable_v<SessionRecord>, "records are copied word by word");
+static_assert(std::is_trivially_copyable_v<ServerStats>, "stats are copied word by word");
+
+class ServerRegistry {
+public:
+  // Maps an anonymous shared region for `workers` workers of up to
+  // `sessions_per_worker` sessions each; create it before forking them.
+  // Returns nullptr with the reason in `error` on failure.
+  static std::unique_ptr<ServerRegistry> create(int workers, size_t sessions_per_worker,
+                                                std::string *error = nullptr);
+
+  ~ServerRegistry();
+  ServerRegistry(const ServerRegistry &) = delete;
+  ServerRegistry &operator=(const ServerRegistry &) = delete;
+
+  int get_workers() const { return workers; }
+  size_t get_sessions_per_worker() const { return sessions_per_worker; }
+
+  static uint32_t global_id(int worker, uint32_t local) {
+    return uint32_t(worker) << REGISTRY_LOCAL_BITS | local;
+  }
+
+  // Writer side, each worker only for itself
+  void put_session(int worker, uint32_t local, const SessionRecord &record);
+  void publish_stats(int worker, const ServerStats &stats);
+
+  // Reader side, from any process. False if the session is unknown or closed.
+  bool find_session(uint32_t session, SessionRecord &record) const;
+  // Sessions a worker has open, e.g. to tell what was lost when it died
+  size_t count_sessions(int worker) const;
+  // Marks every session of a worker closed; only once the worker is gone
+  void clear_worker(int worker);
+  // Stats a worker published since `*seen`, which is updated; false if
+  // nothing new was published
+  bool take_stats(int worker, uint64_t *seen, ServerStats &stats) const;
+
+private:
+  struct Slot;
+
+  ServerRegistry(void *memory, size_t size, int workers, size_t sessions_per_worker)
+    : memory(memory), size(size), workers(workers), sessions_per_worker(sessions_per_worker) {}
+
+  Slot *slot(int worker) const;
+  uint64_t *record_sequence(int worker, uint32_t local) const;
+
+  void *memory;
+  size_t size;
+  int workers;
+  size_t sessions_per_worker;
+};
@@ -0,0 +1,277 @@
+#include "shm_channel.hpp"
+#include "util.hpp"
+
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <climits>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// Polls before sleeping, long enough to catch an answer from a process on
+// another core. Single core machines go straight to the futex.
+constexpr int SPIN_ITERATIONS = 2000;
+
+template <typename T>
+std::atomic_ref<T> shared(T &value) { return std::atomic_ref<T>(value); }
+
+int spin_iterations() {
+  static const int iterations = std::thread::hardware_concurrency() > 1 ? SPIN_ITERATIONS : 0;
+  return iterations;
+}
+
+inline void cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_ia32_pause();
+#elif defined(__aarch64__)
+  asm volatile("yield");
+#endif
+}
+
+// The segment is shared between processes, so these are not the private
+// futex operations
+void futex_wait(uint32_t *word, uint32_t seen, Clock::duration timeout) {
+  auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(timeout).count();
+  timespec relative{ static_cast<time_t>(ns / 1000000000), static_cast<long>(ns % 1000000000) };
+  syscall(SYS_futex, word, FUTEX_WAIT, seen, &relative, nullptr, 0);
+}
+
+void futex_wake(uint32_t *word) { syscall(SYS_futex, word, FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0); }
+
+std::string segment_path(const std::string &name) { return "/snakey-" + name; }
+
+} // namespace
+
+std::unique_ptr<ShmChannel> ShmChannel::create(const std::string &name, std::string *error) {
+  if (name.empty() || name.find('/') != std::string::npos) {
+    fail(error, "channel names must be non-empty and without '/'");
+    return nullptr;
+  }
+  std::string path = segment_path(name);
+  int fd = shm_open(path.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+  if (fd < 0) {
+    fail(error, errno == EEXIST
+      ? "/dev/shm" + path + " already exists; remove it if no game is using it"
+      : "cannot create /dev/shm" + path + ": " + std::strerror(errno));
+    return nullptr;
+  }
+  void *memory = MAP_FAILED;
+  if (ftruncate(fd, sizeof(ShmLayout)) == 0) {
+    memory = mmap(nullptr, sizeof(ShmLayout), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  }
+  int saved = errno;
+  close(fd);
+  if (memory == MAP_FAILED) {
+    shm_unlink(path.c_str());
+    fail(error, "cannot map /dev/shm" + path + ": " + std::strerror(saved));
+    return nullptr;
+  }
+
+  // The segment starts out zeroed; the magic goes in last so an agent that
+  // attaches early sees either nothing or a complete header
+  auto *layout = static_cast<ShmLayout *>(memory);
+  layout->version = SHM_VERSION;
+  layout->ring_capacity = SHM_RING_CAPACITY;
+  layout->state_bytes = sizeof(ShmState);
+  shared(layout->magic).store(SHM_MAGIC, std::memory_order_release);
+  return std::unique_ptr<ShmChannel>(new ShmChannel(layout, path, true));
+}
+
+std::unique_ptr<ShmChannel> ShmChannel::attach(const std::string &name, std::string *error) {
+  std::string path = segment_path(name);
+  int fd = shm_open(path.c_str(), O_RDWR, 0);
+  if (fd < 0) {
+    fail(error, "cannot open /dev/shm" + path + ": " + std::strerror(errno));
+    return nullptr;
+  }
+  struct stat info;
+  void *memory = MAP_FAILED;
+  if (fstat(fd, &info) == 0 && static_cast<size_t>(info.st_size) >= sizeof(ShmLayout)) {
+    memory = mmap(nullptr, sizeof(ShmLayout), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  }
+  close(fd);
+  if (memory == MAP_FAILED) {
+    fail(error, "/dev/shm" + path + " is not a snakey channel");
+    return nullptr;
+  }
+  auto *layout = static_cast<ShmLayout *>(memory);
+  if (shared(layout->magic).load(std::memory_order_acquire) != SHM_MAGIC ||
+      layout->version != SHM_VERSION || layout->state_bytes != sizeof(ShmState)) {
+    munmap(memory, sizeof(ShmLayout));
+    fail(error, "/dev/shm" + path + " is not a snakey channel of this version");
+    return nullptr;
+  }
+  return std::unique_ptr<ShmChannel>(new ShmChannel(layout, path, false));
+}
+
+ShmChannel::~ShmChannel() {
+  munmap(layout, sizeof(ShmLayout));
+  if (owner) { shm_unlink(path.c_str()); }
+}
+
+bool ShmChannel::wait(uint32_t *word, uint32_t *waiters, uint32_t seen, Clock::time_point deadline) {
+  for (int i = spin_iterations(); i > 0; --i) {
+    if (shared(*word).load(std::memory_order_acquire) != seen) { return true; }
+    cpu_relax();
+  }
+  auto remaining = deadline - Clock::now();
+  if (remaining <= Clock::duration::zero()) { return false; }
+  // Announcing the waiter before the final check pairs with the other side
+  // changing the word before it looks for waiters, so one of them always
+  // sees the other
+  shared(*waiters).fetch_add(1);
+  if (shared(*word).load() == seen) { futex_wait(word, seen, remaining); }
+  shared(*waiters).fetch_sub(1);
+  return true;
+}
+
+void ShmChannel::publish(const ShmState &state) {
+  auto sequence = shared(layout->state_sequence);
+  uint32_t before = sequence.load(std::memory_order_relaxed);
+  sequence.store(before + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  for (size_t i = 0; i < SHM_STATE_WORDS; ++i) {
+    uint64_t word;
+    std::memcpy(&word, reinterpret_cast<const char *>(&state) + i * 8, 8);
+    shared(layout->state[i]).store(word, std::memory_order_relaxed);
+  }
+  sequence.store(before + 2);
+  if (shared(layout->state_waiters).load() > 0) { futex_wake(&layout->state_sequence); }
+}
+
+bool ShmChannel::take_action(uint32_t tick, Direction &direction, int64_t timeout_us) {
+  const auto deadline = Clock::now() + std::chrono::microseconds(timeout_us);
+  auto head = shared(layout->action_head);
+  auto tail = shared(layout->action_tail);
+  for (;;) {
+    uint32_t read = head.load(std::memory_order_relaxed);
+    uint32_t written = tail.load(std::memory_order_acquire);
+    bool found = false;
+    for (; read != written; ++read) {
+      const ShmAction &action = layout->actions[read % SHM_RING_CAPACITY];
+      if (action.tick >= tick && action.direction <= static_cast<uint32_t>(Direction::Right)) {
+        direction = static_cast<Direction>(action.direction);
+        found = true;
+      }
+    }
+    head.store(read, std::memory_order_release);
+    if (found) { return true; }
+    if (!wait(&layout->action_tail, &layout->action_waiters, written, deadline)) { return false; }
+    if (Clock::now() >= deadline && tail.load(std::memory_order_acquire) == written) { return false; }
+  }
+}
+
+bool ShmChannel::send_action(uint32_t tick, Direction direction) {
+  auto tail = shared(layout->action_tail);
+  uint32_t written = tail.load(std::memory_order_relaxed);
+  if (written - shared(layout->action_head).load(std::memory_order_acquire) >= SHM_RING_CAPACITY) { return false; }
+  layout->actions[written % SHM_RING_CAPACITY] = { tick, static_cast<uint32_t>(direction) };
+  tail.store(written + 1);
+  if (shared(layout->action_waiters).load() > 0) { futex_wake(&layout->action_tail); }
+  return true;
+}
+
+bool ShmChannel::read_state(ShmState &state, uint32_t *sequence, int64_t timeout_us) {
+  const auto deadline = Clock::now() + std::chrono::microseconds(timeout_us);
+  auto current = shared(layout->state_sequence);
+  for (;;) {
+    uint32_t before = current.load(std::memory_order_acquire);
+    if (before != *sequence && (before & 1) == 0) {
+      for (size_t i = 0; i < SHM_STATE_WORDS; ++i) {
+        uint64_t word = shared(layout->state[i]).load(std::memory_order_relaxed);
+        std::memcpy(reinterpret_cast<char *>(&state) + i * 8, &word, 8);
+      }
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (current.load(std::memory_order_relaxed) == before) {
+        *sequence = before;
+        return true;
+      }
+      continue;
+    }
+    if (!wait(&layout->state_sequence, &layout->state_waiters, before, deadline)) { return false; }
+    if (Clock::now() >= deadline && current.load(std::memory_order_acquire) == before) { return false; }
+  }
+}
+
+void ShmChannel::fill_state(const World &world, int self, uint32_t game, ShmState &state) {
+  const Rules &rules = world.get_rules();
+  const Snake &snake = world.get_snake(self);
+  state.tick = world.get_tick();
+  state.game = game;
+  state.head_x = snake.get_head().x;
+  state.head_y = snake.get_head().y;
+  state.food_x = world.get_food().x;
+  state.food_y = world.get_food().y;
+  state.length = static_cast<uint16_t>(snake.get_length());
+  state.direction = static_cast<uint8_t>(snake.get_direction());
+  state.death_cause = static_cast<uint8_t>(world.get_death_cause(self));
+  // Boards larger than the default are cut to the part that fits
+  state.width = static_cast<uint8_t>(std::min(rules.width, GRID_WIDTH));
+  state.height = static_cast<uint8_t>(std::min(rules.height, GRID_HEIGHT));
+  std::memset(state.reserved, 0, sizeof(state.reserved));
+  const uint8_t *occupancy = world.get_occupancy();
+  for (int y = 0; y < state.height; ++y) {
+    std::memcpy(state.cells + y * state.width, occupancy + y * rules.width, state.width);
+  }
+  std::memset(state.cells + state.width * state.height, 0, sizeof(state.cells) - state.width * state.height);
+}
+
+namespace {
+
+class ShmBot : public Bot {
+public:
+  explicit ShmBot(std::unique_ptr<ShmChannel> channel) : channel(std::move(channel)) {}
+
+  Direction choose(const World &world, int self) override {
+    publish(world, self);
+    const Direction fallback = world.get_snake(self).get_direction();
+    // Half the tick is left for the game itself, as for plugins
+    int64_t budget_us = int64_t(std::max(1, world.get_rules().tick_rate_ms)) * 500;
+    Direction answer = fallback;
+    if (!channel->take_action(world.get_tick(), answer, budget_us)) { return fallback; }
+    return answer;
+  }
+
+  // Publishes the result of every tick, so the agent also sees how a game ended
+  void on_tick(const World &world, int self) override { publish(world, self); }
+
+private:
+  void publish(const World &world, int self) {
+    if (world.get_tick() == last_tick && &world == last_world) { return; }
+    if (world.get_tick() < last_tick || &world != last_world) { ++game; }
+    last_tick = world.get_tick();
+    last_world = &world;
+    ShmChannel::fill_state(world, self, game, state);
+    channel->publish(state);
+  }
+
+  std::unique_ptr<ShmChannel> channel;
+  ShmState state{};
+  const World *last_world = nullptr;
+  uint32_t last_tick = 0;
+  uint32_t game = 0;
+};
+
+} // namespace
+
+std::unique_ptr<Bot> make_shm_bot(const std::string &name) {
+  std::string error;
+  auto channel = ShmChannel::create(name, &error);
+  if (!channel) {
+    std::fprintf(stderr, "shm:%s: %s\n", name.c_str(), error.c_str());
+    return nullptr;
+  }
+  return std::make_unique<ShmBot>(std::move(channel));
+}
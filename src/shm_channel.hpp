@@ -0,0 +1,113 @@
+#pragma once
+
+// Shared-memory link between the game and an external agent process.
+// The game publishes the board after every tick into a seqlock-protected
+// region; the agent pushes directions into a single-producer,
+// single-consumer ring. Either side that has to wait sleeps on a futex on
+// the word it waits for, and a wake syscall is only made when the other
+// side has registered as a waiter, so the common path is a few atomic
+// operations on shared cache lines.
+//
+// The segment is /dev/shm/snakey-NAME and has a fixed little-endian layout
+// (ShmLayout below), so agents in other languages can map it directly:
+// read state_sequence, copy the state, read state_sequence again and retry
+// if it changed or is odd; write an action at actions[action_tail %
+// ring_capacity], then increment action_tail.
+
+#include "bots.hpp"
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+constexpr uint32_t SHM_MAGIC         = 0x4d484e53;  // "SNHM" little-endian
+constexpr uint16_t SHM_VERSION       = 1;
+constexpr uint32_t SHM_RING_CAPACITY = 64;
+
+// What the agent sees of the game after a tick
+struct ShmState {
+  uint32_t tick;
+  uint32_t game;         // Counts restarts, so agents notice a new game
+  int32_t head_x;
+  int32_t head_y;
+  int32_t food_x;
+  int32_t food_y;
+  uint16_t length;
+  uint8_t direction;     // Direction, as in core.hpp
+  uint8_t death_cause;   // DeathCause, None while alive
+  uint8_t width;
+  uint8_t height;
+  uint8_t reserved[2];
+  uint8_t cells[GRID_WIDTH * GRID_HEIGHT];  // Living segments per cell, row-major
+};
+static_assert(sizeof(ShmState) % 8 == 0, "the state is copied in 8-byte words");
+constexpr size_t SHM_STATE_WORDS = sizeof(ShmState) / 8;
+
+struct ShmAction {
+  uint32_t tick;         // Tick the action answers; stale ones are skipped
+  uint32_t direction;
+};
+
+struct ShmLayout {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t ring_capacity;
+  uint32_t state_bytes;
+  uint32_t reserved;
+  alignas(64) uint32_t state_sequence;  // Odd while the game writes; futex word
+  uint32_t state_waiters;
+  alignas(64) uint32_t action_head;     // Next action the game reads
+  alignas(64) uint32_t action_tail;     // Next slot the agent writes; futex word
+  uint32_t action_waiters;
+  alignas(64) ShmAction actions[SHM_RING_CAPACITY];
+  alignas(64) uint64_t state[SHM_STATE_WORDS];  // A ShmState, copied word by word
+};
+static_assert(offsetof(ShmLayout, state_sequence) == 64, "layout is shared with other languages");
+static_assert(offsetof(ShmLayout, action_head) == 128, "layout is shared with other languages");
+static_assert(offsetof(ShmLayout, action_tail) == 192, "layout is shared with other languages");
+static_assert(offsetof(ShmLayout, actions) == 256, "layout is shared with other languages");
+static_assert(offsetof(ShmLayout, state) == 768, "layout is shared with other languages");
+
+class ShmChannel {
+public:
+  // The game creates the segment and removes it again when done. Returns
+  // nullptr with the reason in `error` on failure.
+  static std::unique_ptr<ShmChannel> create(const std::string &name, std::string *error = nullptr);
+  // The agent attaches to a segment the game created
+  static std::unique_ptr<ShmChannel> attach(const std::string &name, std::string *error = nullptr);
+
+  ~ShmChannel();
+  ShmChannel(const ShmChannel &) = delete;
+  ShmChannel &operator=(const ShmChannel &) = delete;
+
+  // Game side
+  void publish(const ShmState &state);
+  // Takes the newest action answering `tick` or later, waiting up to
+  // `timeout_us` for one (0 only polls). Older actions are discarded.
+  bool take_action(uint32_t tick, Direction &direction, int64_t timeout_us);
+
+  // Agent side
+  // False if the ring is full
+  bool send_action(uint32_t tick, Direction direction);
+  // Copies the newest state once its sequence differs from `*sequence`,
+  // waiting up to `timeout_us`, and updates `*sequence`
+  bool read_state(ShmState &state, uint32_t *sequence, int64_t timeout_us);
+
+  static void fill_state(const World &world, int self, uint32_t game, ShmState &state);
+
+private:
+  bool wait(uint32_t *word, uint32_t *waiters, uint32_t seen, std::chrono::steady_clock::time_point deadline);
+
+  ShmChannel(ShmLayout *layout, std::string path, bool owner) : layout(layout), path(std::move(path)), owner(owner) {}
+
+  ShmLayout *layout;
+  std::string path;
+  bool owner;
+};
+
+// Bot that hands each decision to the agent attached to /dev/shm/snakey-NAME.
+// Like plugins, an answer must arrive within half a tick or the snake keeps
+// its direction. Returns nullptr if the segment cannot be created.
+std::unique_ptr<Bot> make_shm_bot(const std::string &name);
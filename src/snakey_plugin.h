@@ -0,0 +1,76 @@
+/* Stable C ABI for bots living in shared objects.
+ *
+ * A plugin exports `snakey_plugin_entry`, returning a description of the
+ * bot. Once per tick the game calls `choose` with a read-only view of the
+ * world that points straight into the game's own storage; nothing in it may
+ * be kept past the call. Bump SNAKEY_PLUGIN_ABI_VERSION on any layout change.
+ */
+#ifndef SNAKEY_PLUGIN_H
+#define SNAKEY_PLUGIN_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SNAKEY_PLUGIN_ABI_VERSION 1
+
+enum {
+  SNAKEY_UP    = 0,
+  SNAKEY_DOWN  = 1,
+  SNAKEY_LEFT  = 2,
+  SNAKEY_RIGHT = 3
+};
+
+typedef struct snakey_point {
+  int32_t x;
+  int32_t y;
+} snakey_point;
+
+/* A snake's body ring: the segment of age a (0 being the head) is
+ * ring[(head_slot + capacity - a) % capacity], for a < length. */
+typedef struct snakey_snake {
+  const snakey_point *ring;
+  uint32_t capacity;
+  uint32_t head_slot;
+  uint32_t length;
+  int32_t direction;
+  uint8_t alive;
+} snakey_snake;
+
+typedef struct snakey_state {
+  uint32_t abi_version;
+  uint32_t tick;
+  int32_t width;
+  int32_t height;
+  uint8_t wrapping;
+  int32_t tick_rate_ms;
+  /* Living segments per cell, row-major, width * height entries */
+  const uint8_t *occupancy;
+  snakey_point food;
+  const snakey_snake *snakes;
+  int32_t snake_count;
+  int32_t self;
+  /* Time the game allows per call; later answers are ignored */
+  uint32_t budget_us;
+} snakey_state;
+
+typedef struct snakey_plugin {
+  uint32_t abi_version;
+  const char *name;
+  /* Per-snake bot state; create may return NULL for stateless bots */
+  void *(*create)(void);
+  void (*destroy)(void *bot);
+  /* Returns one of SNAKEY_UP .. SNAKEY_RIGHT */
+  int32_t (*choose)(void *bot, const snakey_state *state);
+} snakey_plugin;
+
+#define SNAKEY_PLUGIN_ENTRY "snakey_plugin_entry"
+typedef const snakey_plugin *(*snakey_plugin_entry_fn)(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SNAKEY_PLUGIN_H */
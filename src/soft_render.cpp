@@ -0,0 +1,57 @@
+#include "soft_render.hpp"
+
+#include <algorithm>
+
+namespace {
+
+// The game's raylib colours, packed as 0xAABBGGRR
+constexpr uint32_t BACKGROUND = 0xfff5f5f5;  // RAYWHITE
+constexpr uint32_t FOOD       = 0xff3729e6;  // RED
+constexpr uint32_t BODY       = 0xff30e400;  // GREEN
+constexpr uint32_t HEAD       = 0xff2c7500;  // DARKGREEN
+
+} // namespace
+
+void NullRenderer::render(const World &world) {
+  const Point &food = world.get_food();
+  sum += static_cast<uint64_t>(food.x * 31 + food.y);
+  for (int s = 0; s < world.get_snake_count(); ++s) {
+    if (!world.is_alive(s)) { continue; }
+    const Snake &snake = world.get_snake(s);
+    for (int age = 0; age < snake.get_length(); ++age) {
+      const Point &p = snake.segment(age);
+      sum += static_cast<uint64_t>(p.x * 31 + p.y) ^ static_cast<uint64_t>(snake.sprite(age));
+    }
+  }
+}
+
+void SoftwareRenderer::fill_cell(Point p, uint32_t color) {
+  if (p.x < 0 || p.y < 0 || (p.x + 1) * block_size > width || (p.y + 1) * block_size > height) { return; }
+  uint32_t *row = pixels.data() + static_cast<size_t>(p.y) * block_size * width + p.x * block_size;
+  for (int y = 0; y < block_size; ++y, row += width) { std::fill(row, row + block_size, color); }
+}
+
+void SoftwareRenderer::render(const World &world) {
+  const Rules &rules = world.get_rules();
+  if (width != rules.width * block_size || height != rules.height * block_size) {
+    width = rules.width * block_size;
+    height = rules.height * block_size;
+    pixels.assign(static_cast<size_t>(width) * height, BACKGROUND);
+  } else {
+    std::fill(pixels.begin(), pixels.end(), BACKGROUND);
+  }
+  fill_cell(world.get_food(), FOOD);
+  for (int s = 0; s < world.get_snake_count(); ++s) {
+    if (!world.is_alive(s)) { continue; }
+    const Snake &snake = world.get_snake(s);
+    for (int age = snake.get_length() - 1; age > 0; --age) { fill_cell(snake.segment(age), BODY); }
+    fill_cell(snake.get_head(), HEAD);
+  }
+}
+
+uint64_t SoftwareRenderer::checksum() const {
+  // A sparse sample is enough to keep the frame alive
+  uint64_t sum = 0;
+  for (size_t i = 0; i < pixels.size(); i += 97) { sum = sum * 31 + pixels[i]; }
+  return sum;
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+// Headless render backends, for measuring drawing without a window.
+// The null backend walks everything a frame would draw without touching
+// pixels; the software backend rasterises the board into an RGBA
+// framebuffer on the CPU.
+
+#include "core.hpp"
+
+#include <cstdint>
+#include <vector>
+
+class FrameRenderer {
+public:
+  virtual ~FrameRenderer() = default;
+  virtual const char *name() const = 0;
+  virtual void render(const World &world) = 0;
+  // Changes with what was drawn, so the work cannot be optimised away
+  virtual uint64_t checksum() const = 0;
+};
+
+class NullRenderer : public FrameRenderer {
+public:
+  const char *name() const override { return "null"; }
+  void render(const World &world) override;
+  uint64_t checksum() const override { return sum; }
+
+private:
+  uint64_t sum = 0;
+};
+
+class SoftwareRenderer : public FrameRenderer {
+public:
+  explicit SoftwareRenderer(int block_size = 20) : block_size(block_size) {}
+
+  const char *name() const override { return "software"; }
+  void render(const World &world) override;
+  uint64_t checksum() const override;
+
+  const std::vector<uint32_t> &get_pixels() const { return pixels; }
+  int get_width() const { return width; }
+  int get_height() const { return height; }
+
+private:
+  void fill_cell(Point p, uint32_t color);
+
+  int block_size;
+  int width = 0;
+  int height = 0;
+  std::vector<uint32_t> pixels;  // 0xAABBGGRR, row-major
+};
@@ -0,0 +1,84 @@
+#include "timer_wheel.hpp"
+
+#include <algorithm>
+
+TimerWheel::TimerWheel(uint64_t now_ms) : current(now_ms) {
+  std::fill(std::begin(heads), std::end(heads), NONE);
+}
+
+void TimerWheel::resize(size_t timers) {
+  if (timers > nodes.size()) { nodes.resize(timers); }
+}
+
+void TimerWheel::schedule(uint32_t id, uint64_t due_ms) {
+  if (nodes[id].slot >= 0) { unlink(id); }
+  nodes[id].due = due_ms;
+  place(id, current + 1);
+}
+
+void TimerWheel::cancel(uint32_t id) {
+  if (id < nodes.size() && nodes[id].slot >= 0) { unlink(id); }
+}
+
+void TimerWheel::place(uint32_t id, uint64_t earliest) {
+  uint64_t due = std::max(nodes[id].due, earliest);
+  // The level is the highest group of slot bits in which the due time and
+  // the current time differ, so the slot is reached before the due time
+  // and cascades the timer down a level
+  constexpr uint64_t SPAN = uint64_t(1) << (SLOT_BITS * LEVELS);
+  if (due - current >= SPAN) { due = current + SPAN - 1; }  // Parked, placed again on the way down
+  int level = 0;
+  while (level < LEVELS - 1 && (due >> (SLOT_BITS * (level + 1))) != (current >> (SLOT_BITS * (level + 1)))) {
+    ++level;
+  }
+  link(id, level * SLOTS + static_cast<int>((due >> (SLOT_BITS * level)) & (SLOTS - 1)));
+}
+
+void TimerWheel::link(uint32_t id, int slot) {
+  Node &node = nodes[id];
+  node.slot = static_cast<int16_t>(slot);
+  node.prev = NONE;
+  node.next = heads[slot];
+  if (node.next != NONE) { nodes[node.next].prev = id; }
+  heads[slot] = id;
+  occupied[slot / SLOTS] |= uint64_t(1) << (slot % SLOTS);
+  ++scheduled;
+}
+
+void TimerWheel::unlink(uint32_t id) {
+  Node &node = nodes[id];
+  int slot = node.slot;
+  if (node.prev != NONE) { nodes[node.prev].next = node.next; }
+  else { heads[slot] = node.next; }
+  if (node.next != NONE) { nodes[node.next].prev = node.prev; }
+  if (heads[slot] == NONE) { occupied[slot / SLOTS] &= ~(uint64_t(1) << (slot % SLOTS)); }
+  node.slot = -1;
+  node.prev = node.next = NONE;
+  --scheduled;
+}
+
+void TimerWheel::cascade(int level, uint64_t time) {
+  int slot = level * SLOTS + static_cast<int>((time >> (SLOT_BITS * level)) & (SLOTS - 1));
+  if (!(occupied[level] & (uint64_t(1) << (slot % SLOTS)))) { return; }
+  uint32_t id = heads[slot];
+  while (id != NONE) {
+    uint32_t next = nodes[id].next;
+    unlink(id);
+    place(id, time);
+    id = next;
+  }
+}
+
+uint64_t TimerWheel::next_wakeup() const {
+  if (scheduled == 0) { return NEVER; }
+  // The nearest occupied level 0 slot after the current time, within the
+  // current block of 64
+  int from = static_cast<int>((current + 1) & (SLOTS - 1));
+  uint64_t block = (current + 1) & ~uint64_t(SLOTS - 1);
+  if (from != 0) {
+    uint64_t ahead = occupied[0] & (~uint64_t(0) << from);
+    if (ahead) { return block + __builtin_ctzll(ahead); }
+    return block + SLOTS;  // The next cascade may bring timers down
+  }
+  return block;  // A cascade is due, or a timer in the first slot
+}
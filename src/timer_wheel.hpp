@@ -0,0 +1,108 @@
+#pragma once
+
+// Hierarchical timer wheel with millisecond slots for scheduling game ticks.
+// Four levels of 64 slots cover 2^24 ms (about 4.6 hours) ahead; timers
+// further out wait in the last level. Scheduling and cancelling are O(1),
+// and a timer moves down a level at most three times before it fires.
+// Timers are identified by small integer ids, such as indices into a
+// session pool, and live in intrusive lists, so the wheel never allocates
+// once sized.
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+class TimerWheel {
+public:
+  static constexpr int LEVELS = 4;
+  static constexpr int SLOT_BITS = 6;
+  static constexpr int SLOTS = 1 << SLOT_BITS;
+  static constexpr uint64_t NEVER = std::numeric_limits<uint64_t>::max();
+
+  explicit TimerWheel(uint64_t now_ms = 0);
+
+  // Ids must be below `timers`
+  void resize(size_t timers);
+
+  // Fires at `due_ms`, or on the next advance if that has passed.
+  // Rescheduling a scheduled timer moves it.
+  void schedule(uint32_t id, uint64_t due_ms);
+  void cancel(uint32_t id);
+  bool is_scheduled(uint32_t id) const { return id < nodes.size() && nodes[id].slot >= 0; }
+  uint64_t due(uint32_t id) const { return nodes[id].due; }
+  size_t size() const { return scheduled; }
+
+  // Fires every timer due up to `now_ms`. `expire(ids, count)` is called
+  // once per millisecond slot with all of its timers; they are no longer
+  // scheduled by then and may be rescheduled from the callback.
+  template <typename Expire>
+  void advance(uint64_t now_ms, Expire &&expire);
+
+  // Time of the next slot that may hold a due timer, NEVER when empty. May
+  // be earlier than the next timer when the nearest ones are still on a
+  // higher level, so it is a bound for how long a caller may sleep.
+  uint64_t next_wakeup() const;
+
+  uint64_t get_now() const { return current; }
+
+private:
+  static constexpr uint32_t NONE = std::numeric_limits<uint32_t>::max();
+
+  struct Node {
+    uint32_t prev = NONE;
+    uint32_t next = NONE;
+    uint64_t due = 0;
+    int16_t slot = -1;  // level * SLOTS + slot, -1 when not scheduled
+  };
+
+  // Timers due before `earliest` go into its slot, so timers that are
+  // already due fire on the next advance
+  void place(uint32_t id, uint64_t earliest);
+  void link(uint32_t id, int slot);
+  void unlink(uint32_t id);
+  void cascade(int level, uint64_t time);
+
+  std::vector<Node> nodes;
+  uint32_t heads[LEVELS * SLOTS];
+  uint64_t occupied[LEVELS] = {};  // Bit per non-empty slot
+  uint64_t current;                // Timers due at or before this have fired
+  size_t scheduled = 0;
+  std::vector<uint32_t> batch;
+};
+
+template <typename Expire>
+void TimerWheel::advance(uint64_t now_ms, Expire &&expire) {
+  while (current < now_ms) {
+    if (scheduled == 0) {
+      current = now_ms;
+      return;
+    }
+    uint64_t time = current + 1;
+    // Nothing can fire before the next occupied level 0 slot or the next
+    // cascade, so idle stretches are skipped rather than walked
+    if (occupied[0] == 0 && (time & (SLOTS - 1)) != 0) {
+      uint64_t boundary = (time | (SLOTS - 1)) + 1;
+      if (boundary > now_ms) {
+        current = now_ms;
+        return;
+      }
+      time = boundary;
+    }
+    current = time;
+    for (int level = LEVELS - 1; level > 0; --level) {
+      if ((time & ((uint64_t(1) << (SLOT_BITS * level)) - 1)) == 0) { cascade(level, time); }
+    }
+    int slot = static_cast<int>(time & (SLOTS - 1));
+    if (!(occupied[0] & (uint64_t(1) << slot))) { continue; }
+    batch.clear();
+    for (uint32_t id = heads[slot]; id != NONE;) {
+      uint32_t next = nodes[id].next;
+      unlink(id);
+      if (nodes[id].due > time) { place(id, time); }  // Parked far ahead, not due yet
+      else { batch.push_back(id); }
+      id = next;
+    }
+    if (!batch.empty()) { expire(batch.data(), batch.size()); }
+  }
+}
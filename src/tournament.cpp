@@ -0,0 +1,346 @@
+// snakey_tournament: ranks bots by playing round-robin matches on a pool of
+// worker threads.
+//
+// arena   every bot plays the same seeded boards alone and each pair of bots
+//         is compared board by board (length first, then survival time)
+// versus  each pair shares a board, swapping spawn sides between seeds
+//
+// Ratings are Elo, applied in match order once every match has finished so
+// the standings do not depend on thread scheduling.
+
+#include "async_writer.hpp"
+#include "bot_process.hpp"
+#include "bots.hpp"
+#include "plugin.hpp"
+#include "replay.hpp"
+#include "replay_codec.hpp"
+#include "util.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+struct Options {
+  std::string mode = "arena";
+  std::vector<std::string> bots;
+  int seeds = 16;
+  uint64_t base_seed = 1;
+  int threads = 0;
+  std::string replay_dir;
+  bool compress_replays = false;
+  std::string log_path;
+  Rules rules;
+};
+
+struct GameResult {
+  int length = 0;
+  uint32_t ticks = 0;
+};
+
+// One pairing on one seed; score is from bot a's point of view
+struct Match {
+  int a;
+  int b;
+  uint64_t seed;
+  double score = 0.5;
+  GameResult result_a;
+  GameResult result_b;
+};
+
+struct Standing {
+  std::string name;
+  double rating = 1500.0;
+  int wins = 0;
+  int draws = 0;
+  int losses = 0;
+  long long total_length = 0;
+  int games = 0;
+};
+
+void print_usage() {
+  std::printf("usage: snakey_tournament [options]\n"
+              "  --mode arena|versus   match format (default arena)\n"
+              "  --bots a,b,...        bots to rank (default all but search, which is slow)\n"
+              "  --seeds N             boards per pairing (default 16)\n"
+              "  --seed N              first board seed (default 1)\n"
+              "  --threads N           worker threads (default all cores)\n"
+              "  --replays DIR         write a replay per game into DIR\n"
+              "  --compress            write replays with the compressed codec\n"
+              "  --log FILE            append one line per match to FILE\n"
+              "  --tick-rate MS        tick rate recorded in replays (default 100)\n"
+              "  --length N            initial snake length (default 3)\n"
+              "  --no-wrap             walls instead of wrapping\n"
+              "  --max-ticks N         game length cap (default 10000)\n"
+              "bots: plugin:PATH");
+  for (const std::string &name : bot_names()) { std::printf(" %s", name.c_str()); }
+  std::printf("\n");
+}
+
+bool parse_options(int argc, char **argv, Options &options) {
+  options.rules.max_ticks = 10000;
+  options.rules.starvation_ticks = 2 * options.rules.width * options.rules.height;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    auto value = [&]() -> const char * { return i + 1 < argc ? argv[++i] : nullptr; };
+    const char *v = nullptr;
+    if (arg == "--no-wrap") { options.rules.wrapping = false; continue; }
+    if (arg == "--compress") { options.compress_replays = true; continue; }
+    if (arg == "--help" || arg == "-h") { return false; }
+    if (!(v = value())) { std::fprintf(stderr, "missing value for %s\n", arg.c_str()); return false; }
+    if (arg == "--mode") { options.mode = v; }
+    else if (arg == "--bots") { options.bots = split(v); }
+    else if (arg == "--seeds") { options.seeds = std::atoi(v); }
+    else if (arg == "--seed") { options.base_seed = std::strtoull(v, nullptr, 10); }
+    else if (arg == "--threads") { options.threads = std::atoi(v); }
+    else if (arg == "--replays") { options.replay_dir = v; }
+    else if (arg == "--log") { options.log_path = v; }
+    else if (arg == "--tick-rate") { options.rules.tick_rate_ms = std::atoi(v); }
+    else if (arg == "--length") { options.rules.initial_length = std::max(1, std::atoi(v)); }
+    else if (arg == "--max-ticks") { options.rules.max_ticks = std::max(0, std::atoi(v)); }
+    else { std::fprintf(stderr, "unknown option %s\n", arg.c_str()); return false; }
+  }
+  if (options.mode != "arena" && options.mode != "versus") {
+    std::fprintf(stderr, "unknown mode %s\n", options.mode.c_str());
+    return false;
+  }
+  if (options.bots.empty()) {
+    for (const std::string &name : bot_names()) {
+      if (name != "search") { options.bots.push_back(name); }
+    }
+  }
+  if (options.threads < 1) { options.threads = std::max(1u, std::thread::hardware_concurrency()); }
+  for (const std::string &name : options.bots) {
+    if (!is_bot_name(name)) { std::fprintf(stderr, "unknown bot %s\n", name.c_str()); return false; }
+    if (is_single_instance_bot(name) &&
+        (options.threads > 1 || std::count(options.bots.begin(), options.bots.end(), name) > 1)) {
+      std::fprintf(stderr, "%s plays one game at a time; use --threads 1 and list it once\n", name.c_str());
+      return false;
+    }
+  }
+  if (options.bots.size() < 2) { std::fprintf(stderr, "need at least two bots\n"); return false; }
+  // Snakes spawn along a row, so a longer body would overlap itself
+  if (options.rules.initial_length > options.rules.width) {
+    std::fprintf(stderr, "--length is at most the board width, %d\n", options.rules.width);
+    return false;
+  }
+  if (options.seeds < 1) { options.seeds = 1; }
+  return true;
+}
+
+// Plays one game to the end, with one bot per snake
+World play_game(const Options &options, uint64_t seed, const std::vector<Bot *> &bots) {
+  World world(options.rules, seed, static_cast<int>(bots.size()));
+  world.set_recording(!options.replay_dir.empty());
+  while (!world.is_over()) {
+    for (int i = 0; i < world.get_snake_count(); ++i) {
+      if (world.is_alive(i)) { world.set_direction(i, bots[i]->choose(world, i)); }
+    }
+    world.step();
+  }
+  return world;
+}
+
+// Bot names such as plugin:PATH or proc:COMMAND carry slashes and spaces;
+// anything outside [A-Za-z0-9_-] becomes '_' in file names
+std::string file_name_part(const std::string &name) {
+  std::string part = name;
+  for (char &c : part) {
+    if (!std::isalnum(static_cast<unsigned char>(c)) && c != '-' && c != '_') { c = '_'; }
+  }
+  return part;
+}
+
+// Replays are encoded on the worker and handed to the background writer,
+// so games never wait on the disk unless its queue is full
+void write_replay(const Options &options, AsyncWriter &writer, const World &world, const std::string &name) {
+  if (options.replay_dir.empty()) { return; }
+  std::string path = options.replay_dir + "/" + file_name_part(name) + ".snr";
+  Replay replay = world.make_replay();
+  std::vector<uint8_t> data = options.compress_replays ? compress_replay(replay) : encode_replay(replay);
+  if (writer.write_file(path, std::move(data))) { return; }
+  if (!save_replay(replay, path, options.compress_replays)) {
+    std::fprintf(stderr, "failed to write %s\n", path.c_str());
+  }
+}
+
+// Games a bot could not be made for. Names are only checked for syntax up
+// front, so a plugin that fails to load or a command that fails to start
+// shows up here.
+std::atomic<uint64_t> failed_games{ 0 };
+
+// Runs `job(index)` for every index on the worker threads
+template <typename Job>
+void run_parallel(int threads, size_t count, Job job) {
+  std::atomic<size_t> next{ 0 };
+  std::vector<std::thread> workers;
+  for (int t = 0; t < threads; ++t) {
+    workers.emplace_back([&]() {
+      for (size_t i = next++; i < count; i = next++) { job(i); }
+    });
+  }
+  for (auto &worker : workers) { worker.join(); }
+}
+
+double compare(const GameResult &a, const GameResult &b) {
+  if (a.length != b.length) { return a.length > b.length ? 1.0 : 0.0; }
+  if (a.ticks != b.ticks) { return a.ticks > b.ticks ? 1.0 : 0.0; }
+  return 0.5;
+}
+
+std::vector<Match> make_pairings(const Options &options) {
+  std::vector<Match> matches;
+  const int bot_count = static_cast<int>(options.bots.size());
+  for (int s = 0; s < options.seeds; ++s) {
+    for (int a = 0; a < bot_count; ++a) {
+      for (int b = a + 1; b < bot_count; ++b) {
+        matches.push_back({ a, b, options.base_seed + s, 0.5, {}, {} });
+      }
+    }
+  }
+  return matches;
+}
+
+// Arena: each bot plays each seed once and pairings are decided from those
+size_t run_arena(const Options &options, AsyncWriter &writer, std::vector<Match> &matches) {
+  const size_t bot_count = options.bots.size();
+  const size_t games = bot_count * options.seeds;
+  std::vector<GameResult> solo(games);
+  run_parallel(options.threads, games, [&](size_t i) {
+    size_t bot = i % bot_count;
+    uint64_t seed = options.base_seed + i / bot_count;
+    std::unique_ptr<Bot> player = make_bot(options.bots[bot]);
+    if (!player) {
+      failed_games++;
+      return;
+    }
+    World world = play_game(options, seed, { player.get() });
+    solo[i] = { world.get_snake(0).get_length(), world.get_tick() };
+    write_replay(options, writer, world, "arena_" + options.bots[bot] + "_" + std::to_string(seed));
+  });
+  for (Match &match : matches) {
+    size_t row = (match.seed - options.base_seed) * bot_count;
+    match.result_a = solo[row + match.a];
+    match.result_b = solo[row + match.b];
+    match.score = compare(match.result_a, match.result_b);
+  }
+  return games;
+}
+
+// Versus: both bots share the board; the survivor wins, otherwise length
+size_t run_versus(const Options &options, AsyncWriter &writer, std::vector<Match> &matches) {
+  run_parallel(options.threads, matches.size(), [&](size_t i) {
+    Match &match = matches[i];
+    std::unique_ptr<Bot> bot_a = make_bot(options.bots[match.a]);
+    std::unique_ptr<Bot> bot_b = make_bot(options.bots[match.b]);
+    if (!bot_a || !bot_b) {
+      failed_games++;
+      return;
+    }
+    bool swapped = match.seed % 2 == 1;
+    std::vector<Bot *> seats = swapped ? std::vector<Bot *>{ bot_b.get(), bot_a.get() }
+                                       : std::vector<Bot *>{ bot_a.get(), bot_b.get() };
+    World world = play_game(options, match.seed, seats);
+    int seat_a = swapped ? 1 : 0, seat_b = 1 - seat_a;
+    auto survived = [&](int seat) {
+      return world.is_alive(seat) ? world.get_tick() : world.get_death_tick(seat);
+    };
+    match.result_a = { world.get_snake(seat_a).get_length(), survived(seat_a) };
+    match.result_b = { world.get_snake(seat_b).get_length(), survived(seat_b) };
+    if (world.is_alive(seat_a) != world.is_alive(seat_b)) {
+      match.score = world.is_alive(seat_a) ? 1.0 : 0.0;
+    } else {
+      match.score = compare(match.result_a, match.result_b);
+    }
+    write_replay(options, writer, world, "versus_" + std::to_string(i) + "_" + options.bots[match.a] +
+                                         "_" + options.bots[match.b]);
+  });
+  return matches.size();
+}
+
+void rate(const std::vector<Match> &matches, std::vector<Standing> &standings) {
+  constexpr double K = 16.0;
+  for (const Match &match : matches) {
+    Standing &a = standings[match.a];
+    Standing &b = standings[match.b];
+    double expected_a = 1.0 / (1.0 + std::pow(10.0, (b.rating - a.rating) / 400.0));
+    a.rating += K * (match.score - expected_a);
+    b.rating -= K * (match.score - expected_a);
+    if (match.score > 0.5) { a.wins++; b.losses++; }
+    else if (match.score < 0.5) { a.losses++; b.wins++; }
+    else { a.draws++; b.draws++; }
+  }
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  Options options;
+  if (!parse_options(argc, argv, options)) {
+    print_usage();
+    return 1;
+  }
+
+  AsyncWriter writer;
+  int log = -1;
+  if (!options.log_path.empty() && (log = writer.open_log(options.log_path)) < 0) {
+    std::fprintf(stderr, "cannot open %s\n", options.log_path.c_str());
+    return 1;
+  }
+
+  std::vector<Match> matches = make_pairings(options);
+  auto start = std::chrono::steady_clock::now();
+  size_t games = options.mode == "arena" ? run_arena(options, writer, matches)
+                                         : run_versus(options, writer, matches);
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  if (failed_games > 0) {
+    std::fprintf(stderr, "%llu games failed: a bot could not be made\n", (unsigned long long)failed_games.load());
+    return 1;
+  }
+
+  if (log >= 0) {
+    char line[256];
+    for (const Match &match : matches) {
+      int n = std::snprintf(line, sizeof(line), "%s,%s,%llu,%.1f,%d,%u,%d,%u\n",
+                            options.bots[match.a].c_str(), options.bots[match.b].c_str(),
+                            (unsigned long long)match.seed, match.score, match.result_a.length,
+                            match.result_a.ticks, match.result_b.length, match.result_b.ticks);
+      writer.append(log, line, std::min<size_t>(n, sizeof(line) - 1));
+    }
+  }
+
+  std::vector<Standing> standings(options.bots.size());
+  for (size_t i = 0; i < options.bots.size(); ++i) { standings[i].name = options.bots[i]; }
+  rate(matches, standings);
+  for (const Match &match : matches) {
+    standings[match.a].total_length += match.result_a.length;
+    standings[match.b].total_length += match.result_b.length;
+    standings[match.a].games++;
+    standings[match.b].games++;
+  }
+  std::sort(standings.begin(), standings.end(),
+            [](const Standing &x, const Standing &y) { return x.rating > y.rating; });
+
+  std::printf("%-4s %-16s %8s %6s %6s %6s %10s\n", "#", "bot", "elo", "won", "drawn", "lost", "avg len");
+  for (size_t i = 0; i < standings.size(); ++i) {
+    const Standing &s = standings[i];
+    std::printf("%-4zu %-16s %8.1f %6d %6d %6d %10.1f\n", i + 1, s.name.c_str(), s.rating,
+                s.wins, s.draws, s.losses, s.games ? double(s.total_length) / s.games : 0.0);
+  }
+  std::printf("\n%zu matches, %zu games in %.2fs on %d threads (%.1f games/s)\n",
+              matches.size(), games, seconds, options.threads, games / std::max(seconds, 1e-9));
+  print_plugin_stats(stdout);
+  print_process_stats(stdout);
+  writer.flush();
+  if (!options.replay_dir.empty() || log >= 0) { writer.print_stats(stdout); }
+  return 0;
+}
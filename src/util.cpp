@@ -0,0 +1,34 @@
+#include "util.hpp"
+
+#include <cerrno>
+#include <cstring>
+
+bool fail(std::string *error, const std::string &message) {
+  if (error) { *error = message; }
+  return false;
+}
+
+bool fail_errno(std::string *error, const std::string &message) {
+  if (error) { *error = message + ": " + std::strerror(errno); }
+  return false;
+}
+
+std::vector<std::string> split(const std::string &list) {
+  std::vector<std::string> parts;
+  size_t start = 0;
+  while (start <= list.size()) {
+    size_t comma = list.find(',', start);
+    if (comma == std::string::npos) { comma = list.size(); }
+    if (comma > start) { parts.push_back(list.substr(start, comma - start)); }
+    start = comma + 1;
+  }
+  return parts;
+}
+
+void put_fixed(std::vector<uint8_t> &out, uint64_t v, int bytes) {
+  for (int i = 0; i < bytes; ++i) { out.push_back(uint8_t(v >> (8 * i))); }
+}
+
+void put_fixed(std::string &out, uint64_t v, int bytes) {
+  for (int i = 0; i < bytes; ++i) { out.push_back(static_cast<char>(uint8_t(v >> (8 * i)))); }
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+// Small helpers shared by the core library and the command line tools.
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Sets `*error`, if given, and returns false, so error paths read
+// `return fail(error, "...")`
+bool fail(std::string *error, const std::string &message);
+// The same with ": " and the description of errno appended
+bool fail_errno(std::string *error, const std::string &message);
+
+// Splits a comma separated list, dropping empty entries
+std::vector<std::string> split(const std::string &list);
+
+// Appends the low `bytes` bytes of `v` in little-endian order
+void put_fixed(std::vector<uint8_t> &out, uint64_t v, int bytes);
+void put_fixed(std::string &out, uint64_t v, int bytes);
@@ -0,0 +1,133 @@
+// snakey_verify: re-simulates submitted replays and checks that they
+// reproduce the lengths they claim, before scores go on the leaderboard.
+//
+//   snakey_verify [--threads N] [--max-ticks N] [--quiet] REPLAY_OR_DIR...
+//
+// Replays are spread over all cores. Files that fail to parse, exceed the
+// tick limit or end with different lengths are rejected. The exit status is
+// 0 only if every replay was accepted.
+
+#include "replay.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <filesystem>
+#include <string>
+#include <sys/stat.h>
+#include <thread>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+// Anything larger is rejected before it is read
+constexpr uintmax_t MAX_REPLAY_BYTES = 64u << 20;
+
+struct Verdict {
+  bool accepted = false;
+  uint64_t ticks = 0;
+  std::string reason;
+};
+
+Verdict verify(const std::string &path, uint32_t max_ticks) {
+  Verdict verdict;
+  std::error_code ec;
+  uintmax_t size = fs::file_size(path, ec);
+  if (ec) { verdict.reason = "cannot stat file"; return verdict; }
+  if (size > MAX_REPLAY_BYTES) { verdict.reason = "file too large"; return verdict; }
+
+  Replay replay;
+  if (!load_replay(path, replay, &verdict.reason)) { return verdict; }
+  // Cap the work a single submission can cause
+  if (replay.ticks > max_ticks) { verdict.reason = "too many ticks"; return verdict; }
+
+  ReplayPlayer player(replay);
+  while (player.step()) {}
+  const World &world = player.get_world();
+  verdict.ticks = world.get_tick();
+  if (world.get_tick() != replay.ticks) {
+    verdict.reason = "game ended at tick " + std::to_string(world.get_tick()) + ", replay claims " +
+                     std::to_string(replay.ticks);
+    return verdict;
+  }
+  for (int s = 0; s < replay.snake_count; ++s) {
+    int length = world.get_snake(s).get_length();
+    if (length != replay.final_lengths[s]) {
+      verdict.reason = "snake " + std::to_string(s) + " reached length " + std::to_string(length) +
+                       ", replay claims " + std::to_string(replay.final_lengths[s]);
+      return verdict;
+    }
+  }
+  verdict.accepted = true;
+  return verdict;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  int threads = std::max(1u, std::thread::hardware_concurrency());
+  uint32_t max_ticks = 10000000;
+  bool quiet = false;
+  std::vector<std::string> paths;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg == "--threads" && i + 1 < argc) { threads = std::max(1, std::atoi(argv[++i])); }
+    else if (arg == "--max-ticks" && i + 1 < argc) { max_ticks = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10)); }
+    else if (arg == "--quiet") { quiet = true; }
+    else {
+      std::error_code ec;
+      if (fs::is_directory(arg, ec)) {
+        for (const auto &entry : fs::recursive_directory_iterator(arg, ec)) {
+          if (entry.is_regular_file() && entry.path().extension() == ".snr") { paths.push_back(entry.path().string()); }
+        }
+      } else {
+        paths.push_back(arg);
+      }
+    }
+  }
+  if (paths.empty()) {
+    std::fprintf(stderr, "usage: snakey_verify [--threads N] [--max-ticks N] [--quiet] REPLAY_OR_DIR...\n");
+    return 2;
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  std::vector<Verdict> verdicts(paths.size());
+  std::atomic<size_t> next{ 0 };
+  std::vector<std::thread> workers;
+  for (int t = 0; t < threads; ++t) {
+    workers.emplace_back([&]() {
+      for (size_t i = next++; i < paths.size(); i = next++) {
+        // One bad file rejects itself, never the whole batch
+        try {
+          verdicts[i] = verify(paths[i], max_ticks);
+        } catch (const std::exception &e) {
+          verdicts[i] = Verdict{};
+          verdicts[i].reason = std::string("verification failed: ") + e.what();
+        }
+      }
+    });
+  }
+  for (auto &worker : workers) { worker.join(); }
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  size_t rejected = 0;
+  uint64_t ticks = 0;
+  for (size_t i = 0; i < paths.size(); ++i) {
+    ticks += verdicts[i].ticks;
+    if (verdicts[i].accepted) {
+      if (!quiet) { std::printf("ok       %s\n", paths[i].c_str()); }
+    } else {
+      ++rejected;
+      std::printf("REJECTED %s: %s\n", paths[i].c_str(), verdicts[i].reason.c_str());
+    }
+  }
+  seconds = std::max(seconds, 1e-9);
+  std::printf("%zu accepted, %zu rejected in %.3fs on %d threads (%.0f replays/s, %.0f ticks/s)\n",
+              paths.size() - rejected, rejected, seconds, threads, paths.size() / seconds, ticks / seconds);
+  return rejected == 0 ? 0 : 1;
+}
@@ -0,0 +1,113 @@
+#include "watchdog.hpp"
+
+#include <malloc.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <ctime>
+
+namespace {
+
+// AsyncWriter waits for a full batch before syncing; dumps are rare and
+// small, so sync each one
+AsyncWriter::Options writer_options() {
+  AsyncWriter::Options options;
+  options.queue_capacity = 16;
+  options.fsync_batch = 1;
+  return options;
+}
+
+double ms_between(std::chrono::steady_clock::time_point from, std::chrono::steady_clock::time_point to) {
+  return std::chrono::duration<double, std::milli>(to - from).count();
+}
+
+std::string number(double value) {
+  char text[32];
+  std::snprintf(text, sizeof(text), "%.3f", value);
+  return text;
+}
+
+} // namespace
+
+std::string allocator_stats_json() {
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+  struct mallinfo2 info = mallinfo2();
+  return "{\"arena\": " + std::to_string(info.arena) + ", \"in_use\": " + std::to_string(info.uordblks) +
+         ", \"free\": " + std::to_string(info.fordblks) + ", \"releasable\": " + std::to_string(info.keepcost) +
+         ", \"mmapped\": " + std::to_string(info.hblkhd) + ", \"mmapped_chunks\": " + std::to_string(info.hblks) +
+         ", \"free_chunks\": " + std::to_string(info.ordblks) + "}";
+#else
+  return "{}";
+#endif
+}
+
+Watchdog::Watchdog(WatchdogOptions options)
+  : options(std::move(options)),
+    start(std::chrono::steady_clock::now()),
+    writer(writer_options()) {
+  trace.resize(std::max<size_t>(1, this->options.trace_frames));
+}
+
+void Watchdog::record_frame(const FrameTrace &frame) {
+  trace[trace_next % trace.size()] = frame;
+  trace_next++;
+}
+
+bool Watchdog::check(const char *kind, double elapsed_ms, double budget_ms, const Snapshot &snapshot) {
+  if (elapsed_ms <= budget_ms) { return false; }
+  stats.overruns++;
+  const auto now = std::chrono::steady_clock::now();
+  const bool limited = stats.dumps + stats.rejected >= uint64_t(std::max(0, options.max_dumps)) ||
+                       (stats.dumps > 0 && ms_between(last_dump, now) < options.min_interval_ms);
+  if (limited) {
+    stats.suppressed++;
+    suppressed_since_dump++;
+    return true;
+  }
+
+  std::string json = "{\"kind\": \"" + std::string(kind) + "\", \"elapsed_ms\": " + number(elapsed_ms) +
+                     ", \"budget_ms\": " + number(budget_ms) + ", \"uptime_ms\": " + number(ms_between(start, now)) +
+                     ", \"overruns\": " + std::to_string(stats.overruns) +
+                     ", \"suppressed_since_last_dump\": " + std::to_string(suppressed_since_dump) +
+                     ",\n \"state\": " + (snapshot ? snapshot() : "null") +
+                     ",\n \"allocator\": " + allocator_stats_json() + ",\n \"trace\": [";
+  // Oldest frame first
+  const size_t count = std::min(trace_next, trace.size());
+  for (size_t i = 0; i < count; ++i) {
+    const FrameTrace &frame = trace[(trace_next - count + i) % trace.size()];
+    json += std::string(i ? ",\n  " : "\n  ") + "{\"frame\": " + std::to_string(frame.frame) +
+            ", \"frame_ms\": " + number(frame.frame_ms) + ", \"update_ms\": " + number(frame.update_ms) +
+            ", \"tick_ms\": " + number(frame.tick_ms) + ", \"state\": \"" + frame.state + "\"}";
+  }
+  json += "]}\n";
+
+  std::string path = next_path();
+  if (writer.write_file(path, std::vector<uint8_t>(json.begin(), json.end()))) {
+    stats.dumps++;
+    std::fprintf(stderr, "%s overrun (%.1f ms of %.1f ms), details in %s\n", kind, elapsed_ms, budget_ms, path.c_str());
+  } else {
+    stats.rejected++;
+  }
+  last_dump = now;
+  suppressed_since_dump = 0;
+  return true;
+}
+
+void Watchdog::print_stats(FILE *out) const {
+  if (stats.overruns == 0) { return; }
+  std::fprintf(out, "watchdog: %llu overruns, %llu dumped, %llu rate limited, %llu not written\n",
+               (unsigned long long)stats.overruns, (unsigned long long)stats.dumps,
+               (unsigned long long)stats.suppressed, (unsigned long long)stats.rejected);
+}
+
+std::string Watchdog::next_path() const {
+  auto now = std::chrono::system_clock::now();
+  std::time_t seconds = std::chrono::system_clock::to_time_t(now);
+  int millis = static_cast<int>(
+      std::chrono::duration_cast<std::chrono::milliseconds>(now.time_since_epoch()).count() % 1000);
+  std::tm local{};
+  localtime_r(&seconds, &local);
+  char name[64];
+  std::strftime(name, sizeof(name), "%Y%m%d_%H%M%S", &local);
+  return options.directory + "/overrun_" + name + "_" + std::to_string(millis) + ".json";
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+// Records ticks and frames that miss their deadline. The watchdog keeps a
+// short trace of recent frames; when an overrun comes in it writes a JSON
+// dump with that trace, the allocator's stats and a snapshot of the
+// caller's state, then lets the game carry on. Dumps go out through an
+// AsyncWriter, so writing one never adds to the stall it describes.
+// They are rate limited, with a minimum interval and a cap per run, so a
+// slow machine that overruns every frame gets a few dumps and a count of
+// the rest rather than a flood.
+
+#include "async_writer.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+struct WatchdogOptions {
+  std::string directory = ".";
+  int min_interval_ms = 30000;   // Between two dumps
+  int max_dumps = 10;            // Per run
+  size_t trace_frames = 240;     // About four seconds at 60 FPS
+};
+
+// One frame of the trace
+struct FrameTrace {
+  uint64_t frame = 0;
+  float frame_ms = 0;   // Since the start of the previous frame
+  float update_ms = 0;
+  float tick_ms = -1;   // The tick stepped in this frame, -1 for none
+  const char *state = "";
+};
+
+class Watchdog {
+public:
+  struct Stats {
+    uint64_t overruns = 0;
+    uint64_t dumps = 0;
+    uint64_t suppressed = 0;  // Overruns the rate limit kept from dumping
+    uint64_t rejected = 0;    // Dumps the writer queue had no room for
+  };
+
+  explicit Watchdog(WatchdogOptions options = {});
+
+  void record_frame(const FrameTrace &trace);
+
+  // Counts an overrun if `elapsed_ms` is over `budget_ms` and, rate limits
+  // permitting, queues a dump. `snapshot` returns a JSON value describing
+  // the caller's state and is only called for a dump. True if it overran.
+  using Snapshot = std::function<std::string()>;
+  bool check(const char *kind, double elapsed_ms, double budget_ms, const Snapshot &snapshot);
+
+  Stats get_stats() const { return stats; }
+  void print_stats(FILE *out) const;
+
+private:
+  std::string next_path() const;
+
+  WatchdogOptions options;
+  std::vector<FrameTrace> trace;  // Ring of the latest frames
+  size_t trace_next = 0;
+  std::chrono::steady_clock::time_point start;
+  std::chrono::steady_clock::time_point last_dump;
+  uint64_t suppressed_since_dump = 0;
+  Stats stats;
+  AsyncWriter writer;
+};
+
+// The C library allocator's view of the heap as a JSON object; empty
+// braces where it cannot tell
+std::string allocator_stats_json();
@@ -0,0 +1,84 @@
+// Checks that dataset records credit food to the move that eats it, both
+// for games played live and for games rebuilt from replays.
+
+#include "bots.hpp"
+#include "dataset.hpp"
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+namespace {
+
+int failures = 0;
+
+void check(bool condition, const std::string &what) {
+  if (condition) { return; }
+  std::fprintf(stderr, "FAILED: %s\n", what.c_str());
+  failures++;
+}
+
+Rules dataset_rules() {
+  Rules rules;
+  rules.max_ticks = 3000;
+  rules.starvation_ticks = 2 * rules.width * rules.height;
+  return rules;
+}
+
+// A record ate if its move takes the head onto the food in its observation
+void check_rewards(const std::vector<DatasetRecord> &records, const std::string &what) {
+  int eaten = 0;
+  for (const DatasetRecord &record : records) {
+    Point head{ -1, -1 }, food{ -1, -1 };
+    for (int y = 0; y < GRID_HEIGHT; ++y) {
+      for (int x = 0; x < GRID_WIDTH; ++x) {
+        if (record.cell(x, y) == DatasetCell::Head) { head = { x, y }; }
+        if (record.cell(x, y) == DatasetCell::Food) { food = { x, y }; }
+      }
+    }
+    Point next = step_towards(head, static_cast<Direction>(record.action));
+    next = { (next.x + GRID_WIDTH) % GRID_WIDTH, (next.y + GRID_HEIGHT) % GRID_HEIGHT };
+    const bool ate = next.x == food.x && next.y == food.y;
+    if (record.reward < 0) { continue; }
+    check(record.reward == (ate ? 1.0f : 0.0f), what + ": reward at tick " + std::to_string(record.tick));
+    eaten += ate;
+  }
+  check(eaten > 0, what + ": no food eaten");
+}
+
+void test_bot_game() {
+  std::unique_ptr<Bot> bot = make_bot("path");
+  check_rewards(record_bot_game(dataset_rules(), 7, *bot), "path bot game");
+}
+
+void test_replay() {
+  // Seed 3 gives a game long enough for both snakes to eat
+  Rules rules = dataset_rules();
+  World world(rules, 3, 2);
+  world.set_recording(true);
+  std::unique_ptr<Bot> bots[2] = { make_bot("path"), make_bot("path") };
+  while (!world.is_over()) {
+    for (int i = 0; i < 2; ++i) {
+      if (world.is_alive(i)) { world.set_direction(i, bots[i]->choose(world, i)); }
+    }
+    world.step();
+  }
+  std::vector<DatasetRecord> records;
+  std::string error;
+  check(record_replay(world.make_replay(), records, &error), "replay: " + error);
+  // Each snake sees the other as OtherHead, so its own head is unambiguous
+  check_rewards(records, "replayed game");
+}
+
+} // namespace
+
+int main() {
+  test_bot_game();
+  test_replay();
+  if (failures) {
+    std::fprintf(stderr, "%d checks failed\n", failures);
+    return 1;
+  }
+  std::printf("dataset: all checks passed\n");
+  return 0;
+}